@@ -3,25 +3,41 @@
   * @brief Provides accelerometer data to the rest of the system.
   *
   * Main tasks:
-  * - Read motors PWM values and simulate accelerometer based on it.
+  * - Sample the specific force of the airframe ground truth (see physics.c) and simulate accelerometer based on it.
   * - Mutate accelerometer data within the shared memory with additional noise.
+  * - Adapt the sampling rate to the drone state.
+  * - Aggregate full rate samples into windows (min/max/mean/RMS) published for telemetry.
   *
   * @note
   *
   * Only this module changes internal accelerometer values. There are two readers of
   * acceleration values (flight_ctrl.c and telemetry.c).
+  *
+  * Readings are the specific force in the body frame, like a real sensor: 9.81 on Z at rest and in hover.
   **/
 
 #include "proj_types.h"
 
-#define MAX_THRUST      9.81f * 2.0f        // 2g max upward acceleration.
-#define DIFF_FACTOR     0.2f                // Motor imbalance on X/Y tilt.
-#define NOISE_XY_STD    0.02f
-#define NOISE_Z_STD     0.05f
+#define ACCEL_PERIOD_US         1000        // 1 kHz while the motors may spin.
+#define ACCEL_GROUND_PERIOD_US  100000      // 10 Hz on the ground (`Idle`, `Charge`).
+#define ACCEL_LOG_PERIOD_US     10000       // Raw samples are logged at 100 Hz at most, whatever the sampling rate.
 
 static bat_charge_t current_battery;
 static acceleration_t acc;
 static motors_t m;
+static truth_t truth;
+static struct timespec next_sample;
+static wait_stats_t wait_stats = { .name = "accelerometer" };
+static duty_stats_t duty = { .name = "accelerometer", .full_period_us = ACCEL_PERIOD_US };
+
+/* Current aggregation window. Only its statistics leave the actor. */
+static agg_acc_t window;
+static struct timespec window_start;
+static struct timespec last_log;
+
+static long us_since(const struct timespec *then, const struct timespec *now) {
+    return (now->tv_sec - then->tv_sec) * 1000000 + (now->tv_nsec - then->tv_nsec) / 1000;
+}
 
 /* Simulation purpose noise for sensor. (Box-Muller) */
 static float gauss_noise(float stddev) {
@@ -35,10 +51,21 @@ static float gauss_noise(float stddev) {
   * @brief Main accelerometer loop function.
   *
   * Does the following:
-  * - Reads motor values. Simulates accelerometer data based on motor values.
+  * - Reads the airframe ground truth. Simulates accelerometer data based on its specific force.
+  * - Samples at full rate while the motors may spin, and at a reduced rate on the ground.
+  * - Publishes the window statistics each `agg_window_us`, or every sample when aggregation is off. Raw samples are
+  *   then logged at `ACCEL_LOG_PERIOD_US` only.
   *
   **/
 void accel_loop(drone_shared_t *shm_ptr) { 
+    drone_state_t *s, state;
+    struct timespec now;
+    uint32_t window_us = shm_ptr->agg_window_us;
+    uint32_t seen = notify_seq(&shm_ptr->action.changed);
+
+    snapshot_read(shm_ptr, &state);
+    duty_account(&duty, state.action);
+
     sem_wait(&shm_ptr->pwm.mutex); 
     m = shm_ptr->pwm.motors;
     sem_post(&shm_ptr->pwm.mutex);
@@ -48,24 +75,51 @@ void accel_loop(drone_shared_t *shm_ptr) {
     float m2 = m.motors[2];
     float m3 = m.motors[3];
 
-    /* Upward thrust (Z axis) — sum of 4 motors */
-    float thrust = (m0 + m1 + m2 + m3) * MAX_THRUST;
+    /* Specific force of the airframe, as integrated by the physics actor */
+    truth_read(shm_ptr, &truth);
 
-    /* Differential thrust → tilt acceleration */
-    float roll_acc  = (m1 + m3 - m0 - m2) * (MAX_THRUST * DIFF_FACTOR);
-    float pitch_acc = (m2 + m3 - m0 - m1) * (MAX_THRUST * DIFF_FACTOR);
-
-    /* Gravity always pulls down */
-    acc.x = roll_acc + gauss_noise(NOISE_XY_STD);
-    acc.y = pitch_acc + gauss_noise(NOISE_XY_STD);
-    acc.z = thrust - 9.81f + gauss_noise(NOISE_Z_STD);
-
-    printf("Accelerometer sample: [x: %f, y: %f, z: %f];\n", acc.x, acc.y, acc.z);
+    acc.x = truth.force[0] + gauss_noise(NOISE_XY_STD);
+    acc.y = truth.force[1] + gauss_noise(NOISE_XY_STD);
+    acc.z = truth.force[2] + gauss_noise(NOISE_Z_STD);
 
+    // Flight controller always gets the latest sample.
     sem_wait(&shm_ptr->accel.mutex); 
     shm_ptr->accel.acceleration = acc;
     sem_post(&shm_ptr->accel.mutex);
+    notify_post(&shm_ptr->accel.published);
+
+    if (window.count == 0) {
+        agg_reset(&window);
+        clock_gettime(CLOCK_MONOTONIC, &window_start);
+    }
+    agg_add(&window, (float[AGG_LANES]){ acc.x, acc.y, acc.z, m0, m1, m2, m3 });
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (window_us == 0) {
+        if (us_since(&last_log, &now) >= ACCEL_LOG_PERIOD_US) {
+            printf("Accelerometer sample: [x: %f, y: %f, z: %f];\n", acc.x, acc.y, acc.z);
+            last_log = now;
+        }
+
+        s = snapshot_begin(shm_ptr);
+        s->acceleration = acc;
+        snapshot_commit(shm_ptr);
+        window.count = 0;
+    } else if (us_since(&window_start, &now) >= window_us) {
+        s = snapshot_begin(shm_ptr);
+        s->acceleration = acc;
+        agg_finish(&window, &s->window);
+        printf("Accelerometer window: n=%u mean=[x: %f, y: %f, z: %f] rms=[x: %f, y: %f, z: %f];\n", s->window.count,
+            s->window.mean[AggAccelX], s->window.mean[AggAccelY], s->window.mean[AggAccelZ],
+            s->window.rms[AggAccelX], s->window.rms[AggAccelY], s->window.rms[AggAccelZ]);
+        snapshot_commit(shm_ptr);
+        window.count = 0;
+    }
 
     shm_ptr->wdg.accel++;
-    usleep(10000);
+
+    // Sampling rate follows the drone state. A state change restarts the schedule with the new rate immediately.
+    deadline_next(&next_sample, state.action & (Idle | Charge) ? ACCEL_GROUND_PERIOD_US : ACCEL_PERIOD_US);
+    if (notify_wait(&shm_ptr->action.changed, seen, shm_ptr->wait.state, &next_sample, &wait_stats) == 0)
+        clock_gettime(CLOCK_MONOTONIC, &next_sample);
 }
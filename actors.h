@@ -19,7 +19,7 @@
  * @brief Main accelerometer loop function.
  *
  * Does the following:
- * - Reads motor values. Simulates accelerometer data based on motor values.
+ * - Reads the airframe ground truth. Simulates accelerometer data based on its specific force.
  *
  **/
 void accel_loop(drone_shared_t *shm_ptr); 
@@ -41,7 +41,7 @@ void battery_loop(drone_shared_t *shm_ptr);
   * @brief Main GPS loop function.
   *
   * Does the following:
-  * - Acts as a producer that writes upcoming NMEA strings to shared circular buffer.
+  * - Acts as a producer that writes upcoming NMEA strings, derived from the ground truth, to shared circular buffer.
   *
   **/
 void gps_loop(drone_shared_t *shm_ptr);
@@ -61,14 +61,23 @@ void flight_loop(drone_shared_t *shm_ptr);
   * @brief telemetry sender loop function.
   *
   * Does the following:
-  * - Reads all types of data within the shared memory region.
+  * - Reads a consistent snapshot of all data within the shared memory region.
   * - If operator is ready, sends data packages for real time samples of the system.
-  * - Not all resources are guaranteed to be sent in each package.
   * - Only sends GPS data when internal state is `SampleGPS` (consumer).
   *
   **/
 void telemetry_loop(drone_shared_t *shm_ptr);
 
+/**
+  * @brief Physics loop.
+  *
+  * Does the following:
+  * - Integrates the airframe dynamics under the current PWM at a fixed step.
+  * - Publishes the ground truth the accelerometer and GPS derive their readings from.
+  *
+  **/
+void physics_loop(drone_shared_t *shm_ptr);
+
 /**
   * @brief Watchdog loop.
   *
@@ -0,0 +1,60 @@
+/**
+  * @file aggregate.c
+  * @brief Windowed min/max/mean/RMS statistics of full rate sensor streams.
+  *
+  * Main tasks:
+  * - Accumulate samples of all streams at the sensor rate.
+  * - Reduce a window into statistics published at the telemetry rate, so that telemetry describes every sample
+  *   instead of aliasing on whichever one happens to be the latest.
+  *
+  * @note
+  *
+  * Accumulators keep one array per statistic with one lane per stream, padded to `AGG_LANES`. The per sample update is
+  * therefore four straight loops over 8 floats, which the compiler turns into single SIMD min, max, add and multiply
+  * instructions. Float sums are exact enough for the few thousand samples of a window.
+  **/
+
+#include "proj_types.h"
+
+/**
+  * @brief Starts an empty window.
+  **/
+void agg_reset(agg_acc_t *a) {
+    for (int i = 0; i < AGG_LANES; ++i) {
+        a->min[i] = INFINITY;
+        a->max[i] = -INFINITY;
+        a->sum[i] = 0.0f;
+        a->sum_sq[i] = 0.0f;
+    }
+    a->count = 0;
+}
+
+/**
+  * @brief Adds one sample of every stream.
+  **/
+void agg_add(agg_acc_t *restrict a, const float v[restrict AGG_LANES]) {
+    for (int i = 0; i < AGG_LANES; ++i)
+        a->min[i] = v[i] < a->min[i] ? v[i] : a->min[i];
+    for (int i = 0; i < AGG_LANES; ++i)
+        a->max[i] = v[i] > a->max[i] ? v[i] : a->max[i];
+    for (int i = 0; i < AGG_LANES; ++i)
+        a->sum[i] += v[i];
+    for (int i = 0; i < AGG_LANES; ++i)
+        a->sum_sq[i] += v[i] * v[i];
+    a->count++;
+}
+
+/**
+  * @brief Computes statistics of the accumulated window.
+  **/
+void agg_finish(const agg_acc_t *a, agg_window_t *out) {
+    float n = a->count ? (float)a->count : 1.0f;
+
+    for (int i = 0; i < AGG_LANES; ++i) {
+        out->min[i] = a->count ? a->min[i] : 0.0f;
+        out->max[i] = a->count ? a->max[i] : 0.0f;
+        out->mean[i] = a->sum[i] / n;
+        out->rms[i] = sqrtf(a->sum_sq[i] / n);
+    }
+    out->count = a->count;
+}
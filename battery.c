@@ -18,14 +18,21 @@
 
 #include "proj_types.h"
 
-#define DISCHARGE_INTERVAL_MS 2000
-#define CHARGE_INTERVAL_MS 500
+#define BATTERY_PERIOD_US 100
 
-static struct timespec last_time, now;
+static struct timespec last_time, now, next_check;
+static wait_stats_t wait_stats = { .name = "battery" };
 static bat_charge_t current_battery;
 static current_action_t current_action;
 static bool init = true;
 
+/* Publishes new charge within the state snapshot. */
+static void publish_battery(drone_shared_t *shm_ptr, uint8_t charge) {
+    drone_state_t *s = snapshot_begin(shm_ptr);
+    s->battery = charge;
+    snapshot_commit(shm_ptr);
+}
+
 /**
   * @brief Main battery loop function.
   *
@@ -60,8 +67,10 @@ void battery_loop(drone_shared_t *shm_ptr) {
     if (current_action == Charge) {
         if (elapsed_ms >= CHARGE_INTERVAL_MS) {
             last_time = now;
-            if (current_battery < 100)
+            if (current_battery < 100) {
                 atomic_store_explicit(&shm_ptr->battery, current_battery + 1, memory_order_release);
+                publish_battery(shm_ptr, current_battery + 1);
+            }
             printf("Charging: Battery value (%u%%)\n", current_battery);
         }
     } else {
@@ -69,15 +78,14 @@ void battery_loop(drone_shared_t *shm_ptr) {
             last_time = now;
             if (current_battery > 0) {
                 atomic_store_explicit(&shm_ptr->battery, current_battery - 1, memory_order_release);                    
+                publish_battery(shm_ptr, current_battery - 1);
                 printf("Discharging: Battery value %u%%\n", current_battery);
 
-                if (current_battery < 15 && current_action != Abort) {
+                if (current_battery < BATTERY_LOW && current_action != Abort) {
                     printf("Battery low (%u%%). Switching to Abort state.\n", current_battery);
 
-                    // Changing global drone state to `Abort`.
-                    rwlock_write_lock(&shm_ptr->action.lock);
-                    shm_ptr->action.type = Abort;
-                    rwlock_write_unlock(&shm_ptr->action.lock);
+                    // Requesting global drone state change to `Abort`.
+                    intent_post(shm_ptr, Abort, IntentSafety, SourceBattery);
                 }
             } else {
                 perror("Battery charge is 0. Hard system shutdown.");
@@ -87,5 +95,7 @@ void battery_loop(drone_shared_t *shm_ptr) {
     }
 
     shm_ptr->wdg.battery++;
-    usleep(100);
+
+    deadline_next(&next_check, BATTERY_PERIOD_US);
+    notify_wait(NULL, 0, shm_ptr->wait.state, &next_check, &wait_stats);
 }
@@ -0,0 +1,51 @@
+# Shared part of the benchmark scripts, sourced by them.
+#
+# `run_flight` starts one operator, netem_proxy and drone_sys on loopback, sends `fly`, and stops everything after
+# the given time. The operator listens on 127.0.0.1, the proxy on 127.0.0.2 and the drone on 127.0.0.3, with the
+# same ports: every packet between them goes through the proxy.
+#
+# Each run gets its own directory, with the logs of the three programs (`operator.log`, `proxy.log`, `drone_sys.log`)
+# and the actor logs of drone_sys under `build/`. Only one drone_sys may run at a time, they share the same shm.
+
+BUILD=$(cd "$(dirname "$0")/../build" && pwd)
+OPERATOR_IP=127.0.0.1
+PROXY_IP=127.0.0.2
+DRONE_IP=127.0.0.3
+FLY_AT_S=4              # The flight controller binds its port within 2 s of the start.
+
+# run_flight <dir> <seconds> <netem_script> <drone_sys options> <operator options>
+#
+# Times in the netem script count from the drone_sys start, give or take a few ms.
+run_flight() {
+    dir=$1
+    tp=$((20000 + ($$ + $(date +%s)) % 20000 * 2))
+    fp=$((tp + 1))
+
+    rm -rf "$dir"
+    mkdir -p "$dir/build"
+    rm -f /dev/shm/drone_shm
+    mkfifo "$dir/operator.in"
+
+    # Options are left unquoted on purpose: they are word lists.
+    setsid stdbuf -oL "$BUILD/operator" $5 $OPERATOR_IP $tp $PROXY_IP $fp \
+        < "$dir/operator.in" > "$dir/operator.log" 2>&1 &
+    op=$!
+    exec 3> "$dir/operator.in"
+    sleep 0.3
+    "$BUILD/netem_proxy" -r 1 -s "$3" $PROXY_IP $OPERATOR_IP $tp $DRONE_IP $fp > "$dir/proxy.log" 2>&1 &
+    proxy=$!
+    (cd "$dir" && exec setsid stdbuf -oL "$BUILD/drone_sys" $4 $PROXY_IP $tp $DRONE_IP $fp > drone_sys.log 2>&1) &
+    drone=$!
+
+    sleep $FLY_AT_S
+    echo fly >&3
+    sleep $(($2 - FLY_AT_S))
+
+    # The operator goes first, so that it does not see the drone go silent.
+    exec 3>&-
+    kill -TERM $op $proxy
+    sleep 0.5
+    kill -TERM $drone
+    wait $drone $op $proxy 2> /dev/null
+    rm -f "$dir/operator.in"
+}
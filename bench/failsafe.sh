@@ -0,0 +1,42 @@
+# Link-loss failsafe under a partition and under random loss, over TCP and UDP telemetry.
+#
+# Usage: sh bench/failsafe.sh [work_dir]
+#
+# Cases, with drone_sys and operator defaults (heartbeats every 100 ms, link lost after 1000 ms on the drone, stale
+# after 500 ms on the operator):
+# - netem/partition.netem: 5 s partition in flight, 25 s run;
+# - netem/random_loss{10,30,50}.netem: random loss both ways, 60 s of flight.
+#
+# Read from the logs of each run:
+# - drone lost: "Operator link lost" lines of build/CTRL.log. Over random loss every one is a false positive;
+# - detect ms: the silence each of them reports. It counts from the last datagram heard, so it is the detection
+#   latency as seen by the drone, heartbeat gap included;
+# - landed: whether build/CTRL.log shows the Land state;
+# - op stale: "Telemetry link stale" lines of operator.log, and the longest silence reported when the link came
+#   back. A stall that lasts until the end of the run has no such report.
+
+. "$(dirname "$0")/common.sh"
+
+NETEM=$(cd "$(dirname "$0")/netem" && pwd)
+WORK=${1:-/tmp/failsafe}
+
+printf "%-4s %-14s %10s %14s %7s %9s %14s\n" tlm netem "drone lost" "detect ms" landed "op stale" "op restored ms"
+for transport in tcp udp; do
+    for netem in partition random_loss10 random_loss30 random_loss50; do
+        dir="$WORK/$transport-$netem"
+        case $netem in
+            partition)  secs=25 ;;
+            *)          secs=64 ;;
+        esac
+        run_flight "$dir" $secs "$NETEM/$netem.netem" "-t $transport" ""
+
+        lost=$(grep -c "Operator link lost" "$dir/build/CTRL.log")
+        detect=$(awk '/Operator link lost/ { printf "%s%s", n++ ? "," : "", $(NF - 1) }' "$dir/build/CTRL.log")
+        landed=$(grep -q "Current state: Land" "$dir/build/CTRL.log" && echo yes || echo no)
+        stale=$(grep -c "Telemetry link stale" "$dir/operator.log")
+        restored=$(awk '/Telemetry link restored/ { if ($(NF - 3) > max) max = $(NF - 3) } END { print max + 0 }' \
+            "$dir/operator.log")
+
+        printf "%-4s %-14s %10s %14s %7s %9s %14s\n" $transport $netem $lost "${detect:--}" $landed $stale $restored
+    done
+done
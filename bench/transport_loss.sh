@@ -0,0 +1,52 @@
+# Telemetry latency over TCP, UDP and UDP with parity, with and without loss.
+#
+# Usage: sh bench/transport_loss.sh [work_dir]
+#
+# Each case flies the drone for 30 s with delta encoding, behind netem_proxy:
+# - netem/clean.netem: no impairment;
+# - netem/telemetry_loss2.netem: 2% loss on telemetry after the takeoff, 200 ms retransmission delay over TCP.
+#
+# The operator reports every 10 s; the first report, mostly on the ground, is left out. Latency is from the frame
+# build on the drone to its decoding on the operator. Loss is what the operator did not get, after parity.
+
+. "$(dirname "$0")/common.sh"
+
+NETEM=$(cd "$(dirname "$0")/netem" && pwd)
+WORK=${1:-/tmp/transport_loss}
+SECONDS_PER_RUN=34
+
+printf "%-10s %-6s %10s %10s %10s %8s\n" transport loss "mean ms" "max ms" "B/s" "lost %"
+for transport in tcp udp udp+fec4; do
+    case $transport in
+        tcp)        opts="-e delta" ;;
+        udp)        opts="-e delta -t udp" ;;
+        udp+fec4)   opts="-e delta -t udp -f 4" ;;
+    esac
+    for netem in clean telemetry_loss2; do
+        dir="$WORK/$transport-$netem"
+        run_flight "$dir" $SECONDS_PER_RUN "$NETEM/$netem.netem" "$opts" ""
+
+        awk -v t=$transport -v n=$netem '
+            # Value before or after a word of the line.
+            function before(w) { for (i = 2; i <= NF; i++) if ($i == w) return $(i - 1) + 0 }
+            function after(w)  { for (i = 1; i < NF; i++) if ($i == w) return $(i + 1) + 0 }
+
+            /^Telemetry link \(/        { reports++ }
+            reports < 2                 { next }
+            /^Telemetry link \(/        { bytes += before("B/s,"); rates++ }
+            # Over UDP the operator prints both, the UDP line covers the datagrams only.
+            $0 ~ (t == "tcp" ? "^Frames latency" : "^UDP frames latency") {
+                sum += after("mean"); count++
+                if (after("max") > max) max = after("max")
+            }
+            /^UDP datagrams/ {
+                expected += before("expected,")
+                lost += before("expected,") * before("lost,") / 100
+            }
+            END {
+                printf "%-10s %-6s %10.2f %10.1f %10.0f %8s\n", t, n == "clean" ? "0%" : "2%",
+                    count ? sum / count / 1000 : 0, max / 1000, rates ? bytes / rates : 0,
+                    expected ? sprintf("%.2f", 100 * lost / expected) : "-"
+            }' "$dir/operator.log"
+    done
+done
@@ -0,0 +1,149 @@
+/**
+  * @file clock_sync.c
+  * @brief Drone clock offset and drift estimation on the operator side.
+  *
+  * Main tasks:
+  * - Turn each heartbeat exchange (four timestamps, as in NTP) into an offset and round trip sample.
+  * - Keep the samples least disturbed by queueing and fit the offset and drift of the drone clock on them.
+  * - Translate drone timestamps into operator time, with an error bound.
+  *
+  * @note
+  *
+  * The operator sends `t1` in its heartbeat, the flight controller notes when it received it (`t2`) and the
+  * telemetry unit echoes both in its next heartbeat, sent at `t3` and received at `t4`. Then:
+  *
+  *     offset = ((t2 - t1) + (t3 - t4)) / 2        delay = (t4 - t1) - (t3 - t2)
+  *
+  * Whatever the asymmetry of the two paths, the true offset is within `delay / 2` of that sample. Queueing only ever
+  * adds delay, so every `SYNC_BIN_US` only the sample with the shortest round trip is kept. Bins whose best round
+  * trip is still much longer than the shortest one (a congested period) are left out of the fit.
+  *
+  * The offset is fitted as a line of local time by weighted least squares over the last `SYNC_BINS` bins, its slope
+  * is the drift of the drone clock. A bin whose round trip exceeds the shortest one by `excess` may be off by up to
+  * `excess / 2` more than the best one, so it weighs `1 / (excess / 2 + SYNC_DELAY_SLACK_US)^2`. Until the bins
+  * span `SYNC_SPAN_US` the drift is assumed to be zero. The error bound is the largest distance of a fitted sample
+  * to the line plus its `delay / 2`, so the line stays within every sample's interval by that much.
+  **/
+
+#include "proj_types.h"
+
+#define SYNC_BIN_US         1000000     // Samples are reduced to the best one per bin.
+#define SYNC_SPAN_US        4000000     // Shortest time span the drift is fitted on.
+#define SYNC_DELAY_MAX_US   2000000     // Longer round trips are discarded.
+#define SYNC_DELAY_SLACK_US 200         // Bins up to twice the shortest round trip plus that much are fitted.
+#define SYNC_DRIFT_MAX      500e-6      // Steeper fits are noise, quartz clocks drift less than that.
+
+/**
+  * @brief Fits the estimate on the kept bins and the bin being filled.
+  **/
+static void clock_sync_fit(clock_sync_t *c) {
+    const clock_sample_t *s[SYNC_BINS + 1];
+    uint64_t min_delay = UINT64_MAX, first_us = UINT64_MAX, last_us = 0, limit;
+    const clock_sample_t *shortest = NULL;
+    double sw = 0, sx = 0, sy = 0, sxx = 0, sxy = 0, err = 0;
+    int n = 0, used = 0;
+
+    for (int i = 0; i < c->bins_len; ++i)
+        s[n++] = &c->bins[i];
+    if (c->has_best)
+        s[n++] = &c->best;
+    if (n == 0)
+        return;
+
+    for (int i = 0; i < n; ++i) {
+        if (s[i]->delay_us < min_delay) {
+            min_delay = s[i]->delay_us;
+            shortest = s[i];
+        }
+        if (s[i]->at_us > last_us)
+            last_us = s[i]->at_us;
+    }
+    limit = 2 * min_delay + SYNC_DELAY_SLACK_US;
+
+    // Relative to the newest sample, so that the sums keep their precision.
+    c->ref_us = last_us;
+    for (int i = 0; i < n; ++i) {
+        double x = (int64_t)(s[i]->at_us - last_us), y = s[i]->offset_us - shortest->offset_us;
+        double w = 1.0 / ((s[i]->delay_us - min_delay) / 2.0 + SYNC_DELAY_SLACK_US);
+
+        if (s[i]->delay_us > limit)
+            continue;
+        if (s[i]->at_us < first_us)
+            first_us = s[i]->at_us;
+        w *= w;
+        sw += w;
+        sx += w * x;
+        sy += w * y;
+        sxx += w * x * x;
+        sxy += w * x * y;
+        used++;
+    }
+
+    c->drift = 0.0;
+    if (last_us - first_us >= SYNC_SPAN_US && used >= 2) {
+        c->drift = (sw * sxy - sx * sy) / (sw * sxx - sx * sx);
+        if (c->drift > SYNC_DRIFT_MAX)
+            c->drift = SYNC_DRIFT_MAX;
+        if (c->drift < -SYNC_DRIFT_MAX)
+            c->drift = -SYNC_DRIFT_MAX;
+        c->offset_us = shortest->offset_us + (sy - c->drift * sx) / sw;
+    } else {
+        c->offset_us = shortest->offset_us;
+    }
+
+    for (int i = 0; i < n; ++i) {
+        double fit = c->offset_us + c->drift * (int64_t)(s[i]->at_us - last_us);
+        double e = fabs(fit - s[i]->offset_us) + s[i]->delay_us / 2.0;
+
+        if (s[i]->delay_us <= limit && e > err)
+            err = e;
+    }
+
+    c->error_us = (uint64_t)ceil(err);
+    c->fitted = used;
+    c->valid = true;
+}
+
+void clock_sync_sample(clock_sync_t *c, uint64_t t1, uint64_t t2, uint64_t t3, uint64_t t4) {
+    int64_t rtt = (int64_t)(t4 - t1), held = (int64_t)(t3 - t2);
+    clock_sample_t sample;
+
+    c->samples++;
+    if (rtt < 0 || held < 0 || rtt < held || (uint64_t)(rtt - held) > SYNC_DELAY_MAX_US) {
+        c->rejected++;
+        return;
+    }
+
+    sample.at_us = t4;
+    sample.delay_us = rtt - held;
+    sample.offset_us = ((int64_t)(t2 - t1) + (int64_t)(t3 - t4)) / 2;
+
+    if (c->has_best && t4 - c->bin_start_us >= SYNC_BIN_US) {
+        c->bins[c->bins_next] = c->best;
+        c->bins_next = (c->bins_next + 1) % SYNC_BINS;
+        if (c->bins_len < SYNC_BINS)
+            c->bins_len++;
+        c->has_best = false;
+    }
+    if (!c->has_best) {
+        c->bin_start_us = t4;
+        c->best = sample;
+        c->has_best = true;
+    } else if (sample.delay_us <= c->best.delay_us) {
+        c->best = sample;
+    }
+
+    clock_sync_fit(c);
+}
+
+bool clock_sync_local(const clock_sync_t *c, uint64_t remote_us, uint64_t *local_us) {
+    double offset;
+
+    if (!c->valid)
+        return false;
+
+    // The drift term barely depends on where exactly around `remote_us - offset_us` it is evaluated.
+    offset = c->offset_us + c->drift * (double)(int64_t)(remote_us - (uint64_t)(int64_t)c->offset_us - c->ref_us);
+    *local_us = remote_us - (uint64_t)(int64_t)llround(offset);
+    return true;
+}
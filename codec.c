@@ -0,0 +1,847 @@
+/**
+  * @file codec.c
+  * @brief Telemetry frame encodings shared by the drone and the operator.
+  *
+  * Main tasks:
+  * - Format telemetry records as plain text frames.
+  * - Encode records as binary keyframes or deltas of the previously sent record.
+  * - Batch binary frames and compress them with LZ4.
+  * - Encode alerts, which travel outside of the key and delta sequence.
+  * - Decode all of the above on the operator side.
+  * - Encode operator subscriptions and decode them on the drone side.
+  * - Encode and decode link heartbeats, sent both ways. They carry the timestamps of the clock offset exchange.
+  * - Encode history keyframes and backfill requests, see telemetry.c.
+  * - Encode and decode hello frames, which tell a ground station serving a fleet which drone a stream comes from.
+  * - Encode and decode numbered commands and their acknowledgements.
+  *
+  * @note
+  *
+  * Binary frame layout (little endian), `len` counts the bytes after itself:
+  *
+  *     key, batch: magic:u8 (0xA5) | type:u8 (flags << 4 | type) | len:u16 | seq:u32 | ts_us:u64 | payload
+  *     delta:      magic:u8 (0xA5) | type:u8                      | len:u16 | seq:u8  | dt_us:varint | payload
+  *     alert:      magic:u8 (0xA5) | type:u8                      | len:u16 | seq:u32 | ts_us:u64 | kind, actor, value
+  *     heartbeat:  magic:u8 (0xA5) | type:u8                      | len:u16 | seq:u32 | ts_us:u64 [| echo_ts_us:u64 |
+  *                                                                                       echo_rx_us:u64]
+  *     resume:     magic:u8 (0xA5) | type:u8                      | len:u16 | from:u32
+  *     hello:      magic:u8 (0xA5) | type:u8                      | len:u16 | id:u32 | flight_ctrl_port:u16
+  *     command,
+  *     ack:        magic:u8 (0xA5) | type:u8                      | len:u16 | seq:u32 | id:u32 | action:u8
+  *     subscribe:  magic:u8 (0xA5) | type:u8                      | len:u16 | channels:varint | interval_us:varint,
+  *                                                                                              threshold:f32 (each)
+  *
+  * A delta only carries the low byte of its sequence number and the time since the previous frame, which is enough
+  * to detect a missing frame and keeps the per frame overhead at about 7 bytes.
+  *
+  * Key and delta payloads start with a varint bit mask of the fields that follow. Integers are varints, floats are
+  * varints of their bits XORed with the previous value, so a field that barely moved costs few bytes and an unchanged
+  * field costs nothing. A keyframe is a delta from an all zero record and is sent every `TLM_KEYFRAME_US`, so a
+  * decoder that joins late or misses a frame resynchronizes quickly. Channels that are not part of a frame keep their
+  * last sent values in the record and therefore cost nothing either.
+  *
+  * A keyframe flagged `TLM_FLAG_HISTORY` replays a past record. It keeps its original sequence number and time and
+  * is decoded apart from the live sequence, so backfill and live frames interleave freely.
+  *
+  * A heartbeat echoing the last one heard from the peer appends its `ts_us` and the local time it was received at,
+  * see clock_sync.c. Text heartbeats never do.
+  *
+  * Batch payloads are whole frames back to back, optionally LZ4 compressed (block format, prefixed by the varint of
+  * the uncompressed length). Text frames never start with the magic byte, which lets the operator detect the encoding.
+  **/
+
+#include "proj_types.h"
+
+#define TLM_KEYFRAME_US     1000000     // Keyframe interval.
+
+#define PERCENT(f) (int)(f * 100 + 0.5f)
+
+/* Helpers to fill text frame. Callers guarantee the space (see `TLM_TEXT_MAX`). */
+#define BUF_LIT(msg, ptr, lit)  do { memcpy((msg) + (ptr), lit, sizeof(lit) - 1); (ptr) += sizeof(lit) - 1; } while (0)
+#define BUF_INT(msg, ptr, v)    ((ptr) += fmt_i32((msg) + (ptr), (v)))
+#define BUF_F6(msg, ptr, v)     ((ptr) += fmt_f6((msg) + (ptr), (v)))
+
+/* Longest possible text frame. */
+_Static_assert(sizeof("BAT = 255%\n") + 4 * (sizeof("ACCEL MIN = (x: , y: , z: )\n") + 3 * FMT_F6_MAX)
+    + sizeof("ACCEL SAMPLES = \n") + 11
+    + sizeof("MOTORS PWM = [%, %, %, %]\n") + 4 * 11 + sizeof("ACTION = \n") + 11
+    + sizeof("GPS {\n\n\n}\n") + GPS_SENTENCE_SIZE <= TLM_TEXT_MAX, "TLM_TEXT_MAX too small");
+
+/* Longest possible text alert. */
+_Static_assert(sizeof("ALERT {\nKIND = \nACTOR = \nVALUE = \n}\n") + sizeof("LINK_LOST") + 2 * 11 <= TLM_ALERT_MAX,
+    "TLM_ALERT_MAX too small");
+
+/* Longest possible heartbeat. */
+_Static_assert(sizeof("HEARTBEAT = \n") + 10 <= TLM_HEARTBEAT_MAX && TLM_HEADER_SIZE + 28 <= TLM_HEARTBEAT_MAX,
+    "TLM_HEARTBEAT_MAX too small");
+
+/* Longest possible subscription. */
+_Static_assert(TLM_HEADER_SIZE + 1 + TlmChannels * (5 + 4) <= TLM_SUBSCRIBE_MAX, "TLM_SUBSCRIBE_MAX too small");
+
+/* Field bits of key and delta payloads. */
+#define F_BATTERY       (1u << 0)
+#define F_ACTION        (1u << 1)
+#define F_SAMPLES       (1u << 2)
+#define F_CHANNELS      (1u << 3)
+#define F_FLOAT(i)      (1u << (4 + (i)))   // See `record_floats`.
+#define F_GPS           (1u << 20)
+#define F_GPS_LOST      (1u << 21)
+
+#define TLM_FLOATS      16
+
+#define LZ4_HASH_BITS       12
+#define LZ4_MIN_MATCH       4
+#define LZ4_LAST_LITERALS   5               // Block always ends with at least that many literals.
+#define LZ4_MFLIMIT         12              // Last match starts at least that far from the end.
+#define LZ4_MAX_OFFSET      65535
+
+/**
+  * @brief Writes `(x: <x>, y: <y>, z: <z>)`.
+  **/
+static size_t text_vec(char *msg, const acceleration_t *v) {
+    size_t ptr = 0;
+
+    BUF_LIT(msg, ptr, "(x: ");
+    BUF_F6(msg, ptr, v->x);
+    BUF_LIT(msg, ptr, ", y: ");
+    BUF_F6(msg, ptr, v->y);
+    BUF_LIT(msg, ptr, ", z: ");
+    BUF_F6(msg, ptr, v->z);
+    BUF_LIT(msg, ptr, ")\n");
+    return ptr;
+}
+
+static size_t text_battery(const tlm_record_t *r, char *msg) {
+    size_t ptr = 0;
+
+    BUF_LIT(msg, ptr, "BAT = ");
+    BUF_INT(msg, ptr, r->battery);
+    BUF_LIT(msg, ptr, "%\n");
+    return ptr;
+}
+
+static size_t text_accel(const tlm_record_t *r, char *msg) {
+    size_t ptr = 0;
+
+    BUF_LIT(msg, ptr, "ACCEL = ");
+    ptr += text_vec(msg + ptr, &r->acceleration);
+    return ptr;
+}
+
+static size_t text_accel_stats(const tlm_record_t *r, char *msg) {
+    size_t ptr = 0;
+
+    BUF_LIT(msg, ptr, "ACCEL MIN = ");
+    ptr += text_vec(msg + ptr, &r->accel_min);
+    BUF_LIT(msg, ptr, "ACCEL MAX = ");
+    ptr += text_vec(msg + ptr, &r->accel_max);
+    BUF_LIT(msg, ptr, "ACCEL RMS = ");
+    ptr += text_vec(msg + ptr, &r->accel_rms);
+    BUF_LIT(msg, ptr, "ACCEL SAMPLES = ");
+    BUF_INT(msg, ptr, r->samples);
+    BUF_LIT(msg, ptr, "\n");
+    return ptr;
+}
+
+static size_t text_motors(const tlm_record_t *r, char *msg) {
+    size_t ptr = 0;
+
+    BUF_LIT(msg, ptr, "MOTORS PWM = [");
+    for (int i = 0; i < 4; ++i) {
+        if (i)
+            BUF_LIT(msg, ptr, "%, ");
+        BUF_INT(msg, ptr, PERCENT(r->motors.motors[i]));
+    }
+    BUF_LIT(msg, ptr, "%]\n");
+    return ptr;
+}
+
+static size_t text_action(const tlm_record_t *r, char *msg) {
+    size_t ptr = 0;
+
+    BUF_LIT(msg, ptr, "ACTION = ");
+    BUF_INT(msg, ptr, r->action);
+    BUF_LIT(msg, ptr, "\n");
+    return ptr;
+}
+
+static size_t text_gps(const tlm_record_t *r, char *msg) {
+    size_t ptr = 0;
+
+    if (r->gps_len > 0) {
+        BUF_LIT(msg, ptr, "GPS {\n\n");
+        memcpy(msg + ptr, r->gps, r->gps_len);
+        ptr += r->gps_len;
+        BUF_LIT(msg, ptr, "\n}\n");
+    } else if (r->gps_lost) {
+        BUF_LIT(msg, ptr, "GPS {\n\nNO FIX.\n\n}\n");
+    }
+    return ptr;
+}
+
+size_t tlm_text(const tlm_record_t *r, char *msg) {
+    static size_t (*const channel_text[TlmChannels])(const tlm_record_t *, char *) = {
+        [TlmBattery]    = text_battery,
+        [TlmAccel]      = text_accel,
+        [TlmAccelStats] = text_accel_stats,
+        [TlmMotors]     = text_motors,
+        [TlmAction]     = text_action,
+        [TlmGps]        = text_gps,
+    };
+    size_t ptr = 0;
+
+    // Only visits the channels of this frame.
+    for (uint32_t m = r->channels & ((1u << TlmChannels) - 1); m; m &= m - 1)
+        ptr += channel_text[__builtin_ctz(m)](r, msg + ptr);
+
+    return ptr;
+}
+
+static uint8_t *put_varint(uint8_t *p, uint32_t v) {
+    while (v >= 0x80) {
+        *p++ = v | 0x80;
+        v >>= 7;
+    }
+    *p++ = v;
+    return p;
+}
+
+/**
+  * @return Pointer past the varint, NULL when it is truncated or too long.
+  **/
+static const uint8_t *get_varint(const uint8_t *p, const uint8_t *end, uint32_t *v) {
+    uint32_t r = 0;
+
+    for (int shift = 0; shift < 35 && p < end; shift += 7) {
+        uint8_t b = *p++;
+        r |= (uint32_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            *v = r;
+            return p;
+        }
+    }
+
+    return NULL;
+}
+
+static uint8_t *put_le(uint8_t *p, uint64_t v, int bytes) {
+    for (int i = 0; i < bytes; ++i)
+        *p++ = v >> (8 * i);
+    return p;
+}
+
+static uint64_t get_le(const uint8_t *p, int bytes) {
+    uint64_t v = 0;
+
+    for (int i = 0; i < bytes; ++i)
+        v |= (uint64_t)p[i] << (8 * i);
+    return v;
+}
+
+static void put_header(uint8_t *p, uint8_t type, size_t len) {
+    p[0] = TLM_MAGIC;
+    p[1] = type;
+    put_le(p + 2, len, 2);
+}
+
+/**
+  * @brief Bit patterns of all float fields, in field bit order: acceleration, motors, then acceleration min, max and
+  *        RMS.
+  **/
+static void record_floats(const tlm_record_t *r, uint32_t out[TLM_FLOATS]) {
+    memcpy(&out[0], &r->acceleration, 12);
+    memcpy(&out[3], r->motors.motors, 16);
+    memcpy(&out[7], &r->accel_min, 12);
+    memcpy(&out[10], &r->accel_max, 12);
+    memcpy(&out[13], &r->accel_rms, 12);
+}
+
+static void record_set_floats(tlm_record_t *r, const uint32_t in[TLM_FLOATS]) {
+    memcpy(&r->acceleration, &in[0], 12);
+    memcpy(r->motors.motors, &in[3], 16);
+    memcpy(&r->accel_min, &in[7], 12);
+    memcpy(&r->accel_max, &in[10], 12);
+    memcpy(&r->accel_rms, &in[13], 12);
+}
+
+size_t tlm_encode(tlm_encoder_t *e, const tlm_record_t *r, uint64_t ts_us, uint8_t *dst) {
+    static const tlm_record_t zero;
+    bool key = e->key_us == 0 || ts_us - e->key_us >= TLM_KEYFRAME_US;
+    const tlm_record_t *prev = key ? &zero : &e->prev;
+    uint32_t cur[TLM_FLOATS], old[TLM_FLOATS], mask = 0;
+    uint8_t *p = dst + TLM_HEADER_SIZE;
+
+    record_floats(r, cur);
+    record_floats(prev, old);
+
+    if (key) {
+        p = put_le(p, e->seq, 4);
+        p = put_le(p, ts_us, 8);
+    } else {
+        *p++ = e->seq;
+        p = put_varint(p, ts_us - e->ts_us);
+    }
+
+    // Fields a keyframe leaves out are zero, which is where the decoder starts from.
+    if (r->battery != prev->battery)    mask |= F_BATTERY;
+    if (r->action != prev->action)      mask |= F_ACTION;
+    if (r->samples != prev->samples)    mask |= F_SAMPLES;
+    if (r->channels != prev->channels)  mask |= F_CHANNELS;
+    for (int i = 0; i < TLM_FLOATS; ++i)
+        if (cur[i] != old[i])
+            mask |= F_FLOAT(i);
+    if (r->gps_len > 0) mask |= F_GPS;
+    if (r->gps_lost)    mask |= F_GPS_LOST;
+
+    p = put_varint(p, mask);
+    if (mask & F_BATTERY) {
+        int32_t diff = (int32_t)r->battery - prev->battery;
+        p = put_varint(p, ((uint32_t)diff << 1) ^ (uint32_t)(diff >> 31));  // Zigzag, small either way.
+    }
+    if (mask & F_ACTION)
+        p = put_varint(p, r->action);
+    if (mask & F_SAMPLES)
+        p = put_varint(p, r->samples);
+    if (mask & F_CHANNELS)
+        p = put_varint(p, r->channels);
+    for (int i = 0; i < TLM_FLOATS; ++i)
+        if (mask & F_FLOAT(i))
+            p = put_varint(p, cur[i] ^ old[i]);
+    if (mask & F_GPS) {
+        p = put_varint(p, r->gps_len);
+        memcpy(p, r->gps, r->gps_len);
+        p += r->gps_len;
+    }
+
+    put_header(dst, key ? FrameKey : FrameDelta, p - dst - TLM_HEADER_SIZE);
+    e->seq++;
+    e->ts_us = ts_us;
+    e->prev = *r;
+    if (key)
+        e->key_us = ts_us;
+
+    return p - dst;
+}
+
+const char *tlm_channel_name(uint8_t channel) {
+    static const char *names[TlmChannels] = { "battery", "accel", "stats", "motors", "action", "gps" };
+
+    return channel < TlmChannels ? names[channel] : "unknown";
+}
+
+void tlm_subscription_default(tlm_subscription_t *s, uint32_t interval_us) {
+    for (int i = 0; i < TlmChannels; ++i) {
+        s->interval_us[i] = interval_us;
+        s->threshold[i] = 0.0f;
+    }
+}
+
+size_t tlm_subscribe(const tlm_subscription_t *s, uint8_t *dst) {
+    uint8_t *p = dst + TLM_HEADER_SIZE;
+    uint32_t mask = 0, bits;
+
+    for (int i = 0; i < TlmChannels; ++i)
+        if (s->interval_us[i] > 0 || s->threshold[i] > 0)
+            mask |= 1u << i;
+
+    p = put_varint(p, mask);
+    for (int i = 0; i < TlmChannels; ++i) {
+        if (mask & (1u << i)) {
+            memcpy(&bits, &s->threshold[i], 4);
+            p = put_varint(p, s->interval_us[i]);
+            p = put_le(p, bits, 4);
+        }
+    }
+
+    put_header(dst, FrameSubscribe, p - dst - TLM_HEADER_SIZE);
+    return p - dst;
+}
+
+int tlm_subscription_decode(const uint8_t *frame, size_t len, tlm_subscription_t *s) {
+    const uint8_t *p = frame + TLM_HEADER_SIZE, *end = frame + len;
+    uint32_t mask, bits;
+
+    if (tlm_frame_len(frame, len) != (int)len || len < TLM_HEADER_SIZE || frame[1] != FrameSubscribe)
+        return -1;
+    if (!(p = get_varint(p, end, &mask)) || mask >> TlmChannels)
+        return -1;
+
+    memset(s, 0, sizeof(*s));
+    for (int i = 0; i < TlmChannels; ++i) {
+        if (!(mask & (1u << i)))
+            continue;
+        if (!(p = get_varint(p, end, &s->interval_us[i])) || end - p < 4)
+            return -1;
+        bits = get_le(p, 4);
+        memcpy(&s->threshold[i], &bits, 4);
+        p += 4;
+
+        // Also rejects NaN.
+        if (!(s->threshold[i] >= 0 && s->threshold[i] < INFINITY))
+            return -1;
+    }
+
+    return p == end ? 0 : -1;
+}
+
+size_t tlm_history(const tlm_record_t *r, uint32_t seq, uint64_t ts_us, uint8_t *dst) {
+    tlm_encoder_t e = { .seq = seq };   // Zeroed, starts with a keyframe.
+    size_t len = tlm_encode(&e, r, ts_us, dst);
+
+    dst[1] |= TLM_FLAG_HISTORY;
+    return len;
+}
+
+size_t tlm_resume(uint32_t from, uint8_t *dst) {
+    put_le(dst + TLM_HEADER_SIZE, from, 4);
+    put_header(dst, FrameResume, 4);
+    return TLM_RESUME_SIZE;
+}
+
+int tlm_resume_decode(const uint8_t *frame, size_t len, uint32_t *from) {
+    if (len != TLM_RESUME_SIZE || tlm_frame_len(frame, len) != (int)len || frame[1] != FrameResume)
+        return -1;
+
+    *from = get_le(frame + TLM_HEADER_SIZE, 4);
+    return 0;
+}
+
+size_t tlm_hello(const tlm_hello_t *h, uint8_t *dst) {
+    put_le(put_le(dst + TLM_HEADER_SIZE, h->id, 4), h->flight_ctrl_port, 2);
+    put_header(dst, FrameHello, 6);
+    return TLM_HELLO_SIZE;
+}
+
+int tlm_hello_decode(const uint8_t *frame, size_t len, tlm_hello_t *h) {
+    if (len != TLM_HELLO_SIZE || tlm_frame_len(frame, len) != (int)len || frame[1] != FrameHello)
+        return -1;
+
+    h->id = get_le(frame + TLM_HEADER_SIZE, 4);
+    h->flight_ctrl_port = get_le(frame + TLM_HEADER_SIZE + 4, 2);
+    return h->id != 0 ? 0 : -1;
+}
+
+size_t tlm_command(const tlm_command_t *c, bool ack, uint8_t *dst) {
+    put_le(put_le(put_le(dst + TLM_HEADER_SIZE, c->seq, 4), c->id, 4), c->action, 1);
+    put_header(dst, ack ? FrameAck : FrameCommand, 9);
+    return TLM_COMMAND_SIZE;
+}
+
+int tlm_command_decode(const uint8_t *frame, size_t len, bool ack, tlm_command_t *c) {
+    if (len != TLM_COMMAND_SIZE || tlm_frame_len(frame, len) != (int)len || frame[1] != (ack ? FrameAck : FrameCommand))
+        return -1;
+
+    c->seq = get_le(frame + TLM_HEADER_SIZE, 4);
+    c->id = get_le(frame + TLM_HEADER_SIZE + 4, 4);
+    c->action = frame[TLM_HEADER_SIZE + 8];
+    return 0;
+}
+
+static const struct {
+    const char *name;
+    current_action_t action;
+} actions[] = {
+    { "samplegps", SampleGPS }, { "fly", Fly }, { "land", Land }, { "idle", Idle }, { "charge", Charge },
+    { "abort", Abort },
+};
+
+int tlm_action_parse(const char *name, current_action_t *out) {
+    for (size_t i = 0; i < sizeof(actions) / sizeof(actions[0]); ++i) {
+        if (strcmp(name, actions[i].name) == 0) {
+            *out = actions[i].action;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+const char *tlm_action_name(current_action_t a) {
+    for (size_t i = 0; i < sizeof(actions) / sizeof(actions[0]); ++i)
+        if (actions[i].action == a)
+            return actions[i].name;
+    return "unknown";
+}
+
+const char *alert_name(uint8_t kind) {
+    static const char *names[] = { "UNKNOWN", "STATE", "GPS_LOST", "WATCHDOG", "RESPAWN", "LINK_LOST" };
+
+    return names[kind < sizeof(names) / sizeof(names[0]) ? kind : 0];
+}
+
+size_t tlm_alert(const alert_t *a, uint32_t seq, bool text, uint8_t *dst) {
+    uint8_t *p = dst + TLM_HEADER_SIZE;
+
+    if (text) {
+        char *msg = (char *)dst;
+        const char *name = alert_name(a->kind);
+        size_t ptr = 0;
+
+        BUF_LIT(msg, ptr, "ALERT {\nKIND = ");
+        memcpy(msg + ptr, name, strlen(name));
+        ptr += strlen(name);
+        BUF_LIT(msg, ptr, "\nACTOR = ");
+        BUF_INT(msg, ptr, a->actor);
+        BUF_LIT(msg, ptr, "\nVALUE = ");
+        BUF_INT(msg, ptr, a->value);
+        BUF_LIT(msg, ptr, "\n}\n");
+        return ptr;
+    }
+
+    p = put_le(p, seq, 4);
+    p = put_le(p, a->stamp_us, 8);
+    p = put_varint(p, a->kind);
+    p = put_varint(p, a->actor);
+    p = put_varint(p, ((uint32_t)a->value << 1) ^ (uint32_t)(a->value >> 31));
+
+    put_header(dst, FrameAlert, p - dst - TLM_HEADER_SIZE);
+    return p - dst;
+}
+
+size_t tlm_heartbeat(const tlm_heartbeat_t *h, bool text, uint8_t *dst) {
+    uint8_t *p = dst + TLM_HEADER_SIZE;
+
+    if (text) {
+        char *msg = (char *)dst;
+        size_t ptr = 0;
+
+        BUF_LIT(msg, ptr, "HEARTBEAT = ");
+        ptr += fmt_u64(msg + ptr, h->seq);
+        BUF_LIT(msg, ptr, "\n");
+        return ptr;
+    }
+
+    p = put_le(p, h->seq, 4);
+    p = put_le(p, h->ts_us, 8);
+    if (h->echo_ts_us != 0) {
+        p = put_le(p, h->echo_ts_us, 8);
+        p = put_le(p, h->echo_rx_us, 8);
+    }
+
+    put_header(dst, FrameHeartbeat, p - dst - TLM_HEADER_SIZE);
+    return p - dst;
+}
+
+int tlm_heartbeat_decode(const uint8_t *frame, size_t len, tlm_heartbeat_t *h) {
+    const uint8_t *p = frame + TLM_HEADER_SIZE;
+
+    if ((len != TLM_HEADER_SIZE + 12 && len != TLM_HEADER_SIZE + 28) || tlm_frame_len(frame, len) != (int)len ||
+        frame[1] != FrameHeartbeat)
+    {
+        return -1;
+    }
+
+    h->seq = get_le(p, 4);
+    h->ts_us = get_le(p + 4, 8);
+    h->echo_ts_us = len > TLM_HEADER_SIZE + 12 ? get_le(p + 12, 8) : 0;
+    h->echo_rx_us = len > TLM_HEADER_SIZE + 12 ? get_le(p + 20, 8) : 0;
+    return 0;
+}
+
+size_t tlm_batch(tlm_encoder_t *e, const uint8_t *frames, size_t len, uint64_t ts_us, uint8_t *dst) {
+    uint8_t *payload = dst + TLM_HEADER_SIZE + 12, *p;
+    uint8_t type = FrameBatch;
+    size_t packed;
+
+    if (len > TLM_BATCH_MAX)
+        return 0;
+
+    // Carries the sequence number of the last frame inside.
+    put_le(dst + TLM_HEADER_SIZE, e->seq - 1, 4);
+    put_le(dst + TLM_HEADER_SIZE + 4, ts_us, 8);
+
+    // Only kept compressed when it is actually shorter.
+    p = put_varint(payload, len);
+    packed = len > (size_t)(p - payload) ? lz4_compress(frames, len, p, len - (p - payload)) : 0;
+    if (packed > 0) {
+        type |= TLM_FLAG_LZ4;
+        p += packed;
+    } else {
+        memcpy(payload, frames, len);
+        p = payload + len;
+    }
+
+    put_header(dst, type, p - dst - TLM_HEADER_SIZE);
+    return p - dst;
+}
+
+int tlm_frame_len(const uint8_t *buf, size_t len) {
+    size_t payload;
+
+    if (len == 0)
+        return 0;
+    if (buf[0] != TLM_MAGIC)
+        return -1;
+    if (len < TLM_HEADER_SIZE)
+        return 0;
+
+    payload = get_le(buf + 2, 2);
+    if (payload > TLM_PAYLOAD_MAX)
+        return -1;
+
+    return len >= TLM_HEADER_SIZE + payload ? (int)(TLM_HEADER_SIZE + payload) : 0;
+}
+
+int tlm_decode(tlm_decoder_t *d, const uint8_t *frame, size_t len, const tlm_sink_t *sink) {
+    const uint8_t *p = frame + TLM_HEADER_SIZE, *end = frame + len;
+    uint8_t type = frame[1] & 0x0f, flags = frame[1] & 0xf0;
+    uint32_t seq, mask, v, cur[TLM_FLOATS];
+    uint64_t ts_us;
+    tlm_record_t r;
+
+    if (type == FrameHello) {
+        tlm_hello_t h;
+
+        if (tlm_hello_decode(frame, len, &h) < 0)
+            return -1;
+        if (sink->hello)
+            sink->hello(&h, sink->arg);
+        return 0;
+    }
+
+    if (type == FrameKey || type == FrameBatch || type == FrameAlert || type == FrameHeartbeat) {
+        if (end - p < 12)
+            return -1;
+        seq = get_le(p, 4);
+        ts_us = get_le(p + 4, 8);
+        p += 12;
+    } else if (type == FrameDelta) {
+        if (p >= end || !(p = get_varint(p + 1, end, &v)))
+            return -1;
+        seq = d->seq + 1;
+        ts_us = d->ts_us + v;
+
+        // A delta is only meaningful on top of the frame right before it.
+        if (!d->synced || frame[TLM_HEADER_SIZE] != (uint8_t)seq) {
+            d->synced = false;
+            d->skipped++;
+            return 0;
+        }
+    } else {
+        return -1;
+    }
+
+    if (type == FrameHeartbeat) {
+        tlm_heartbeat_t h;
+
+        if (tlm_heartbeat_decode(frame, len, &h) < 0)
+            return -1;
+        if (sink->heartbeat)
+            sink->heartbeat(&h, sink->arg);
+        return 0;
+    }
+
+    if (type == FrameAlert) {
+        alert_t a = { .stamp_us = ts_us };
+
+        if (!(p = get_varint(p, end, &v)))
+            return -1;
+        a.kind = v;
+        if (!(p = get_varint(p, end, &v)))
+            return -1;
+        a.actor = v;
+        if (!(p = get_varint(p, end, &v)))
+            return -1;
+        a.value = (int32_t)((v >> 1) ^ -(v & 1));
+
+        sink->alert(&a, seq, sink->arg);
+        return 1;
+    }
+
+    if (type == FrameBatch) {
+        uint8_t raw[TLM_BATCH_MAX];
+        int n, k, count = 0;
+
+        if (flags & TLM_FLAG_LZ4) {
+            if (!(p = get_varint(p, end, &v)) || v > sizeof(raw) || lz4_decompress(p, end - p, raw, v) != (int)v)
+                return -1;
+            p = raw;
+        } else {
+            v = end - p;
+        }
+
+        // Batches hold key and delta frames only.
+        for (size_t off = 0; off < v; off += n) {
+            n = tlm_frame_len(p + off, v - off);
+            if (n <= 0 || ((p[off + 1] & 0x0f) != FrameKey && (p[off + 1] & 0x0f) != FrameDelta)
+                    || (k = tlm_decode(d, p + off, n, sink)) < 0)
+                return -1;
+            count += k;
+        }
+        return count;
+    }
+
+    if (type == FrameKey)
+        memset(&r, 0, sizeof(r));
+    else
+        r = d->prev;
+    r.gps_len = 0;
+    r.gps_lost = false;
+    record_floats(&r, cur);
+
+    if (!(p = get_varint(p, end, &mask)))
+        return -1;
+    if (mask & F_BATTERY) {
+        if (!(p = get_varint(p, end, &v)))
+            return -1;
+        r.battery += (int32_t)((v >> 1) ^ -(v & 1));
+    }
+    if (mask & F_ACTION) {
+        if (!(p = get_varint(p, end, &v)))
+            return -1;
+        r.action = v;
+    }
+    if (mask & F_SAMPLES) {
+        if (!(p = get_varint(p, end, &v)))
+            return -1;
+        r.samples = v;
+    }
+    if (mask & F_CHANNELS) {
+        if (!(p = get_varint(p, end, &v)))
+            return -1;
+        r.channels = v;
+    }
+    for (int i = 0; i < TLM_FLOATS; ++i) {
+        if (mask & F_FLOAT(i)) {
+            if (!(p = get_varint(p, end, &v)))
+                return -1;
+            cur[i] ^= v;
+        }
+    }
+    record_set_floats(&r, cur);
+    if (mask & F_GPS) {
+        if (!(p = get_varint(p, end, &v)) || v > sizeof(r.gps) || v > (size_t)(end - p))
+            return -1;
+        memcpy(r.gps, p, v);
+        r.gps_len = v;
+        p += v;
+    }
+    r.gps_lost = mask & F_GPS_LOST;
+
+    if (flags & TLM_FLAG_HISTORY) {
+        if (type != FrameKey)
+            return -1;
+        if (sink->history)
+            sink->history(&r, seq, ts_us, sink->arg);
+        return 1;
+    }
+
+    d->prev = r;
+    d->seq = seq;
+    d->ts_us = ts_us;
+    d->synced = true;
+    sink->record(&r, seq, ts_us, sink->arg);
+
+    return 1;
+}
+
+static uint8_t *lz4_put_length(uint8_t *op, size_t n) {
+    if (n >= 15) {
+        for (n -= 15; n >= 255; n -= 255)
+            *op++ = 255;
+        *op++ = n;
+    }
+    return op;
+}
+
+size_t lz4_compress(const uint8_t *src, size_t len, uint8_t *dst, size_t cap) {
+    uint32_t table[1 << LZ4_HASH_BITS] = {0};   // Position + 1 of the last 4-byte sequence with that hash.
+    const uint8_t *ip = src, *anchor = src, *end = src + len;
+    uint8_t *op = dst, *oend = dst + cap;
+    size_t lit;
+
+    while (len >= LZ4_MFLIMIT && ip < end - LZ4_MFLIMIT) {
+        const uint8_t *match;
+        uint32_t seq, h, ref;
+        size_t mlen = LZ4_MIN_MATCH;
+
+        memcpy(&seq, ip, 4);
+        h = (seq * 2654435761u) >> (32 - LZ4_HASH_BITS);
+        ref = table[h];
+        table[h] = ip - src + 1;
+
+        if (ref == 0 || (size_t)(ip - src) - (ref - 1) > LZ4_MAX_OFFSET || memcmp(src + ref - 1, ip, LZ4_MIN_MATCH) != 0) {
+            ip++;
+            continue;
+        }
+        match = src + ref - 1;
+        while (ip + mlen < end - LZ4_LAST_LITERALS && ip[mlen] == match[mlen])
+            mlen++;
+
+        // Token, literal length, literals, offset, match length.
+        lit = ip - anchor;
+        if ((size_t)(oend - op) < 1 + lit / 255 + 1 + lit + 2 + (mlen - LZ4_MIN_MATCH) / 255 + 1)
+            return 0;
+
+        uint8_t *token = op++;
+        *token = (lit >= 15 ? 15 : lit) << 4 | (mlen - LZ4_MIN_MATCH >= 15 ? 15 : mlen - LZ4_MIN_MATCH);
+        op = lz4_put_length(op, lit);
+        memcpy(op, anchor, lit);
+        op += lit;
+        *op++ = (ip - match) & 0xff;
+        *op++ = (ip - match) >> 8;
+        op = lz4_put_length(op, mlen - LZ4_MIN_MATCH);
+
+        ip += mlen;
+        anchor = ip;
+    }
+
+    // Last sequence holds literals only.
+    lit = end - anchor;
+    if ((size_t)(oend - op) < 1 + lit / 255 + 1 + lit)
+        return 0;
+    *op++ = (lit >= 15 ? 15 : lit) << 4;
+    op = lz4_put_length(op, lit);
+    memcpy(op, anchor, lit);
+    op += lit;
+
+    return op - dst;
+}
+
+int lz4_decompress(const uint8_t *src, size_t len, uint8_t *dst, size_t cap) {
+    const uint8_t *ip = src, *iend = src + len;
+    uint8_t *op = dst, *oend = dst + cap;
+
+    while (ip < iend) {
+        uint8_t token = *ip++, b;
+        size_t lit = token >> 4, mlen = token & 15, off;
+
+        if (lit == 15) {
+            do {
+                if (ip >= iend)
+                    return -1;
+                lit += b = *ip++;
+            } while (b == 255);
+        }
+        if (lit > (size_t)(iend - ip) || lit > (size_t)(oend - op))
+            return -1;
+        memcpy(op, ip, lit);
+        op += lit;
+        ip += lit;
+
+        if (ip == iend)
+            break;
+
+        if (iend - ip < 2)
+            return -1;
+        off = ip[0] | (size_t)ip[1] << 8;
+        ip += 2;
+        if (off == 0 || off > (size_t)(op - dst))
+            return -1;
+
+        if (mlen == 15) {
+            do {
+                if (ip >= iend)
+                    return -1;
+                mlen += b = *ip++;
+            } while (b == 255);
+        }
+        mlen += LZ4_MIN_MATCH;
+        if (mlen > (size_t)(oend - op))
+            return -1;
+
+        // Byte by byte, matches may overlap their own output.
+        for (const uint8_t *m = op - off; mlen > 0; --mlen)
+            *op++ = *m++;
+    }
+
+    return op - dst;
+}
@@ -1,13 +1,21 @@
 # Project build script 
 #
-# Two separate binaries:
+# Eight separate binaries:
 # - drone_sys;
 # - operator;
+# - netem_proxy, network impairment proxy for benchmarks;
+# - fanout_bench, benchmark of the telemetry fan-out to several ground stations, multicast against TCP;
+# - fleet_bench, telemetry load generator for the fleet ground station;
+# - swarm, batch simulator of many drones per process for the fleet ground station;
+# - wait_bench, checks and benchmark of the timed waits, and ping-pong benchmark of the wait strategies (`-p`);
+# - fmt_check, checks and benchmark of the text telemetry number formatting against printf;
+#
+# `sh compile.sh check` also runs the checks after the build.
 
 set -e
 mkdir -p build
 
-SRCS="drone_sys.c flight_ctrl.c telemetry.c gps_ctrl.c accelerometer.c battery.c watchdog.c"
+SRCS="drone_sys.c flight_ctrl.c telemetry.c gps_ctrl.c nmea.c accelerometer.c physics.c battery.c watchdog.c ipc_sync.c gps_ring.c state.c mpsc.c fmt.c codec.c aggregate.c datagram.c"
 CC=gcc
 CFLAGS="-Wall -Wextra -O2"
 LDFLAGS="-lm"
@@ -19,7 +27,32 @@ $CC $CFLAGS -I.             \
     $LDFLAGS
 
 echo "Compiling operator..."
-$CC $CFLAGS -I. operator.c -o build/operator $LDFLAGS
+$CC $CFLAGS -I. operator.c fleet.c dashboard.c ipc_sync.c fmt.c codec.c datagram.c clock_sync.c -o build/operator $LDFLAGS -pthread
+
+echo "Compiling netem_proxy..."
+$CC $CFLAGS -I. netem_proxy.c -o build/netem_proxy $LDFLAGS
+
+echo "Compiling fanout_bench..."
+$CC $CFLAGS -I. fanout_bench.c codec.c fmt.c datagram.c -o build/fanout_bench $LDFLAGS -pthread
+
+echo "Compiling fleet_bench..."
+$CC $CFLAGS -I. fleet_bench.c codec.c fmt.c datagram.c -o build/fleet_bench $LDFLAGS -pthread
+
+echo "Compiling swarm..."
+$CC $CFLAGS -I. swarm.c nmea.c codec.c fmt.c datagram.c -o build/swarm $LDFLAGS -pthread
+
+echo "Compiling wait_bench..."
+$CC $CFLAGS -I. wait_bench.c ipc_sync.c -o build/wait_bench $LDFLAGS
+
+echo "Compiling fmt_check..."
+$CC $CFLAGS -I. fmt_check.c fmt.c -o build/fmt_check $LDFLAGS
 
 echo "Done."
 
+if [ "$1" = "check" ]; then
+    echo "Checking timed waits..."
+    build/wait_bench
+    echo "Checking number formatting..."
+    build/fmt_check
+fi
+
@@ -0,0 +1,838 @@
+/**
+  * @file dashboard.c
+  * @brief Live telemetry for web browsers: a WebSocket gateway embedded in the operator (`-g` option).
+  *
+  * Main tasks:
+  * - Serve a small dashboard page on `/`, and the live stream as WebSocket on the same port. `/?drone=N` streams one
+  *   drone only, a text message with a drone id (0 for all) changes it on an open connection.
+  * - Encode each telemetry frame and alert once, as JSON inside a complete WebSocket frame, and share that buffer
+  *   between all viewers.
+  * - Telemetry never waits for viewers: those that do not keep up lose their oldest frames, and are closed when they
+  *   take nothing for `DASH_STALL_US`.
+  * - Report every `DASH_REPORT_S` seconds what was published, sent and dropped.
+  *
+  * @note
+  *
+  * Publishers (the operator main loop, or the fleet workers) push frames onto a lock-free list and wake the gateway
+  * thread only when it was empty. The gateway takes the whole list at once, and queues a reference to each frame for
+  * every viewer that wants it. Frames are counted references, but only the gateway thread ever touches the count:
+  * it owns a frame from the moment it takes it off the list. A viewer queue is written with one `sendmsg` of up to
+  * `DASH_IOV` frames, straight from the shared buffers.
+  *
+  * Nothing is encoded while no viewer is connected. The list holds at most `DASH_PENDING_MAX` frames, publishers drop
+  * the frames beyond it. Text encoded telemetry is printed as it comes and never decoded, it does not reach viewers.
+  *
+  * SHA-1 and base64 are only there for the handshake (RFC 6455, section 4.2.2), they are written out here rather than
+  * pulled from a library.
+  **/
+
+#include "proj_types.h"
+#include <pthread.h>
+#include <math.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#define DASH_QUEUE          1024        // Frames queued per viewer, a power of two.
+#define DASH_IOV            64          // Frames per `sendmsg`.
+#define DASH_PENDING_MAX    65536       // Frames published and not taken by the gateway yet.
+#define DASH_RX_SIZE        4096        // Longest request, and longest message from a viewer.
+#define DASH_EVENTS         64
+#define DASH_POLL_MS        100
+#define DASH_STALL_US       5000000     // A viewer that takes nothing for that long is closed.
+#define DASH_REPORT_S       10
+#define DASH_JSON_MAX       (1024 + 6 * GPS_SENTENCE_SIZE)
+#define DASH_WS_GUID        "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+
+_Static_assert((DASH_QUEUE & (DASH_QUEUE - 1)) == 0, "DASH_QUEUE must be a power of two.");
+
+/**
+  * @brief Complete message to viewers: a WebSocket frame, or an HTTP response.
+  **/
+typedef struct dash_frame {
+    struct dash_frame *next;        // Pending list.
+    uint32_t refs;                  // Viewer queues holding it, plus the pending list. Gateway thread only.
+    uint32_t drone;                 // Drone it is about, 0 for none.
+    uint32_t len;
+    uint8_t data[];
+} dash_frame_t;
+
+/**
+  * @brief One browser connection.
+  **/
+typedef struct dash_client {
+    int fd;
+    bool open;                      // Handshake done, takes telemetry.
+    bool closing;                   // Closed once its queue is written.
+    bool blocked;                   // Socket buffer full, waits for `EPOLLOUT`.
+    uint32_t drone;                 // Drone it streams, 0 for all.
+    uint8_t rx[DASH_RX_SIZE];
+    size_t rx_len;
+    dash_frame_t *queue[DASH_QUEUE];
+    uint32_t head, len;
+    size_t sent;                    // Bytes of the head frame already written.
+    uint64_t progress_us;           // Last write, or last time its queue was empty.
+    struct dash_client *prev, *next;
+} dash_client_t;
+
+static const char page[] =
+    "<!DOCTYPE html><meta charset=utf-8><title>Drones</title>\n"
+    "<style>body{font:13px monospace}th,td{padding:2px 10px;text-align:right}</style>\n"
+    "<table><thead><tr><th>drone<th>seq<th>action<th>battery<th>accel<th>motors<th>gps<th>last alert</thead>\n"
+    "<tbody id=rows></tbody></table>\n"
+    "<script>\n"
+    "const drones = {}, ws = new WebSocket('ws://' + location.host + '/' + location.search);\n"
+    "const fix = v => v ? v.map(x => x.toFixed(2)).join(' ') : '';\n"
+    "ws.onmessage = e => {\n"
+    "    const m = JSON.parse(e.data);\n"
+    "    Object.assign(drones[m.drone] = drones[m.drone] || {}, m);\n"
+    "};\n"
+    "setInterval(() => rows.innerHTML = Object.entries(drones).map(([id, d]) => '<tr><td>' + [id, d.seq, d.action,\n"
+    "    d.battery, fix(d.accel), fix(d.motors), d.gps_lost ? 'lost' : (d.gps || '').split(',')[0], d.alert || '']\n"
+    "    .join('<td>')).join(''), 250);\n"
+    "</script>\n";
+
+static struct {
+    _Atomic(dash_frame_t *) pending;    // Newest first.
+    atomic_uint pending_len;
+    atomic_uint viewers;                // Open WebSocket connections.
+    atomic_ulong refused;               // Frames dropped by publishers, the list was full.
+    atomic_bool stopping;
+    int listen_fd, epoll_fd, wake_fd;
+    pthread_t thread;
+    bool started;
+    dash_client_t *clients;
+    struct { uint64_t published, sent, bytes, dropped, stalled; } stats;     // Gateway thread only.
+} dash = { .listen_fd = -1, .epoll_fd = -1, .wake_fd = -1 };
+
+static char tag_listen, tag_wake;
+
+/* Helpers to fill JSON. Callers guarantee the space (see `DASH_JSON_MAX`). */
+#define JSON_LIT(msg, ptr, lit) do { memcpy((msg) + (ptr), lit, sizeof(lit) - 1); (ptr) += sizeof(lit) - 1; } while (0)
+#define JSON_U64(msg, ptr, v)   ((ptr) += fmt_u64((msg) + (ptr), (v)))
+#define JSON_I32(msg, ptr, v)   ((ptr) += fmt_i32((msg) + (ptr), (v)))
+
+static uint64_t now_us(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000ull + now.tv_nsec / 1000;
+}
+
+static inline uint32_t rol(uint32_t v, int n) {
+    return v << n | v >> (32 - n);
+}
+
+static void sha1_block(uint32_t h[5], const uint8_t *p) {
+    uint32_t w[80], a = h[0], b = h[1], c = h[2], d = h[3], e = h[4], f, k, t;
+
+    for (int i = 0; i < 16; ++i)
+        w[i] = (uint32_t)p[4 * i] << 24 | p[4 * i + 1] << 16 | p[4 * i + 2] << 8 | p[4 * i + 3];
+    for (int i = 16; i < 80; ++i)
+        w[i] = rol(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+    for (int i = 0; i < 80; ++i) {
+        if (i < 20) {
+            f = (b & c) | (~b & d);
+            k = 0x5a827999;
+        } else if (i < 40) {
+            f = b ^ c ^ d;
+            k = 0x6ed9eba1;
+        } else if (i < 60) {
+            f = (b & c) | (b & d) | (c & d);
+            k = 0x8f1bbcdc;
+        } else {
+            f = b ^ c ^ d;
+            k = 0xca62c1d6;
+        }
+        t = rol(a, 5) + f + e + k + w[i];
+        e = d;
+        d = c;
+        c = rol(b, 30);
+        b = a;
+        a = t;
+    }
+    h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e;
+}
+
+/**
+  * @brief SHA-1 digest of `len` bytes (RFC 3174).
+  **/
+static void sha1(const uint8_t *msg, size_t len, uint8_t out[20]) {
+    uint32_t h[5] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0 };
+    uint8_t tail[128] = { 0 };
+    size_t rest = len % 64, tail_len = rest < 56 ? 64 : 128;
+
+    for (size_t off = 0; off + 64 <= len; off += 64)
+        sha1_block(h, msg + off);
+
+    // Last partial block, the 1 bit, zeros and the message length in bits.
+    memcpy(tail, msg + len - rest, rest);
+    tail[rest] = 0x80;
+    for (int i = 0; i < 8; ++i)
+        tail[tail_len - 1 - i] = (uint64_t)len * 8 >> (8 * i);
+    sha1_block(h, tail);
+    if (tail_len == 128)
+        sha1_block(h, tail + 64);
+
+    for (int i = 0; i < 20; ++i)
+        out[i] = h[i / 4] >> (24 - 8 * (i % 4));
+}
+
+/**
+  * @brief Writes `len` bytes in base64 (RFC 4648) with padding. No terminator.
+  *
+  * @return Characters written.
+  **/
+static size_t base64(const uint8_t *src, size_t len, char *dst) {
+    static const char digits[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    size_t n = 0, i = 0;
+    uint32_t v;
+
+    for (; i + 3 <= len; i += 3) {
+        v = (uint32_t)src[i] << 16 | src[i + 1] << 8 | src[i + 2];
+        dst[n++] = digits[v >> 18];
+        dst[n++] = digits[(v >> 12) & 63];
+        dst[n++] = digits[(v >> 6) & 63];
+        dst[n++] = digits[v & 63];
+    }
+    if (i < len) {
+        v = (uint32_t)src[i] << 16 | (i + 1 < len ? src[i + 1] << 8 : 0);
+        dst[n++] = digits[v >> 18];
+        dst[n++] = digits[(v >> 12) & 63];
+        dst[n++] = i + 1 < len ? digits[(v >> 6) & 63] : '=';
+        dst[n++] = '=';
+    }
+    return n;
+}
+
+static size_t json_f6(char *msg, float v) {
+    if (!isfinite(v)) {
+        memcpy(msg, "null", 4);
+        return 4;
+    }
+    return fmt_f6(msg, v);
+}
+
+static size_t json_vec(char *msg, const float *v, int len) {
+    size_t ptr = 0;
+
+    msg[ptr++] = '[';
+    for (int i = 0; i < len; ++i) {
+        if (i)
+            msg[ptr++] = ',';
+        ptr += json_f6(msg + ptr, v[i]);
+    }
+    msg[ptr++] = ']';
+    return ptr;
+}
+
+static size_t json_accel(char *msg, const acceleration_t *a) {
+    return json_vec(msg, (const float[]){ a->x, a->y, a->z }, 3);
+}
+
+/**
+  * @brief Writes `len` bytes as a JSON string, quotes included.
+  **/
+static size_t json_str(char *msg, const char *s, size_t len) {
+    static const char hex[] = "0123456789abcdef";
+    size_t ptr = 0;
+
+    msg[ptr++] = '"';
+    for (size_t i = 0; i < len; ++i) {
+        unsigned char ch = s[i];
+
+        if (ch == '"' || ch == '\\') {
+            msg[ptr++] = '\\';
+            msg[ptr++] = ch;
+        } else if (ch < 0x20 || ch >= 0x7f) {
+            JSON_LIT(msg, ptr, "\\u00");
+            msg[ptr++] = hex[ch >> 4];
+            msg[ptr++] = hex[ch & 15];
+        } else {
+            msg[ptr++] = ch;
+        }
+    }
+    msg[ptr++] = '"';
+    return ptr;
+}
+
+/**
+  * @brief Encodes the channels of record `r`, as JSON members of the same names as the text frame.
+  **/
+static size_t json_record(char *msg, uint32_t drone, const tlm_record_t *r, uint32_t seq, uint64_t ts_us) {
+    size_t ptr = 0;
+
+    JSON_LIT(msg, ptr, "{\"drone\":");
+    JSON_U64(msg, ptr, drone);
+    JSON_LIT(msg, ptr, ",\"seq\":");
+    JSON_U64(msg, ptr, seq);
+    JSON_LIT(msg, ptr, ",\"ts_us\":");
+    JSON_U64(msg, ptr, ts_us);
+    if (r->channels & 1 << TlmBattery) {
+        JSON_LIT(msg, ptr, ",\"battery\":");
+        JSON_U64(msg, ptr, r->battery);
+    }
+    if (r->channels & 1 << TlmAction) {
+        JSON_LIT(msg, ptr, ",\"action\":");
+        ptr += json_str(msg + ptr, tlm_action_name(r->action), strlen(tlm_action_name(r->action)));
+    }
+    if (r->channels & 1 << TlmAccel) {
+        JSON_LIT(msg, ptr, ",\"accel\":");
+        ptr += json_accel(msg + ptr, &r->acceleration);
+    }
+    if (r->channels & 1 << TlmAccelStats) {
+        JSON_LIT(msg, ptr, ",\"accel_min\":");
+        ptr += json_accel(msg + ptr, &r->accel_min);
+        JSON_LIT(msg, ptr, ",\"accel_max\":");
+        ptr += json_accel(msg + ptr, &r->accel_max);
+        JSON_LIT(msg, ptr, ",\"accel_rms\":");
+        ptr += json_accel(msg + ptr, &r->accel_rms);
+        JSON_LIT(msg, ptr, ",\"samples\":");
+        JSON_U64(msg, ptr, r->samples);
+    }
+    if (r->channels & 1 << TlmMotors) {
+        JSON_LIT(msg, ptr, ",\"motors\":");
+        ptr += json_vec(msg + ptr, r->motors.motors, 4);
+    }
+    if (r->channels & 1 << TlmGps) {
+        if (r->gps_len > 0) {
+            JSON_LIT(msg, ptr, ",\"gps\":");
+            ptr += json_str(msg + ptr, r->gps, r->gps_len);
+        }
+        if (r->gps_lost)
+            JSON_LIT(msg, ptr, ",\"gps_lost\":true");
+    }
+    msg[ptr++] = '}';
+    return ptr;
+}
+
+/**
+  * @brief Allocates a message of `len` bytes, the caller fills it.
+  **/
+static dash_frame_t *frame_alloc(uint32_t drone, size_t len) {
+    dash_frame_t *f = malloc(sizeof(*f) + len);
+
+    if (f == NULL) {
+        perror("malloc");
+        return NULL;
+    }
+    f->refs = 1;
+    f->drone = drone;
+    f->len = len;
+    return f;
+}
+
+static void frame_release(dash_frame_t *f) {
+    if (--f->refs == 0)
+        free(f);
+}
+
+/**
+  * @brief Wraps `len` bytes of payload into an unmasked WebSocket frame of opcode `op`, final.
+  **/
+static dash_frame_t *frame_ws(uint32_t drone, uint8_t op, const void *payload, size_t len) {
+    size_t header = len < 126 ? 2 : 4;
+    dash_frame_t *f = frame_alloc(drone, header + len);
+
+    if (f == NULL)
+        return NULL;
+    f->data[0] = 0x80 | op;
+    if (len < 126) {
+        f->data[1] = len;
+    } else {
+        f->data[1] = 126;
+        f->data[2] = len >> 8;
+        f->data[3] = len;
+    }
+    memcpy(f->data + header, payload, len);
+    return f;
+}
+
+/**
+  * @brief Hands a frame to the gateway. Callable from any thread.
+  **/
+static void dash_publish(uint32_t drone, const char *json, size_t len) {
+    dash_frame_t *f, *head;
+
+    if (atomic_fetch_add_explicit(&dash.pending_len, 1, memory_order_relaxed) >= DASH_PENDING_MAX) {
+        atomic_fetch_sub_explicit(&dash.pending_len, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&dash.refused, 1, memory_order_relaxed);
+        return;
+    }
+    if ((f = frame_ws(drone, 0x1, json, len)) == NULL) {
+        atomic_fetch_sub_explicit(&dash.pending_len, 1, memory_order_relaxed);
+        return;
+    }
+
+    // `f` belongs to the gateway as soon as it is on the list, only `head` is looked at afterwards.
+    head = atomic_load_explicit(&dash.pending, memory_order_relaxed);
+    do {
+        f->next = head;
+    } while (!atomic_compare_exchange_weak_explicit(&dash.pending, &head, f, memory_order_release,
+        memory_order_relaxed));
+
+    // The gateway sleeps only with an empty list, the first frame after it took the list wakes it.
+    if (head == NULL && eventfd_write(dash.wake_fd, 1) < 0)
+        perror("eventfd_write");
+}
+
+void dash_record(uint32_t drone, const tlm_record_t *r, uint32_t seq, uint64_t ts_us) {
+    char json[DASH_JSON_MAX];
+
+    if (atomic_load_explicit(&dash.viewers, memory_order_relaxed) == 0)
+        return;
+    dash_publish(drone, json, json_record(json, drone, r, seq, ts_us));
+}
+
+void dash_alert(uint32_t drone, const alert_t *a, uint32_t seq) {
+    char json[DASH_JSON_MAX];
+    const char *name = alert_name(a->kind);
+    size_t ptr = 0;
+
+    if (atomic_load_explicit(&dash.viewers, memory_order_relaxed) == 0)
+        return;
+    JSON_LIT(json, ptr, "{\"drone\":");
+    JSON_U64(json, ptr, drone);
+    JSON_LIT(json, ptr, ",\"alert\":");
+    ptr += json_str(json + ptr, name, strlen(name));
+    JSON_LIT(json, ptr, ",\"alert_seq\":");
+    JSON_U64(json, ptr, seq);
+    JSON_LIT(json, ptr, ",\"actor\":");
+    JSON_U64(json, ptr, a->actor);
+    JSON_LIT(json, ptr, ",\"value\":");
+    JSON_I32(json, ptr, a->value);
+    JSON_LIT(json, ptr, ",\"ts_us\":");
+    JSON_U64(json, ptr, a->stamp_us);
+    json[ptr++] = '}';
+    dash_publish(drone, json, ptr);
+}
+
+/**
+  * @brief Queues `f` for client `c`, taking a reference. A full queue loses its oldest frame not being written.
+  **/
+static void client_push(dash_client_t *c, dash_frame_t *f) {
+    uint32_t victim;
+
+    if (c->len == DASH_QUEUE) {
+        victim = c->sent > 0 ? c->head + 1 : c->head;
+        frame_release(c->queue[victim % DASH_QUEUE]);
+        if (victim != c->head)
+            c->queue[victim % DASH_QUEUE] = c->queue[c->head % DASH_QUEUE];
+        c->head++;
+        c->len--;
+        dash.stats.dropped++;
+    }
+    if (c->len == 0)
+        c->progress_us = now_us();
+    f->refs++;
+    c->queue[(c->head + c->len++) % DASH_QUEUE] = f;
+}
+
+/**
+  * @brief Queues a message of its own for client `c`, not counted as telemetry.
+  **/
+static void client_reply(dash_client_t *c, dash_frame_t *f) {
+    if (f == NULL)
+        return;
+    client_push(c, f);
+    frame_release(f);
+}
+
+static void client_close(dash_client_t *c) {
+    if (c->open)
+        atomic_fetch_sub_explicit(&dash.viewers, 1, memory_order_relaxed);
+    for (uint32_t i = 0; i < c->len; ++i)
+        frame_release(c->queue[(c->head + i) % DASH_QUEUE]);
+    close(c->fd);
+
+    if (c->prev != NULL)
+        c->prev->next = c->next;
+    else
+        dash.clients = c->next;
+    if (c->next != NULL)
+        c->next->prev = c->prev;
+    free(c);
+}
+
+/**
+  * @brief Writes as much of the queue of `c` as its socket takes, `DASH_IOV` frames per system call.
+  *
+  * @return -1 when the connection failed.
+  **/
+static int client_flush(dash_client_t *c) {
+    struct iovec iov[DASH_IOV];
+    int len;
+    ssize_t n;
+    size_t part, total;
+    bool full;
+
+    while (c->len > 0) {
+        len = c->len < DASH_IOV ? c->len : DASH_IOV;
+        total = 0;
+        for (int i = 0; i < len; ++i) {
+            dash_frame_t *f = c->queue[(c->head + i) % DASH_QUEUE];
+            iov[i] = (struct iovec){ f->data, f->len };
+        }
+        iov[0].iov_base = (uint8_t *)iov[0].iov_base + c->sent;
+        iov[0].iov_len -= c->sent;
+        for (int i = 0; i < len; ++i)
+            total += iov[i].iov_len;
+
+        n = sendmsg(c->fd, &(struct msghdr){ .msg_iov = iov, .msg_iovlen = len }, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                return -1;
+            n = 0;
+        }
+        if (n > 0)
+            c->progress_us = now_us();
+        dash.stats.bytes += n;
+        full = (size_t)n < total;
+
+        for (int i = 0; i < len && n > 0; ++i) {
+            part = iov[i].iov_len < (size_t)n ? iov[i].iov_len : (size_t)n;
+            n -= part;
+            if (part < iov[i].iov_len) {
+                c->sent += part;
+                break;
+            }
+            frame_release(c->queue[c->head % DASH_QUEUE]);
+            c->head++;
+            c->len--;
+            c->sent = 0;
+            dash.stats.sent++;
+        }
+
+        // Wait for room, rather than trying again on every frame.
+        if (full) {
+            c->blocked = true;
+            if (epoll_ctl(dash.epoll_fd, EPOLL_CTL_MOD, c->fd,
+                &(struct epoll_event){ .events = EPOLLIN | EPOLLOUT, .data.ptr = c }) < 0)
+            {
+                perror("epoll_ctl");
+                return -1;
+            }
+            break;
+        }
+    }
+    return 0;
+}
+
+/**
+  * @brief Answers the HTTP request at the start of `rx`: the page, or the WebSocket handshake.
+  *
+  * @return -1 on a malformed request.
+  **/
+static int client_request(dash_client_t *c, size_t len) {
+    static const char accept_fmt[] =
+        "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+        "Sec-WebSocket-Accept: %.*s\r\n\r\n";
+    static const char page_fmt[] =
+        "HTTP/1.1 200 OK\r\nContent-Type: text/html\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n%s";
+    char *req = (char *)c->rx, *line, *drone, key[64], accept[28], reply[sizeof(page_fmt) + sizeof(page) + 32];
+    uint8_t digest[20];
+    size_t key_len = 0;
+    dash_frame_t *f;
+    int n;
+
+    req[len - 2] = 0;
+    if (strncmp(req, "GET /", 5) != 0)
+        return -1;
+    if ((drone = strstr(req, "?drone=")) != NULL && drone < strchr(req, '\r'))
+        c->drone = strtoul(drone + 7, NULL, 10);
+
+    for (line = strstr(req, "\r\n"); line != NULL; line = strstr(line + 2, "\r\n")) {
+        if (strncasecmp(line + 2, "Sec-WebSocket-Key:", 18) != 0)
+            continue;
+        line += 2 + 18;
+        line += strspn(line, " ");
+        key_len = strcspn(line, " \r");
+        if (key_len > sizeof(key) - sizeof(DASH_WS_GUID))
+            return -1;
+        memcpy(key, line, key_len);
+        break;
+    }
+
+    if (key_len == 0) {
+        n = snprintf(reply, sizeof(reply), page_fmt, sizeof(page) - 1, page);
+        c->closing = true;
+    } else {
+        memcpy(key + key_len, DASH_WS_GUID, sizeof(DASH_WS_GUID) - 1);
+        sha1((uint8_t *)key, key_len + sizeof(DASH_WS_GUID) - 1, digest);
+        n = snprintf(reply, sizeof(reply), accept_fmt, (int)base64(digest, sizeof(digest), accept), accept);
+        c->open = true;
+        atomic_fetch_add_explicit(&dash.viewers, 1, memory_order_relaxed);
+    }
+
+    if ((f = frame_alloc(0, n)) == NULL)
+        return -1;
+    memcpy(f->data, reply, n);
+    client_reply(c, f);
+    return 0;
+}
+
+/**
+  * @brief Handles the whole messages at the start of `rx`: pings, close, and drone selection.
+  *
+  * @return -1 on a protocol error.
+  **/
+static int client_messages(dash_client_t *c) {
+    size_t off = 0, header, len;
+    uint8_t *p, *mask;
+    char id[16];
+
+    while (c->rx_len - off >= 2) {
+        p = c->rx + off;
+        len = p[1] & 0x7f;
+        header = len == 126 ? 8 : 6;
+        if (!(p[1] & 0x80) || len == 127)
+            return -1;                      // Viewers must mask, and send nothing that large.
+        if (c->rx_len - off < header)
+            break;
+        if (len == 126)
+            len = p[2] << 8 | p[3];
+        if (header + len > sizeof(c->rx))
+            return -1;
+        if (c->rx_len - off < header + len)
+            break;
+
+        mask = p + header - 4;
+        for (size_t i = 0; i < len; ++i)
+            p[header + i] ^= mask[i % 4];
+
+        switch (p[0] & 0x0f) {
+            case 0x8:
+                client_reply(c, frame_ws(0, 0x8, p + header, len < 2 ? len : 2));
+                c->closing = true;
+                break;
+            case 0x9:
+                client_reply(c, frame_ws(0, 0xa, p + header, len));
+                break;
+            case 0x1:
+                snprintf(id, sizeof(id), "%.*s", (int)(len < sizeof(id) - 1 ? len : sizeof(id) - 1), p + header);
+                c->drone = strtoul(id, NULL, 10);
+                break;
+            default:
+                break;
+        }
+        off += header + len;
+    }
+
+    memmove(c->rx, c->rx + off, c->rx_len - off);
+    c->rx_len -= off;
+    return 0;
+}
+
+/**
+  * @brief Reads what client `c` sent.
+  *
+  * @return -1 when the connection is over.
+  **/
+static int client_read(dash_client_t *c) {
+    ssize_t n = recv(c->fd, c->rx + c->rx_len, sizeof(c->rx) - c->rx_len, MSG_DONTWAIT);
+    uint8_t *end;
+    size_t len;
+
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK))
+        return -1;
+    if (n < 0 || c->closing)
+        return 0;
+    c->rx_len += n;
+
+    if (c->open)
+        return client_messages(c);
+    if ((end = memmem(c->rx, c->rx_len, "\r\n\r\n", 4)) == NULL)
+        return c->rx_len == sizeof(c->rx) ? -1 : 0;
+
+    len = end + 4 - c->rx;
+    if (client_request(c, len) < 0)
+        return -1;
+    memmove(c->rx, c->rx + len, c->rx_len - len);
+    c->rx_len -= len;
+    return c->open ? client_messages(c) : 0;
+}
+
+static void client_accept(void) {
+    dash_client_t *c;
+    int fd;
+
+    while ((fd = accept4(dash.listen_fd, NULL, NULL, SOCK_NONBLOCK)) >= 0) {
+        if ((c = calloc(1, sizeof(*c))) == NULL) {
+            perror("calloc");
+            close(fd);
+            continue;
+        }
+        c->fd = fd;
+        if (epoll_ctl(dash.epoll_fd, EPOLL_CTL_ADD, fd, &(struct epoll_event){ .events = EPOLLIN, .data.ptr = c }) < 0)
+        {
+            perror("epoll_ctl");
+            close(fd);
+            free(c);
+            continue;
+        }
+        c->next = dash.clients;
+        if (c->next != NULL)
+            c->next->prev = c;
+        dash.clients = c;
+    }
+    if (errno != EAGAIN && errno != EWOULDBLOCK)
+        perror("accept4");
+}
+
+/**
+  * @brief Takes every published frame, in publication order, and queues it for each viewer that wants it.
+  **/
+static void dash_fanout(void) {
+    dash_frame_t *f = atomic_exchange_explicit(&dash.pending, NULL, memory_order_acquire), *ordered = NULL, *next;
+    uint32_t taken = 0;
+
+    for (; f != NULL; f = next, ++taken) {
+        next = f->next;
+        f->next = ordered;
+        ordered = f;
+    }
+    atomic_fetch_sub_explicit(&dash.pending_len, taken, memory_order_relaxed);
+    dash.stats.published += taken;
+
+    for (f = ordered; f != NULL; f = next) {
+        next = f->next;
+        for (dash_client_t *c = dash.clients; c != NULL; c = c->next)
+            if (c->open && !c->closing && (c->drone == 0 || c->drone == f->drone))
+                client_push(c, f);
+        frame_release(f);
+    }
+}
+
+static void dash_report(double s, struct timespec *cpu_since) {
+    struct timespec cpu;
+    uint64_t sent = dash.stats.sent;
+    double cpu_us;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu);
+    cpu_us = (cpu.tv_sec - cpu_since->tv_sec) * 1e6 + (cpu.tv_nsec - cpu_since->tv_nsec) / 1e3;
+    *cpu_since = cpu;
+
+    printf("Dashboard: %u viewers, %.0f frames/s published, %.0f frames/s sent, %.0f B/s, %lu dropped, %lu refused, "
+        "%lu stalled viewers closed, %.2f us cpu/frame sent\n", atomic_load(&dash.viewers), dash.stats.published / s,
+        sent / s, dash.stats.bytes / s, (unsigned long)dash.stats.dropped, (unsigned long)atomic_load(&dash.refused),
+        (unsigned long)dash.stats.stalled, sent ? cpu_us / sent : 0.0);
+    dash.stats.published = dash.stats.sent = dash.stats.bytes = 0;
+}
+
+static void *dash_loop(void *arg) {
+    struct epoll_event events[DASH_EVENTS];
+    struct timespec since, now, cpu_since;
+    dash_client_t *c, *next;
+    eventfd_t wakes;
+    uint64_t t;
+    int n;
+
+    (void)arg;
+    clock_gettime(CLOCK_MONOTONIC, &since);
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu_since);
+
+    while (!atomic_load_explicit(&dash.stopping, memory_order_relaxed)) {
+        n = epoll_wait(dash.epoll_fd, events, DASH_EVENTS, DASH_POLL_MS);
+        if (n < 0 && errno != EINTR) {
+            perror("epoll_wait");
+            break;
+        }
+
+        for (int i = 0; i < n; ++i) {
+            c = events[i].data.ptr;
+            if (events[i].data.ptr == &tag_listen) {
+                client_accept();
+            } else if (events[i].data.ptr == &tag_wake) {
+                eventfd_read(dash.wake_fd, &wakes);
+            } else if ((events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) && client_read(c) < 0) {
+                client_close(c);
+            } else if ((events[i].events & EPOLLOUT) && c->blocked) {
+                c->blocked = false;
+                epoll_ctl(dash.epoll_fd, EPOLL_CTL_MOD, c->fd,
+                    &(struct epoll_event){ .events = EPOLLIN, .data.ptr = c });
+            }
+        }
+
+        dash_fanout();
+        t = now_us();
+        for (c = dash.clients; c != NULL; c = next) {
+            next = c->next;
+            if (!c->blocked && c->len > 0 && client_flush(c) < 0) {
+                client_close(c);
+            } else if (c->closing && c->len == 0) {
+                client_close(c);
+            } else if (c->len > 0 && c->progress_us + DASH_STALL_US < t) {
+                dash.stats.stalled++;
+                client_close(c);
+            }
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (now.tv_sec - since.tv_sec >= DASH_REPORT_S) {
+            dash_report((now.tv_sec - since.tv_sec) + (now.tv_nsec - since.tv_nsec) / 1e9, &cpu_since);
+            since = now;
+        }
+    }
+    return NULL;
+}
+
+int dash_start(const struct sockaddr_in *addr) {
+    char ip[INET_ADDRSTRLEN];
+    int reuse = 1;
+
+    dash.listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    dash.epoll_fd = epoll_create1(0);
+    dash.wake_fd = eventfd(0, EFD_NONBLOCK);
+    if (dash.listen_fd < 0 || dash.epoll_fd < 0 || dash.wake_fd < 0) {
+        perror("dashboard");
+        return -1;
+    }
+    setsockopt(dash.listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    if (bind(dash.listen_fd, (const struct sockaddr *)addr, sizeof(*addr)) < 0 || listen(dash.listen_fd, 128) < 0) {
+        perror("bind(dashboard)");
+        return -1;
+    }
+    if (epoll_ctl(dash.epoll_fd, EPOLL_CTL_ADD, dash.listen_fd,
+            &(struct epoll_event){ .events = EPOLLIN, .data.ptr = &tag_listen }) < 0 ||
+        epoll_ctl(dash.epoll_fd, EPOLL_CTL_ADD, dash.wake_fd,
+            &(struct epoll_event){ .events = EPOLLIN, .data.ptr = &tag_wake }) < 0)
+    {
+        perror("epoll_ctl");
+        return -1;
+    }
+
+    if ((errno = pthread_create(&dash.thread, NULL, dash_loop, NULL)) != 0) {
+        perror("pthread_create");
+        return -1;
+    }
+    dash.started = true;
+
+    inet_ntop(AF_INET, &addr->sin_addr, ip, sizeof(ip));
+    printf("Dashboard on http://%s:%u/\n", ip, ntohs(addr->sin_port));
+    return 0;
+}
+
+void dash_stop(void) {
+    dash_frame_t *f, *next;
+
+    if (dash.started) {
+        atomic_store(&dash.stopping, true);
+        eventfd_write(dash.wake_fd, 1);
+        pthread_join(dash.thread, NULL);
+        dash.started = false;
+    }
+    while (dash.clients != NULL)
+        client_close(dash.clients);
+    for (f = atomic_exchange(&dash.pending, NULL); f != NULL; f = next) {
+        next = f->next;
+        free(f);
+    }
+
+    if (dash.listen_fd >= 0)
+        close(dash.listen_fd);
+    if (dash.epoll_fd >= 0)
+        close(dash.epoll_fd);
+    if (dash.wake_fd >= 0)
+        close(dash.wake_fd);
+    dash.listen_fd = dash.epoll_fd = dash.wake_fd = -1;
+}
@@ -0,0 +1,291 @@
+/**
+  * @file datagram.c
+  * @brief Telemetry datagrams of the UDP transport.
+  *
+  * Main tasks:
+  * - Wrap telemetry frames into datagrams stamped with a sequence number and the send time. Frames longer than
+  *   `DGRAM_FRAGMENT` are split into several datagrams, so none of them exceeds a typical link MTU.
+  * - Follow each group of data datagrams with an XOR parity datagram (FEC), which restores any single datagram lost
+  *   within the group.
+  * - On the operator side, count lost, duplicated and reordered datagrams, restore lost ones from parity and
+  *   reassemble fragmented frames.
+  *
+  * @note
+  *
+  * Datagram layout (little endian):
+  *
+  *     magic:u8 (0xA6) | type:u8 | group:u8 | seq:u32 | ts_us:u64 | len:u16 | frag:u8 | data
+  *
+  * `frag` holds the fragment index in the upper nibble and the fragment count minus one in the lower one. Fragments
+  * of a frame have consecutive sequence numbers and all but the last one carry exactly `DGRAM_FRAGMENT` bytes.
+  *
+  * `group` is the FEC group size, 0 without FEC. Data datagram `seq` belongs to the group starting at
+  * `seq - seq % group`. A parity datagram carries the first `seq` of its group and the XOR of the bodies (everything
+  * after `seq`) of all data datagrams of the group, each padded with zeros to the longest one. A missing body is the
+  * XOR of the parity and all the other bodies.
+  *
+  * Frames are delivered as soon as they are complete, never held back for older ones. The telemetry unit keeps every
+  * datagram decodable on its own, so nothing waits for a retransmission or for a lost predecessor.
+  **/
+
+#include "proj_types.h"
+
+#define DGRAM_BODY_HEADER   11      // Timestamp, data length and fragment.
+#define DGRAM_WINDOW        64      // Duplicates are detected that far behind the highest sequence number.
+#define DGRAM_RESTART       65536   // Sequence numbers further behind mean that the drone restarted.
+
+static void put_le(uint8_t *p, uint64_t v, int bytes) {
+    for (int i = 0; i < bytes; ++i)
+        p[i] = v >> (8 * i);
+}
+
+static uint64_t get_le(const uint8_t *p, int bytes) {
+    uint64_t v = 0;
+
+    for (int i = 0; i < bytes; ++i)
+        v |= (uint64_t)p[i] << (8 * i);
+    return v;
+}
+
+static void put_header(uint8_t *dst, uint8_t type, uint8_t group, uint32_t seq) {
+    dst[0] = DGRAM_MAGIC;
+    dst[1] = type;
+    dst[2] = group;
+    put_le(dst + 3, seq, 4);
+}
+
+static void xor_into(uint8_t *dst, const uint8_t *src, size_t len) {
+    for (size_t i = 0; i < len; ++i)
+        dst[i] ^= src[i];
+}
+
+int dgram_fragments(size_t len) {
+    return len > DGRAM_FRAGMENT ? (int)((len + DGRAM_FRAGMENT - 1) / DGRAM_FRAGMENT) : 1;
+}
+
+size_t dgram_data(dgram_tx_t *tx, const uint8_t *frame, size_t len, int index, uint64_t ts_us, uint8_t *dst) {
+    uint8_t *body = dst + DGRAM_HEADER_SIZE;
+    int count = dgram_fragments(len);
+
+    if (count > DGRAM_FRAGMENTS_MAX || index >= count)
+        return 0;
+
+    frame += index * DGRAM_FRAGMENT;
+    len = index < count - 1 ? DGRAM_FRAGMENT : len - index * DGRAM_FRAGMENT;
+
+    put_header(dst, DgramData, tx->group, tx->seq);
+    put_le(body, ts_us, 8);
+    put_le(body + 8, len, 2);
+    body[10] = index << 4 | (count - 1);
+    memcpy(body + DGRAM_BODY_HEADER, frame, len);
+    len += DGRAM_BODY_HEADER;
+
+    if (tx->group > 0) {
+        xor_into(tx->parity, body, len);
+        if (len > tx->parity_len)
+            tx->parity_len = len;
+    }
+
+    tx->seq++;
+    return DGRAM_HEADER_SIZE + len;
+}
+
+size_t dgram_parity(dgram_tx_t *tx, uint8_t *dst) {
+    size_t len = tx->parity_len;
+
+    if (tx->group == 0 || tx->seq % tx->group != 0 || len == 0)
+        return 0;
+
+    put_header(dst, DgramParity, tx->group, tx->seq - tx->group);
+    memcpy(dst + DGRAM_HEADER_SIZE, tx->parity, len);
+
+    memset(tx->parity, 0, len);
+    tx->parity_len = 0;
+    return DGRAM_HEADER_SIZE + len;
+}
+
+/**
+  * @brief Records data datagram `seq`.
+  *
+  * @return 0 for a duplicate, 1 when in order (possibly after a gap), 2 when older than the highest one received.
+  **/
+static int dgram_accept(dgram_rx_t *rx, uint32_t seq) {
+    int32_t ahead = seq - rx->highest;
+
+    if (!rx->started || ahead < -DGRAM_RESTART) {
+        if (rx->started) {
+            memset(rx->groups, 0, sizeof(rx->groups));
+            memset(rx->frames, 0, sizeof(rx->frames));
+        }
+        rx->started = true;
+        rx->highest = seq;
+        rx->seen = 1;
+        rx->expected++;
+        rx->received++;
+        return 1;
+    }
+
+    if (ahead > 0) {
+        rx->seen = ahead >= DGRAM_WINDOW ? 1 : rx->seen << ahead | 1;
+        rx->highest = seq;
+        rx->expected += ahead;
+        rx->received++;
+        return 1;
+    }
+
+    if (-ahead < DGRAM_WINDOW) {
+        if (rx->seen >> -ahead & 1)
+            return 0;
+        rx->seen |= 1ull << -ahead;
+    }
+    rx->received++;
+    return 2;
+}
+
+/**
+  * @brief Returns the entry of the group starting at `first`, NULL when it is older than the group kept in its place.
+  **/
+static dgram_group_t *dgram_group(dgram_rx_t *rx, uint32_t first, uint8_t size) {
+    dgram_group_t *g = &rx->groups[(first / size) % DGRAM_GROUPS];
+
+    if (g->size != size || g->first != first) {
+        if (g->size == size && (int32_t)(first - g->first) < 0)
+            return NULL;
+        g->size = size;
+        g->first = first;
+        g->have = 0;
+        g->parity = false;
+    }
+    return g;
+}
+
+/**
+  * @brief Passes the data of a received or restored datagram on, once its frame is complete.
+  **/
+static void dgram_fragment(dgram_rx_t *rx, uint32_t seq, const uint8_t *body, size_t len, bool restored,
+    dgram_sink_t deliver, void *arg)
+{
+    int index = body[10] >> 4, count = (body[10] & 0x0f) + 1;
+    dgram_frame_t *f;
+
+    len -= DGRAM_BODY_HEADER;
+    if (index >= count || len > DGRAM_FRAGMENT || (index < count - 1 && len != DGRAM_FRAGMENT))
+        return;
+
+    if (count == 1) {
+        deliver(body + DGRAM_BODY_HEADER, len, get_le(body, 8), restored, arg);
+        return;
+    }
+
+    // A new frame takes a free entry or replaces the oldest incomplete one, unless it is even older.
+    f = NULL;
+    for (int i = 0; i < DGRAM_REASSEMBLY; ++i) {
+        dgram_frame_t *e = &rx->frames[i];
+
+        if (e->count != 0 && e->first == seq - index) {
+            f = e;
+            break;
+        }
+        if (f == NULL || (f->count != 0 && (e->count == 0 || (int32_t)(e->first - f->first) < 0)))
+            f = e;
+    }
+    if (f->count == 0 || f->first != seq - index) {
+        if (f->count != 0 && (int32_t)(seq - index - f->first) < 0)
+            return;
+        f->first = seq - index;
+        f->count = count;
+        f->have = 0;
+        f->restored = false;
+    }
+    if (f->count != count)
+        return;
+
+    memcpy(f->data + index * DGRAM_FRAGMENT, body + DGRAM_BODY_HEADER, len);
+    if (index == count - 1)
+        f->len = index * DGRAM_FRAGMENT + len;
+    f->have |= 1u << index;
+    f->restored |= restored;
+
+    if (f->have == (1u << count) - 1) {
+        deliver(f->data, f->len, get_le(body, 8), f->restored, arg);
+        f->count = 0;
+    }
+}
+
+/**
+  * @brief Restores the only missing data datagram of `g`, once its parity is known.
+  **/
+static void dgram_restore(dgram_rx_t *rx, dgram_group_t *g, dgram_sink_t deliver, void *arg) {
+    uint8_t *body = g->body[DGRAM_FEC_MAX];
+    int missing;
+    size_t len;
+
+    if (!g->parity || __builtin_popcount(g->have) != g->size - 1)
+        return;
+
+    missing = __builtin_ctz(~g->have);
+    for (int i = 0; i < g->size; ++i)
+        if (i != missing)
+            xor_into(body, g->body[i], g->len[i]);
+    g->have |= 1u << missing;
+
+    len = DGRAM_BODY_HEADER + get_le(body + 8, 2);
+    if (len > g->len[DGRAM_FEC_MAX] || dgram_accept(rx, g->first + missing) == 0)
+        return;
+
+    rx->restored++;
+    dgram_fragment(rx, g->first + missing, body, len, true, deliver, arg);
+}
+
+int dgram_receive(dgram_rx_t *rx, const uint8_t *pkt, size_t len, dgram_sink_t deliver, void *arg) {
+    const uint8_t *body = pkt + DGRAM_HEADER_SIZE;
+    uint8_t type, size;
+    uint32_t seq;
+    dgram_group_t *g = NULL;
+
+    if (len < DGRAM_HEADER_SIZE + DGRAM_BODY_HEADER || len > DGRAM_MAX || pkt[0] != DGRAM_MAGIC)
+        return -1;
+
+    type = pkt[1];
+    size = pkt[2];
+    seq = get_le(pkt + 3, 4);
+    len -= DGRAM_HEADER_SIZE;
+    if (size == 1 || size > DGRAM_FEC_MAX)
+        return -1;
+
+    if (type == DgramData) {
+        if (get_le(body + 8, 2) != len - DGRAM_BODY_HEADER)
+            return -1;
+
+        switch (dgram_accept(rx, seq)) {
+            case 0:
+                rx->duplicates++;
+                return 0;
+            case 2:
+                rx->reordered++;
+                break;
+        }
+        dgram_fragment(rx, seq, body, len, false, deliver, arg);
+
+        if (size > 0 && (g = dgram_group(rx, seq - seq % size, size)) != NULL) {
+            memcpy(g->body[seq % size], body, len);
+            g->len[seq % size] = len;
+            g->have |= 1u << (seq % size);
+        }
+    } else if (type == DgramParity) {
+        if (size == 0 || seq % size != 0)
+            return -1;
+
+        if ((g = dgram_group(rx, seq, size)) != NULL) {
+            memcpy(g->body[DGRAM_FEC_MAX], body, len);
+            g->len[DGRAM_FEC_MAX] = len;
+            g->parity = true;
+        }
+    } else {
+        return -1;
+    }
+
+    if (g != NULL)
+        dgram_restore(rx, g, deliver, arg);
+    return 0;
+}
@@ -108,10 +108,10 @@ static void init_locks_shm(drone_shared_t *ptr) {
 
     sem_init(&ptr->accel.mutex, 1, 1);  // One access at a time.
     sem_init(&ptr->pwm.mutex, 1, 1);    // One access at a time.
+    sem_init(&ptr->snapshot.mutex, 1, 1);   // One snapshot writer at a time. Readers are lock-free.
+
+    mpsc_init(&ptr->intents);           // Pending state changes are dropped.
 
-    sem_init(&ptr->gps.mutex, 1, 1);                // One access to critical section at a time. Started at 0 and appended when state is changed to `SampleGPS`.
-    sem_init(&ptr->gps.empty, 1, GPS_BUFFER_SIZE);  // Initially all buffer slots are empty.
-    sem_init(&ptr->gps.full, 1, 0);                 // Initially zero buffer slots are full.
 }
 
 /**
@@ -127,6 +127,12 @@ static void init_drone_shm(drone_shared_t *ptr) {
     ptr->battery = 100;
     ptr->action.type = Idle;
     ptr->accel.acceleration.x = ptr->accel.acceleration.y = ptr->accel.acceleration.z = 0.0f;
+    ptr->truth.state.att[0] = 1.0f;     // Level, on the ground at the origin.
+    ptr->snapshot.buf[0].battery = ptr->battery;
+    ptr->snapshot.buf[0].action = ptr->action.type;
+
+    // Not part of the lock reinit, so the watchdog alert posted right before it is kept.
+    mpsc_init(&ptr->alerts.queue);
 
     init_locks_shm(ptr);
 }
@@ -145,10 +151,38 @@ static void sigusr1_handler(int _) {
     kill(shm_ptr->pids.telemetry, SIGTERM);
     kill(shm_ptr->pids.flight_ctrl, SIGTERM);
     kill(shm_ptr->pids.wdg, SIGTERM);
+    kill(shm_ptr->pids.physics, SIGTERM);
 
     init_locks_shm(shm_ptr);
 }
 
+/**
+  * @brief Parses `-w` option value: comma separated `channel=strategy` pairs.
+  *
+  * Channels: `gps`, `state`, `action`, `heartbeat` or `all`. Strategies: `spin`, `yield`, `spinpark`, `park`.
+  *
+  * @return 0 on success, -1 on malformed value.
+  **/
+static int parse_wait_option(char *arg, wait_config_t *cfg) {
+    for (char *tok = strtok(arg, ","); tok; tok = strtok(NULL, ",")) {
+        char *eq = strchr(tok, '=');
+        wait_strategy_t w;
+
+        if (!eq || wait_strategy_parse(eq + 1, &w) < 0)
+            return -1;
+        *eq = 0;
+
+        if (strcmp(tok, "gps") == 0)            cfg->gps = w;
+        else if (strcmp(tok, "state") == 0)     cfg->state = w;
+        else if (strcmp(tok, "action") == 0)    cfg->action = w;
+        else if (strcmp(tok, "heartbeat") == 0) cfg->heartbeat = w;
+        else if (strcmp(tok, "all") == 0)       cfg->gps = cfg->state = cfg->action = cfg->heartbeat = w;
+        else return -1;
+    }
+
+    return 0;
+}
+
 /**
   * @brief Main application entry point. 
   *
@@ -160,12 +194,95 @@ static void sigusr1_handler(int _) {
   **/
 int main(int argc, char **argv) {
     struct sigaction sa;
-    int created = 0, ret = 0;
+    int created = 0, ret = 0, opt;
+    char *end;
+    wait_config_t wait = { WaitPark, WaitPark, WaitPark, WaitPark };
+    telemetry_encoding_t encoding = EncodingText;
+    telemetry_transport_t transport = TransportTcp;
+    long agg_window_ms = 10, fec_group = 0, multicast_ttl = 1, heartbeat_ms = 100, link_timeout_ms = 1000;
+    unsigned long drone_id = 1;
+    struct in_addr group = { 0 };
+
+    while ((opt = getopt(argc, argv, "w:e:a:t:f:m:T:b:l:i:")) != -1) {
+        switch (opt) {
+            case 'w':
+                if (parse_wait_option(optarg, &wait) < 0) {
+                    fprintf(stderr, "Bad wait strategy option.\n");
+                    goto _usage;
+                }
+                break;
+            case 'e':
+                if (strcmp(optarg, "text") == 0)        encoding = EncodingText;
+                else if (strcmp(optarg, "delta") == 0)  encoding = EncodingDelta;
+                else if (strcmp(optarg, "lz4") == 0)    encoding = EncodingLz4;
+                else {
+                    fprintf(stderr, "Bad telemetry encoding.\n");
+                    goto _usage;
+                }
+                break;
+            case 'a':
+                agg_window_ms = strtol(optarg, &end, 10);
+                if (*optarg == 0 || *end != 0 || agg_window_ms < 0 || agg_window_ms > 60000) {
+                    fprintf(stderr, "Bad aggregation window.\n");
+                    goto _usage;
+                }
+                break;
+            case 't':
+                if (strcmp(optarg, "tcp") == 0)         transport = TransportTcp;
+                else if (strcmp(optarg, "udp") == 0)    transport = TransportUdp;
+                else {
+                    fprintf(stderr, "Bad telemetry transport.\n");
+                    goto _usage;
+                }
+                break;
+            case 'f':
+                fec_group = strtol(optarg, &end, 10);
+                if (*optarg == 0 || *end != 0 || fec_group == 1 || fec_group < 0 || fec_group > DGRAM_FEC_MAX) {
+                    fprintf(stderr, "Bad FEC group size (0 or 2 to %d).\n", DGRAM_FEC_MAX);
+                    goto _usage;
+                }
+                break;
+            case 'm':
+                if (inet_pton(AF_INET, optarg, &group) <= 0 || !IN_MULTICAST(ntohl(group.s_addr))) {
+                    fprintf(stderr, "Bad multicast group.\n");
+                    goto _usage;
+                }
+                transport = TransportUdp;
+                break;
+            case 'T':
+                multicast_ttl = strtol(optarg, &end, 10);
+                if (*optarg == 0 || *end != 0 || multicast_ttl < 1 || multicast_ttl > 255) {
+                    fprintf(stderr, "Bad multicast TTL (1 to 255).\n");
+                    goto _usage;
+                }
+                break;
+            case 'b':
+            case 'l':
+                *(opt == 'b' ? &heartbeat_ms : &link_timeout_ms) = strtol(optarg, &end, 10);
+                if (*optarg == 0 || *end != 0 || heartbeat_ms < 0 || heartbeat_ms > 60000 ||
+                    link_timeout_ms < 0 || link_timeout_ms > 60000) {
+                    fprintf(stderr, "Bad heartbeat interval or link timeout (0 to 60000 ms).\n");
+                    goto _usage;
+                }
+                break;
+            case 'i':
+                drone_id = strtoul(optarg, &end, 10);
+                if (*optarg == 0 || *end != 0 || drone_id == 0 || drone_id > UINT32_MAX) {
+                    fprintf(stderr, "Bad drone id (1 to %u).\n", UINT32_MAX);
+                    goto _usage;
+                }
+                break;
+            default:
+                goto _usage;
+        }
+    }
 
-    if (argc < 5) {
-        fprintf(stderr, "Usage: %s <telemetry_ip> <telemetry_port> <drone_ip> <flight_ctrl_port>\n", argv[0]);
+    if (argc - optind < 4) {
+_usage:
+        fprintf(stderr, "Usage: %s [-w channel=strategy,...] [-e text|delta|lz4] [-a window_ms] [-t tcp|udp] [-f fec_group] [-m group] [-T ttl] [-b heartbeat_ms] [-l link_timeout_ms] [-i drone_id] <telemetry_ip> <telemetry_port> <drone_ip> <flight_ctrl_port>\n", argv[0]);
         return 1;
     }
+    argv += optind - 1;     // Positional arguments start at argv[1].
 
     printf("SHM open...\n");
 
@@ -216,6 +333,16 @@ int main(int argc, char **argv) {
     strncpy(shm_ptr->drone_ip, argv[3], INET_ADDRSTRLEN);
     shm_ptr->drone_ip[INET_ADDRSTRLEN - 1] = 0;
     shm_ptr->flight_ctrl_port = (uint16_t)atoi(argv[4]);
+    shm_ptr->wait = wait;
+    shm_ptr->encoding = encoding;
+    shm_ptr->drone_id = drone_id;
+    shm_ptr->transport = transport;
+    shm_ptr->fec_group = fec_group;
+    shm_ptr->multicast_group = group;
+    shm_ptr->multicast_ttl = multicast_ttl;
+    shm_ptr->heartbeat_us = heartbeat_ms * 1000;
+    shm_ptr->link_timeout_us = link_timeout_ms * 1000;
+    shm_ptr->agg_window_us = agg_window_ms * 1000;
 
     printf("Config stored in SHM: ip=%s tp=%u fp=%u\n",
         shm_ptr->operator_ip,
@@ -246,6 +373,7 @@ int main(int argc, char **argv) {
     printf("Spawning children processes.\n");
 
     /* Forking children */
+    shm_ptr->pids.physics = spawn_actor(physics_loop, shm_ptr, "PHYSICS");
     shm_ptr->pids.battery = spawn_actor(battery_loop, shm_ptr, "BATTERY");
     shm_ptr->pids.accel = spawn_actor(accel_loop, shm_ptr, "ACCELEROMETER");
     shm_ptr->pids.gps_ctrl = spawn_actor(gps_loop, shm_ptr, "GPS");
@@ -286,18 +414,27 @@ int main(int argc, char **argv) {
                 if (cpid == shm_ptr->pids.accel) {
                     printf("ACCELEROMETER\n");
                     shm_ptr->pids.accel = spawn_actor(accel_loop, shm_ptr, "ACCELEROMETER"); 
+                    alert_post(shm_ptr, AlertRespawn, ActorAccel, shm_ptr->pids.accel);
                 } else if (cpid == shm_ptr->pids.battery) {
                     printf("BATTERY\n");
                     shm_ptr->pids.battery = spawn_actor(battery_loop, shm_ptr, "BATTERY"); 
+                    alert_post(shm_ptr, AlertRespawn, ActorBattery, shm_ptr->pids.battery);
                 } else if (cpid == shm_ptr->pids.gps_ctrl) {
                     printf("GPS\n");
                     shm_ptr->pids.gps_ctrl = spawn_actor(gps_loop, shm_ptr, "GPS"); 
+                    alert_post(shm_ptr, AlertRespawn, ActorGps, shm_ptr->pids.gps_ctrl);
                 } else if (cpid == shm_ptr->pids.flight_ctrl) {
                     shm_ptr->pids.flight_ctrl = spawn_actor(flight_loop, shm_ptr, "CTRL");
+                    alert_post(shm_ptr, AlertRespawn, ActorFlightCtrl, shm_ptr->pids.flight_ctrl);
                 } else if (cpid == shm_ptr->pids.telemetry) {
                     shm_ptr->pids.telemetry = spawn_actor(telemetry_loop, shm_ptr, "TELEMETRY");
+                    alert_post(shm_ptr, AlertRespawn, ActorTelemetry, shm_ptr->pids.telemetry);
                 } else if (cpid == shm_ptr->pids.wdg) {
                     shm_ptr->pids.wdg = spawn_actor(watchdog_loop, shm_ptr, "WATCHDOG");
+                    alert_post(shm_ptr, AlertRespawn, ActorWatchdog, shm_ptr->pids.wdg);
+                } else if (cpid == shm_ptr->pids.physics) {
+                    shm_ptr->pids.physics = spawn_actor(physics_loop, shm_ptr, "PHYSICS");
+                    alert_post(shm_ptr, AlertRespawn, ActorPhysics, shm_ptr->pids.physics);
                 } else {
                     fprintf(stderr, "Unmarked PID child dead.\n");
                 }
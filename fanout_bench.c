@@ -0,0 +1,299 @@
+/**
+  * @file fanout_bench.c
+  * @brief Benchmark of the drone CPU spent per telemetry frame to reach several ground stations.
+  *
+  * Main tasks:
+  * - Connect N local stations over TCP and write every frame to each connection, as a drone serving one TCP client
+  *   per station would.
+  * - Join N local stations to a multicast group and send every frame once, wrapped in a datagram, as drone_sys does
+  *   with `-m`.
+  * - Report the CPU time the drone spends per frame in both cases, and what the stations received.
+  *
+  * @note
+  *
+  * Frames are encoded once, a cycle of `BENCH_CYCLE` records of a drone in the air: deltas for TCP, keyframes for
+  * multicast, where every datagram stands alone. A thread plays the drone and sends the cycle for `-d` seconds per
+  * case, at `-r` frames per second, or as fast as the stations take them without `-r`, which lets TCP coalesce
+  * frames. Another thread plays all the stations and drains them. Only the CPU time the drone thread spends sending
+  * counts, its pacing sleeps do not.
+  *
+  * On loopback, the kernel still delivers a multicast datagram to each socket on the sending thread. Over a real
+  * link, the network replicates it instead.
+  **/
+
+#include "proj_types.h"
+#include <pthread.h>
+#include <poll.h>
+
+#define BENCH_CYCLE         1000        // Records sent in a loop, 10 s at 100 Hz.
+#define BENCH_STATIONS_MAX  256
+#define BENCH_POLL_MS       10
+#define BENCH_DRAIN_US      200000      // Stations keep draining after the last frame.
+
+/**
+  * @brief Ground stations, all drained by one thread.
+  **/
+typedef struct {
+    int fds[BENCH_STATIONS_MAX];
+    int len;
+    uint64_t bytes, datagrams;      // Received by all of them.
+} bench_stations_t;
+
+volatile sig_atomic_t sigterm = 0;
+
+static double rate_hz;
+static uint64_t start_us, end_us;
+
+/* Encoded cycle. Frame `i` is `cycle[offsets[i]]` to `cycle[offsets[i + 1]]`. */
+static uint8_t cycle[BENCH_CYCLE * TLM_FRAME_MAX];
+static size_t offsets[BENCH_CYCLE + 1];
+
+static uint64_t now_us(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000ull + now.tv_nsec / 1000;
+}
+
+static uint64_t thread_cpu_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void sigterm_handler(int sig) {
+    (void)sig;
+    sigterm = 1;
+}
+
+/**
+  * @brief Encodes the cycle: a drone in the air, with noisy sensors and a slowly draining battery.
+  *
+  * @param keyframes Every frame stands alone, as over UDP.
+  **/
+static void cycle_encode(bool keyframes) {
+    tlm_encoder_t e = { 0 };
+    tlm_record_t r = { .channels = (1 << TlmChannels) - 1 - (1 << TlmGps), .battery = 90, .action = Fly };
+    uint32_t lcg = 12345;
+
+    for (int i = 0; i < BENCH_CYCLE; ++i) {
+        float noise[7];
+
+        for (int k = 0; k < 7; ++k) {
+            lcg = lcg * 1664525u + 1013904223u;
+            noise[k] = (lcg >> 8) / (float)(1 << 24) - 0.5f;
+        }
+        r.battery = 90 - i / 100;
+        r.acceleration = (acceleration_t){ 0.05f * noise[0], 0.05f * noise[1], 1.0f + 0.1f * noise[2] };
+        for (int m = 0; m < 4; ++m)
+            r.motors.motors[m] = 0.6f + 0.02f * noise[3 + m];
+
+        if (keyframes)
+            e.key_us = 0;
+        offsets[i + 1] = offsets[i] + tlm_encode(&e, &r, i * 10000ull, cycle + offsets[i]);
+    }
+}
+
+/**
+  * @brief Drains every station until `BENCH_DRAIN_US` after the end of the run.
+  **/
+static void *stations_loop(void *arg) {
+    bench_stations_t *s = arg;
+    struct pollfd fds[BENCH_STATIONS_MAX];
+    uint8_t buf[65536];
+    ssize_t n;
+
+    for (int i = 0; i < s->len; ++i)
+        fds[i] = (struct pollfd){ .fd = s->fds[i], .events = POLLIN };
+
+    while (!sigterm && now_us() < end_us + BENCH_DRAIN_US) {
+        if (poll(fds, s->len, BENCH_POLL_MS) <= 0)
+            continue;
+        for (int i = 0; i < s->len; ++i) {
+            if (!(fds[i].revents & POLLIN))
+                continue;
+            while ((n = recv(fds[i].fd, buf, sizeof(buf), MSG_DONTWAIT)) > 0) {
+                s->bytes += n;
+                s->datagrams++;
+            }
+        }
+    }
+    return NULL;
+}
+
+/**
+  * @brief Sends the cycle for `seconds`, to each of the `len` connections in `fds`, or once to `group` when `fds` is
+  *        NULL. Reports the CPU time of the calling thread per frame, and what `stations` received.
+  **/
+static void fanout_run(const int *fds, int len, int group_fd, const struct sockaddr_in *group, long seconds,
+    bench_stations_t *stations)
+{
+    uint8_t pkt[DGRAM_HEADER_SIZE + DGRAM_BODY_MAX];
+    dgram_tx_t tx = { 0 };
+    pthread_t thread;
+    uint64_t frames = 0, bytes = 0, cpu_ns = 0, cpu, now;
+
+    cycle_encode(fds == NULL);
+    stations->bytes = stations->datagrams = 0;
+    start_us = now_us();
+    end_us = start_us + seconds * 1000000ull;
+    if ((errno = pthread_create(&thread, NULL, stations_loop, stations)) != 0) {
+        perror("pthread_create");
+        sigterm = 1;
+        return;
+    }
+
+    while (!sigterm && (now = now_us()) < end_us) {
+        int i = frames % BENCH_CYCLE;
+        size_t n = offsets[i + 1] - offsets[i];
+
+        if (rate_hz > 0 && frames >= (now - start_us) * rate_hz / 1e6) {
+            usleep(100);
+            continue;
+        }
+
+        cpu = thread_cpu_ns();
+        if (fds) {
+            for (int k = 0; k < len; ++k) {
+                if (send(fds[k], cycle + offsets[i], n, MSG_NOSIGNAL) != (ssize_t)n) {
+                    perror("send");
+                    sigterm = 1;
+                }
+            }
+            bytes += n * len;
+        } else {
+            n = dgram_data(&tx, cycle + offsets[i], n, 0, now, pkt);
+            if (sendto(group_fd, pkt, n, 0, (const struct sockaddr *)group, sizeof(*group)) < 0 && errno != ENOBUFS) {
+                perror("sendto(multicast)");
+                sigterm = 1;
+            }
+            bytes += n;
+        }
+        cpu_ns += thread_cpu_ns() - cpu;
+        frames++;
+    }
+    pthread_join(thread, NULL);
+
+    printf("%-9s %3d stations: %8lu frames of %5.1f B, %7.1f us CPU/frame, %9.0f B/s sent, received %5.1f%%\n",
+        fds ? "TCP" : "multicast", len, (unsigned long)frames, (double)offsets[BENCH_CYCLE] / BENCH_CYCLE,
+        frames ? cpu_ns / 1e3 / frames : 0.0, bytes / ((now_us() - start_us) / 1e6),
+        frames ? 100.0 * (fds ? (double)stations->bytes / bytes : (double)stations->datagrams / frames / len) : 0.0);
+}
+
+/**
+  * @brief Benchmark entry point.
+  *
+  * Does the following:
+  * - Connects `<stations>` local stations over TCP, one connection each, and runs the TCP case.
+  * - Joins as many stations to `<group>` and runs the multicast case.
+  **/
+int main(int argc, char **argv) {
+    static int drone_fds[BENCH_STATIONS_MAX];
+    struct sigaction sa = { .sa_handler = sigterm_handler };
+    struct sockaddr_in addr = { .sin_family = AF_INET }, group = { .sin_family = AF_INET };
+    struct ip_mreq mreq;
+    bench_stations_t stations = { 0 };
+    unsigned char ttl = 1, loop = 1;
+    long seconds = 10, count;
+    int opt, listen_fd, group_fd, ret = 0;
+    char *end;
+
+    while ((opt = getopt(argc, argv, "d:r:")) != -1) {
+        switch (opt) {
+            case 'd':
+                seconds = strtol(optarg, &end, 10);
+                if (*optarg == 0 || *end != 0 || seconds < 1) {
+                    fprintf(stderr, "Bad duration.\n");
+                    goto _usage;
+                }
+                break;
+            case 'r':
+                rate_hz = strtod(optarg, &end);
+                if (*optarg == 0 || *end != 0 || !(rate_hz >= 0)) {
+                    fprintf(stderr, "Bad frame rate.\n");
+                    goto _usage;
+                }
+                break;
+            default:
+                goto _usage;
+        }
+    }
+
+    if (argc - optind < 4) {
+_usage:
+        fprintf(stderr, "Usage: %s [-d seconds] [-r frames_per_s] <local_ip> <port> <group> <stations>\n", argv[0]);
+        return 1;
+    }
+    argv += optind - 1;     // Positional arguments start at argv[1].
+
+    count = strtol(argv[4], &end, 10);
+    if (inet_pton(AF_INET, argv[1], &addr.sin_addr) <= 0 || inet_pton(AF_INET, argv[3], &group.sin_addr) <= 0 ||
+        !IN_MULTICAST(ntohl(group.sin_addr.s_addr)) || *end != 0 || count < 1 || count > BENCH_STATIONS_MAX)
+    {
+        fprintf(stderr, "Bad local address, multicast group or station count (%d at most).\n", BENCH_STATIONS_MAX);
+        return 1;
+    }
+    addr.sin_port = group.sin_port = htons(atoi(argv[2]));
+    mreq = (struct ip_mreq){ .imr_multiaddr = group.sin_addr, .imr_interface = addr.sin_addr };
+    stations.len = count;
+
+    sigemptyset(&sa.sa_mask);
+    if (sigaction(SIGTERM, &sa, NULL) == -1 || sigaction(SIGINT, &sa, NULL) == -1) {
+        perror("sigaction");
+        return 1;
+    }
+
+    // One connection per station, the drone writes every frame to each.
+    listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (listen_fd < 0 || setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &(int){ 1 }, sizeof(int)) < 0 ||
+        bind(listen_fd, (const struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(listen_fd, count) < 0)
+    {
+        perror("listen(TCP)");
+        return 1;
+    }
+    for (int i = 0; i < count; ++i) {
+        stations.fds[i] = socket(AF_INET, SOCK_STREAM, 0);
+        if (stations.fds[i] < 0 || connect(stations.fds[i], (const struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+            (drone_fds[i] = accept(listen_fd, NULL, NULL)) < 0)
+        {
+            perror("connect(TCP)");
+            return 1;
+        }
+    }
+    close(listen_fd);
+    fanout_run(drone_fds, count, -1, NULL, seconds, &stations);
+    for (int i = 0; i < count; ++i) {
+        close(drone_fds[i]);
+        close(stations.fds[i]);
+    }
+
+    // Every station joins the group, the drone sends each frame once.
+    for (int i = 0; i < count && !sigterm; ++i) {
+        stations.fds[i] = socket(AF_INET, SOCK_DGRAM, 0);
+        if (stations.fds[i] < 0 ||
+            setsockopt(stations.fds[i], SOL_SOCKET, SO_REUSEADDR, &(int){ 1 }, sizeof(int)) < 0 ||
+            bind(stations.fds[i], (const struct sockaddr *)&group, sizeof(group)) < 0 ||
+            setsockopt(stations.fds[i], IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0)
+        {
+            perror("join(multicast)");
+            return 1;
+        }
+    }
+    group_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (group_fd < 0 ||
+        setsockopt(group_fd, IPPROTO_IP, IP_MULTICAST_IF, &addr.sin_addr, sizeof(addr.sin_addr)) < 0 ||
+        setsockopt(group_fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl)) < 0 ||
+        setsockopt(group_fd, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop)) < 0)
+    {
+        perror("setsockopt(multicast)");
+        ret = 1;
+    } else if (!sigterm) {
+        fanout_run(NULL, count, group_fd, &group, seconds, &stations);
+    }
+    if (group_fd >= 0)
+        close(group_fd);
+    for (int i = 0; i < count; ++i)
+        close(stations.fds[i]);
+    return ret;
+}
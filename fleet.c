@@ -0,0 +1,990 @@
+/**
+  * @file fleet.c
+  * @brief Ground station serving a whole fleet of drones (`-w` option of the operator).
+  *
+  * Main tasks:
+  * - Run `-w` worker threads. Each one owns a TCP listener and a UDP socket bound to the telemetry address with
+  *   `SO_REUSEPORT`, an epoll set, and the decoders of every stream the kernel hands to it.
+  * - Identify drones by their hello frame and keep the latest state of each one in a fleet table shared by all
+  *   workers.
+  * - Send link heartbeats to every drone that takes commands, so that none of them lands on link loss.
+  * - Command the fleet from the console: `all land`, `<group> fly`, `<id> abort`. Groups are defined with
+  *   `group <name> <id>...`, `drones` lists the address book. Each command is repeated to the drones that did not
+  *   acknowledge it yet, and the time until the last acknowledgement is reported.
+  * - Report ingest throughput, per worker and in total, and the fleet size once per `FLEET_REPORT_S`.
+  *
+  * @note
+  *
+  * The kernel spreads TCP connections and UDP flows across the reuseport sockets by a hash of their addresses. A
+  * stream is therefore read, reassembled and decoded by one worker only, and decoders are private to it. Workers share
+  * nothing but the fleet table, so they scale with the cores instead of queueing behind a single `select` loop, which
+  * also cannot watch descriptors past `FD_SETSIZE`.
+  *
+  * The fleet table is an open addressing hash table of drone ids. A slot is claimed by CAS on its id and never freed,
+  * so lookups take no lock and an entry never moves. Entry contents are guarded by a sequence counter like the shm
+  * subscription (see state.c): readers retry a torn copy, and a writer makes the counter odd by CAS. Writers only
+  * contend while a drone has two streams, for example a reconnect racing with its old connection on another worker.
+  *
+  * Worker counters are written by their worker only and sit on cache lines of their own, the reporter reads them
+  * without stopping anything.
+  *
+  * The address book is the fleet table itself: a drone takes commands at the address its telemetry comes from, on
+  * the port its hello names. Commands and heartbeats go out with `sendmmsg`, up to `FLEET_SEND_BATCH` datagrams
+  * per system call, from one socket which also receives the acknowledgements. A command is numbered and addressed to
+  * its drone, acknowledged by every copy received and applied once (see flight_ctrl.c).
+  **/
+
+#include "proj_types.h"
+#include <pthread.h>
+#include <poll.h>
+#include <sys/epoll.h>
+
+#define FLEET_WORKERS_MAX   64
+#define FLEET_MAX           4096        // Drones tracked at once, power of two.
+#define FLEET_PEERS         1024        // UDP sources tracked by each worker, power of two.
+#define FLEET_EVENTS        64          // Epoll events per wakeup.
+#define FLEET_BATCH         32          // Datagrams per `recvmmsg`.
+#define FLEET_REPORT_S      10
+#define FLEET_ACTIVE_US     2000000     // Drones heard from within that time count as active.
+#define FLEET_POLL_MS       100         // Longest worker sleep, bounds the shutdown delay.
+#define FLEET_SEND_BATCH    1024        // Datagrams per `sendmmsg`, the kernel limit.
+#define FLEET_COMMANDS      8           // Commands awaiting acknowledgements at once.
+#define FLEET_RETRY_US      200000      // Repetition period of unacknowledged commands.
+#define FLEET_TRIES         5           // Sends of a command before the missing drones are reported.
+#define FLEET_GROUPS        16
+#define FLEET_GROUP_MAX     256         // Drones per group.
+#define FLEET_NAME_MAX      16
+
+#define FLEET_RX_SIZE       (2 * (TLM_HEADER_SIZE + TLM_PAYLOAD_MAX))
+
+/**
+  * @brief Latest known state of one drone.
+  **/
+typedef struct {
+    struct sockaddr_in addr;                // Flight controller, port 0 when the drone takes no commands.
+    int worker;                             // Worker decoding its telemetry.
+    bool udp;
+    tlm_record_t record;                    // Latest record.
+    uint32_t seq;
+    uint64_t ts_us;                         // Drone time of the latest record.
+    uint64_t heard_us;                      // Operator time the drone was last heard from.
+    uint64_t frames, alerts;
+} fleet_state_t;
+
+/**
+  * @brief Fleet table entry.
+  **/
+typedef struct {
+    _Atomic(uint32_t) id;                   // Drone id, 0 while the slot is free.
+    _Atomic(uint32_t) version;              // Odd while written.
+    fleet_state_t state;
+} fleet_drone_t;
+
+struct fleet_worker;
+
+/**
+  * @brief One telemetry stream: a TCP connection or the datagrams of one UDP source.
+  **/
+typedef struct fleet_stream {
+    int fd;                                 // TCP connection, -1 for a UDP source.
+    struct sockaddr_in from;
+    struct fleet_worker *worker;
+    fleet_drone_t *drone;                   // Known once its hello arrived.
+    tlm_decoder_t decoder;
+    uint8_t *rx;                            // TCP bytes not decoded yet.
+    size_t rx_len;
+    dgram_rx_t *dgram;                      // UDP receiver state.
+    struct fleet_stream *prev, *next;       // TCP connections of the worker.
+} fleet_stream_t;
+
+/**
+  * @brief Counters of one worker. Written by the worker only.
+  **/
+typedef struct {
+    _Atomic(uint64_t) bytes, datagrams, records, alerts, malformed;
+    _Atomic(uint32_t) streams;
+} fleet_stats_t;
+
+typedef struct fleet_worker {
+    fleet_stats_t stats;
+    int index;
+    pthread_t thread;
+    int epoll_fd, listen_fd, udp_fd;
+    uint64_t now_us;                        // Time of the current wakeup.
+    fleet_stream_t *conns;                  // TCP connections.
+    fleet_stream_t *peers[FLEET_PEERS];     // UDP sources, open addressing by address.
+    int peers_len;
+} __attribute__((aligned(64))) fleet_worker_t;
+
+static fleet_drone_t fleet[FLEET_MAX];
+static _Atomic(bool) fleet_full_warned;
+
+static fleet_worker_t workers[FLEET_WORKERS_MAX];
+static int workers_len;
+static volatile sig_atomic_t *stopping;
+
+/**
+  * @brief Named set of drones, a command target.
+  **/
+typedef struct {
+    char name[FLEET_NAME_MAX];
+    int len;
+    uint32_t ids[FLEET_GROUP_MAX];
+} fleet_group_t;
+
+/**
+  * @brief Command awaiting acknowledgements. Targets are indexed in dispatch order.
+  **/
+typedef struct {
+    bool active;
+    tlm_command_t command;                  // Addressed to each target in turn.
+    char target[FLEET_NAME_MAX];
+    int len, acked, tries, resent, calls;
+    uint64_t sent_us, retry_us, dispatch_us;
+    uint32_t ids[FLEET_MAX];
+    struct sockaddr_in addrs[FLEET_MAX];
+    uint64_t ack_us[FLEET_MAX];             // Time from the first dispatch, 0 while unacknowledged.
+    int target_of[FLEET_MAX];               // Target index plus one of each fleet slot, 0 for none.
+} fleet_command_t;
+
+/* Console side, touched by the main thread only. */
+static fleet_group_t groups[FLEET_GROUPS];
+static fleet_command_t commands[FLEET_COMMANDS];
+static uint32_t command_seq;
+
+/* Epoll tags of the two sockets every worker owns, streams are tagged with their own address. */
+static char tag_listen, tag_udp;
+
+static uint64_t now_us(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000ull + now.tv_nsec / 1000;
+}
+
+/**
+  * @brief Adds `n` to a counter only its worker writes. A plain load and store, no locked instruction.
+  **/
+static inline void count(_Atomic(uint64_t) *c, uint64_t n) {
+    atomic_store_explicit(c, atomic_load_explicit(c, memory_order_relaxed) + n, memory_order_relaxed);
+}
+
+static inline void count_streams(fleet_worker_t *w, int n) {
+    atomic_store_explicit(&w->stats.streams, atomic_load_explicit(&w->stats.streams, memory_order_relaxed) + n,
+        memory_order_relaxed);
+}
+
+/**
+  * @brief Finds drone `id`, claiming a free slot for it when `claim` is set.
+  *
+  * @return NULL when it is unknown, or when the table is full.
+  **/
+static fleet_drone_t *fleet_find(uint32_t id, bool claim) {
+    uint32_t slot = id * 2654435761u;
+
+    for (int i = 0; i < FLEET_MAX; ++i, ++slot) {
+        fleet_drone_t *d = &fleet[slot % FLEET_MAX];
+        uint32_t cur = atomic_load_explicit(&d->id, memory_order_acquire);
+
+        if (cur == 0 && claim && atomic_compare_exchange_strong_explicit(&d->id, &cur, id,
+                memory_order_acq_rel, memory_order_acquire))
+            return d;
+        if (cur == id)
+            return d;
+        if (cur == 0)
+            return NULL;
+    }
+    return NULL;
+}
+
+/**
+  * @brief Copies the state of `d`. Lock-free, retries while a writer is in the middle of it.
+  *
+  * @return false when the slot holds no drone yet.
+  **/
+static bool fleet_read(const fleet_drone_t *d, fleet_state_t *out) {
+    uint32_t v;
+
+    do {
+        v = seqlock_read_begin(&d->version);
+        *out = d->state;
+    } while (seqlock_read_retry(&d->version, v));
+    return out->heard_us != 0;
+}
+
+static void on_record(const tlm_record_t *r, uint32_t seq, uint64_t ts_us, void *arg) {
+    fleet_stream_t *s = arg;
+    fleet_drone_t *d = s->drone;
+
+    count(&s->worker->stats.records, 1);
+    if (d == NULL)
+        return;
+
+    seqlock_write_begin(&d->version);
+    d->state.record = *r;
+    d->state.seq = seq;
+    d->state.ts_us = ts_us;
+    d->state.heard_us = s->worker->now_us;
+    d->state.frames++;
+    seqlock_write_end(&d->version);
+    dash_record(atomic_load_explicit(&d->id, memory_order_relaxed), r, seq, ts_us);
+}
+
+static void on_alert(const alert_t *a, uint32_t seq, void *arg) {
+    fleet_stream_t *s = arg;
+    char ip[INET_ADDRSTRLEN];
+
+    count(&s->worker->stats.alerts, 1);
+    inet_ntop(AF_INET, &s->from.sin_addr, ip, sizeof(ip));
+    if (s->drone != NULL) {
+        printf("[ALERT drone %u] %s actor %u value %d\n", atomic_load_explicit(&s->drone->id, memory_order_relaxed),
+            alert_name(a->kind), a->actor, a->value);
+        seqlock_write_begin(&s->drone->version);
+        s->drone->state.alerts++;
+        seqlock_write_end(&s->drone->version);
+        dash_alert(atomic_load_explicit(&s->drone->id, memory_order_relaxed), a, seq);
+    } else {
+        printf("[ALERT %s:%u] %s actor %u value %d\n", ip, ntohs(s->from.sin_port), alert_name(a->kind), a->actor,
+            a->value);
+    }
+}
+
+static void on_heartbeat(const tlm_heartbeat_t *h, void *arg) {
+    fleet_stream_t *s = arg;
+
+    (void)h;
+    if (s->drone == NULL)
+        return;
+    seqlock_write_begin(&s->drone->version);
+    s->drone->state.heard_us = s->worker->now_us;
+    seqlock_write_end(&s->drone->version);
+}
+
+/**
+  * @brief Binds the stream to the drone it introduces. Repeated hellos of a known stream cost a comparison.
+  **/
+static void on_hello(const tlm_hello_t *h, void *arg) {
+    fleet_stream_t *s = arg;
+    fleet_drone_t *d = s->drone;
+    char ip[INET_ADDRSTRLEN];
+    bool known;
+
+    if (d != NULL && atomic_load_explicit(&d->id, memory_order_relaxed) == h->id)
+        return;
+    if ((d = fleet_find(h->id, true)) == NULL) {
+        if (!atomic_exchange(&fleet_full_warned, true))
+            fprintf(stderr, "Fleet table full (%d drones), drone %u ignored.\n", FLEET_MAX, h->id);
+        return;
+    }
+
+    seqlock_write_begin(&d->version);
+    known = d->state.heard_us != 0;
+    d->state.addr = s->from;
+    d->state.addr.sin_port = htons(h->flight_ctrl_port);
+    d->state.worker = s->worker->index;
+    d->state.udp = s->fd < 0;
+    d->state.heard_us = s->worker->now_us;
+    seqlock_write_end(&d->version);
+    s->drone = d;
+
+    inet_ntop(AF_INET, &s->from.sin_addr, ip, sizeof(ip));
+    printf("Drone %u %s %s:%u over %s, worker %d.\n", h->id, known ? "is back from" : "joined from", ip,
+        ntohs(s->from.sin_port), s->fd < 0 ? "UDP" : "TCP", s->worker->index);
+}
+
+static const tlm_sink_t sink_template = {
+    .record = on_record, .alert = on_alert, .heartbeat = on_heartbeat, .hello = on_hello,
+};
+
+static void stream_close(fleet_stream_t *s) {
+    if (s->drone != NULL)
+        printf("Drone %u disconnected.\n", atomic_load_explicit(&s->drone->id, memory_order_relaxed));
+    epoll_ctl(s->worker->epoll_fd, EPOLL_CTL_DEL, s->fd, NULL);
+    close(s->fd);
+    if (s->prev != NULL)
+        s->prev->next = s->next;
+    else
+        s->worker->conns = s->next;
+    if (s->next != NULL)
+        s->next->prev = s->prev;
+    count_streams(s->worker, -1);
+    free(s->rx);
+    free(s);
+}
+
+static void stream_accept(fleet_worker_t *w) {
+    struct sockaddr_in from;
+    socklen_t from_len = sizeof(from);
+    fleet_stream_t *s;
+    int fd;
+
+    while ((fd = accept4(w->listen_fd, (struct sockaddr *)&from, &from_len, SOCK_NONBLOCK)) >= 0) {
+        s = calloc(1, sizeof(*s));
+        if (s == NULL || (s->rx = malloc(FLEET_RX_SIZE)) == NULL) {
+            perror("malloc(stream)");
+            free(s);
+            close(fd);
+            return;
+        }
+        s->fd = fd;
+        s->from = from;
+        s->worker = w;
+        if (epoll_ctl(w->epoll_fd, EPOLL_CTL_ADD, fd, &(struct epoll_event){ .events = EPOLLIN, .data.ptr = s }) < 0) {
+            perror("epoll_ctl(stream)");
+            free(s->rx);
+            free(s);
+            close(fd);
+            return;
+        }
+        s->next = w->conns;
+        if (w->conns != NULL)
+            w->conns->prev = s;
+        w->conns = s;
+        count_streams(w, 1);
+        from_len = sizeof(from);
+    }
+    if (errno != EAGAIN && errno != EWOULDBLOCK)
+        perror("accept");
+}
+
+/**
+  * @brief Reads what a TCP stream has and decodes every whole frame of it.
+  **/
+static void stream_read(fleet_stream_t *s) {
+    tlm_sink_t sink = sink_template;
+    ssize_t n = read(s->fd, s->rx + s->rx_len, FLEET_RX_SIZE - s->rx_len);
+    size_t off = 0;
+    int len;
+
+    if (n < 0 && (errno == EAGAIN || errno == EINTR))
+        return;
+    if (n <= 0) {
+        stream_close(s);
+        return;
+    }
+    count(&s->worker->stats.bytes, n);
+    s->rx_len += n;
+
+    sink.arg = s;
+    while ((len = tlm_frame_len(s->rx + off, s->rx_len - off)) > 0) {
+        if (tlm_decode(&s->decoder, s->rx + off, len, &sink) < 0)
+            break;
+        off += len;
+    }
+
+    // Text telemetry carries no hello and cannot be told apart from other drones.
+    if (len != 0) {
+        count(&s->worker->stats.malformed, 1);
+        fprintf(stderr, "Malformed or text telemetry stream, dropped.\n");
+        stream_close(s);
+        return;
+    }
+    memmove(s->rx, s->rx + off, s->rx_len - off);
+    s->rx_len -= off;
+}
+
+static void udp_deliver(const uint8_t *frame, size_t len, uint64_t ts_us, bool restored, void *arg) {
+    fleet_stream_t *s = arg;
+    tlm_sink_t sink = sink_template;
+
+    (void)ts_us; (void)restored;
+    sink.arg = s;
+    if (tlm_frame_len(frame, len) != (int)len || tlm_decode(&s->decoder, frame, len, &sink) < 0)
+        count(&s->worker->stats.malformed, 1);
+}
+
+/**
+  * @brief Returns the stream of UDP source `from`, created on its first datagram. NULL when the worker is full.
+  **/
+static fleet_stream_t *udp_peer(fleet_worker_t *w, const struct sockaddr_in *from) {
+    uint32_t slot = (from->sin_addr.s_addr ^ from->sin_port * 2654435761u) * 2654435761u;
+    fleet_stream_t **p;
+
+    for (int i = 0; i < FLEET_PEERS; ++i, ++slot) {
+        p = &w->peers[slot % FLEET_PEERS];
+        if (*p == NULL)
+            break;
+        if ((*p)->from.sin_addr.s_addr == from->sin_addr.s_addr && (*p)->from.sin_port == from->sin_port)
+            return *p;
+    }
+    if (w->peers_len == FLEET_PEERS / 2)
+        return NULL;
+
+    // Reassembly state is large, only UDP sources pay for it.
+    *p = calloc(1, sizeof(**p));
+    if (*p == NULL || ((*p)->dgram = calloc(1, sizeof(dgram_rx_t))) == NULL) {
+        free(*p);
+        *p = NULL;
+        return NULL;
+    }
+    (*p)->fd = -1;
+    (*p)->from = *from;
+    (*p)->worker = w;
+    w->peers_len++;
+    count_streams(w, 1);
+    return *p;
+}
+
+/**
+  * @brief Receives and decodes every queued datagram, `FLEET_BATCH` per system call.
+  **/
+static void udp_read(fleet_worker_t *w) {
+    static __thread uint8_t pkts[FLEET_BATCH][DGRAM_MAX];
+    struct sockaddr_in from[FLEET_BATCH];
+    struct iovec iov[FLEET_BATCH];
+    struct mmsghdr msgs[FLEET_BATCH];
+    fleet_stream_t *s;
+    int n;
+
+    for (int i = 0; i < FLEET_BATCH; ++i) {
+        iov[i] = (struct iovec){ .iov_base = pkts[i], .iov_len = DGRAM_MAX };
+        msgs[i] = (struct mmsghdr){ .msg_hdr = {
+            .msg_name = &from[i], .msg_namelen = sizeof(from[i]), .msg_iov = &iov[i], .msg_iovlen = 1,
+        } };
+    }
+
+    do {
+        n = recvmmsg(w->udp_fd, msgs, FLEET_BATCH, MSG_DONTWAIT, NULL);
+        for (int i = 0; i < n; ++i) {
+            count(&w->stats.bytes, msgs[i].msg_len);
+            count(&w->stats.datagrams, 1);
+            if ((s = udp_peer(w, &from[i])) == NULL ||
+                dgram_receive(s->dgram, pkts[i], msgs[i].msg_len, udp_deliver, s) < 0)
+            {
+                count(&w->stats.malformed, 1);
+            }
+            msgs[i].msg_hdr.msg_namelen = sizeof(from[i]);
+        }
+    } while (n == FLEET_BATCH && !*stopping);
+}
+
+static void *worker_loop(void *arg) {
+    fleet_worker_t *w = arg;
+    struct epoll_event events[FLEET_EVENTS];
+    int n;
+
+    while (!*stopping) {
+        n = epoll_wait(w->epoll_fd, events, FLEET_EVENTS, FLEET_POLL_MS);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("epoll_wait");
+            break;
+        }
+
+        w->now_us = now_us();
+        for (int i = 0; i < n; ++i) {
+            if (events[i].data.ptr == &tag_listen)
+                stream_accept(w);
+            else if (events[i].data.ptr == &tag_udp)
+                udp_read(w);
+            else
+                stream_read(events[i].data.ptr);
+        }
+    }
+    return NULL;
+}
+
+/**
+  * @brief Opens the sockets of worker `w`, sharing the telemetry address with the other workers.
+  **/
+static int worker_open(fleet_worker_t *w, const struct sockaddr_in *addr) {
+    int one = 1;
+
+    w->epoll_fd = epoll_create1(0);
+    w->listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    w->udp_fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+    if (w->epoll_fd < 0 || w->listen_fd < 0 || w->udp_fd < 0) {
+        perror("socket(worker)");
+        return -1;
+    }
+
+    if (setsockopt(w->listen_fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) < 0 ||
+        setsockopt(w->udp_fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) < 0 ||
+        bind(w->listen_fd, (const struct sockaddr *)addr, sizeof(*addr)) < 0 ||
+        bind(w->udp_fd, (const struct sockaddr *)addr, sizeof(*addr)) < 0 ||
+        listen(w->listen_fd, SOMAXCONN) < 0)
+    {
+        perror("bind(worker)");
+        return -1;
+    }
+
+    if (epoll_ctl(w->epoll_fd, EPOLL_CTL_ADD, w->listen_fd,
+            &(struct epoll_event){ .events = EPOLLIN, .data.ptr = &tag_listen }) < 0 ||
+        epoll_ctl(w->epoll_fd, EPOLL_CTL_ADD, w->udp_fd,
+            &(struct epoll_event){ .events = EPOLLIN, .data.ptr = &tag_udp }) < 0)
+    {
+        perror("epoll_ctl(worker)");
+        return -1;
+    }
+    return 0;
+}
+
+static void worker_close(fleet_worker_t *w) {
+    while (w->conns != NULL)
+        stream_close(w->conns);
+    for (int i = 0; i < FLEET_PEERS; ++i) {
+        if (w->peers[i] != NULL) {
+            free(w->peers[i]->dgram);
+            free(w->peers[i]);
+        }
+    }
+    if (w->udp_fd >= 0)
+        close(w->udp_fd);
+    if (w->listen_fd >= 0)
+        close(w->listen_fd);
+    if (w->epoll_fd >= 0)
+        close(w->epoll_fd);
+}
+
+/**
+  * @brief Sends datagram `iov[i]` to `addrs[i]` for each of the `count` drones, `FLEET_SEND_BATCH` per system call.
+  *
+  * @return System calls made.
+  **/
+static int fleet_send(int fd, struct iovec *iov, const struct sockaddr_in *addrs, int count) {
+    static struct mmsghdr msgs[FLEET_SEND_BATCH];
+    int calls = 0, n;
+
+    for (int off = 0; off < count; ) {
+        n = count - off < FLEET_SEND_BATCH ? count - off : FLEET_SEND_BATCH;
+        for (int i = 0; i < n; ++i)
+            msgs[i] = (struct mmsghdr){ .msg_hdr = {
+                .msg_name = (void *)&addrs[off + i], .msg_namelen = sizeof(addrs[0]),
+                .msg_iov = &iov[off + i], .msg_iovlen = 1,
+            } };
+
+        // A datagram the kernel refuses stops the batch, it is skipped and the rest goes on.
+        n = sendmmsg(fd, msgs, n, 0);
+        calls++;
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0) {
+            perror("sendmmsg");
+            n = 1;
+        }
+        off += n;
+    }
+    return calls;
+}
+
+/**
+  * @brief Sends a heartbeat to every drone that takes commands.
+  **/
+static void fleet_beat(int fd, uint32_t seq) {
+    static struct sockaddr_in addrs[FLEET_MAX];
+    static struct iovec iov[FLEET_MAX];
+    uint8_t beat[TLM_HEARTBEAT_MAX];
+    fleet_state_t s;
+    size_t len = tlm_heartbeat(&(tlm_heartbeat_t){ .seq = seq, .ts_us = now_us() }, false, beat);
+    int count = 0;
+
+    for (int i = 0; i < FLEET_MAX; ++i) {
+        if (atomic_load_explicit(&fleet[i].id, memory_order_acquire) == 0 || !fleet_read(&fleet[i], &s) ||
+            s.addr.sin_port == 0)
+        {
+            continue;
+        }
+        addrs[count] = s.addr;
+        iov[count++] = (struct iovec){ beat, len };
+    }
+    fleet_send(fd, iov, addrs, count);
+}
+
+static int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+/**
+  * @brief Reports a command once every target acknowledged it, or once it was sent `FLEET_TRIES` times.
+  **/
+static void command_report(fleet_command_t *c) {
+    static uint64_t latencies[FLEET_MAX];
+    int n = 0, missing = 0;
+
+    for (int i = 0; i < c->len; ++i)
+        if (c->ack_us[i] != 0)
+            latencies[n++] = c->ack_us[i];
+    qsort(latencies, n, sizeof(latencies[0]), compare_u64);
+
+    printf("Command #%u %s to %s: %d/%d drones acknowledged", c->command.seq, tlm_action_name(c->command.action),
+        c->target, c->acked, c->len);
+    if (n > 0)
+        printf(", last after %.2f ms (first %.2f ms, median %.2f ms)", latencies[n - 1] / 1e3, latencies[0] / 1e3,
+            latencies[n / 2] / 1e3);
+    printf(", dispatched in %lu us with %d sendmmsg calls, %d resent\n", (unsigned long)c->dispatch_us, c->calls,
+        c->resent);
+
+    if (c->acked < c->len) {
+        printf("No acknowledgement from:");
+        for (int i = 0; i < c->len && missing < 16; ++i)
+            if (c->ack_us[i] == 0 && ++missing)
+                printf(" %u", c->ids[i]);
+        printf("%s\n", c->len - c->acked > missing ? " ..." : "");
+    }
+    c->active = false;
+}
+
+/**
+  * @brief Sends command `c` to each target that did not acknowledge it yet.
+  **/
+static void command_send(int fd, fleet_command_t *c) {
+    static uint8_t frames[FLEET_MAX][TLM_COMMAND_SIZE];
+    static struct sockaddr_in addrs[FLEET_MAX];
+    static struct iovec iov[FLEET_MAX];
+    int count = 0;
+
+    for (int i = 0; i < c->len; ++i) {
+        if (c->ack_us[i] != 0)
+            continue;
+        c->command.id = c->ids[i];
+        addrs[count] = c->addrs[i];
+        iov[count] = (struct iovec){ frames[count], tlm_command(&c->command, false, frames[count]) };
+        count++;
+    }
+    if (c->tries > 0)
+        c->resent += count;
+    c->calls += fleet_send(fd, iov, addrs, count);
+    c->tries++;
+}
+
+/**
+  * @brief Adds drone `id` to the targets of `c`, when it is known and takes commands.
+  **/
+static void command_target(fleet_command_t *c, uint32_t id) {
+    fleet_drone_t *d = fleet_find(id, false);
+    fleet_state_t s;
+
+    if (d == NULL || !fleet_read(d, &s) || s.addr.sin_port == 0 || c->target_of[d - fleet] != 0)
+        return;
+
+    c->ids[c->len] = id;
+    c->addrs[c->len] = s.addr;
+    c->ack_us[c->len] = 0;
+    c->target_of[d - fleet] = ++c->len;
+}
+
+/**
+  * @brief Sends `action` to `target`: `all`, a group name or a drone id.
+  **/
+static void command_dispatch(int fd, const char *target, current_action_t action) {
+    fleet_command_t *c = NULL;
+    fleet_group_t *g = NULL;
+    uint64_t t;
+    char *end;
+    unsigned long id = strtoul(target, &end, 10);
+
+    for (int i = 0; i < FLEET_COMMANDS && c == NULL; ++i)
+        if (!commands[i].active)
+            c = &commands[i];
+    if (c == NULL) {
+        printf("Too many commands awaiting acknowledgements (%d).\n", FLEET_COMMANDS);
+        return;
+    }
+    for (int i = 0; i < FLEET_GROUPS && g == NULL; ++i)
+        if (groups[i].len > 0 && strcmp(groups[i].name, target) == 0)
+            g = &groups[i];
+
+    memset(c->target_of, 0, sizeof(c->target_of));
+    c->len = c->acked = c->tries = c->resent = c->calls = 0;
+    if (strcmp(target, "all") == 0) {
+        for (int i = 0; i < FLEET_MAX; ++i) {
+            uint32_t known = atomic_load_explicit(&fleet[i].id, memory_order_acquire);
+
+            if (known != 0)
+                command_target(c, known);
+        }
+    } else if (g != NULL) {
+        for (int i = 0; i < g->len; ++i)
+            command_target(c, g->ids[i]);
+    } else if (*target != 0 && *end == 0 && id > 0 && id <= UINT32_MAX) {
+        command_target(c, id);
+    } else {
+        printf("Unknown drone or group: %s\n", target);
+        return;
+    }
+    if (c->len == 0) {
+        printf("No drone of %s takes commands.\n", target);
+        return;
+    }
+
+    c->active = true;
+    c->command = (tlm_command_t){ .seq = command_seq++, .action = action };
+    snprintf(c->target, sizeof(c->target), "%s", target);
+
+    t = now_us();
+    c->sent_us = t;
+    command_send(fd, c);
+    c->dispatch_us = now_us() - t;
+    c->retry_us = t + FLEET_RETRY_US;
+}
+
+/**
+  * @brief Repeats every command due for it, reports the ones sent `FLEET_TRIES` times.
+  *
+  * @return Time of the next repetition, UINT64_MAX for none.
+  **/
+static uint64_t commands_retry(int fd, uint64_t now) {
+    uint64_t next = UINT64_MAX;
+
+    for (int i = 0; i < FLEET_COMMANDS; ++i) {
+        fleet_command_t *c = &commands[i];
+
+        if (!c->active)
+            continue;
+        if (now >= c->retry_us) {
+            if (c->tries == FLEET_TRIES) {
+                command_report(c);
+                continue;
+            }
+            command_send(fd, c);
+            c->retry_us = now + FLEET_RETRY_US;
+        }
+        if (c->retry_us < next)
+            next = c->retry_us;
+    }
+    return next;
+}
+
+/**
+  * @brief Receives every queued acknowledgement. Repeated ones are ignored.
+  **/
+static void acks_read(int fd) {
+    uint8_t frame[TLM_COMMAND_SIZE + 1];
+    tlm_command_t ack;
+    fleet_drone_t *d;
+    ssize_t n;
+    int t;
+
+    while ((n = recv(fd, frame, sizeof(frame), MSG_DONTWAIT)) >= 0) {
+        if (tlm_command_decode(frame, n, true, &ack) < 0 || (d = fleet_find(ack.id, false)) == NULL)
+            continue;
+
+        for (int i = 0; i < FLEET_COMMANDS; ++i) {
+            fleet_command_t *c = &commands[i];
+
+            if (!c->active || c->command.seq != ack.seq || (t = c->target_of[d - fleet]) == 0 || c->ack_us[t - 1])
+                continue;
+            c->ack_us[t - 1] = now_us() - c->sent_us;
+            if (++c->acked == c->len)
+                command_report(c);
+        }
+    }
+}
+
+/**
+  * @brief Lists the address book: every drone known, where it takes commands and its latest state.
+  **/
+static void fleet_list(void) {
+    uint64_t now = now_us();
+    fleet_state_t s;
+    char ip[INET_ADDRSTRLEN];
+    uint32_t id;
+
+    for (int i = 0; i < FLEET_MAX; ++i) {
+        if ((id = atomic_load_explicit(&fleet[i].id, memory_order_acquire)) == 0 || !fleet_read(&fleet[i], &s))
+            continue;
+        inet_ntop(AF_INET, &s.addr.sin_addr, ip, sizeof(ip));
+        printf("Drone %u: %s:%u, %s, worker %d, %s, battery %u%%, %lu frames, %lu alerts, heard %lu ms ago\n", id,
+            ip, ntohs(s.addr.sin_port), s.udp ? "UDP" : "TCP", s.worker, tlm_action_name(s.record.action),
+            s.record.battery, (unsigned long)s.frames, (unsigned long)s.alerts,
+            (unsigned long)((now - s.heard_us) / 1000));
+    }
+}
+
+/**
+  * @brief Defines group `name` from the ids listed in `ids`, replacing a previous definition.
+  **/
+static void group_define(const char *name, char *ids) {
+    fleet_group_t *g = NULL;
+    char *tok, *end;
+    unsigned long id;
+
+    for (int i = 0; i < FLEET_GROUPS && g == NULL; ++i)
+        if (groups[i].len > 0 && strcmp(groups[i].name, name) == 0)
+            g = &groups[i];
+    for (int i = 0; i < FLEET_GROUPS && g == NULL; ++i)
+        if (groups[i].len == 0)
+            g = &groups[i];
+    if (g == NULL) {
+        printf("Too many groups (%d).\n", FLEET_GROUPS);
+        return;
+    }
+
+    g->len = 0;
+    for (tok = strtok(ids, " \t\n"); tok != NULL && g->len < FLEET_GROUP_MAX; tok = strtok(NULL, " \t\n")) {
+        id = strtoul(tok, &end, 10);
+        if (*end != 0 || id == 0 || id > UINT32_MAX) {
+            printf("Bad drone id: %s\n", tok);
+            g->len = 0;
+            return;
+        }
+        g->ids[g->len++] = id;
+    }
+    snprintf(g->name, sizeof(g->name), "%s", name);
+    printf("Group %s: %d drones.\n", name, g->len);
+}
+
+/**
+  * @brief Handles one console line.
+  **/
+static void fleet_console(int fd, char *line) {
+    char first[FLEET_NAME_MAX], second[FLEET_NAME_MAX];
+    current_action_t action;
+    int off = 0, rest = 0;
+
+    for (char *p = line; *p; ++p)
+        *p = tolower((unsigned char)*p);
+    if (sscanf(line, "%15s %n", first, &off) < 1)
+        return;
+
+    if (strcmp(first, "drones") == 0) {
+        fleet_list();
+    } else if (strcmp(first, "group") == 0 && sscanf(line + off, "%15s %n", second, &rest) == 1 &&
+            strcmp(second, "all") != 0 && !isdigit((unsigned char)second[0]))
+    {
+        group_define(second, line + off + rest);
+    } else if (sscanf(line + off, "%15s", second) == 1 && tlm_action_parse(second, &action) == 0) {
+        command_dispatch(fd, first, action);
+    } else {
+        printf("Invalid command: %s", line);
+        printf("Valid: <all|group|id> <fly|samplegps|land|idle|charge|abort>, group <name> <id>..., drones\n");
+    }
+}
+
+/**
+  * @brief Prints ingest throughput since the previous report, per worker and in total, and the fleet size.
+  **/
+static void fleet_report(double s, const struct timespec *cpu_since) {
+    static uint64_t last[FLEET_WORKERS_MAX][3];
+    uint64_t total_records = 0, total_bytes = 0, now = now_us();
+    uint32_t total_streams = 0, drones = 0, active = 0;
+    struct timespec cpu;
+    fleet_state_t st;
+    double cpu_us;
+
+    for (int i = 0; i < workers_len; ++i) {
+        fleet_stats_t *c = &workers[i].stats;
+        uint64_t records = atomic_load_explicit(&c->records, memory_order_relaxed);
+        uint64_t bytes = atomic_load_explicit(&c->bytes, memory_order_relaxed);
+        uint64_t malformed = atomic_load_explicit(&c->malformed, memory_order_relaxed);
+        uint32_t streams = atomic_load_explicit(&c->streams, memory_order_relaxed);
+
+        printf("Worker %d: %u streams, %.0f frames/s, %.0f B/s, %lu malformed\n", i, streams,
+            (records - last[i][0]) / s, (bytes - last[i][1]) / s, (unsigned long)(malformed - last[i][2]));
+        total_records += records - last[i][0];
+        total_bytes += bytes - last[i][1];
+        total_streams += streams;
+        last[i][0] = records;
+        last[i][1] = bytes;
+        last[i][2] = malformed;
+    }
+
+    for (int i = 0; i < FLEET_MAX; ++i) {
+        if (atomic_load_explicit(&fleet[i].id, memory_order_acquire) == 0 || !fleet_read(&fleet[i], &st))
+            continue;
+        drones++;
+        if (now - st.heard_us < FLEET_ACTIVE_US)
+            active++;
+    }
+
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu);
+    cpu_us = (cpu.tv_sec - cpu_since->tv_sec) * 1e6 + (cpu.tv_nsec - cpu_since->tv_nsec) / 1e3;
+    printf("Fleet: %u drones (%u active), %u streams, %d workers: %.0f frames/s, %.0f B/s, %.2f us cpu/frame\n",
+        drones, active, total_streams, workers_len, total_records / s, total_bytes / s,
+        total_records ? cpu_us / total_records : 0.0);
+}
+
+int fleet_serve(const struct sockaddr_in *addr, int threads, uint64_t heartbeat_us, volatile sig_atomic_t *stop) {
+    struct timespec since, cpu_since, now;
+    uint64_t next_beat = 0, next_retry, wake, t;
+    uint32_t beat_seq = 0;
+    int cmd_fd, ret = 0, opened = 0, started = 0;
+    char ip[INET_ADDRSTRLEN], line[4096];
+    struct pollfd fds[2];
+
+    stopping = stop;
+    workers_len = threads < FLEET_WORKERS_MAX ? threads : FLEET_WORKERS_MAX;
+
+    // Heartbeats and commands leave from one socket, the acknowledgements come back to it.
+    cmd_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (cmd_fd < 0) {
+        perror("socket(UDP)");
+        return 1;
+    }
+    // Every drone acknowledges a fleet command at once, the datagrams wait here for the main loop.
+    if (setsockopt(cmd_fd, SOL_SOCKET, SO_RCVBUF, &(int){ FLEET_MAX * 1024 }, sizeof(int)) < 0)
+        perror("setsockopt(SO_RCVBUF)");
+    // Numbered from the wall clock, so that a restarted operator does not repeat what the drones already applied.
+    command_seq = (uint32_t)time(NULL);
+    fds[0] = (struct pollfd){ .fd = STDIN_FILENO, .events = POLLIN };
+    fds[1] = (struct pollfd){ .fd = cmd_fd, .events = POLLIN };
+
+    for (int i = 0; i < workers_len; ++i) {
+        workers[i].index = i;
+        opened++;
+        if (worker_open(&workers[i], addr) < 0) {
+            ret = 1;
+            goto _shutdown;
+        }
+        if ((errno = pthread_create(&workers[i].thread, NULL, worker_loop, &workers[i])) != 0) {
+            perror("pthread_create");
+            ret = 1;
+            goto _shutdown;
+        }
+        started++;
+    }
+
+    inet_ntop(AF_INET, &addr->sin_addr, ip, sizeof(ip));
+    printf("Fleet ground station on %s:%u, %d workers.\n", ip, ntohs(addr->sin_port), workers_len);
+
+    clock_gettime(CLOCK_MONOTONIC, &since);
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu_since);
+    while (!*stop) {
+        t = now_us();
+        if (heartbeat_us > 0 && t >= next_beat) {
+            fleet_beat(cmd_fd, beat_seq++);
+            next_beat = t - next_beat < heartbeat_us ? next_beat + heartbeat_us : t + heartbeat_us;
+        }
+        next_retry = commands_retry(cmd_fd, t);
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (now.tv_sec - since.tv_sec >= FLEET_REPORT_S) {
+            fleet_report((now.tv_sec - since.tv_sec) + (now.tv_nsec - since.tv_nsec) / 1e9, &cpu_since);
+            since = now;
+            clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu_since);
+        }
+
+        wake = t + FLEET_POLL_MS * 1000;
+        if (heartbeat_us > 0 && next_beat < wake)
+            wake = next_beat;
+        if (next_retry < wake)
+            wake = next_retry;
+        if (poll(fds, 2, wake > t ? (wake - t + 999) / 1000 : 0) < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("poll");
+            ret = 1;
+            break;
+        }
+        if (fds[1].revents & POLLIN)
+            acks_read(cmd_fd);
+        if (fds[0].revents & (POLLIN | POLLHUP)) {
+            if (fgets(line, sizeof(line), stdin))
+                fleet_console(cmd_fd, line);
+            else
+                fds[0].fd = -1;     // End of the console, the station keeps serving.
+        }
+    }
+
+_shutdown:
+    *stop = 1;
+    for (int i = 0; i < started; ++i)
+        pthread_join(workers[i].thread, NULL);
+    for (int i = 0; i < opened; ++i)
+        worker_close(&workers[i]);
+    close(cmd_fd);
+    return ret;
+}
@@ -0,0 +1,610 @@
+/**
+  * @file fleet_bench.c
+  * @brief Telemetry load generator for the fleet ground station (`-w` option of the operator).
+  *
+  * Main tasks:
+  * - Open one telemetry stream per simulated drone, a TCP connection or a UDP socket, and introduce it with a hello.
+  * - Send binary frames on all of them from `-j` threads, as fast as the ground station takes them or at `-r` frames
+  *   per second each.
+  * - Report the frames sent per second. The ground station reports what it actually decoded.
+  * - Acknowledge the commands of the ground station, so that its fleet commands can be timed.
+  * - Watch the dashboard (`-g`) with `-v` WebSocket viewers, `-s` of which stall: they never read past the handshake.
+  *   Report what the others received.
+  *
+  * @note
+  *
+  * Frames are encoded once: every drone replays the same cycle of `BENCH_CYCLE` records. The generator then spends
+  * its time in system calls and leaves the CPU to the ground station. The cycle starts with a keyframe, so wrapping
+  * around keeps the stream valid. Over UDP every frame is a keyframe, as drone_sys sends them, wrapped into a datagram
+  * numbered by its drone, and the hello is repeated with each cycle in case the first one is lost.
+  *
+  * The drones of a thread share one command socket, whose port their hellos name. A command is acknowledged for the
+  * drone it is addressed to, as flight_ctrl.c does, but changes nothing: the drones keep flying the cycle.
+  **/
+
+#include "proj_types.h"
+#include <pthread.h>
+#include <poll.h>
+
+#define BENCH_CYCLE         1000        // Records replayed by every drone, 10 s at 100 Hz.
+#define BENCH_CHUNK         32          // Frames per system call.
+#define BENCH_THREADS_MAX   64
+#define BENCH_POLL_MS       10
+#define BENCH_VIEWERS_MAX   4096
+#define BENCH_VIEWER_RX     16384
+
+/* Example key of RFC 6455, and the answer it requires. */
+#define BENCH_WS_KEY        "dGhlIHNhbXBsZSBub25jZQ=="
+#define BENCH_WS_ACCEPT     "s3pPLMBiTxaQ9kYGzzhZRbK+xOo="
+
+/**
+  * @brief One simulated drone.
+  **/
+typedef struct {
+    int fd;
+    uint32_t id;
+    size_t pos;                     // TCP: next byte of the cycle to send.
+    int frame;                      // Next frame of the cycle.
+    uint64_t sent;                  // Frames sent.
+    dgram_tx_t tx;                  // UDP: datagram numbering.
+} bench_drone_t;
+
+typedef struct {
+    pthread_t thread;
+    bench_drone_t *drones;
+    int len;
+    int cmd_fd;                     // Commands to these drones, -1 when not open.
+    uint16_t cmd_port;
+    uint64_t frames, bytes, commands;
+} bench_thread_t;
+
+/**
+  * @brief One dashboard viewer.
+  **/
+typedef struct {
+    int fd;
+    bool stalled;                   // Reads nothing after the handshake.
+    bool closed;                    // Closed by the gateway.
+    uint64_t frames, bytes;
+    uint8_t rx[BENCH_VIEWER_RX];
+    size_t rx_len;
+} bench_viewer_t;
+
+volatile sig_atomic_t sigterm = 0;
+
+static telemetry_transport_t transport = TransportTcp;
+static double rate_hz;
+static uint64_t start_us, end_us;
+
+/* Encoded cycle. Frame `i` is `cycle[offsets[i]]` to `cycle[offsets[i + 1]]`. */
+static uint8_t cycle[BENCH_CYCLE * TLM_FRAME_MAX];
+static size_t offsets[BENCH_CYCLE + 1];
+
+static uint64_t now_us(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000ull + now.tv_nsec / 1000;
+}
+
+static void sigterm_handler(int sig) {
+    (void)sig;
+    sigterm = 1;
+}
+
+/**
+  * @brief Encodes the cycle: a drone in the air, with noisy sensors and a slowly draining battery.
+  **/
+static void cycle_encode(void) {
+    tlm_encoder_t e = { 0 };
+    tlm_record_t r = { .channels = (1 << TlmChannels) - 1 - (1 << TlmGps), .battery = 90, .action = Fly };
+    uint32_t lcg = 12345;
+
+    for (int i = 0; i < BENCH_CYCLE; ++i) {
+        float noise[7];
+
+        for (int k = 0; k < 7; ++k) {
+            lcg = lcg * 1664525u + 1013904223u;
+            noise[k] = (lcg >> 8) / (float)(1 << 24) - 0.5f;
+        }
+        r.battery = 90 - i / 100;
+        r.acceleration = (acceleration_t){ 0.05f * noise[0], 0.05f * noise[1], 1.0f + 0.1f * noise[2] };
+        for (int m = 0; m < 4; ++m)
+            r.motors.motors[m] = 0.6f + 0.02f * noise[3 + m];
+
+        // Every frame stands alone over UDP.
+        if (transport == TransportUdp)
+            e.key_us = 0;
+        offsets[i + 1] = offsets[i] + tlm_encode(&e, &r, i * 10000ull, cycle + offsets[i]);
+    }
+}
+
+/**
+  * @brief Frames drone `d` may send now.
+  **/
+static int bench_allowed(const bench_drone_t *d, uint64_t now) {
+    uint64_t due;
+
+    if (rate_hz <= 0)
+        return BENCH_CHUNK;
+    due = (now - start_us) * rate_hz / 1e6 + 1;
+    return due > d->sent ? (due - d->sent < BENCH_CHUNK ? due - d->sent : BENCH_CHUNK) : 0;
+}
+
+/**
+  * @brief Sends the next frames of a TCP drone, as many as the socket takes.
+  *
+  * @return Frames completed.
+  **/
+static int tcp_send(bench_thread_t *t, bench_drone_t *d, int allowed) {
+    int last = d->frame + allowed < BENCH_CYCLE ? d->frame + allowed : BENCH_CYCLE, done = 0;
+    ssize_t n = send(d->fd, cycle + d->pos, offsets[last] - d->pos, MSG_DONTWAIT | MSG_NOSIGNAL);
+
+    if (n <= 0) {
+        if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+            perror("send");
+            sigterm = 1;
+        }
+        return 0;
+    }
+
+    t->bytes += n;
+    d->pos += n;
+    while (d->frame < BENCH_CYCLE && offsets[d->frame + 1] <= d->pos) {
+        d->frame++;
+        done++;
+    }
+    if (d->frame == BENCH_CYCLE)
+        d->pos = d->frame = 0;
+    return done;
+}
+
+/**
+  * @brief Sends the next frames of a UDP drone in a single `sendmmsg`, a hello first at the start of each cycle.
+  *
+  * @return Frames sent.
+  **/
+static int udp_send(bench_thread_t *t, bench_drone_t *d, int allowed) {
+    static __thread uint8_t pkts[BENCH_CHUNK + 1][DGRAM_HEADER_SIZE + DGRAM_BODY_MAX];
+    struct iovec iov[BENCH_CHUNK + 1];
+    struct mmsghdr msgs[BENCH_CHUNK + 1];
+    uint8_t hello[TLM_HELLO_SIZE];
+    uint64_t ts_us = now_us();
+    int len = 0, frames = 0, n;
+
+    if (d->frame == 0) {
+        tlm_hello(&(tlm_hello_t){ .id = d->id, .flight_ctrl_port = t->cmd_port }, hello);
+        iov[len] = (struct iovec){ pkts[len], dgram_data(&d->tx, hello, sizeof(hello), 0, ts_us, pkts[len]) };
+        len++;
+    }
+    for (; frames < allowed && d->frame + frames < BENCH_CYCLE; ++frames, ++len) {
+        int i = d->frame + frames;
+
+        iov[len] = (struct iovec){ pkts[len],
+            dgram_data(&d->tx, cycle + offsets[i], offsets[i + 1] - offsets[i], 0, ts_us, pkts[len]) };
+    }
+    for (int i = 0; i < len; ++i) {
+        msgs[i] = (struct mmsghdr){ .msg_hdr = { .msg_iov = &iov[i], .msg_iovlen = 1 } };
+        t->bytes += iov[i].iov_len;
+    }
+
+    // Datagrams the socket does not take are lost, as they would be on the air.
+    n = sendmmsg(d->fd, msgs, len, MSG_DONTWAIT);
+    if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != ECONNREFUSED) {
+        perror("sendmmsg");
+        sigterm = 1;
+    }
+
+    d->frame += frames;
+    if (d->frame == BENCH_CYCLE)
+        d->frame = 0;
+    return frames;
+}
+
+/**
+  * @brief Acknowledges every queued command of the ground station. Heartbeats are dropped.
+  **/
+static void commands_read(bench_thread_t *t) {
+    uint8_t frame[TLM_FRAME_MAX], ack[TLM_COMMAND_SIZE];
+    struct sockaddr_in from;
+    socklen_t len = sizeof(from);
+    tlm_command_t c;
+    ssize_t n;
+
+    while ((n = recvfrom(t->cmd_fd, frame, sizeof(frame), MSG_DONTWAIT, (struct sockaddr *)&from, &len)) >= 0) {
+        if (tlm_command_decode(frame, n, false, &c) < 0 || c.id < t->drones[0].id || c.id > t->drones[t->len - 1].id)
+            continue;
+        c.action = Fly;
+        if (sendto(t->cmd_fd, ack, tlm_command(&c, true, ack), MSG_DONTWAIT, (struct sockaddr *)&from, len) < 0)
+            perror("sendto(ack)");
+        t->commands++;
+        len = sizeof(from);
+    }
+}
+
+static void *bench_loop(void *arg) {
+    bench_thread_t *t = arg;
+    struct pollfd *fds = calloc(t->len + 1, sizeof(*fds));
+    uint64_t now;
+    int progress, allowed, n;
+
+    if (fds == NULL) {
+        perror("calloc");
+        return NULL;
+    }
+    for (int i = 0; i < t->len; ++i)
+        fds[i] = (struct pollfd){ .fd = t->drones[i].fd, .events = POLLOUT };
+    fds[t->len] = (struct pollfd){ .fd = t->cmd_fd, .events = POLLIN };
+
+    while (!sigterm && (now = now_us()) < end_us) {
+        commands_read(t);
+        progress = 0;
+        for (int i = 0; i < t->len; ++i) {
+            bench_drone_t *d = &t->drones[i];
+
+            if ((allowed = bench_allowed(d, now)) == 0)
+                continue;
+            n = transport == TransportTcp ? tcp_send(t, d, allowed) : udp_send(t, d, allowed);
+            d->sent += n;
+            t->frames += n;
+            progress += n;
+        }
+
+        // Paced, or every connection is full.
+        if (progress == 0) {
+            if (rate_hz > 0 || transport == TransportUdp)
+                usleep(1000);
+            else
+                poll(fds, t->len + 1, BENCH_POLL_MS);
+        }
+    }
+    free(fds);
+    return NULL;
+}
+
+/**
+  * @brief Counts the whole WebSocket frames at the start of the buffer of `v`, and drops them.
+  **/
+static void viewer_frames(bench_viewer_t *v) {
+    size_t off = 0, header, len;
+
+    while (v->rx_len - off >= 2) {
+        const uint8_t *p = v->rx + off;
+
+        len = p[1] & 0x7f;
+        header = len == 126 ? 4 : 2;
+        if (v->rx_len - off < header)
+            break;
+        if (len == 126)
+            len = p[2] << 8 | p[3];
+        if (v->rx_len - off < header + len)
+            break;
+        v->frames++;
+        off += header + len;
+    }
+    memmove(v->rx, v->rx + off, v->rx_len - off);
+    v->rx_len -= off;
+}
+
+/**
+  * @brief Reads every viewer that does not stall, until the end of the benchmark. The stalled ones come first.
+  **/
+static void *viewers_loop(void *arg) {
+    bench_viewer_t *viewers = arg;
+    struct pollfd fds[BENCH_VIEWERS_MAX];
+    int len = 0;
+    ssize_t n;
+
+    while (viewers->stalled)
+        viewers++;
+    for (; viewers[len].fd >= 0; ++len)
+        fds[len] = (struct pollfd){ .fd = viewers[len].fd, .events = POLLIN };
+
+    while (!sigterm && now_us() < end_us) {
+        if (poll(fds, len, BENCH_POLL_MS) <= 0)
+            continue;
+        for (int i = 0; i < len; ++i) {
+            bench_viewer_t *v = &viewers[i];
+
+            if (!(fds[i].revents & (POLLIN | POLLHUP | POLLERR)))
+                continue;
+            n = recv(v->fd, v->rx + v->rx_len, sizeof(v->rx) - v->rx_len, MSG_DONTWAIT);
+            if (n <= 0) {
+                if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+                    v->closed = true;
+                    fds[i].fd = -1;
+                }
+                continue;
+            }
+            v->bytes += n;
+            v->rx_len += n;
+            viewer_frames(v);
+        }
+    }
+    return NULL;
+}
+
+/**
+  * @brief Connects viewer `v` to the dashboard on `addr` and completes the WebSocket handshake.
+  **/
+static int viewer_open(bench_viewer_t *v, const struct sockaddr_in *addr) {
+    static const char request[] = "GET / HTTP/1.1\r\nHost: bench\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+        "Sec-WebSocket-Key: " BENCH_WS_KEY "\r\nSec-WebSocket-Version: 13\r\n\r\n";
+    uint8_t *end = NULL;
+    ssize_t n;
+
+    v->fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (v->fd < 0 || connect(v->fd, (const struct sockaddr *)addr, sizeof(*addr)) < 0) {
+        perror("connect(dashboard)");
+        return -1;
+    }
+    if (send(v->fd, request, sizeof(request) - 1, MSG_NOSIGNAL) != sizeof(request) - 1) {
+        perror("send(handshake)");
+        return -1;
+    }
+    while (end == NULL) {
+        n = recv(v->fd, v->rx + v->rx_len, sizeof(v->rx) - 1 - v->rx_len, 0);
+        if (n <= 0) {
+            fprintf(stderr, "Dashboard closed the handshake.\n");
+            return -1;
+        }
+        v->rx_len += n;
+        v->rx[v->rx_len] = 0;
+        end = memmem(v->rx, v->rx_len, "\r\n\r\n", 4);
+    }
+    if (strncmp((char *)v->rx, "HTTP/1.1 101", 12) != 0 || strstr((char *)v->rx, BENCH_WS_ACCEPT) == NULL) {
+        fprintf(stderr, "Bad handshake answer:\n%s", v->rx);
+        return -1;
+    }
+    v->rx_len -= end + 4 - v->rx;
+    memmove(v->rx, end + 4, v->rx_len);
+    return 0;
+}
+
+/**
+  * @brief Opens the command socket of thread `t`, on a port chosen by the system.
+  **/
+static int thread_open(bench_thread_t *t) {
+    struct sockaddr_in local = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_ANY) };
+    socklen_t len = sizeof(local);
+
+    t->cmd_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (t->cmd_fd < 0) {
+        perror("socket(commands)");
+        return -1;
+    }
+    if (bind(t->cmd_fd, (struct sockaddr *)&local, sizeof(local)) < 0 ||
+        getsockname(t->cmd_fd, (struct sockaddr *)&local, &len) < 0)
+    {
+        perror("bind(commands)");
+        return -1;
+    }
+    // All drones of the thread receive a fleet command at once.
+    if (setsockopt(t->cmd_fd, SOL_SOCKET, SO_RCVBUF, &(int){ t->len * 1024 }, sizeof(int)) < 0)
+        perror("setsockopt(SO_RCVBUF)");
+    t->cmd_port = ntohs(local.sin_port);
+    return 0;
+}
+
+/**
+  * @brief Opens the telemetry stream of drone `d` and introduces it. Over UDP the hello goes with the first frames.
+  **/
+static int drone_open(bench_drone_t *d, const struct sockaddr_in *addr, uint16_t cmd_port) {
+    uint8_t hello[TLM_HELLO_SIZE];
+
+    d->fd = socket(AF_INET, transport == TransportTcp ? SOCK_STREAM : SOCK_DGRAM, 0);
+    if (d->fd < 0) {
+        perror("socket");
+        return -1;
+    }
+    if (connect(d->fd, (const struct sockaddr *)addr, sizeof(*addr)) < 0) {
+        perror("connect");
+        return -1;
+    }
+    if (transport == TransportTcp &&
+        send(d->fd, hello, tlm_hello(&(tlm_hello_t){ .id = d->id, .flight_ctrl_port = cmd_port }, hello),
+            MSG_NOSIGNAL) != TLM_HELLO_SIZE)
+    {
+        perror("send(hello)");
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    static bench_thread_t threads[BENCH_THREADS_MAX];
+    struct sigaction sa = { .sa_handler = sigterm_handler };
+    struct sockaddr_in addr = { .sin_family = AF_INET };
+    bench_drone_t *drones = NULL;
+    bench_viewer_t *viewers = NULL;
+    struct sockaddr_in dash_addr;
+    pthread_t viewers_thread;
+    long jobs = 1, seconds = 10, count, first_id = 1, dash_port = 0, viewer_count = 0, stalled = 0;
+    uint64_t viewer_min = UINT64_MAX, viewer_max = 0, viewer_frames_sum = 0, viewer_bytes = 0;
+    int watching = 0, closed = 0;
+    uint64_t frames = 0, bytes = 0, commands = 0;
+    int opt, ret = 0, opened = 0, started = 0;
+    double s;
+    char *end;
+
+    while ((opt = getopt(argc, argv, "t:j:d:r:i:g:v:s:")) != -1) {
+        switch (opt) {
+            case 't':
+                if (strcmp(optarg, "tcp") == 0)         transport = TransportTcp;
+                else if (strcmp(optarg, "udp") == 0)    transport = TransportUdp;
+                else {
+                    fprintf(stderr, "Bad telemetry transport.\n");
+                    goto _usage;
+                }
+                break;
+            case 'j':
+            case 'd':
+                *(opt == 'j' ? &jobs : &seconds) = strtol(optarg, &end, 10);
+                if (*optarg == 0 || *end != 0 || jobs < 1 || jobs > BENCH_THREADS_MAX || seconds < 1) {
+                    fprintf(stderr, "Bad thread count (1 to %d) or duration.\n", BENCH_THREADS_MAX);
+                    goto _usage;
+                }
+                break;
+            case 'r':
+                rate_hz = strtod(optarg, &end);
+                if (*optarg == 0 || *end != 0 || !(rate_hz >= 0)) {
+                    fprintf(stderr, "Bad frame rate.\n");
+                    goto _usage;
+                }
+                break;
+            case 'g':
+            case 'v':
+            case 's':
+                *(opt == 'g' ? &dash_port : opt == 'v' ? &viewer_count : &stalled) = strtol(optarg, &end, 10);
+                if (*optarg == 0 || *end != 0 || dash_port < 0 || dash_port > 65535 || viewer_count < 0 ||
+                    viewer_count > BENCH_VIEWERS_MAX || stalled < 0)
+                {
+                    fprintf(stderr, "Bad dashboard port or viewer count (%d at most).\n", BENCH_VIEWERS_MAX);
+                    goto _usage;
+                }
+                break;
+            case 'i':
+                first_id = strtol(optarg, &end, 10);
+                if (*optarg == 0 || *end != 0 || first_id < 1) {
+                    fprintf(stderr, "Bad first drone id.\n");
+                    goto _usage;
+                }
+                break;
+            default:
+                goto _usage;
+        }
+    }
+
+    if (argc - optind < 3) {
+_usage:
+        fprintf(stderr, "Usage: %s [-t tcp|udp] [-j threads] [-d seconds] [-r frames_per_s] [-i first_id] "
+            "[-g dashboard_port -v viewers [-s stalled]] <operator_ip> <telemetry_port> <drones>\n", argv[0]);
+        return 1;
+    }
+    argv += optind - 1;     // Positional arguments start at argv[1].
+
+    count = strtol(argv[3], &end, 10);
+    if (inet_pton(AF_INET, argv[1], &addr.sin_addr) <= 0 || *end != 0 || count < 1) {
+        fprintf(stderr, "Bad operator address or drone count.\n");
+        return 1;
+    }
+    addr.sin_port = htons(atoi(argv[2]));
+    if (jobs > count)
+        jobs = count;
+    if ((viewer_count > 0) != (dash_port > 0) || stalled > viewer_count) {
+        fprintf(stderr, "Viewers need the dashboard port, and no more of them may stall.\n");
+        return 1;
+    }
+    dash_addr = addr;
+    dash_addr.sin_port = htons(dash_port);
+
+    sigemptyset(&sa.sa_mask);
+    if (sigaction(SIGTERM, &sa, NULL) == -1 || sigaction(SIGINT, &sa, NULL) == -1) {
+        perror("sigaction");
+        return 1;
+    }
+
+    cycle_encode();
+    printf("Cycle of %d frames, %.1f B/frame.\n", BENCH_CYCLE, (double)offsets[BENCH_CYCLE] / BENCH_CYCLE);
+
+    drones = calloc(count, sizeof(*drones));
+    if (drones == NULL) {
+        perror("calloc");
+        return 1;
+    }
+    for (int i = 0; i < jobs; ++i) {
+        threads[i].drones = drones + count * i / jobs;
+        threads[i].len = count * (i + 1) / jobs - count * i / jobs;
+        threads[i].cmd_fd = -1;
+    }
+    for (int i = 0; i < jobs; ++i) {
+        if (thread_open(&threads[i]) < 0) {
+            ret = 1;
+            goto _shutdown;
+        }
+        for (int k = 0; k < threads[i].len; ++k, ++opened) {
+            threads[i].drones[k].id = first_id + opened;
+            if (drone_open(&threads[i].drones[k], &addr, threads[i].cmd_port) < 0) {
+                ret = 1;
+                goto _shutdown;
+            }
+        }
+    }
+    printf("%ld drones connected over %s, %ld threads.\n", count, transport == TransportTcp ? "TCP" : "UDP", jobs);
+
+    // Terminated by fd -1.
+    viewers = calloc(viewer_count + 1, sizeof(*viewers));
+    if (viewers == NULL) {
+        perror("calloc");
+        ret = 1;
+        goto _shutdown;
+    }
+    for (int i = 0; i <= viewer_count; ++i)
+        viewers[i].fd = -1;
+    for (int i = 0; i < viewer_count; ++i) {
+        viewers[i].stalled = i < stalled;
+        if (viewer_open(&viewers[i], &dash_addr) < 0) {
+            ret = 1;
+            goto _shutdown;
+        }
+    }
+    if (viewer_count > 0)
+        printf("%ld dashboard viewers connected, %ld stalled.\n", viewer_count, stalled);
+
+    start_us = now_us();
+    end_us = start_us + seconds * 1000000ull;
+    for (int i = 0; i < jobs; ++i) {
+        if ((errno = pthread_create(&threads[i].thread, NULL, bench_loop, &threads[i])) != 0) {
+            perror("pthread_create");
+            sigterm = 1;
+            break;
+        }
+        started++;
+    }
+    if (viewer_count > stalled && (errno = pthread_create(&viewers_thread, NULL, viewers_loop, viewers)) != 0) {
+        perror("pthread_create");
+        sigterm = 1;
+        viewer_count = 0;
+    }
+    for (int i = 0; i < started; ++i) {
+        pthread_join(threads[i].thread, NULL);
+        frames += threads[i].frames;
+        bytes += threads[i].bytes;
+        commands += threads[i].commands;
+    }
+
+    s = (now_us() - start_us) / 1e6;
+    printf("Sent %lu frames in %.1f s: %.0f frames/s, %.0f B/s, %lu commands acknowledged\n", (unsigned long)frames,
+        s, frames / s, bytes / s, (unsigned long)commands);
+
+    if (viewer_count > stalled) {
+        pthread_join(viewers_thread, NULL);
+        // The stalled ones cannot tell, their window is closed. The dashboard reports them.
+        for (int i = stalled; i < viewer_count; ++i) {
+            bench_viewer_t *v = &viewers[i];
+
+            closed += v->closed;
+            watching++;
+            viewer_frames_sum += v->frames;
+            viewer_bytes += v->bytes;
+            viewer_min = v->frames < viewer_min ? v->frames : viewer_min;
+            viewer_max = v->frames > viewer_max ? v->frames : viewer_max;
+        }
+        printf("Viewers: %d watching got %.0f frames/s each (min %.0f, max %.0f), %.0f B/s in all, %d of them closed by "
+            "the dashboard\n", watching, viewer_frames_sum / s / watching, viewer_min / s, viewer_max / s,
+            viewer_bytes / s, closed);
+    }
+
+_shutdown:
+    for (int i = 0; viewers != NULL && viewers[i].fd >= 0; ++i)
+        close(viewers[i].fd);
+    free(viewers);
+    for (int i = 0; i < opened; ++i)
+        if (drones[i].fd >= 0)
+            close(drones[i].fd);
+    for (int i = 0; i < jobs; ++i)
+        if (threads[i].cmd_fd >= 0)
+            close(threads[i].cmd_fd);
+    free(drones);
+    return ret;
+}
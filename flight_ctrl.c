@@ -5,6 +5,14 @@
   * Main tasks:
   * - Controls internal state of the drone based on it's state command.
   * - Responds to operator's command via UDP (non-blocking). 
+  * - Passes telemetry subscriptions and backfill requests received on the same socket to the telemetry unit.
+  * - Lands when nothing was heard from the operator (commands, subscriptions or heartbeats) within the link timeout
+  *   (`-l` option of drone_sys). UDP never reports a vanished peer, silence is the only sign.
+  * - Stamps operator heartbeats with the time the kernel received them, for the telemetry unit to echo (clock offset
+  *   exchange, see clock_sync.c).
+  * - Acknowledges numbered commands to their sender. The operator repeats a command until it is acknowledged, a
+  *   repeated one is acknowledged again but applied only once.
+  * - Sole writer of the drone state: arbitrates state change intents posted by all actors once per cycle.
   *
   * @note
   *
@@ -12,16 +20,12 @@
 
 #include "proj_types.h"
 
-#define DELTA_SIMULATION_US 50000
-#define DELTA_DECREASE      0.01f
-#define DELTA_INCREASE      0.005f
 #define MAGNITUDE_THRESH    1.0f
-#define FLY_THRESH          0.7f
 #define BIND_RETRY_MS       2000 
 
 #define MAX_FLY_TIMEOUT     10
 
-#define ACCEL_STABILIZATION_THRESHOLD 0.5f
+#define SAMPLE_WAIT_US      2000        // Longest wait for a fresh accelerometer sample after the cycle deadline.
 
 static bat_charge_t current_battery;
 static current_action_t last_action = Reserved;
@@ -30,7 +34,17 @@ static bool init = true;
 
 static int sockfd;
 static struct sockaddr_in serveraddr;
-static struct timespec now, last_time;
+static struct timespec now, last_time, next_cycle;
+static wait_stats_t wait_stats = { .name = "flight controller" };
+static wait_stats_t sample_stats = { .name = "flight controller sample" };
+
+/* Operator link. Silence is measured from the bind until the first datagram. */
+static struct timespec last_heard;
+static bool link_lost = false;
+
+/* Last numbered command applied. */
+static uint32_t command_seq;
+static bool command_seen = false;
 
 /**
   * @brief Tries to bind for operator's UDP traffic.
@@ -74,9 +88,146 @@ bool try_bind(drone_shared_t *shm_ptr) {
         return false;
     }
 
+    // Heartbeats wait for the next cycle, their arrival time has to come from the kernel. Read time otherwise.
+    int on = 1;
+    if (setsockopt(sockfd, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)) < 0)
+        perror("setsockopt(SO_TIMESTAMPNS)");
+
     return true;
 }
 
+/**
+  * @brief Receives one datagram like `recvfrom` and the CLOCK_MONOTONIC time it arrived at, in microseconds.
+  **/
+static ssize_t recv_stamped(uint8_t *buf, size_t size, socklen_t *addr_len, uint64_t *rx_us) {
+    union {
+        char buf[CMSG_SPACE(sizeof(struct timespec))];
+        struct cmsghdr align;
+    } control;
+    struct iovec iov = { .iov_base = buf, .iov_len = size };
+    struct msghdr mh = {
+        .msg_name = &serveraddr, .msg_namelen = *addr_len,
+        .msg_iov = &iov, .msg_iovlen = 1,
+        .msg_control = control.buf, .msg_controllen = sizeof(control.buf),
+    };
+    struct timespec mono, real, stamp;
+    ssize_t n = recvmsg(sockfd, &mh, MSG_DONTWAIT);
+
+    if (n < 0)
+        return n;
+
+    *addr_len = mh.msg_namelen;
+    clock_gettime(CLOCK_MONOTONIC, &mono);
+    *rx_us = mono.tv_sec * 1000000ull + mono.tv_nsec / 1000;
+
+    // Kernel stamps use CLOCK_REALTIME, only the time elapsed since is carried over.
+    for (struct cmsghdr *c = CMSG_FIRSTHDR(&mh); c; c = CMSG_NXTHDR(&mh, c)) {
+        if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_TIMESTAMPNS) {
+            int64_t age_us;
+
+            memcpy(&stamp, CMSG_DATA(c), sizeof(stamp));
+            clock_gettime(CLOCK_REALTIME, &real);
+            age_us = (real.tv_sec - stamp.tv_sec) * 1000000ll + (real.tv_nsec - stamp.tv_nsec) / 1000;
+            if (age_us > 0 && (uint64_t)age_us < *rx_us)
+                *rx_us -= age_us;
+        }
+    }
+    return n;
+}
+
+/**
+  * @brief Records that the operator was heard from.
+  **/
+static void link_heard(void) {
+    if (link_lost)
+        printf("Operator link restored after %ld ms of silence.\n",
+            (now.tv_sec - last_heard.tv_sec) * 1000 + (now.tv_nsec - last_heard.tv_nsec) / NANOSECONDS_IN_MS);
+    link_lost = false;
+    last_heard = now;
+}
+
+/**
+  * @brief Link-loss failsafe. Lands once the operator was silent for the link timeout, when in the air.
+  **/
+static void link_check(drone_shared_t *shm_ptr, current_action_t current) {
+    long silent_ms = (now.tv_sec - last_heard.tv_sec) * 1000 + (now.tv_nsec - last_heard.tv_nsec) / NANOSECONDS_IN_MS;
+
+    if (init || link_lost || shm_ptr->link_timeout_us == 0 || silent_ms * 1000 < (long)shm_ptr->link_timeout_us)
+        return;
+
+    link_lost = true;
+    printf("Operator link lost: nothing heard for %ld ms.\n", silent_ms);
+    alert_post(shm_ptr, AlertLinkLost, ActorFlightCtrl, silent_ms);
+    if (current & (Fly | SampleGPS))
+        intent_post(shm_ptr, Land, IntentSafety, SourceFlightCtrl);
+}
+
+/**
+  * @brief Applies pending state change requests. Called once per control cycle.
+  *
+  * Drains the whole intent queue. The intent with the highest priority wins, the latest one among equal priorities.
+  * Intents requesting the current state are ignored. Each applied or superseded intent is logged with its latency.
+  **/
+static void arbitrate_intents(drone_shared_t *shm_ptr, current_action_t current) {
+    static const char *sources[] = { "operator", "flight controller", "battery", "telemetry" };
+    intent_t batch[MPSC_CAPACITY];
+    int count = 0, winner = -1;
+    struct timespec applied;
+
+    while (count < MPSC_CAPACITY && mpsc_pop(&shm_ptr->intents, &batch[count], sizeof(intent_t))) {
+        if (batch[count].type != current && (winner < 0 || batch[count].priority >= batch[winner].priority))
+            winner = count;
+        count++;
+    }
+
+    if (winner < 0)
+        return;
+
+    action_set(shm_ptr, batch[winner].type);
+    clock_gettime(CLOCK_MONOTONIC, &applied);
+
+    for (int i = 0; i < count; ++i) {
+        if (batch[i].type == current)
+            continue;
+
+        printf("Intent %d from %s (priority %u) %s after %ld us.\n",
+            batch[i].type,
+            batch[i].source < sizeof(sources) / sizeof(sources[0]) ? sources[batch[i].source] : "unknown",
+            batch[i].priority,
+            i == winner ? "applied" : "superseded",
+            (applied.tv_sec - batch[i].stamp.tv_sec) * 1000000 + (applied.tv_nsec - batch[i].stamp.tv_nsec) / 1000
+        );
+    }
+}
+
+/**
+  * @brief Acknowledges command `c` to the address it came from, and takes it unless it is a repeated or older one.
+  *
+  * The station numbers its commands upwards (from the wall clock at its start, so a restarted one goes on above the
+  * last number) and resends each unacknowledged one, several of them at once. Every copy is acknowledged, but only
+  * a command newer than the last applied one is taken: a late resend must not undo a newer command.
+  *
+  * @return The command to apply, `Reserved` for none.
+  **/
+static current_action_t command_take(drone_shared_t *shm_ptr, const tlm_command_t *c, socklen_t len) {
+    uint8_t ack[TLM_COMMAND_SIZE];
+    bool stale = command_seen && (int32_t)(c->seq - command_seq) <= 0;
+
+    if (c->id != 0 && c->id != shm_ptr->drone_id)
+        return Reserved;
+
+    tlm_command(&(tlm_command_t){ .seq = c->seq, .id = shm_ptr->drone_id, .action = last_action }, true, ack);
+    if (sendto(sockfd, ack, sizeof(ack), 0, (struct sockaddr *)&serveraddr, len) < 0)
+        perror("sendto(ack)");
+
+    if (stale)
+        return Reserved;
+    command_seq = c->seq;
+    command_seen = true;
+    printf("Obtained command #%u from operator: %d.\n", c->seq, c->action);
+    return c->action;
+}
+
 /**
   * @brief Flight controller loop function.
   *
@@ -90,7 +241,14 @@ void flight_loop(drone_shared_t *shm_ptr) {
     static socklen_t len;
     static uint8_t fly_timeout = 0;
     motors_t tmp_m = {0};
+    drone_state_t *s;
     current_action_t current_action, operator_cmd = Reserved;
+    uint8_t msg[TLM_SUBSCRIBE_MAX];
+    tlm_subscription_t sub;
+    tlm_heartbeat_t beat;
+    tlm_command_t command;
+    uint64_t rx_us;
+    uint32_t resume_from;
     float avg_pwm;
     ssize_t n;
 
@@ -107,27 +265,49 @@ void flight_loop(drone_shared_t *shm_ptr) {
                 printf("Socket bind complete..\n");
                 init = false;
                 len = sizeof(serveraddr);
+                last_heard = now;
                 goto _binded;
             }
         }
         last_time = now;
     } else {
 _binded:
-        /* Trying to get new command from operator. This part is non-blocking. */
-        n = recvfrom(sockfd, &operator_cmd, sizeof(operator_cmd), MSG_DONTWAIT, (struct sockaddr*)&serveraddr, &len);
-        if (n < 0) {                                                // UDP receive error.
-            if (errno == EWOULDBLOCK) {} else    // Doing nothing when no data can be read.
-            if (errno == EAGAIN || errno == EINTR) { goto _binded; }                   // Socket read interrupted. Retrying.
-            else { 
-                // Communication error. Set to Abort state.
-                rwlock_write_lock(&shm_ptr->action.lock);
-                shm_ptr->action.type = Abort;
-                rwlock_write_unlock(&shm_ptr->action.lock);
-                perror("recvfrom"); 
-                init = true; 
-            }               
-        } else if (n == sizeof(operator_cmd)) {                     // Received data!
-            printf("Obtained command from operator: %d.\n", operator_cmd);
+        /* Trying to get new command from operator. This part is non-blocking. Heartbeats and subscriptions are all
+         * drained, so that they never delay a command, commands are still taken one per cycle. */
+        while (operator_cmd == Reserved) {
+            n = recv_stamped(msg, sizeof(msg), &len, &rx_us);
+            if (n < 0) {                                                // UDP receive error.
+                if (errno == EWOULDBLOCK) { break; } else    // Doing nothing when no data can be read.
+                if (errno == EAGAIN || errno == EINTR) { continue; }    // Socket read interrupted. Retrying.
+                else { 
+                    // Communication error. Set to Abort state.
+                    intent_post(shm_ptr, Abort, IntentSafety, SourceFlightCtrl);
+                    perror("recvmsg"); 
+                    init = true; 
+                    break;
+                }               
+            } else if (n == sizeof(operator_cmd)) {                     // Received data!
+                memcpy(&operator_cmd, msg, sizeof(operator_cmd));
+                printf("Obtained command from operator: %d.\n", operator_cmd);
+                link_heard();
+            } else if (tlm_command_decode(msg, n, false, &command) == 0) {
+                operator_cmd = command_take(shm_ptr, &command, len);
+                link_heard();
+            } else if (tlm_heartbeat_decode(msg, n, &beat) == 0) {
+                echo_publish(shm_ptr, beat.ts_us, rx_us);
+                link_heard();
+            } else if (tlm_resume_decode(msg, n, &resume_from) == 0) {
+                printf("Obtained telemetry backfill request from seq %u.\n", resume_from);
+                resume_publish(shm_ptr, resume_from);
+                link_heard();
+            } else if (tlm_subscription_decode(msg, n, &sub) == 0) {    // Subscriptions are longer than a command.
+                printf("Obtained telemetry subscription from operator:");
+                for (int i = 0; i < TlmChannels; ++i)
+                    printf(" %s=%uus/%g", tlm_channel_name(i), sub.interval_us[i], sub.threshold[i]);
+                printf("\n");
+                subscription_publish(shm_ptr, &sub);
+                link_heard();
+            }
         }
     }
 
@@ -141,6 +321,8 @@ _binded:
         last_action = current_action;
     }
 
+    link_check(shm_ptr, current_action);
+
     /* Mutating system state based on current action. */
     switch (current_action) {
         case Fly:       // Fly -> Read accelerometer data and adjust motors.
@@ -187,6 +369,9 @@ _binded:
 
             sem_wait(&shm_ptr->pwm.mutex);
             shm_ptr->pwm.motors = tmp_m;
+            s = snapshot_begin(shm_ptr);
+            s->motors = tmp_m;
+            snapshot_commit(shm_ptr);
             sem_post(&shm_ptr->pwm.mutex);
 
             if (
@@ -198,9 +383,7 @@ _binded:
                 // If accelerometer data is not changing, switching to abort.
                 if (fly_timeout >= MAX_FLY_TIMEOUT) {
                     fprintf(stderr, "Too much same accelerometer data. Unable to predict current drone movement. Aborting...");
-                    rwlock_write_lock(&shm_ptr->action.lock);
-                    shm_ptr->action.type = Abort;
-                    rwlock_write_unlock(&shm_ptr->action.lock);
+                    intent_post(shm_ptr, Abort, IntentSafety, SourceFlightCtrl);
                     fly_timeout = 0;
                 }
             } else {
@@ -209,33 +392,25 @@ _binded:
             last_accel = accel;
 
             if (operator_cmd & (SampleGPS | Land | Abort)) {
-                rwlock_write_lock(&shm_ptr->action.lock);
-                shm_ptr->action.type = operator_cmd;
-                rwlock_write_unlock(&shm_ptr->action.lock);
+                intent_post(shm_ptr, operator_cmd, IntentOperator, SourceOperator);
             }
             break; 
         case SampleGPS: // SampleGPS -> Flags the telemetry unit to send newest NMEA data.
             if (operator_cmd & (Fly | Abort)) {
-                rwlock_write_lock(&shm_ptr->action.lock);
-                shm_ptr->action.type = operator_cmd;
-                rwlock_write_unlock(&shm_ptr->action.lock);
+                intent_post(shm_ptr, operator_cmd, IntentOperator, SourceOperator);
             }
             break;
         case Idle:      // Idle -> Wait for command.
             if (operator_cmd & (Fly | Charge | Abort)) {
-                rwlock_write_lock(&shm_ptr->action.lock);
-                shm_ptr->action.type = operator_cmd;
-                rwlock_write_unlock(&shm_ptr->action.lock);
+                intent_post(shm_ptr, operator_cmd, IntentOperator, SourceOperator);
             }
             break;
         case Charge:    // Charge -> Ignore commands until at least charged above 15%. Otherwise change command.
             if (operator_cmd & (Idle | Abort)) {
                 current_battery = atomic_load_explicit(&shm_ptr->battery, memory_order_acquire);
-                if (current_battery >= 15) {
+                if (current_battery >= BATTERY_LOW) {
                     // Battery sufficiently charged, allow operator commands
-                    rwlock_write_lock(&shm_ptr->action.lock);
-                    shm_ptr->action.type = operator_cmd;
-                    rwlock_write_unlock(&shm_ptr->action.lock);
+                    intent_post(shm_ptr, operator_cmd, IntentOperator, SourceOperator);
                 } else {
                     printf("Charging: Battery below 15%%, ignoring operator commands.\n");
                 };
@@ -244,23 +419,17 @@ _binded:
         case Abort:     // Abort -> Turn off the motors and land with additional prerequisites. This state specially ignores operator commands.
             // Maybe charge is less than 15%
             current_battery = atomic_load_explicit(&shm_ptr->battery, memory_order_acquire);
-            if (current_battery < 15) {
+            if (current_battery < BATTERY_LOW) {
                 // If idle on ground, charging immediately.
-                rwlock_write_lock(&shm_ptr->action.lock);
-                shm_ptr->action.type = Charge;
-                rwlock_write_unlock(&shm_ptr->action.lock);
+                intent_post(shm_ptr, Charge, IntentSafety, SourceFlightCtrl);
                 break;
             } else {
                 printf("Changing to previous action.");
-                rwlock_write_lock(&shm_ptr->action.lock);
-                shm_ptr->action.type = last_action;
-                rwlock_write_unlock(&shm_ptr->action.lock);
+                intent_post(shm_ptr, last_action, IntentSystem, SourceFlightCtrl);
             }
         case Land:      // Land -> Turn off the motors and land.
             if (operator_cmd & (Fly | Abort)) {
-                rwlock_write_lock(&shm_ptr->action.lock);
-                shm_ptr->action.type = operator_cmd;
-                rwlock_write_unlock(&shm_ptr->action.lock);
+                intent_post(shm_ptr, operator_cmd, IntentOperator, SourceOperator);
                 break;
             }
 
@@ -281,16 +450,18 @@ _binded:
             avg /= 4;
             printf("Landing: Average motor PWM: %f%%.\n", avg);
 
+            s = snapshot_begin(shm_ptr);
+            s->motors = shm_ptr->pwm.motors;
+            snapshot_commit(shm_ptr);
+
             if (avg == 0.) {    // Changing to idle when landed.
-                rwlock_write_lock(&shm_ptr->action.lock);
                 if (current_action == Abort) {
                     printf("Landing while Abort: Set to Charge.\n");
-                    shm_ptr->action.type = Charge;
+                    intent_post(shm_ptr, Charge, IntentSystem, SourceFlightCtrl);
                 } else {
                     printf("Landing: Set to Idle.\n");
-                    shm_ptr->action.type = Idle;
+                    intent_post(shm_ptr, Idle, IntentSystem, SourceFlightCtrl);
                 }
-                rwlock_write_unlock(&shm_ptr->action.lock);
             }
 
             sem_post(&shm_ptr->pwm.mutex);
@@ -298,11 +469,23 @@ _binded:
             break;
         default:
             fprintf(stderr, "Unexpected state value obtained: %d. Switching to `Abort` due to undefined behavior.\n.", current_action);
-            rwlock_write_lock(&shm_ptr->action.lock);
-            shm_ptr->action.type = Abort;
-            rwlock_write_unlock(&shm_ptr->action.lock);
+            intent_post(shm_ptr, Abort, IntentSafety, SourceFlightCtrl);
     }
 
+    arbitrate_intents(shm_ptr, current_action);
+
     shm_ptr->wdg.flight_ctrl++;
-    usleep(DELTA_SIMULATION_US);
+
+    deadline_next(&next_cycle, DELTA_SIMULATION_US);
+    notify_wait(NULL, 0, shm_ptr->wait.state, &next_cycle, &wait_stats);
+
+    // In flight, the next cycle corrects the motors with a sample taken right now rather than up to a sampling period
+    // ago: it waits for the next publication of the accelerometer, which a spinning strategy sees within microseconds.
+    if (current_action == Fly) {
+        struct timespec sample_deadline = next_cycle;
+        uint32_t seen = notify_seq(&shm_ptr->accel.published);
+
+        deadline_next(&sample_deadline, SAMPLE_WAIT_US);
+        notify_wait(&shm_ptr->accel.published, seen, shm_ptr->wait.state, &sample_deadline, &sample_stats);
+    }
 }
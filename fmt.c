@@ -0,0 +1,132 @@
+/** 
+  * @file fmt.c
+  * @brief Fast number formatting for text telemetry frames.
+  *
+  * Main tasks:
+  * - Format integers with a two-digits-per-step lookup table.
+  * - Format floats exactly like `printf("%.6f")` using integer arithmetic only.
+  * - Write directly into the caller's frame buffer, without format string parsing.
+  *
+  * @note
+  *
+  * A finite float is `m * 2^e` with a 24-bit mantissa `m`. Its value scaled by 10^6 is therefore `m * 10^6 * 2^e`,
+  * where `m * 10^6 < 2^44` always fits into 64 bits. Shifting it right by `-e` with round-half-to-even on the exact
+  * remainder gives the same digits as glibc's correctly rounded `printf`. Values too large for this scheme (above
+  * 2^43), infinities and NaNs fall back to `snprintf`.
+  **/
+
+#include "proj_types.h"
+
+static const char digit_pairs[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+/**
+  * @brief Writes decimal representation of `v`. No terminator.
+  *
+  * @return Number of characters written (at most 20).
+  **/
+size_t fmt_u64(char *dst, uint64_t v) {
+    char tmp[20];
+    char *p = tmp + sizeof(tmp);
+    size_t len;
+
+    while (v >= 100) {
+        const char *d = &digit_pairs[(v % 100) * 2];
+        v /= 100;
+        *--p = d[1];
+        *--p = d[0];
+    }
+    if (v >= 10) {
+        *--p = digit_pairs[v * 2 + 1];
+        *--p = digit_pairs[v * 2];
+    } else {
+        *--p = '0' + v;
+    }
+
+    len = tmp + sizeof(tmp) - p;
+    memcpy(dst, p, len);
+    return len;
+}
+
+/**
+  * @brief Writes decimal representation of signed `v`, as `printf("%d")` would. No terminator.
+  *
+  * @return Number of characters written (at most 11).
+  **/
+size_t fmt_i32(char *dst, int32_t v) {
+    if (v < 0) {
+        *dst = '-';
+        return 1 + fmt_u64(dst + 1, -(int64_t)v);
+    }
+    return fmt_u64(dst, v);
+}
+
+/**
+  * @brief Writes `v` as `printf("%.6f", (double)v)` would. No terminator.
+  *
+  * @return Number of characters written (at most `FMT_F6_MAX`).
+  **/
+size_t fmt_f6(char *dst, float v) {
+    uint32_t bits, exp, frac;
+    uint64_t m, q;
+    size_t len = 0;
+    int e;
+
+    memcpy(&bits, &v, sizeof(bits));
+    exp = (bits >> 23) & 0xff;
+    frac = bits & 0x7fffff;
+
+    if (exp == 0xff || exp >= 150 + 20) {
+        char tmp[FMT_F6_MAX + 1];
+        int n = snprintf(tmp, sizeof(tmp), "%.6f", v);
+        n = n < 0 ? 0 : (n > FMT_F6_MAX ? FMT_F6_MAX : n);
+        memcpy(dst, tmp, n);
+        return n;
+    }
+
+    if (exp == 0) {                 // Subnormal.
+        m = frac;
+        e = -149;
+    } else {
+        m = frac | (1u << 23);
+        e = (int)exp - 150;
+    }
+
+    m *= 1000000;                   // < 2^44.
+
+    if (e >= 0) {
+        q = m << e;                 // Exact, e < 20 keeps it below 2^64.
+    } else if (e <= -64) {
+        q = 0;                      // Less than half of the last printed digit.
+    } else {
+        uint32_t k = -e;
+        uint64_t r = m & ((1ull << k) - 1), half = 1ull << (k - 1);
+
+        q = m >> k;
+        if (r > half || (r == half && (q & 1)))
+            q++;
+    }
+
+    if (bits >> 31)
+        dst[len++] = '-';
+
+    len += fmt_u64(dst + len, q / 1000000);
+    dst[len++] = '.';
+
+    // Six fraction digits, zero padded.
+    uint32_t f = q % 1000000;
+    memcpy(dst + len,     &digit_pairs[(f / 10000) * 2], 2);
+    memcpy(dst + len + 2, &digit_pairs[(f / 100 % 100) * 2], 2);
+    memcpy(dst + len + 4, &digit_pairs[(f % 100) * 2], 2);
+
+    return len + 6;
+}
@@ -0,0 +1,192 @@
+/**
+  * @file fmt_check.c
+  * @brief Checks that the formatters of fmt.c write the same bytes as `printf`, and benchmarks them against it.
+  *
+  * Main tasks:
+  * - Compare `fmt_f6` with `"%.6f"` on every float exponent (edge and random mantissas, both signs), on rounding
+  *   ties, subnormals, infinities and NaNs, and on `-n` random bit patterns.
+  * - Compare `fmt_i32` with `"%d"` around zero and at the limits, and `fmt_u64` with `"%lu"` around powers of ten.
+  * - Report the numbers formatted per second by both.
+  *
+  * @note
+  *
+  * Ground tools parse the text telemetry frames, so any difference is a failure: the exit status is 1 then, and the
+  * first mismatches are printed. `sh compile.sh check` runs it.
+  **/
+
+#include "proj_types.h"
+
+#define CHECK_RANDOM        4000000     // Default random floats, on top of the sweeps.
+#define CHECK_PER_EXPONENT  4096        // Random mantissas per exponent.
+#define CHECK_TIES          (1 << 20)   // Multiples of 1/128: an odd one ends in 5 at the seventh decimal.
+#define CHECK_INTS          1000000     // Integers each side of zero.
+#define CHECK_REPORT_MAX    10          // Mismatches printed.
+#define CHECK_BENCH         2000000     // Numbers formatted by each benchmark.
+
+static uint64_t rng = 0x9e3779b97f4a7c15ull;
+static uint64_t checked, failures;
+
+static uint64_t next_random(void) {
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return rng;
+}
+
+static uint64_t clock_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * NANOSECONDS_IN_SEC + ts.tv_nsec;
+}
+
+/**
+  * @brief Counts a mismatch between `got` (`len` bytes) and `want`, and prints the first ones.
+  **/
+static void mismatch(const char *what, const char *got, size_t len, const char *want) {
+    if (failures++ < CHECK_REPORT_MAX)
+        fprintf(stderr, "%s: got \"%.*s\", printf gives \"%s\".\n", what, (int)len, got, want);
+}
+
+static void check_f6_bits(uint32_t bits) {
+    char got[FMT_F6_MAX + 1], want[FMT_F6_MAX + 16], what[32];
+    size_t len;
+    float v;
+
+    memcpy(&v, &bits, sizeof(v));
+    len = fmt_f6(got, v);
+    snprintf(want, sizeof(want), "%.6f", v);
+    checked++;
+
+    if (len != strlen(want) || memcmp(got, want, len) != 0) {
+        snprintf(what, sizeof(what), "fmt_f6(0x%08x)", bits);
+        mismatch(what, got, len, want);
+    }
+}
+
+static void check_f6(float v) {
+    uint32_t bits;
+
+    memcpy(&bits, &v, sizeof(bits));
+    check_f6_bits(bits);
+}
+
+static void check_i32(int32_t v) {
+    char got[16], want[16], what[32];
+    size_t len = fmt_i32(got, v);
+
+    snprintf(want, sizeof(want), "%d", v);
+    checked++;
+    if (len != strlen(want) || memcmp(got, want, len) != 0) {
+        snprintf(what, sizeof(what), "fmt_i32(%d)", v);
+        mismatch(what, got, len, want);
+    }
+}
+
+static void check_u64(uint64_t v) {
+    char got[24], want[24], what[40];
+    size_t len = fmt_u64(got, v);
+
+    snprintf(want, sizeof(want), "%lu", (unsigned long)v);
+    checked++;
+    if (len != strlen(want) || memcmp(got, want, len) != 0) {
+        snprintf(what, sizeof(what), "fmt_u64(%lu)", (unsigned long)v);
+        mismatch(what, got, len, want);
+    }
+}
+
+/**
+  * @brief Times `CHECK_BENCH` floats and integers formatted by fmt.c and by `snprintf`.
+  **/
+static void bench(void) {
+    static float floats[1024];
+    static int32_t ints[1024];
+    char buf[FMT_F6_MAX + 16];
+    uint64_t start, ns[4], sink = 0;
+
+    // Telemetry-like values: accelerations and PWM in a few units, battery and counters in the hundreds.
+    for (int i = 0; i < 1024; ++i) {
+        floats[i] = ((int64_t)(next_random() % 40000000) - 20000000) / 1e6f;
+        ints[i] = (int32_t)(next_random() % 100000);
+    }
+
+    start = clock_ns();
+    for (int i = 0; i < CHECK_BENCH; ++i)
+        sink += fmt_f6(buf, floats[i & 1023]);
+    ns[0] = clock_ns() - start;
+
+    start = clock_ns();
+    for (int i = 0; i < CHECK_BENCH; ++i)
+        sink += snprintf(buf, sizeof(buf), "%.6f", floats[i & 1023]);
+    ns[1] = clock_ns() - start;
+
+    start = clock_ns();
+    for (int i = 0; i < CHECK_BENCH; ++i)
+        sink += fmt_i32(buf, ints[i & 1023]);
+    ns[2] = clock_ns() - start;
+
+    start = clock_ns();
+    for (int i = 0; i < CHECK_BENCH; ++i)
+        sink += snprintf(buf, sizeof(buf), "%d", ints[i & 1023]);
+    ns[3] = clock_ns() - start;
+
+    printf("Floats:   fmt_f6 %6.1f M/s (%5.1f ns), snprintf %6.1f M/s (%5.1f ns).\n",
+        CHECK_BENCH * 1e3 / ns[0], (double)ns[0] / CHECK_BENCH, CHECK_BENCH * 1e3 / ns[1], (double)ns[1] / CHECK_BENCH);
+    printf("Integers: fmt_i32 %5.1f M/s (%5.1f ns), snprintf %6.1f M/s (%5.1f ns).\n",
+        CHECK_BENCH * 1e3 / ns[2], (double)ns[2] / CHECK_BENCH, CHECK_BENCH * 1e3 / ns[3], (double)ns[3] / CHECK_BENCH);
+    if (sink == 0)
+        printf("\n");       // Keeps the results alive.
+}
+
+int main(int argc, char **argv) {
+    static const uint32_t edges[] = { 0, 1, 2, 0x3fffff, 0x400000, 0x400001, 0x7ffffe, 0x7fffff };
+    static const uint64_t limits[] = { 0, UINT32_MAX, INT64_MAX, UINT64_MAX };
+    long random_count = CHECK_RANDOM;
+    char *end;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:")) != -1) {
+        random_count = opt == 'n' ? strtol(optarg, &end, 10) : -1;
+        if (opt != 'n' || *optarg == 0 || *end != 0 || random_count < 0) {
+            fprintf(stderr, "Usage: %s [-n random_floats]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    // Every exponent, subnormals, infinities and NaNs included, with edge and random mantissas of both signs.
+    for (uint32_t exp = 0; exp < 256; ++exp) {
+        for (uint32_t sign = 0; sign < 2; ++sign) {
+            for (size_t i = 0; i < sizeof(edges) / sizeof(edges[0]); ++i)
+                check_f6_bits(sign << 31 | exp << 23 | edges[i]);
+            for (int i = 0; i < CHECK_PER_EXPONENT; ++i)
+                check_f6_bits(sign << 31 | exp << 23 | (uint32_t)(next_random() & 0x7fffff));
+        }
+    }
+
+    // Round half to even on exact ties.
+    for (int32_t j = -CHECK_TIES; j <= CHECK_TIES; ++j)
+        check_f6(j / 128.0f);
+
+    for (long i = 0; i < random_count; ++i)
+        check_f6_bits((uint32_t)next_random());
+
+    for (int32_t v = -CHECK_INTS; v <= CHECK_INTS; ++v)
+        check_i32(v);
+    check_i32(INT32_MIN);
+    check_i32(INT32_MIN + 1);
+    check_i32(INT32_MAX);
+
+    for (uint64_t p = 1; p <= UINT64_MAX / 10; p *= 10) {
+        check_u64(p - 1);
+        check_u64(p);
+        check_u64(p + 1);
+    }
+    for (size_t i = 0; i < sizeof(limits) / sizeof(limits[0]); ++i)
+        check_u64(limits[i]);
+
+    printf("%s: %lu values, %lu differ from printf.\n", failures ? "FAIL" : "PASS", (unsigned long)checked,
+        (unsigned long)failures);
+
+    bench();
+    return failures ? 1 : 0;
+}
@@ -3,67 +3,68 @@
   * @brief Sends GPS NMEA string data via circular buffer.
   *
   * Main tasks:
-  * - Send NMEA string data each second via circular buffer (producer).
-  * - Only types new data when buffer is not full (consumer obtains data). Only happen when state is `SampleGPS`.
+  * - Derive NMEA sentences from the airframe ground truth (see physics.c and nmea.c).
+  * - Send NMEA string data each second via circular buffer (producer), only while any consumer demands fixes.
+  * - Park on the demand channel otherwise, and wake up immediately when demand appears.
+  * - Overwrites the oldest sentence when the buffer is full, so consumers always find the freshest fix.
   *
   * @note
   **/
 
 #include "proj_types.h"
 
-#define NMEA_COUNT (sizeof(nmea_samples)/sizeof(nmea_samples[0]))
-
-/* Simulation samples. Those are being sent in a loop. */
-static const char *nmea_samples[] = {
-    "$GPGGA,123519,4807.038,N,01131.000,E,1,08,0.9,545.4,M,46.9,M,,*47\n",
-    "$GPGSA,A,3,04,05,09,12,24,25,29,30,31,,,1.8,1.0,1.5*33\n",
-    "$GPRMC,123519,A,4807.038,N,01131.000,E,022.4,084.4,230394,003.1,W*6A\n",
-    "$GPVTG,084.4,T,003.1,M,022.4,N,041.4,K*1F\n"
-};
+#define GPS_PERIOD_US       1000000
+#define GPS_IDLE_WAKE_MS    500     // Parking is split into chunks to keep the watchdog heartbeat alive.
 
 static int sample_index = 0;
-static size_t nmea_samples_count = sizeof(nmea_samples) / sizeof(nmea_samples[0]);
+static truth_t truth;
+static bool producing = false;
+static struct timespec next_sample;
+static wait_stats_t wait_stats = { .name = "gps" };
 
 /**
   * @brief Main GPS loop function.
   *
   * Does the following:
-  * - Acts as a producer that writes upcoming NMEA strings to shared circular buffer.
+  * - Acts as a producer that writes upcoming NMEA strings, derived from the ground truth, to shared circular buffer.
+  * - Idles while no consumer demands fixes.
   **/
 void gps_loop(drone_shared_t *shm_ptr) {
-    const char *msg = nmea_samples[sample_index];
-    size_t count = 0;
-
-    printf("Writing: ");
-
-    while (count < strlen(msg)) {
-        struct timespec ts;
-        clock_gettime(CLOCK_MONOTONIC, &ts);
-        ts.tv_sec += 1;
+    char msg[GPS_SENTENCE_SIZE];
+    size_t len;
+    uint32_t seen = notify_seq(&shm_ptr->gps.wake);
+    struct timespec ts;
 
-        int s = sem_timedwait(&shm_ptr->gps.empty, &ts);
-        if (s == -1) {
-            if (errno == ETIMEDOUT)
-                goto _wdg;
-            else
-                perror("sem_timedwait");
-        } else {
-            sem_wait(&shm_ptr->gps.mutex);
-
-            shm_ptr->gps.nmea.buf[shm_ptr->gps.write] = msg[count];
+    // Nobody samples. Parks until a consumer raises its demand flag.
+    if (gps_demand(shm_ptr) == 0) {
+        if (producing) {
+            printf("No consumer demand. Idling.\n");
+            producing = false;
+        }
 
-            shm_ptr->gps.write = (shm_ptr->gps.write + 1) % GPS_BUFFER_SIZE;
+        deadline_after_ms(&ts, GPS_IDLE_WAKE_MS);
+        notify_wait(&shm_ptr->gps.wake, seen, shm_ptr->wait.gps, &ts, &wait_stats);
 
-            sem_post(&shm_ptr->gps.mutex);
-            sem_post(&shm_ptr->gps.full);
+        shm_ptr->wdg.gps_ctrl++;
+        return;
+    }
 
-            count++;
-        }
+    if (!producing) {
+        printf("Consumer demand raised. Producing.\n");
+        producing = true;
+        clock_gettime(CLOCK_MONOTONIC, &next_sample);
     }
 
-    sample_index = (sample_index + 1) % nmea_samples_count;
+    truth_read(shm_ptr, &truth);
+    len = nmea_format(msg, sizeof(msg), sample_index, truth.pos, truth.vel);
+    if (len > 0) {
+        gps_ring_publish(shm_ptr, msg, len);
+        printf("Writing: %s", msg);
+    }
+    sample_index = (sample_index + 1) % NmeaCount;
 
-_wdg:
     shm_ptr->wdg.gps_ctrl++;
-    sleep(1);
+
+    deadline_next(&next_sample, GPS_PERIOD_US);
+    notify_wait(NULL, 0, shm_ptr->wait.gps, &next_sample, &wait_stats);
 }
@@ -0,0 +1,186 @@
+/** 
+  * @file gps_ring.c
+  * @brief Single-producer broadcast ring for NMEA sentences.
+  *
+  * Main tasks:
+  * - Publish sentences from the GPS actor without ever waiting for consumers.
+  * - Let any number of consumers (up to `GPS_MAX_READERS`) join and leave at runtime.
+  * - Keep an independent cursor per consumer in shared memory and detect when it was lapped by the producer.
+  * - Track which consumers currently demand fixes, so the producer can idle otherwise.
+  *
+  * @note
+  *
+  * Each slot is guarded by a sequence counter (seqlock). The producer makes it odd while writing and even once the
+  * sentence is complete, consumers copy the slot and retry when the counter changed meanwhile. Consumers never write
+  * anything the producer reads, therefore a slow or crashed consumer cannot block it.
+  **/
+
+#include "proj_types.h"
+
+#define GPS_READ_RETRIES    4
+
+/**
+  * @brief Copies slot holding sentence number `index`.
+  *
+  * @return 1 if the copy is consistent and holds `index`, 0 if it was torn or already overwritten by a newer sentence.
+  **/
+static int gps_slot_copy(drone_shared_t *shm_ptr, uint64_t index, nmea_sentence_t *out) {
+    gps_slot_t *slot = &shm_ptr->gps.nmea.slot[index % GPS_RING_SLOTS];
+
+    for (int i = 0; i < GPS_READ_RETRIES; ++i) {
+        uint32_t v1 = atomic_load_explicit(&slot->version, memory_order_acquire);
+        if (v1 & 1)
+            continue;                       // Producer is writing this slot right now.
+
+        memcpy(out, &slot->sentence, sizeof(*out));
+
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&slot->version, memory_order_relaxed) == v1)
+            return out->index == index;
+    }
+
+    return 0;
+}
+
+/**
+  * @brief Publishes one sentence to all consumers. Overwrites the oldest slot.
+  **/
+void gps_ring_publish(drone_shared_t *shm_ptr, const char *s, size_t len) {
+    uint64_t index = atomic_load_explicit(&shm_ptr->gps.write, memory_order_relaxed);
+    gps_slot_t *slot = &shm_ptr->gps.nmea.slot[index % GPS_RING_SLOTS];
+    uint32_t v = atomic_load_explicit(&slot->version, memory_order_relaxed);
+
+    if (len > GPS_SENTENCE_SIZE)
+        len = GPS_SENTENCE_SIZE;
+
+    atomic_store_explicit(&slot->version, v + 1, memory_order_relaxed);        // Odd: write in progress.
+    atomic_thread_fence(memory_order_release);
+
+    slot->sentence.index = index;
+    clock_gettime(CLOCK_MONOTONIC, &slot->sentence.stamp);
+    memcpy(slot->sentence.s, s, len);
+    slot->sentence.len = len;
+
+    atomic_store_explicit(&slot->version, v + 2, memory_order_release);        // Even: sentence complete.
+    atomic_store_explicit(&shm_ptr->gps.write, index + 1, memory_order_release);
+}
+
+/**
+  * @brief Registers a new consumer. Its cursor starts at the next sentence to be published.
+  *
+  * @return Reader id, or -1 when all reader entries are taken.
+  * @note Entries left behind by dead processes (e.g. crashed and respawned actors) are reclaimed.
+  **/
+int gps_reader_join(drone_shared_t *shm_ptr) {
+    pid_t pid = getpid();
+
+    for (int id = 0; id < GPS_MAX_READERS; ++id) {
+        gps_reader_t *r = &shm_ptr->gps.readers[id];
+        pid_t owner = atomic_load_explicit(&r->pid, memory_order_acquire);
+
+        if (owner != 0 && (owner == pid || kill(owner, 0) == 0 || errno != ESRCH))
+            continue;
+
+        if (atomic_compare_exchange_strong(&r->pid, &owner, pid)) {
+            atomic_fetch_and_explicit(&shm_ptr->gps.demand, ~(1u << id), memory_order_acq_rel);
+            r->cursor = atomic_load_explicit(&shm_ptr->gps.write, memory_order_acquire);
+            r->dropped = 0;
+            r->lagged = 0;
+            return id;
+        }
+    }
+
+    return -1;
+}
+
+/**
+  * @brief Unregisters consumer, making its entry available for others.
+  **/
+void gps_reader_leave(drone_shared_t *shm_ptr, int id) {
+    if (id < 0 || id >= GPS_MAX_READERS)
+        return;
+
+    gps_reader_demand(shm_ptr, id, false);
+    atomic_store_explicit(&shm_ptr->gps.readers[id].pid, 0, memory_order_release);
+}
+
+/**
+  * @brief Raises or clears demand of the given consumer.
+  *
+  * @note The producer parks on `gps.wake` while demand is zero and is woken immediately once demand appears.
+  **/
+void gps_reader_demand(drone_shared_t *shm_ptr, int id, bool on) {
+    uint32_t bit = 1u << id, old;
+
+    if (id < 0 || id >= GPS_MAX_READERS)
+        return;
+
+    if (on) {
+        old = atomic_fetch_or_explicit(&shm_ptr->gps.demand, bit, memory_order_acq_rel);
+        if (old == 0)
+            notify_post(&shm_ptr->gps.wake);
+    } else {
+        atomic_fetch_and_explicit(&shm_ptr->gps.demand, ~bit, memory_order_acq_rel);
+    }
+}
+
+/**
+  * @brief Returns the current demand mask, after dropping demand left behind by dead consumers.
+  **/
+uint32_t gps_demand(drone_shared_t *shm_ptr) {
+    uint32_t demand = atomic_load_explicit(&shm_ptr->gps.demand, memory_order_acquire);
+
+    for (int id = 0; id < GPS_MAX_READERS; ++id) {
+        pid_t owner;
+
+        if (!(demand & (1u << id)))
+            continue;
+
+        owner = atomic_load_explicit(&shm_ptr->gps.readers[id].pid, memory_order_acquire);
+        if (owner == 0 || (kill(owner, 0) == -1 && errno == ESRCH))
+            atomic_fetch_and_explicit(&shm_ptr->gps.demand, ~(1u << id), memory_order_acq_rel);
+    }
+
+    return atomic_load_explicit(&shm_ptr->gps.demand, memory_order_acquire);
+}
+
+/**
+  * @brief Reads next sentence for the given consumer without blocking.
+  *
+  * When `latest` is set, only the newest sentence is returned and all unseen older ones are counted as dropped.
+  * Otherwise sentences are returned in order. A consumer lapped by the producer skips the overwritten part of the ring,
+  * which is counted as dropped and as one lag event.
+  *
+  * @return 1 when `out` holds a sentence, 0 when nothing new is available.
+  **/
+int gps_ring_read(drone_shared_t *shm_ptr, int id, nmea_sentence_t *out, bool latest) {
+    gps_reader_t *r = &shm_ptr->gps.readers[id];
+    uint64_t write = atomic_load_explicit(&shm_ptr->gps.write, memory_order_acquire);
+
+    while (r->cursor < write) {
+        uint64_t index = r->cursor;
+
+        if (latest) {
+            index = write - 1;
+        } else if (write - index > GPS_RING_SLOTS - 1) {
+            // Lapped. Oldest slot may be being rewritten, so resume one slot after it.
+            index = write - (GPS_RING_SLOTS - 1);
+            r->lagged++;
+        }
+
+        r->dropped += index - r->cursor;
+        r->cursor = index;
+
+        if (gps_slot_copy(shm_ptr, index, out)) {
+            r->cursor = index + 1;
+            return 1;
+        }
+
+        // Overwritten while copying. Catch up with the producer and try again.
+        write = atomic_load_explicit(&shm_ptr->gps.write, memory_order_acquire);
+        if (write - r->cursor <= GPS_RING_SLOTS - 1)
+            return 0;                       // Torn by a concurrent write to a slot that is still valid. Next call retries.
+    }
+
+    return 0;
+}
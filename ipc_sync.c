@@ -0,0 +1,317 @@
+/** 
+  * @file ipc_sync.c
+  * @brief Timed waiting primitives shared by all actors.
+  *
+  * Main tasks:
+  * - Build absolute deadlines on the monotonic clock.
+  * - Wait on process-shared semaphores until such deadline.
+  * - Park on / wake up shared futex words, used as event notifications between actors.
+  * - Wait for events or deadlines with a per-channel strategy (spin, spin + yield, spin + park, park).
+  * - Account wakeups and CPU time of periodic actors per drone state.
+  * - Guard records shared without locks with a version counter (seqlock).
+  *
+  * @note
+  *
+  * `sem_timedwait` measures its deadline against `CLOCK_REALTIME`, therefore passing a `CLOCK_MONOTONIC` timestamp
+  * to it results in a deadline that has already expired. All timed waits within the project shall use the helpers
+  * below, which keep both the deadline and the wait itself on `CLOCK_MONOTONIC` (immune to wall clock jumps).
+  **/
+
+#include "proj_types.h"
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <sched.h>
+
+#define WAIT_SPIN_NS            50000L                  // Spinning budget of bounded strategies.
+#define WAIT_REPORT_NS          (10 * NANOSECONDS_IN_SEC)
+
+/* CPU hint for busy loops. Lowers power draw and frees resources for the sibling hyperthread. */
+static inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+static inline uint64_t ts_ns(const struct timespec *ts) {
+    return (uint64_t)ts->tv_sec * NANOSECONDS_IN_SEC + ts->tv_nsec;
+}
+
+static inline uint64_t clock_ns(clockid_t clk) {
+    struct timespec ts;
+    clock_gettime(clk, &ts);
+    return ts_ns(&ts);
+}
+
+/**
+  * @brief Fills `ts` with an absolute `CLOCK_MONOTONIC` deadline located `ms` milliseconds from now.
+  **/
+void deadline_after_ms(struct timespec *ts, long ms) {
+    clock_gettime(CLOCK_MONOTONIC, ts);
+
+    ts->tv_sec  += ms / 1000;
+    ts->tv_nsec += (ms % 1000) * NANOSECONDS_IN_MS;
+    if (ts->tv_nsec >= NANOSECONDS_IN_SEC) {
+        ts->tv_sec++;
+        ts->tv_nsec -= NANOSECONDS_IN_SEC;
+    }
+}
+
+/**
+  * @brief Advances periodic deadline `next` by `period_us`.
+  *
+  * @note When the caller fell behind by more than a whole period, the schedule restarts from now instead of
+  *       producing a burst of late iterations.
+  **/
+void deadline_next(struct timespec *next, long period_us) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    next->tv_sec  += period_us / 1000000;
+    next->tv_nsec += (period_us % 1000000) * 1000;
+    if (next->tv_nsec >= NANOSECONDS_IN_SEC) {
+        next->tv_sec++;
+        next->tv_nsec -= NANOSECONDS_IN_SEC;
+    }
+
+    if ((int64_t)(ts_ns(&now) - ts_ns(next)) > period_us * 1000L)
+        *next = now;
+}
+
+/**
+  * @brief Waits on semaphore until absolute `CLOCK_MONOTONIC` deadline.
+  *
+  * @return 0 on success, -1 with `errno` set on failure (ETIMEDOUT when deadline has passed).
+  * @note Interrupted waits are restarted with the same deadline, so signals never shorten nor extend the wait.
+  **/
+int sem_wait_until(sem_t *sem, const struct timespec *deadline) {
+    int s;
+
+    while ((s = sem_clockwait(sem, CLOCK_MONOTONIC, deadline)) == -1 && errno == EINTR)
+        continue;
+
+    return s;
+}
+
+/**
+  * @brief Waits on semaphore for at most `ms` milliseconds.
+  **/
+int sem_wait_for_ms(sem_t *sem, long ms) {
+    struct timespec ts;
+    deadline_after_ms(&ts, ms);
+    return sem_wait_until(sem, &ts);
+}
+
+/**
+  * @brief Sleeps while `*word == expected`, at most until absolute `CLOCK_MONOTONIC` deadline.
+  *
+  * @return 0 when woken up or the value already differs, -1 with `errno` set to ETIMEDOUT on timeout.
+  * @note Uses shared (non-private) futex operations, since words live in the shared memory region.
+  **/
+int futex_wait_until(_Atomic(uint32_t) *word, uint32_t expected, const struct timespec *deadline) {
+    long s = syscall(SYS_futex, word, FUTEX_WAIT_BITSET, expected, deadline, NULL, FUTEX_BITSET_MATCH_ANY);
+
+    if (s == -1 && (errno == EAGAIN || errno == EINTR))
+        return 0;                       // Value changed before sleeping or a signal arrived. Caller re-checks.
+
+    return (int)s;
+}
+
+/**
+  * @brief Wakes up all processes sleeping on `word`.
+  **/
+void futex_wake_all(_Atomic(uint32_t) *word) {
+    syscall(SYS_futex, word, FUTEX_WAKE, INT32_MAX, NULL, NULL, 0);
+}
+
+/**
+  * @brief Signals an event on the channel. Wakes parked waiters only when there are any.
+  **/
+void notify_post(notify_t *n) {
+    atomic_store_explicit(&n->stamp, clock_ns(CLOCK_MONOTONIC), memory_order_relaxed);
+    atomic_fetch_add_explicit(&n->seq, 1, memory_order_release);
+
+    if (atomic_load_explicit(&n->parked, memory_order_acquire) > 0)
+        futex_wake_all(&n->seq);
+}
+
+/**
+  * @brief Returns the current event counter of the channel. Pass it as `seen` to `notify_wait`.
+  **/
+uint32_t notify_seq(notify_t *n) {
+    return atomic_load_explicit(&n->seq, memory_order_acquire);
+}
+
+/* True once an event newer than `seen` was posted. */
+static inline bool notify_fired(notify_t *n, uint32_t seen) {
+    return n && atomic_load_explicit(&n->seq, memory_order_acquire) != seen;
+}
+
+/* Parks in the kernel until an event or the deadline. */
+static void park(notify_t *n, uint32_t seen, const struct timespec *deadline) {
+    if (!n) {
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, deadline, NULL) == EINTR)
+            continue;
+        return;
+    }
+
+    atomic_fetch_add_explicit(&n->parked, 1, memory_order_acq_rel);
+    if (!notify_fired(n, seen))
+        futex_wait_until(&n->seq, seen, deadline);
+    atomic_fetch_sub_explicit(&n->parked, 1, memory_order_acq_rel);
+}
+
+/**
+  * @brief Waits until an event newer than `seen` is posted on `n`, or until absolute `CLOCK_MONOTONIC` deadline.
+  *
+  * Strategies:
+  * - `WaitSpin`:       busy loop with CPU pause hint. Lowest wake-up latency, consumes the whole core.
+  * - `WaitSpinYield`:  busy loop for `WAIT_SPIN_NS`, then keeps polling with `sched_yield`.
+  * - `WaitSpinPark`:   busy loop for `WAIT_SPIN_NS`, then parks on the futex.
+  * - `WaitPark`:       parks on the futex immediately. Lowest CPU usage.
+  *
+  * @param n        Channel to watch. When NULL, this is a plain sleep until the deadline with the given strategy.
+  * @param stats    Optional statistics, reported to STDOUT every 10 seconds.
+  * @return 0 when an event arrived, -1 when the deadline has passed.
+  **/
+int notify_wait(notify_t *n, uint32_t seen, wait_strategy_t strategy, const struct timespec *deadline, wait_stats_t *stats) {
+    uint64_t end = ts_ns(deadline), start = clock_ns(CLOCK_MONOTONIC), now = start;
+    uint64_t cpu_start = stats ? clock_ns(CLOCK_THREAD_CPUTIME_ID) : 0;
+    uint32_t i = 0;
+    int fired;
+
+    while (!(fired = notify_fired(n, seen)) && now < end) {
+        bool spinning = strategy == WaitSpin || (strategy != WaitPark && now - start < WAIT_SPIN_NS);
+
+        if (spinning) {
+            cpu_relax();
+        } else if (strategy == WaitSpinYield) {
+            sched_yield();
+        } else {
+            park(n, seen, deadline);
+        }
+
+        // Clock is sampled sparsely while spinning, it costs more than a pause hint.
+        if (!spinning || (++i & 63) == 0)
+            now = clock_ns(CLOCK_MONOTONIC);
+    }
+
+    if (stats) {
+        now = clock_ns(CLOCK_MONOTONIC);
+
+        // Latency is measured from the event post or from the deadline, whichever ended the wait.
+        uint64_t from = fired ? atomic_load_explicit(&n->stamp, memory_order_relaxed) : end;
+        uint64_t latency = now > from ? now - from : 0;
+
+        stats->waits++;
+        stats->events += fired;
+        stats->latency_ns += latency;
+        if (latency > stats->max_latency_ns)
+            stats->max_latency_ns = latency;
+        stats->cpu_ns += clock_ns(CLOCK_THREAD_CPUTIME_ID) - cpu_start;
+
+        if (stats->since == 0)
+            stats->since = start;
+        if (now - stats->since >= WAIT_REPORT_NS) {
+            printf("Wait stats (%s): waits=%u events=%u avg latency=%lu us max latency=%lu us cpu=%.1f%%\n",
+                stats->name, stats->waits, stats->events,
+                (unsigned long)(stats->latency_ns / stats->waits / 1000),
+                (unsigned long)(stats->max_latency_ns / 1000),
+                100.0 * stats->cpu_ns / (now - stats->since));
+
+            const char *name = stats->name;
+            memset(stats, 0, sizeof(*stats));
+            stats->name = name;
+            stats->since = now;
+        }
+    }
+
+    return fired ? 0 : -1;
+}
+
+/**
+  * @brief Counts one wakeup of a periodic actor in `action` state.
+  *
+  * When the state changes, prints time spent in the previous state, wakeups, CPU time and the number of wakeups saved
+  * compared to running at `full_period_us` the whole time.
+  **/
+void duty_account(duty_stats_t *d, current_action_t action) {
+    uint64_t now = clock_ns(CLOCK_MONOTONIC), cpu = clock_ns(CLOCK_THREAD_CPUTIME_ID);
+
+    if (d->since != 0 && action != d->action) {
+        uint64_t elapsed = now - d->since, used = cpu - d->cpu_since;
+        long full = (long)(elapsed / 1000 / d->full_period_us);
+
+        printf("Duty cycle (%s) in state %d: %.2f s, %u wakeups (%.1f/s), cpu %.2f ms (%.3f%%), saved %ld wakeups\n",
+            d->name, d->action, elapsed / 1e9, d->wakeups, d->wakeups * 1e9 / elapsed,
+            used / 1e6, 100.0 * used / elapsed, full > d->wakeups ? full - (long)d->wakeups : 0);
+    }
+
+    if (d->since == 0 || action != d->action) {
+        d->action = action;
+        d->since = now;
+        d->cpu_since = cpu;
+        d->wakeups = 0;
+    }
+
+    d->wakeups++;
+}
+
+/**
+  * @brief Parses wait strategy name (`spin`, `yield`, `spinpark`, `park`).
+  *
+  * @return 0 on success, -1 for unknown names.
+  **/
+int wait_strategy_parse(const char *name, wait_strategy_t *out) {
+    if (strcmp(name, "spin") == 0)          { *out = WaitSpin; return 0; }
+    if (strcmp(name, "yield") == 0)         { *out = WaitSpinYield; return 0; }
+    if (strcmp(name, "spinpark") == 0)      { *out = WaitSpinPark; return 0; }
+    if (strcmp(name, "park") == 0)          { *out = WaitPark; return 0; }
+
+    return -1;
+}
+
+/**
+  * @brief Starts a write of the record guarded by `version`.
+  *
+  * The version is odd until `seqlock_write_end`, readers discard what they copy meanwhile. The release fence keeps
+  * the record stores behind the odd version.
+  **/
+void seqlock_write_begin(_Atomic(uint32_t) *version) {
+    uint32_t v = atomic_load_explicit(version, memory_order_relaxed);
+
+    while ((v & 1) || !atomic_compare_exchange_weak_explicit(version, &v, v + 1,
+            memory_order_acquire, memory_order_relaxed))
+    {
+        if (v & 1) {
+            cpu_relax();
+            v = atomic_load_explicit(version, memory_order_relaxed);
+        }
+    }
+    atomic_thread_fence(memory_order_release);
+}
+
+/**
+  * @brief Ends a write, publishing the record with an even version.
+  **/
+void seqlock_write_end(_Atomic(uint32_t) *version) {
+    atomic_fetch_add_explicit(version, 1, memory_order_release);
+}
+
+/**
+  * @brief Returns the version a copy of the record starts at.
+  **/
+uint32_t seqlock_read_begin(const _Atomic(uint32_t) *version) {
+    return atomic_load_explicit(version, memory_order_acquire);
+}
+
+/**
+  * @brief Tells whether a copy started at version `v` is torn: started during a write or overlapped by one.
+  **/
+bool seqlock_read_retry(const _Atomic(uint32_t) *version, uint32_t v) {
+    atomic_thread_fence(memory_order_acquire);
+    return (v & 1) || atomic_load_explicit(version, memory_order_relaxed) != v;
+}
@@ -0,0 +1,82 @@
+/** 
+  * @file mpsc.c
+  * @brief Bounded lock-free multi-producer single-consumer queue living in shared memory.
+  *
+  * Main tasks:
+  * - Let any actor post fixed size messages without locks (claim cell via CAS, publish via cell sequence).
+  * - Let one consumer drain them in posting order.
+  *
+  * @note
+  *
+  * Each cell carries a sequence number. A cell is free for position `pos` when its sequence equals `pos`, and holds a
+  * message for the consumer when it equals `pos + 1`. The consumer hands the cell to the next lap by setting it to
+  * `pos + MPSC_CAPACITY`. A producer that dies between claiming and publishing a cell stalls the queue until the
+  * main process reinitializes it together with the other locks.
+  **/
+
+#include "proj_types.h"
+
+#define MPSC_MASK   (MPSC_CAPACITY - 1)
+
+_Static_assert((MPSC_CAPACITY & MPSC_MASK) == 0, "MPSC_CAPACITY must be a power of two.");
+
+/**
+  * @brief Initializes empty queue.
+  **/
+void mpsc_init(mpsc_queue_t *q) {
+    for (uint32_t i = 0; i < MPSC_CAPACITY; ++i)
+        atomic_store_explicit(&q->cells[i].seq, i, memory_order_relaxed);
+
+    q->tail = 0;
+    atomic_store_explicit(&q->head, 0, memory_order_release);
+}
+
+/**
+  * @brief Posts message. Safe to call from any number of processes concurrently.
+  *
+  * @return false when the queue is full or the message is too large.
+  **/
+bool mpsc_push(mpsc_queue_t *q, const void *msg, size_t len) {
+    uint32_t pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+    mpsc_cell_t *cell;
+
+    if (len > MPSC_MSG_SIZE)
+        return false;
+
+    for (;;) {
+        cell = &q->cells[pos & MPSC_MASK];
+        int32_t diff = (int32_t)(atomic_load_explicit(&cell->seq, memory_order_acquire) - pos);
+
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&q->head, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed))
+                break;                  // Cell claimed.
+        } else if (diff < 0) {
+            return false;               // Consumer has not released this cell yet. Queue is full.
+        } else {
+            pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+        }
+    }
+
+    memcpy(cell->data, msg, len);
+    atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+
+    return true;
+}
+
+/**
+  * @brief Takes the oldest message. Shall only be called by the single consumer.
+  *
+  * @return false when the queue is empty.
+  **/
+bool mpsc_pop(mpsc_queue_t *q, void *msg, size_t len) {
+    mpsc_cell_t *cell = &q->cells[q->tail & MPSC_MASK];
+
+    if ((int32_t)(atomic_load_explicit(&cell->seq, memory_order_acquire) - (q->tail + 1)) < 0)
+        return false;
+
+    memcpy(msg, cell->data, len < MPSC_MSG_SIZE ? len : MPSC_MSG_SIZE);
+    atomic_store_explicit(&cell->seq, q->tail + MPSC_CAPACITY, memory_order_release);
+    q->tail++;
+
+    return true;
+}
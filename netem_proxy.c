@@ -0,0 +1,768 @@
+/**
+ * @file netem_proxy.c
+ * @brief Userspace network impairment proxy between the operator and drone_sys.
+ *
+ * Main tasks:
+ * - Relay telemetry (TCP and UDP, drone to operator) and flight controller commands (UDP, operator to drone).
+ * - Delay, jitter, lose, reorder, duplicate and rate limit the traffic, separately per direction (`-u`, `-d`).
+ * - Change impairments over time from a script (`-s`) and print per direction statistics, for benchmark runs.
+ *
+ * @note
+ *
+ * The proxy listens on its own IP with the ports of the operator and the drone, which talk to it instead of each
+ * other:
+ *
+ *     operator    <operator_ip> <tp> <proxy_ip> <fp>
+ *     drone_sys   <proxy_ip> <tp> <drone_ip> <fp>
+ *     netem_proxy <proxy_ip> <operator_ip> <tp> <drone_ip> <fp>
+ *
+ * "Up" is drone to operator, "down" is operator to drone. Replies on a UDP relay go back to its last sender.
+ *
+ * Datagrams are impaired like `tc netem` does: each one is dropped with `loss` percent probability, doubled with
+ * `dup`, sent right away with `reorder`, overtaking the delayed ones, or delayed by `delay` +- `jitter` otherwise.
+ * `rate` serializes them before the delay, and tail drops them beyond `PROXY_BACKLOG_US` of queue. A stream is
+ * rather left unread while its direction is that far behind, or holds `PROXY_STREAM_QUEUE` segments like a full
+ * TCP window, so that its sender is slowed down. Datagrams never take the entries the streams may still need, so
+ * neither kind of traffic starves the other.
+ *
+ * A TCP stream cannot lose, reorder nor duplicate bytes, its peers would retransmit and sort them. The proxy
+ * rather emulates what that costs: a lost segment arrives `rto` late and everything behind it waits. The
+ * retransmission is lost again with the `loss` in force at that time, and the next one waits twice as long, so a
+ * partition (`loss=100`) stalls the stream until it ends, like it stalls a real one. Jitter never reorders a stream.
+ */
+
+#include "proj_types.h"
+
+#include <poll.h>
+
+#define PROXY_MTU           1500        // Largest datagram or stream segment relayed.
+#define PROXY_QUEUE         1024        // Packets held at once.
+#define PROXY_STREAM_QUEUE  256         // Stream segments held per direction, the rest of the queue is for datagrams.
+#define PROXY_BACKLOG_US    1000000     // Longest queue behind the rate limit.
+#define PROXY_RETRY_US      1000        // Stream send retry period while the receiver is full.
+#define PROXY_REPORT_S      10
+#define PROXY_SCRIPT_MAX    64
+#define PROXY_RTO_MS        200         // Default retransmission delay of a lost stream segment.
+#define PROXY_RTO_MAX_US    60000000    // Longest retransmission backoff.
+
+// SIGTERM Flag.
+volatile sig_atomic_t sigterm = 0;
+
+/**
+  * @brief Impairment of one direction. Probabilities are in percent.
+  **/
+typedef struct {
+    double delay_ms, jitter_ms, loss, reorder, dup, rto_ms;
+    double rate;                                // Bytes per second, 0 for unlimited.
+} impairment_t;
+
+typedef struct packet packet_t;
+
+/**
+  * @brief One direction: its impairment, its queue state and statistics since the last report.
+  **/
+typedef struct {
+    const char *name;
+    impairment_t imp;
+    uint64_t link_free_us;                      // End of the last serialization at `rate`.
+    uint64_t stream_due_us;                     // Latest due time of a stream segment, streams stay in order.
+    uint64_t stream_backoff_us;                 // Next retransmission delay, 0 when the last one got through.
+    packet_t *stream[PROXY_STREAM_QUEUE];       // Stream segments in order, a ring.
+    int stream_head, stream_len;
+    uint64_t in, sent, lost, duplicated, reordered, overflow, bytes, delay_sum_us, delay_max_us;
+} direction_t;
+
+/**
+  * @brief UDP relay: datagrams received on `fd` go to `target` through `out_fd`, replies go back to `client`.
+  **/
+typedef struct {
+    int fd, out_fd;
+    struct sockaddr_in target, client;
+    bool has_client;
+    direction_t *forward, *back;
+} relay_t;
+
+/**
+  * @brief Packet waiting for its due time.
+  **/
+struct packet {
+    uint64_t due_us, queued_us;
+    uint32_t order;                             // Arrival order, breaks due time ties.
+    bool retransmit;                            // Stream segment that was lost, it is due when retransmitted.
+    int fd;
+    struct sockaddr_in to;
+    direction_t *dir;
+    size_t len, off;
+    uint8_t data[PROXY_MTU];
+};
+
+/**
+  * @brief Scripted impairment change.
+  **/
+typedef struct {
+    uint64_t at_us;
+    bool end;
+    direction_t *dirs[2];
+    impairment_t imp;
+} script_event_t;
+
+static direction_t up = { .name = "up" }, down = { .name = "down" };
+static direction_t *const directions[] = { &up, &down };
+
+/* Datagrams are ordered by due time in a binary min heap, stream segments wait in their direction. */
+static packet_t pool[PROXY_QUEUE];
+static packet_t *heap[PROXY_QUEUE], *free_list[PROXY_QUEUE];
+static int heap_len, free_len;
+static uint32_t order;
+
+/* Telemetry stream: the drone connection and the one opened to the operator for it. */
+static int stream_drone = -1, stream_operator = -1;
+
+static script_event_t script[PROXY_SCRIPT_MAX];
+static int script_len, script_next;
+
+static uint64_t rng;
+
+static uint64_t now_us(void) {
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000ull + t.tv_nsec / 1000;
+}
+
+/**
+  * @brief xorshift64*, uniform in [0, 1).
+  **/
+static double uniform(void) {
+    rng ^= rng >> 12;
+    rng ^= rng << 25;
+    rng ^= rng >> 27;
+    return ((rng * 0x2545F4914F6CDD1Dull) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static bool chance(double percent) {
+    return percent > 0 && uniform() * 100.0 < percent;
+}
+
+/**
+  * @brief Parses an impairment: comma separated `key=value` pairs, or `none`.
+  *
+  * Keys: `delay`, `jitter`, `rto` (ms), `loss`, `reorder`, `dup` (%), `rate` (bytes/s). Missing keys are 0, `rto` is
+  * `PROXY_RTO_MS`.
+  *
+  * @return 0 on success, -1 on malformed value.
+  **/
+static int parse_impairment(char *arg, impairment_t *imp) {
+    char *save = NULL;
+
+    memset(imp, 0, sizeof(*imp));
+    imp->rto_ms = PROXY_RTO_MS;
+    if (strcmp(arg, "none") == 0)
+        return 0;
+
+    for (char *tok = strtok_r(arg, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        char *eq = strchr(tok, '='), *end;
+        double v;
+
+        if (!eq)
+            return -1;
+        *eq = 0;
+        v = strtod(eq + 1, &end);
+        if (eq[1] == 0 || *end != 0 || !(v >= 0))
+            return -1;
+
+        if (strcmp(tok, "delay") == 0)          imp->delay_ms = v;
+        else if (strcmp(tok, "jitter") == 0)    imp->jitter_ms = v;
+        else if (strcmp(tok, "rto") == 0)       imp->rto_ms = v;
+        else if (strcmp(tok, "rate") == 0)      imp->rate = v;
+        else if (v > 100)                       return -1;
+        else if (strcmp(tok, "loss") == 0)      imp->loss = v;
+        else if (strcmp(tok, "reorder") == 0)   imp->reorder = v;
+        else if (strcmp(tok, "dup") == 0)       imp->dup = v;
+        else return -1;
+    }
+
+    return 0;
+}
+
+static void impairment_print(const direction_t *d) {
+    const impairment_t *i = &d->imp;
+
+    printf("%s: delay %.1f ms, jitter %.1f ms, loss %.2f%%, reorder %.2f%%, dup %.2f%%, rate %.0f B/s, rto %.0f ms\n",
+        d->name, i->delay_ms, i->jitter_ms, i->loss, i->reorder, i->dup, i->rate, i->rto_ms);
+}
+
+/**
+  * @brief Loads a script: one `<seconds> <up|down|both> <impairment>` or `<seconds> end` line per change, in time
+  *        order. `#` starts a comment.
+  *
+  * @return 0 on success, -1 on malformed script.
+  **/
+static int script_load(const char *path) {
+    char line[256], dir[16], spec[200];
+    double at, last = 0;
+    int lineno = 0, n;
+    FILE *f = fopen(path, "r");
+
+    if (!f) {
+        perror("fopen(script)");
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), f)) {
+        script_event_t *e = &script[script_len];
+
+        lineno++;
+        line[strcspn(line, "#\n")] = 0;
+        n = sscanf(line, "%lf %15s %199s", &at, dir, spec);
+        if (n <= 0)
+            continue;
+        if (script_len == PROXY_SCRIPT_MAX || n < 2 || at < last)
+            goto _bad;
+        last = at;
+
+        memset(e, 0, sizeof(*e));
+        e->at_us = at * 1e6;
+        if (strcmp(dir, "end") == 0 && n == 2)      e->end = true;
+        else if (n < 3 || parse_impairment(spec, &e->imp) < 0) goto _bad;
+        else if (strcmp(dir, "up") == 0)            e->dirs[0] = &up;
+        else if (strcmp(dir, "down") == 0)          e->dirs[0] = &down;
+        else if (strcmp(dir, "both") == 0)          { e->dirs[0] = &up; e->dirs[1] = &down; }
+        else goto _bad;
+        script_len++;
+    }
+
+    fclose(f);
+    return 0;
+
+_bad:
+    fprintf(stderr, "%s:%d: bad script line.\n", path, lineno);
+    fclose(f);
+    return -1;
+}
+
+static bool before(const packet_t *a, const packet_t *b) {
+    return a->due_us < b->due_us || (a->due_us == b->due_us && (int32_t)(a->order - b->order) < 0);
+}
+
+static void heap_push(packet_t *p) {
+    int i = heap_len++;
+
+    while (i > 0 && before(p, heap[(i - 1) / 2])) {
+        heap[i] = heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    heap[i] = p;
+}
+
+static void heap_pop(void) {
+    packet_t *last = heap[--heap_len];
+    int i = 0;
+
+    free_list[free_len++] = heap[0];
+    for (;;) {
+        int c = 2 * i + 1;
+
+        if (c >= heap_len)
+            break;
+        if (c + 1 < heap_len && before(heap[c + 1], heap[c]))
+            c++;
+        if (!before(heap[c], last))
+            break;
+        heap[i] = heap[c];
+        i = c;
+    }
+    if (heap_len > 0)
+        heap[i] = last;
+}
+
+/**
+  * @brief Queue entries the streams may still take, which datagrams must leave free.
+  **/
+static int stream_reserved(void) {
+    return 2 * PROXY_STREAM_QUEUE - up.stream_len - down.stream_len;
+}
+
+/**
+  * @brief Impairs a received packet and queues its copies, if any, for their due time.
+  *
+  * @param to  Datagram destination, NULL for a segment of the stream on `fd`.
+  **/
+static void enqueue(direction_t *d, int fd, const struct sockaddr_in *to, const uint8_t *data, size_t len) {
+    const impairment_t *i = &d->imp;
+    uint64_t now = now_us(), sent, due;
+    int copies = 1;
+
+    d->in++;
+    if (to && chance(i->loss)) {
+        d->lost++;
+        return;
+    }
+    if (to && chance(i->dup)) {
+        d->duplicated++;
+        copies = 2;
+    }
+
+    while (copies-- > 0) {
+        packet_t *p;
+
+        if (to && free_len <= stream_reserved()) {
+            d->overflow++;
+            return;
+        }
+
+        // Serialization at `rate`, then propagation delay.
+        sent = now;
+        if (i->rate > 0) {
+            if (to && d->link_free_us > now + PROXY_BACKLOG_US) {
+                d->overflow++;
+                return;
+            }
+            sent = (d->link_free_us > now ? d->link_free_us : now) + len * 1e6 / i->rate;
+            d->link_free_us = sent;
+        }
+
+        due = sent + i->delay_ms * 1000;
+        if (i->jitter_ms > 0) {
+            double j = (2 * uniform() - 1) * i->jitter_ms * 1000;
+            due = j < 0 && -j > due - sent ? sent : due + j;
+        }
+
+        p = free_list[--free_len];
+        p->retransmit = false;
+        if (!to) {
+            if (chance(i->loss)) {
+                d->lost++;
+                due += i->rto_ms * 1000;
+                p->retransmit = true;
+            }
+            if (due < d->stream_due_us)
+                due = d->stream_due_us;
+            d->stream_due_us = due;
+        } else if (chance(i->reorder)) {
+            d->reordered++;
+            due = sent;
+        }
+
+        p->due_us = due;
+        p->queued_us = now;
+        p->order = order++;
+        p->fd = fd;
+        if (to)
+            p->to = *to;
+        p->dir = d;
+        p->len = len;
+        p->off = 0;
+        memcpy(p->data, data, len);
+        if (to)
+            heap_push(p);
+        else
+            d->stream[(d->stream_head + d->stream_len++) % PROXY_STREAM_QUEUE] = p;
+    }
+}
+
+static void stream_close(void) {
+    if (stream_drone >= 0) {
+        close(stream_drone);
+        printf("Telemetry stream closed.\n");
+    }
+    if (stream_operator >= 0)
+        close(stream_operator);
+    stream_drone = stream_operator = -1;
+
+    // Segments still queued for it are dropped.
+    for (int i = 0; i < 2; ++i) {
+        direction_t *d = directions[i];
+
+        while (d->stream_len > 0) {
+            free_list[free_len++] = d->stream[d->stream_head];
+            d->stream_head = (d->stream_head + 1) % PROXY_STREAM_QUEUE;
+            d->stream_len--;
+        }
+        d->stream_due_us = d->stream_backoff_us = 0;
+    }
+}
+
+static void account(packet_t *p, uint64_t now) {
+    p->dir->sent++;
+    p->dir->bytes += p->len;
+    p->dir->delay_sum_us += now - p->queued_us;
+    if (now - p->queued_us > p->dir->delay_max_us)
+        p->dir->delay_max_us = now - p->queued_us;
+}
+
+/**
+  * @brief Sends the stream segments of `d` that are due, in order.
+  *
+  * A retransmitted segment is lost again with the current `loss`, and then waits for twice the previous backoff.
+  *
+  * @return Time to try again, 0 when nothing is queued.
+  **/
+static uint64_t stream_dequeue(direction_t *d, uint64_t now) {
+    while (d->stream_len > 0) {
+        packet_t *p = d->stream[d->stream_head];
+        ssize_t n;
+
+        if (p->due_us > now)
+            return p->due_us;
+
+        if (p->retransmit) {
+            if (d->stream_backoff_us == 0)
+                d->stream_backoff_us = 2 * d->imp.rto_ms * 1000;
+            if (chance(d->imp.loss)) {
+                d->lost++;
+                p->due_us = now + d->stream_backoff_us;
+                if (d->stream_backoff_us < PROXY_RTO_MAX_US)
+                    d->stream_backoff_us *= 2;
+                continue;
+            }
+            p->retransmit = false;
+            d->stream_backoff_us = 0;
+        }
+
+        n = send(p->fd, p->data + p->off, p->len - p->off, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return now + PROXY_RETRY_US;
+        if (n < 0) {
+            stream_close();
+            return 0;
+        }
+        p->off += n;
+        if (p->off < p->len)
+            return now + PROXY_RETRY_US;
+
+        account(p, now);
+        free_list[free_len++] = p;
+        d->stream_head = (d->stream_head + 1) % PROXY_STREAM_QUEUE;
+        d->stream_len--;
+    }
+
+    return 0;
+}
+
+/**
+  * @brief Sends every packet that is due.
+  *
+  * @return Time of the next due packet, 0 when there is none.
+  **/
+static uint64_t dequeue(void) {
+    uint64_t now = now_us(), next = 0;
+
+    while (heap_len > 0 && heap[0]->due_us <= now) {
+        packet_t *p = heap[0];
+
+        sendto(p->fd, p->data, p->len, 0, (struct sockaddr *)&p->to, sizeof(p->to));
+        account(p, now);
+        heap_pop();
+    }
+    if (heap_len > 0)
+        next = heap[0]->due_us;
+
+    for (int i = 0; i < 2; ++i) {
+        uint64_t t = stream_dequeue(directions[i], now);
+
+        if (t != 0 && (next == 0 || t < next))
+            next = t;
+    }
+
+    return next;
+}
+
+static void report(direction_t *d, double s) {
+    printf("%s: %lu in, %lu sent, %lu lost, %lu duplicated, %lu reordered, %lu overflowed, %.0f B/s, "
+        "added delay mean %.2f ms, max %.2f ms\n",
+        d->name, (unsigned long)d->in, (unsigned long)d->sent, (unsigned long)d->lost,
+        (unsigned long)d->duplicated, (unsigned long)d->reordered, (unsigned long)d->overflow, d->bytes / s,
+        d->sent ? d->delay_sum_us / 1e3 / d->sent : 0.0, d->delay_max_us / 1e3);
+    d->in = d->sent = d->lost = d->duplicated = d->reordered = d->overflow = d->bytes = 0;
+    d->delay_sum_us = d->delay_max_us = 0;
+}
+
+/**
+  * @brief Opens a UDP socket bound to `ip:port`, port 0 for any.
+  **/
+static int udp_socket(const char *ip, uint16_t port) {
+    struct sockaddr_in a = { .sin_family = AF_INET, .sin_port = htons(port) };
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+
+    if (fd < 0 || inet_pton(AF_INET, ip, &a.sin_addr) <= 0 || bind(fd, (struct sockaddr *)&a, sizeof(a)) < 0) {
+        perror("UDP relay socket");
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+  * @brief Relays one datagram received on `fd` of `r`.
+  **/
+static void relay_receive(relay_t *r, int fd) {
+    static uint8_t buf[65536];
+    struct sockaddr_in from;
+    socklen_t from_len = sizeof(from);
+    ssize_t n = recvfrom(fd, buf, sizeof(buf), MSG_DONTWAIT, (struct sockaddr *)&from, &from_len);
+
+    if (n < 0)
+        return;
+    if ((size_t)n > PROXY_MTU) {
+        (fd == r->fd ? r->forward : r->back)->overflow++;
+        return;
+    }
+
+    if (fd == r->fd) {
+        r->client = from;
+        r->has_client = true;
+        enqueue(r->forward, r->out_fd, &r->target, buf, n);
+    } else if (r->has_client) {
+        enqueue(r->back, r->fd, &r->client, buf, n);
+    }
+}
+
+/**
+  * @brief Tells whether a stream segment of direction `d` can be queued now. Otherwise the stream is left unread and
+  *        TCP flow control slows its sender down: a stream never loses bytes to a full queue.
+  *
+  * @param wake Lowered to the time the rate limit backlog of `d` gets short enough again.
+  **/
+static bool stream_room(const direction_t *d, uint64_t now, uint64_t *wake) {
+    if (d->stream_len == PROXY_STREAM_QUEUE)
+        return false;
+    if (d->imp.rate > 0 && d->link_free_us > now + PROXY_BACKLOG_US) {
+        if (d->link_free_us - PROXY_BACKLOG_US < *wake)
+            *wake = d->link_free_us - PROXY_BACKLOG_US;
+        return false;
+    }
+    return true;
+}
+
+/**
+  * @brief Relays what is readable on `from` into the stream `to`.
+  **/
+static void stream_receive(int from, int to, direction_t *d) {
+    uint8_t buf[PROXY_MTU];
+    ssize_t n = read(from, buf, sizeof(buf));
+
+    if (n <= 0) {
+        stream_close();
+        return;
+    }
+    enqueue(d, to, NULL, buf, n);
+}
+
+static void sigterm_handler(int sig) {
+    (void)sig;
+    sigterm = 1;
+}
+
+/**
+  * @brief Proxy entry point.
+  *
+  * Does the following:
+  * - Parses impairments, the script and the addresses.
+  * - Opens the telemetry TCP listener and both UDP relays.
+  * - Relays traffic until SIGTERM or the end of the script.
+  **/
+int main(int argc, char **argv) {
+    struct sigaction sa;
+    struct sockaddr_in tel_addr = { .sin_family = AF_INET }, op_addr = { .sin_family = AF_INET };
+    relay_t relays[2] = { { .forward = &up, .back = &down }, { .forward = &down, .back = &up } };
+    int listen_fd = -1, opt, ret = 0, reuse = 1;
+    uint64_t start, last_report, wake, next;
+    char *end;
+
+    rng = now_us() | 1;
+    for (int i = 0; i < PROXY_QUEUE; ++i)
+        free_list[free_len++] = &pool[i];
+    for (int i = 0; i < 2; ++i)
+        relays[i].fd = relays[i].out_fd = -1;
+    parse_impairment("none", &up.imp);
+    parse_impairment("none", &down.imp);
+
+    while ((opt = getopt(argc, argv, "u:d:s:r:")) != -1) {
+        switch (opt) {
+            case 'u':
+            case 'd':
+                if (parse_impairment(optarg, opt == 'u' ? &up.imp : &down.imp) < 0) {
+                    fprintf(stderr, "Bad impairment.\n");
+                    goto _usage;
+                }
+                break;
+            case 's':
+                if (script_load(optarg) < 0)
+                    goto _usage;
+                break;
+            case 'r':
+                rng = strtoull(optarg, &end, 10);
+                if (*optarg == 0 || *end != 0 || rng == 0) {
+                    fprintf(stderr, "Bad seed.\n");
+                    goto _usage;
+                }
+                break;
+            default:
+                goto _usage;
+        }
+    }
+
+    if (argc - optind < 5) {
+_usage:
+        fprintf(stderr, "Usage: %s [-u impairment] [-d impairment] [-s script] [-r seed] <proxy_ip> <operator_ip> "
+            "<telemetry_port> <drone_ip> <flight_ctrl_port>\n"
+            "Impairment: none or key=value,... with delay, jitter, rto (ms), loss, reorder, dup (%%), rate (B/s).\n"
+            "Script lines: <seconds> <up|down|both> <impairment> or <seconds> end.\n", argv[0]);
+        return 1;
+    }
+    argv += optind - 1;     // Positional arguments start at argv[1].
+
+    if (inet_pton(AF_INET, argv[1], &tel_addr.sin_addr) <= 0 || inet_pton(AF_INET, argv[2], &op_addr.sin_addr) <= 0) {
+        fprintf(stderr, "Bad proxy or operator IP.\n");
+        return 1;
+    }
+    tel_addr.sin_port = op_addr.sin_port = htons(atoi(argv[3]));
+
+    // Telemetry TCP, from the drone to the operator.
+    listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (listen_fd < 0 ||
+        setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) < 0 ||
+        bind(listen_fd, (struct sockaddr *)&tel_addr, sizeof(tel_addr)) < 0 ||
+        listen(listen_fd, 1) < 0)
+    {
+        perror("Telemetry TCP listener");
+        ret = 1;
+        goto _shutdown;
+    }
+
+    // Telemetry UDP, from the drone to the operator, and commands, from the operator to the drone.
+    relays[0].target = op_addr;
+    relays[1].target.sin_family = AF_INET;
+    relays[1].target.sin_port = htons(atoi(argv[5]));
+    if (inet_pton(AF_INET, argv[4], &relays[1].target.sin_addr) <= 0) {
+        fprintf(stderr, "Bad drone IP.\n");
+        ret = 1;
+        goto _shutdown;
+    }
+    if ((relays[0].fd = udp_socket(argv[1], atoi(argv[3]))) < 0 ||
+        (relays[0].out_fd = udp_socket(argv[1], 0)) < 0 ||
+        (relays[1].fd = udp_socket(argv[1], atoi(argv[5]))) < 0 ||
+        (relays[1].out_fd = udp_socket(argv[1], 0)) < 0)
+    {
+        ret = 1;
+        goto _shutdown;
+    }
+
+    sa.sa_handler = sigterm_handler;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = 0;
+    if (sigaction(SIGTERM, &sa, NULL) == -1 || sigaction(SIGINT, &sa, NULL) == -1) {
+        perror("sigaction");
+        ret = 1;
+        goto _shutdown;
+    }
+
+    printf("Relaying %s:%s <-> %s (telemetry), %s:%s <-> %s (commands).\n",
+        argv[1], argv[3], argv[2], argv[1], argv[5], argv[4]);
+    impairment_print(&up);
+    impairment_print(&down);
+
+    start = last_report = now_us();
+    while (!sigterm) {
+        struct pollfd pfd[7];
+        struct timespec timeout;
+        int nfds = 0;
+        uint64_t now;
+
+        // Scripted changes, in time order.
+        now = now_us();
+        while (script_next < script_len && script[script_next].at_us <= now - start) {
+            script_event_t *e = &script[script_next++];
+
+            if (e->end) {
+                sigterm = 1;
+                break;
+            }
+            for (int i = 0; i < 2 && e->dirs[i]; ++i) {
+                e->dirs[i]->imp = e->imp;
+                impairment_print(e->dirs[i]);
+            }
+        }
+
+        if (now - last_report >= PROXY_REPORT_S * 1000000ull) {
+            report(&up, (now - last_report) / 1e6);
+            report(&down, (now - last_report) / 1e6);
+            last_report = now;
+        }
+
+        next = dequeue();
+        wake = last_report + PROXY_REPORT_S * 1000000ull;
+        if (next && next < wake)
+            wake = next;
+        if (script_next < script_len && start + script[script_next].at_us < wake)
+            wake = start + script[script_next].at_us;
+
+        // Streams are only read while a segment can be queued, so that they are slowed down rather than cut.
+        pfd[nfds++] = (struct pollfd){ .fd = listen_fd, .events = POLLIN };
+        for (int i = 0; i < 2; ++i) {
+            pfd[nfds++] = (struct pollfd){ .fd = relays[i].fd, .events = POLLIN };
+            pfd[nfds++] = (struct pollfd){ .fd = relays[i].out_fd, .events = POLLIN };
+        }
+        now = now_us();
+        pfd[nfds++] = (struct pollfd){ .fd = stream_drone, .events = stream_room(&up, now, &wake) ? POLLIN : 0 };
+        pfd[nfds++] = (struct pollfd){ .fd = stream_operator, .events = stream_room(&down, now, &wake) ? POLLIN : 0 };
+
+        timeout.tv_sec = wake > now ? (wake - now) / 1000000 : 0;
+        timeout.tv_nsec = wake > now ? (wake - now) % 1000000 * 1000 : 0;
+        if (ppoll(pfd, nfds, &timeout, NULL) < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("ppoll");
+            ret = 1;
+            break;
+        }
+
+        // A new drone connection replaces the previous one.
+        if (pfd[0].revents & POLLIN) {
+            int fd = accept(listen_fd, NULL, NULL);
+
+            if (fd >= 0) {
+                stream_close();
+                stream_drone = fd;
+                stream_operator = socket(AF_INET, SOCK_STREAM, 0);
+                if (stream_operator < 0 || connect(stream_operator, (struct sockaddr *)&op_addr, sizeof(op_addr)) < 0) {
+                    perror("Telemetry connect to operator");
+                    stream_close();
+                } else {
+                    printf("Telemetry stream connected.\n");
+                }
+            }
+        }
+
+        for (int i = 0; i < 2; ++i) {
+            if (pfd[1 + 2 * i].revents & POLLIN)
+                relay_receive(&relays[i], relays[i].fd);
+            if (pfd[2 + 2 * i].revents & POLLIN)
+                relay_receive(&relays[i], relays[i].out_fd);
+        }
+
+        if (stream_drone >= 0 && (pfd[5].revents & (POLLIN | POLLHUP | POLLERR)))
+            stream_receive(stream_drone, stream_operator, &up);
+        if (stream_operator >= 0 && (pfd[6].revents & (POLLIN | POLLHUP | POLLERR)))
+            stream_receive(stream_operator, stream_drone, &down);
+    }
+
+    report(&up, (now_us() - last_report) / 1e6);
+    report(&down, (now_us() - last_report) / 1e6);
+
+_shutdown:
+    stream_close();
+    for (int i = 0; i < 2; ++i) {
+        if (relays[i].fd >= 0)
+            close(relays[i].fd);
+        if (relays[i].out_fd >= 0)
+            close(relays[i].out_fd);
+    }
+    if (listen_fd >= 0)
+        close(listen_fd);
+
+    printf("Proxy stopped.\n");
+    return ret;
+}
@@ -0,0 +1,91 @@
+/**
+  * @file nmea.c
+  * @brief Formats NMEA 0183 sentences of a simulated GPS fix.
+  *
+  * Main tasks:
+  * - Convert a world frame position (see `truth_t`) into latitude, longitude and altitude.
+  * - Format GGA, GSA, RMC and VTG sentences with their checksum, for the GPS actor (gps_ctrl.c) and the batch
+  *   simulator (swarm.c).
+  *
+  * @note
+  *
+  * The world frame origin (takeoff point) is anchored at `ORIGIN_LAT`, `ORIGIN_LON` and `ORIGIN_ALT`. Positions are
+  * quantized by the NMEA format itself (0.001 minute, about 2 m).
+  **/
+
+#include "proj_types.h"
+
+#define ORIGIN_LAT          48.1173         // Degrees north.
+#define ORIGIN_LON          11.516667       // Degrees east.
+#define ORIGIN_ALT          545.4           // Meters above mean sea level.
+#define EARTH_RADIUS        6371000.0
+#define MAG_VARIATION       3.1             // Degrees west.
+#define MS_TO_KNOTS         1.943844
+#define NMEA_SUFFIX_SIZE    5               // "*hh\n" and the terminating NUL.
+
+/**
+  * @brief Formats `deg` as NMEA `(d)ddmm.mmm,H`.
+  **/
+static int nmea_coord(char *buf, size_t size, double deg, int width, char pos, char neg) {
+    double a = fabs(deg);
+    int d = (int)a;
+
+    return snprintf(buf, size, "%0*d%06.3f,%c", width, d, (a - d) * 60.0, deg < 0 ? neg : pos);
+}
+
+/**
+  * @brief Formats sentence `kind` of a fix at `pos` moving at `vel` (world frame) into `buf`, with its checksum. Time
+  *        and date are the current UTC ones.
+  *
+  * @return Sentence length, 0 when it does not fit in `size` bytes (`buf` is then left empty).
+  **/
+size_t nmea_format(char *buf, size_t size, nmea_kind_t kind, const float pos[3], const float vel[3]) {
+    char lat[32], lon[32], hms[8], date[8];
+    double north = pos[1], east = pos[0];
+    double speed = hypot(vel[0], vel[1]) * MS_TO_KNOTS;
+    double course = fmod(atan2(vel[0], vel[1]) * 180.0 / M_PI + 360.0, 360.0);
+    struct timespec now;
+    struct tm utc;
+    uint8_t sum = 0;
+    int len = 0;
+
+    nmea_coord(lat, sizeof(lat), ORIGIN_LAT + north / EARTH_RADIUS * 180.0 / M_PI, 2, 'N', 'S');
+    nmea_coord(lon, sizeof(lon), ORIGIN_LON + east / (EARTH_RADIUS * cos(ORIGIN_LAT * M_PI / 180.0)) * 180.0 / M_PI,
+        3, 'E', 'W');
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    gmtime_r(&now.tv_sec, &utc);
+    strftime(hms, sizeof(hms), "%H%M%S", &utc);
+    strftime(date, sizeof(date), "%d%m%y", &utc);
+
+    switch (kind) {
+        case NmeaGGA:
+            len = snprintf(buf, size, "$GPGGA,%s,%s,%s,1,08,0.9,%.1f,M,46.9,M,,", hms, lat, lon, ORIGIN_ALT + pos[2]);
+            break;
+        case NmeaGSA:
+            len = snprintf(buf, size, "$GPGSA,A,3,04,05,09,12,24,25,29,30,31,,,1.8,1.0,1.5");
+            break;
+        case NmeaRMC:
+            len = snprintf(buf, size, "$GPRMC,%s,A,%s,%s,%05.1f,%05.1f,%s,%05.1f,W", hms, lat, lon, speed, course,
+                date, MAG_VARIATION);
+            break;
+        default:
+            len = snprintf(buf, size, "$GPVTG,%05.1f,T,%05.1f,M,%05.1f,N,%05.1f,K", course,
+                fmod(course + MAG_VARIATION, 360.0), speed, speed * 1.852);
+            break;
+    }
+
+    // A truncated sentence is useless to a receiver, and `size - len` would wrap below.
+    if (len < 0 || (size_t)len + NMEA_SUFFIX_SIZE > size) {
+        if (size > 0)
+            buf[0] = '\0';
+        return 0;
+    }
+
+    // Checksum: XOR of everything between `$` and `*`.
+    for (int i = 1; i < len; ++i)
+        sum ^= (uint8_t)buf[i];
+    len += snprintf(buf + len, size - len, "*%02X\n", sum);
+
+    return len;
+}
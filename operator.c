@@ -3,15 +3,85 @@
  * @brief Operator console application for communicating with the drone.
  *
  * Main tasks:
- * - Telemetry: TCP server on operator side.
+ * - Telemetry: TCP server on operator side. Decodes text and binary (delta, LZ4) frames.
+ * - Telemetry: UDP receiver on the same port. Tracks loss, reordering and latency, restores lost datagrams from parity
+ *   and reassembles fragmented frames.
+ * - Telemetry: joins multicast groups (`-m`), so any number of operators receive one drone stream.
  * - Flight controller: UDP command sender
+ * - Telemetry subscription: per channel rate and on change threshold, sent over the command channel.
+ * - Link heartbeat: sent to the flight controller every `-b` ms, which lands the drone when they stop. Telemetry
+ *   silent for `-l` ms flags the link stale.
+ * - Drone clock: estimates its offset and drift from the heartbeat echoes (see clock_sync.c) and reports the age of
+ *   frames and alerts in operator time, with an error bound.
+ * - Backfill: on each telemetry connection, and when UDP telemetry comes back after a silence, asks the drone to
+ *   replay the frames after the last one received. Reports how long it took to catch up.
+ * - Fleet: with `-w`, serves any number of drones on worker threads instead of this single drone console (see
+ *   fleet.c).
+ * - Dashboard: with `-g`, streams the telemetry of this drone, or of the fleet, to web browsers (see dashboard.c).
  */
 
 #include "proj_types.h"
 
+#define LINK_REPORT_S   10
+#define OPERATOR_GROUPS 4       // Multicast groups joined at most.
+
 // SIGTERM Flag.
 volatile sig_atomic_t sigterm = 0;
 
+/* Telemetry stream of the current connection. */
+static uint8_t rx[2 * (TLM_HEADER_SIZE + TLM_PAYLOAD_MAX)];
+static size_t rx_len;
+static int binary = -1;                 // Encoding is unknown until the first byte arrives.
+static tlm_decoder_t decoder;
+
+/**
+  * @brief One UDP telemetry stream: unicast to the operator address or one joined multicast group. Every frame is
+  *        decodable alone.
+  **/
+typedef struct {
+    int fd;
+    char name[INET_ADDRSTRLEN];
+    dgram_rx_t rx;
+    tlm_decoder_t decoder;
+    struct { uint64_t expected, received, reordered, duplicates, restored; } since;   // At the last link report.
+} udp_stream_t;
+
+static udp_stream_t udp[1 + OPERATOR_GROUPS];
+static int udp_len;
+static uint64_t udp_count, udp_sum_us, udp_max_us;
+
+/* Received since the last link report. */
+static uint64_t link_bytes, link_records;
+static struct timespec link_since;
+
+/* Alert delivery latency and frame age since the last link report. Drone stamps use its CLOCK_MONOTONIC, they are
+ * translated with the drone clock estimate, or taken as they are (same host) until there is one. */
+static uint64_t alert_count, alert_sum_us, alert_max_us;
+static uint64_t frame_sum_us, frame_max_us;
+static clock_sync_t drone_clock;
+
+/* Link liveness. Any telemetry byte counts, the drone sends heartbeats when it has nothing else to send. */
+static uint64_t heartbeat_us = 100000, stale_us = 500000;
+static uint64_t last_heard_us, next_beat_us;
+static uint32_t beat_seq;
+static bool link_stale = false;
+
+/* Backfill. The last live frame tells the drone where to resume, a new operator asks for the whole history. */
+static uint32_t last_seq;
+static bool have_seq = false;
+static struct {
+    bool waiting, have_live, have_history;
+    uint32_t from, live_first, first, last, count;
+    uint64_t since_us;
+} backfill;
+
+/* Drone id from its hello, 0 until then. */
+static uint32_t drone_id;
+
+/* Subscription requested with `sub`. Resent on each telemetry connection, a restarted drone starts from defaults. */
+static tlm_subscription_t subscription;
+static bool subscribed = false;
+
 /**
   * @brief Converts obtained string to lower case.
   **/
@@ -35,14 +105,380 @@ static int get_action_from_cmd(const char *cmd, current_action_t *out_action) {
 
     str_tolower(tmp);
 
-    if (strcmp(tmp, "samplegps") == 0) { *out_action = SampleGPS; return 1; }
-    if (strcmp(tmp, "fly") == 0)       { *out_action = Fly; return 1; }
-    if (strcmp(tmp, "land") == 0)      { *out_action = Land; return 1; }
-    if (strcmp(tmp, "idle") == 0)      { *out_action = Idle; return 1; }
-    if (strcmp(tmp, "charge") == 0)    { *out_action = Charge; return 1; }
-    if (strcmp(tmp, "abort") == 0)     { *out_action = Abort; return 1; }
+    return tlm_action_parse(tmp, out_action) == 0;
+}
+
+/**
+  * @brief Sends the current subscription to the flight controller.
+  **/
+static void subscription_send(int udp_fd, const struct sockaddr_in *fc_addr) {
+    uint8_t frame[TLM_SUBSCRIBE_MAX];
+    size_t len = tlm_subscribe(&subscription, frame);
+
+    if (sendto(udp_fd, frame, len, 0, (const struct sockaddr *)fc_addr, sizeof(*fc_addr)) != (ssize_t)len) {
+        perror("sendto");
+        return;
+    }
+
+    printf("Sent telemetry subscription via UDP (%zu bytes):", len);
+    for (int i = 0; i < TlmChannels; ++i) {
+        if (subscription.interval_us[i] == 0 && subscription.threshold[i] == 0)
+            printf(" %s=off", tlm_channel_name(i));
+        else
+            printf(" %s=%uus/%g", tlm_channel_name(i), subscription.interval_us[i], subscription.threshold[i]);
+    }
+    printf("\n");
+}
+
+/**
+  * @brief Parses `sub <channel|all> <rate_hz> [threshold]` into the subscription.
+  *
+  * Rate 0 sends the channel only when it moved more than the threshold, rate and threshold 0 unsubscribes it.
+  *
+  * @return 1 on success, 0 when `cmd` is not a subscription, -1 when it is malformed.
+  **/
+static int get_subscription_from_cmd(const char *cmd) {
+    char name[16];
+    double hz;
+    float threshold = 0.0f;
+    int n, ch;
+
+    if (strncmp(cmd, "sub", 3) != 0 || !isspace((unsigned char)cmd[3]))
+        return 0;
+
+    n = sscanf(cmd + 3, "%15s %lf %f", name, &hz, &threshold);
+    // Intervals are whole microseconds on 32 bits: rates below one per `UINT32_MAX` us are out of range too.
+    if (n < 2 || !(hz >= 0 && hz <= 1000000) || (hz > 0 && 1000000 / hz > UINT32_MAX)
+        || !(threshold >= 0 && threshold < INFINITY))
+        return -1;
+
+    str_tolower(name);
+    for (ch = 0; ch < TlmChannels; ++ch)
+        if (strcmp(name, tlm_channel_name(ch)) == 0)
+            break;
+    if (ch == TlmChannels && strcmp(name, "all") != 0)
+        return -1;
+
+    for (int i = 0; i < TlmChannels; ++i) {
+        if (i == ch || ch == TlmChannels) {
+            subscription.interval_us[i] = hz > 0 ? (uint32_t)(1000000 / hz) : 0;
+            subscription.threshold[i] = threshold;
+        }
+    }
+    return 1;
+}
+
+static uint64_t now_us(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000ull + now.tv_nsec / 1000;
+}
+
+/**
+  * @brief Time elapsed since drone time `drone_us`, in operator time. Within the clock error bound, so never negative.
+  **/
+static uint64_t drone_age(uint64_t drone_us) {
+    uint64_t now = now_us(), local;
+
+    if (!clock_sync_local(&drone_clock, drone_us, &local))
+        local = drone_us;
+    return (int64_t)(now - local) > 0 ? now - local : 0;
+}
+
+/**
+  * @brief Feeds a heartbeat echo to the drone clock estimate.
+  **/
+static void on_heartbeat(const tlm_heartbeat_t *h, void *arg) {
+    (void)arg;
+    if (h->echo_ts_us != 0)
+        clock_sync_sample(&drone_clock, h->echo_ts_us, h->echo_rx_us, h->ts_us, now_us());
+}
+
+/**
+  * @brief Prints which drone the stream comes from, once.
+  **/
+static void on_hello(const tlm_hello_t *h, void *arg) {
+    (void)arg;
+    if (h->id != drone_id)
+        printf("Drone %u says hello, flight controller port %u.\n", h->id, h->flight_ctrl_port);
+    drone_id = h->id;
+}
+
+/**
+  * @brief Asks the drone to replay every frame after the last one received.
+  **/
+static void resume_send(int udp_fd, const struct sockaddr_in *fc_addr) {
+    uint8_t frame[TLM_RESUME_SIZE];
+    uint32_t from = have_seq ? last_seq + 1 : 0;
+
+    if (sendto(udp_fd, frame, tlm_resume(from, frame), 0, (const struct sockaddr *)fc_addr, sizeof(*fc_addr)) < 0) {
+        perror("sendto(resume)");
+        return;
+    }
+
+    printf("Requested telemetry backfill from seq %u.\n", from);
+    memset(&backfill, 0, sizeof(backfill));
+    backfill.waiting = true;
+    backfill.from = from;
+    backfill.since_us = now_us();
+}
+
+/**
+  * @brief Reports the backfill once it reached the first live frame received after the request.
+  **/
+static void backfill_check(void) {
+    if (!backfill.waiting || !backfill.have_live)
+        return;
+    if ((int32_t)(backfill.live_first - backfill.from) > 0 &&
+        (!backfill.have_history || (int32_t)(backfill.last + 1 - backfill.live_first) < 0))
+    {
+        return;
+    }
+
+    backfill.waiting = false;
+    if (!backfill.have_history) {
+        printf("Backfill: nothing missing.\n");
+        return;
+    }
+    printf("Backfill caught up %lu ms after the request: %u frames, seq %u to %u",
+        (unsigned long)((now_us() - backfill.since_us) / 1000), backfill.count, backfill.first, backfill.last);
+    if ((int32_t)(backfill.first - backfill.from) > 0)
+        printf(", %u older frames were gone", backfill.first - backfill.from);
+    printf(".\n");
+}
+
+/**
+  * @brief Prints a decoded binary frame exactly like a text one.
+  **/
+static void print_record(const tlm_record_t *r, uint32_t seq, uint64_t ts_us, void *arg) {
+    char text[TLM_TEXT_MAX];
+    uint64_t latency = drone_age(ts_us);
+
+    (void)arg;
+    if (!have_seq || (int32_t)(seq - last_seq) > 0)
+        last_seq = seq;
+    have_seq = true;
+    if (backfill.waiting && !backfill.have_live) {
+        backfill.have_live = true;
+        backfill.live_first = seq;
+    }
+
+    printf("[TELEMETRY] {\n%.*s}\n", (int)tlm_text(r, text), text);
+    dash_record(drone_id, r, seq, ts_us);
+    link_records++;
+    frame_sum_us += latency;
+    if (latency > frame_max_us)
+        frame_max_us = latency;
+    backfill_check();
+}
+
+/**
+  * @brief Prints a replayed frame with its sequence number. Its age is not a latency, it is left out of the stats.
+  *
+  * Over UDP the drone replays up to its latest frame, the ones from the first live frame on were already printed.
+  **/
+static void print_history(const tlm_record_t *r, uint32_t seq, uint64_t ts_us, void *arg) {
+    char text[TLM_TEXT_MAX];
+
+    (void)ts_us; (void)arg;
+    if (backfill.have_live && (int32_t)(seq - backfill.live_first) >= 0)
+        return;
+    printf("[HISTORY #%u] {\n%.*s}\n", seq, (int)tlm_text(r, text), text);
+    link_records++;
+
+    if (!backfill.have_history)
+        backfill.first = seq;
+    backfill.have_history = true;
+    backfill.last = seq;
+    backfill.count++;
+    backfill_check();
+}
+
+/**
+  * @brief Prints a decoded alert exactly like a text one, with its delivery latency.
+  **/
+static void print_alert(const alert_t *a, uint32_t seq, void *arg) {
+    char text[TLM_ALERT_MAX];
+    uint64_t latency = drone_age(a->stamp_us);
+
+    (void)arg;
+    printf("[TELEMETRY] {\n%.*s}\n", (int)tlm_alert(a, seq, true, (uint8_t *)text), text);
+    dash_alert(drone_id, a, seq);
+    if (drone_clock.valid)
+        printf("Alert #%u (%s) delivered %lu +- %lu us after it was raised.\n", seq, alert_name(a->kind),
+            (unsigned long)latency, (unsigned long)drone_clock.error_us);
+    else
+        printf("Alert #%u (%s) delivered %lu us after it was raised.\n", seq, alert_name(a->kind),
+            (unsigned long)latency);
+
+    alert_count++;
+    alert_sum_us += latency;
+    if (latency > alert_max_us)
+        alert_max_us = latency;
+}
+
+/**
+  * @brief Consumes all whole frames at the start of `rx`.
+  *
+  * @return -1 on a malformed stream.
+  **/
+static int drain_frames(void) {
+    static const tlm_sink_t sink = {
+        .record = print_record, .alert = print_alert, .heartbeat = on_heartbeat, .history = print_history,
+        .hello = on_hello,
+    };
+    size_t off = 0;
+    int len, ret = 0;
+
+    while ((len = tlm_frame_len(rx + off, rx_len - off)) > 0) {
+        if (tlm_decode(&decoder, rx + off, len, &sink) < 0)
+            break;
+        off += len;
+    }
+    if (len != 0)
+        ret = -1;
+
+    memmove(rx, rx + off, rx_len - off);
+    rx_len -= off;
+    return ret;
+}
+
+/**
+  * @brief Handles one frame received over UDP, text or binary.
+  **/
+static void udp_deliver(const uint8_t *frame, size_t len, uint64_t ts_us, bool restored, void *arg) {
+    static const tlm_sink_t sink = {
+        .record = print_record, .alert = print_alert, .heartbeat = on_heartbeat, .history = print_history,
+        .hello = on_hello,
+    };
+    udp_stream_t *stream = arg;
+    uint64_t latency = drone_age(ts_us);
+
+    udp_count++;
+    udp_sum_us += latency;
+    if (latency > udp_max_us)
+        udp_max_us = latency;
+
+    if (restored)
+        printf("Datagram restored from parity.\n");
+
+    if (len > 0 && frame[0] == TLM_MAGIC) {
+        if (tlm_frame_len(frame, len) != (int)len || tlm_decode(&stream->decoder, frame, len, &sink) < 0)
+            fprintf(stderr, "Malformed telemetry frame.\n");
+    } else {
+        printf("[TELEMETRY] {\n%.*s}\n", (int)len, (const char *)frame);
+        link_records++;
+    }
+}
+
+/**
+  * @brief Records that the drone was heard from.
+  *
+  * @return true on the first contact and when the link was stale.
+  **/
+static bool link_heard(void) {
+    uint64_t now = now_us();
+    bool back = link_stale || last_heard_us == 0;
+
+    if (link_stale)
+        printf("Telemetry link restored after %lu ms of silence.\n", (unsigned long)((now - last_heard_us) / 1000));
+    link_stale = false;
+    last_heard_us = now;
+    return back;
+}
 
-    return 0;
+/**
+  * @brief Sends due heartbeats and flags a stale link.
+  *
+  * @return Time until the next deadline, for `select`.
+  **/
+static struct timeval link_check(int udp_fd, const struct sockaddr_in *fc_addr) {
+    uint64_t now = now_us(), wake = UINT64_MAX;
+    uint8_t beat[TLM_HEARTBEAT_MAX];
+    size_t len;
+
+    if (heartbeat_us > 0) {
+        if (now >= next_beat_us) {
+            len = tlm_heartbeat(&(tlm_heartbeat_t){ .seq = beat_seq++, .ts_us = now }, false, beat);
+            if (sendto(udp_fd, beat, len, 0, (const struct sockaddr *)fc_addr, sizeof(*fc_addr)) != (ssize_t)len)
+                perror("sendto(heartbeat)");
+            next_beat_us = now - next_beat_us < heartbeat_us ? next_beat_us + heartbeat_us : now + heartbeat_us;
+        }
+        wake = next_beat_us;
+    }
+
+    // Only once the drone was heard from at all.
+    if (stale_us > 0 && last_heard_us > 0 && !link_stale) {
+        if (now - last_heard_us >= stale_us) {
+            link_stale = true;
+            printf("Telemetry link stale: nothing received for %lu ms.\n", (unsigned long)((now - last_heard_us) / 1000));
+        } else if (last_heard_us + stale_us < wake) {
+            wake = last_heard_us + stale_us;
+        }
+    }
+
+    if (wake == UINT64_MAX)
+        wake = now + 1000000;
+    return (struct timeval){ .tv_sec = (wake - now) / 1000000, .tv_usec = (wake - now) % 1000000 };
+}
+
+/**
+  * @brief Prints received bandwidth once per `LINK_REPORT_S`.
+  **/
+static void link_report(void) {
+    struct timespec now;
+    double s;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (link_since.tv_sec == 0)
+        link_since = now;
+    if (now.tv_sec - link_since.tv_sec < LINK_REPORT_S)
+        return;
+
+    s = (now.tv_sec - link_since.tv_sec) + (now.tv_nsec - link_since.tv_nsec) / 1e9;
+    printf("Telemetry link (%s): %.0f B/s, %.1f frames/s\n",
+        udp_count ? "udp" : binary ? "binary" : "text", link_bytes / s, link_records / s);
+    if (drone_clock.valid)
+        printf("Drone clock: offset %+.0f us, drift %+.2f ppm, error bound %lu us, %u bins fitted, "
+            "%lu samples, %lu rejected\n", drone_clock.offset_us, drone_clock.drift * 1e6,
+            (unsigned long)drone_clock.error_us, drone_clock.fitted, (unsigned long)drone_clock.samples,
+            (unsigned long)drone_clock.rejected);
+    else
+        printf("Drone clock: not estimated yet, latencies assume a shared clock\n");
+    if (binary && link_records)
+        printf("Frames latency mean %lu us, max %lu us\n",
+            (unsigned long)(frame_sum_us / link_records), (unsigned long)frame_max_us);
+    for (int i = 0; i < udp_len; ++i) {
+        udp_stream_t *u = &udp[i];
+        uint64_t expected = u->rx.expected - u->since.expected;
+        uint64_t received = u->rx.received - u->since.received;
+
+        if (received == 0)
+            continue;
+        printf("UDP datagrams (%s): %lu expected, %.2f%% lost, %lu reordered, %lu duplicates, %lu restored by FEC\n",
+            u->name, (unsigned long)expected, expected > received ? 100.0 * (expected - received) / expected : 0.0,
+            (unsigned long)(u->rx.reordered - u->since.reordered),
+            (unsigned long)(u->rx.duplicates - u->since.duplicates),
+            (unsigned long)(u->rx.restored - u->since.restored));
+        u->since.expected = u->rx.expected;
+        u->since.received = u->rx.received;
+        u->since.reordered = u->rx.reordered;
+        u->since.duplicates = u->rx.duplicates;
+        u->since.restored = u->rx.restored;
+    }
+    if (udp_count) {
+        printf("UDP frames latency mean %lu us, max %lu us\n",
+            (unsigned long)(udp_sum_us / udp_count), (unsigned long)udp_max_us);
+        udp_count = udp_sum_us = udp_max_us = 0;
+    }
+    if (decoder.skipped)
+        printf("Telemetry deltas skipped while out of sync: %u\n", decoder.skipped);
+    if (alert_count)
+        printf("Alerts: %lu, latency mean %lu us, max %lu us\n", (unsigned long)alert_count,
+            (unsigned long)(alert_sum_us / alert_count), (unsigned long)alert_max_us);
+    link_bytes = link_records = alert_count = alert_sum_us = alert_max_us = frame_sum_us = frame_max_us = 0;
+    link_since = now;
 }
 
 /**
@@ -69,20 +505,70 @@ int main(int argc, char **argv) {
     struct sockaddr_in tel_addr, fc_addr, drone_addr;
     socklen_t drone_addr_len = sizeof(drone_addr);
 
-    char buf[1024];
+    struct in_addr groups[OPERATOR_GROUPS];
+    struct ip_mreq mreq;
+    int group_count = 0, reuse = 1;
+
     int telemetry_listen_fd = -1;
     int telemetry_fd = -1;
     int udp_fd = -1;
-    int n;
+    int n, opt;
+    char *end;
     int ret = 0;
+    long fleet_workers = 0, dash_port = 0;
+    struct sockaddr_in dash_addr;
+
+    while ((opt = getopt(argc, argv, "m:b:l:w:g:")) != -1) {
+        switch (opt) {
+            case 'g':
+                dash_port = strtol(optarg, &end, 10);
+                if (*optarg == 0 || *end != 0 || dash_port < 1 || dash_port > 65535) {
+                    fprintf(stderr, "Bad dashboard port.\n");
+                    goto _usage;
+                }
+                break;
+            case 'w':
+                fleet_workers = strtol(optarg, &end, 10);
+                if (*optarg == 0 || *end != 0 || fleet_workers < 1 || fleet_workers > 64) {
+                    fprintf(stderr, "Bad fleet worker count (1 to 64).\n");
+                    goto _usage;
+                }
+                break;
+            case 'b':
+            case 'l':
+                *(opt == 'b' ? &heartbeat_us : &stale_us) = strtoul(optarg, &end, 10) * 1000;
+                if (*optarg == 0 || *end != 0 || heartbeat_us > 60000000 || stale_us > 60000000) {
+                    fprintf(stderr, "Bad heartbeat interval or stale timeout (0 to 60000 ms).\n");
+                    goto _usage;
+                }
+                break;
+            case 'm':
+                if (group_count == OPERATOR_GROUPS ||
+                    inet_pton(AF_INET, optarg, &groups[group_count]) <= 0 ||
+                    !IN_MULTICAST(ntohl(groups[group_count].s_addr)))
+                {
+                    fprintf(stderr, "Bad multicast group (%d at most).\n", OPERATOR_GROUPS);
+                    goto _usage;
+                }
+                group_count++;
+                break;
+            default:
+                goto _usage;
+        }
+    }
 
-    if (argc < 5) {
+    if (argc - optind < (fleet_workers ? 2 : 4)) {
+_usage:
         fprintf(stderr,
-            "Usage: %s <operator_ip> <telemetry_unit_port> <drone_ip> <flight_ctrl_port>\n",
-            argv[0]
+            "Usage: %s [-m group]... [-b heartbeat_ms] [-l stale_ms] [-g dashboard_port] <operator_ip> <telemetry_unit_port> <drone_ip> <flight_ctrl_port>\n"
+            "       %s -w workers [-b heartbeat_ms] [-g dashboard_port] <operator_ip> <telemetry_unit_port>\n",
+            argv[0], argv[0]
         );
         return 1;
     }
+    argv += optind - 1;     // Positional arguments start at argv[1].
+    for (int i = 0; i < 1 + OPERATOR_GROUPS; ++i)
+        udp[i].fd = -1;
 
     printf("Starting operator console...\n");
 
@@ -97,6 +583,35 @@ int main(int argc, char **argv) {
     tel_addr.sin_port   = htons(atoi(argv[2]));
     printf("Telemetry IP/port parsed.\n");
 
+    // SIGINT | SIGTERM handlers.
+    sa.sa_handler = sigterm_handler;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = 0;
+
+    if (sigaction(SIGTERM, &sa, NULL) == -1 ||
+        sigaction(SIGINT,  &sa, NULL) == -1) {
+        perror("sigaction");
+        ret = 1;
+        goto _shutdown;
+    }
+
+    printf("Signal handlers installed.\n");
+
+    // Dashboard on the operator address.
+    if (dash_port > 0) {
+        dash_addr = tel_addr;
+        dash_addr.sin_port = htons(dash_port);
+        if (dash_start(&dash_addr) < 0) {
+            ret = 1;
+            goto _shutdown;
+        }
+    }
+
+    if (fleet_workers > 0) {
+        ret = fleet_serve(&tel_addr, fleet_workers, heartbeat_us, &sigterm);
+        goto _shutdown;
+    }
+
     // Parsing drone's IP + port.
     telemetry_listen_fd = socket(AF_INET, SOCK_STREAM, 0);
     if (telemetry_listen_fd < 0) {
@@ -120,6 +635,51 @@ int main(int argc, char **argv) {
     }
     printf("Telemetry TCP listener created.\n");
 
+    // UDP telemetry, same address and port.
+    udp[0].fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (udp[0].fd < 0) {
+        perror("socket(UDP telemetry)");
+        ret = 1;
+        goto _shutdown;
+    }
+    udp_len = 1;
+    if (bind(udp[0].fd, (struct sockaddr*)&tel_addr, sizeof(tel_addr)) < 0) {
+        perror("bind(UDP telemetry)");
+        ret = 1;
+        goto _shutdown;
+    }
+    strcpy(udp[0].name, "unicast");
+    printf("Telemetry UDP receiver created.\n");
+
+    // Multicast telemetry, one socket per group on the telemetry port. Bound to the group, so that it only receives
+    // that group, and shareable, so that several operators on one host receive it too.
+    for (int i = 0; i < group_count; ++i) {
+        udp_stream_t *u = &udp[udp_len];
+        struct sockaddr_in group_addr = tel_addr;
+
+        u->fd = socket(AF_INET, SOCK_DGRAM, 0);
+        if (u->fd < 0) {
+            perror("socket(UDP multicast)");
+            ret = 1;
+            goto _shutdown;
+        }
+        udp_len++;
+
+        group_addr.sin_addr = groups[i];
+        mreq.imr_multiaddr = groups[i];
+        mreq.imr_interface = tel_addr.sin_addr;
+        if (setsockopt(u->fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) < 0 ||
+            bind(u->fd, (struct sockaddr*)&group_addr, sizeof(group_addr)) < 0 ||
+            setsockopt(u->fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0)
+        {
+            perror("join(UDP multicast)");
+            ret = 1;
+            goto _shutdown;
+        }
+        inet_ntop(AF_INET, &groups[i], u->name, sizeof(u->name));
+        printf("Joined telemetry multicast group %s.\n", u->name);
+    }
+
     // UDP socket.
     udp_fd = socket(AF_INET, SOCK_DGRAM, 0);
     if (udp_fd < 0) {
@@ -138,19 +698,8 @@ int main(int argc, char **argv) {
     fc_addr.sin_port   = htons(atoi(argv[4]));
     printf("UDP socket ready for Flight Controller commands.\n");
 
-    // SIGINT | SIGTERM handlers.
-    sa.sa_handler = sigterm_handler;
-    sigemptyset(&sa.sa_mask);
-    sa.sa_flags = 0;
-
-    if (sigaction(SIGTERM, &sa, NULL) == -1 ||
-        sigaction(SIGINT,  &sa, NULL) == -1) {
-        perror("sigaction");
-        ret = 1;
-        goto _shutdown;
-    }
-
-    printf("Signal handlers installed.\n");
+    // Mirrors the drone default: every channel at full rate.
+    tlm_subscription_default(&subscription, 10000);
 
     fd_set rfds;
 
@@ -160,13 +709,19 @@ int main(int argc, char **argv) {
         FD_SET(STDIN_FILENO, &rfds);
 
         int maxfd = telemetry_listen_fd;
+        for (int i = 0; i < udp_len; ++i) {
+            FD_SET(udp[i].fd, &rfds);
+            if (udp[i].fd > maxfd)
+                maxfd = udp[i].fd;
+        }
         if (telemetry_fd > 0) {
             FD_SET(telemetry_fd, &rfds);
             if (telemetry_fd > maxfd)
                 maxfd = telemetry_fd;
         }
 
-        int sel = select(maxfd+1, &rfds, NULL, NULL, NULL);
+        struct timeval timeout = link_check(udp_fd, &fc_addr);
+        int sel = select(maxfd+1, &rfds, NULL, NULL, &timeout);
         if (sel < 0) {
             if (errno == EINTR)
                 continue;
@@ -183,16 +738,57 @@ int main(int argc, char **argv) {
                 perror("accept");
             } else {
                 printf("Telemetry client connected.\n");
+                link_heard();
+                rx_len = 0;
+                binary = -1;
+                memset(&decoder, 0, sizeof(decoder));
+                if (subscribed)
+                    subscription_send(udp_fd, &fc_addr);
+                resume_send(udp_fd, &fc_addr);
+            }
+        }
+
+        /* Datagrams are independent, lost ones never hold the others back. */
+        for (int i = 0; i < udp_len; ++i) {
+            static uint8_t pkt[DGRAM_MAX];
+
+            if (!FD_ISSET(udp[i].fd, &rfds))
+                continue;
+            n = recv(udp[i].fd, pkt, sizeof(pkt), MSG_DONTWAIT);
+            if (n > 0) {
+                link_bytes += n;
+                if (link_heard())
+                    resume_send(udp_fd, &fc_addr);
+                if (dgram_receive(&udp[i].rx, pkt, n, udp_deliver, &udp[i]) < 0)
+                    fprintf(stderr, "Malformed telemetry datagram.\n");
+                link_report();
             }
         }
 
         /* Printing upcoming telemetry data. */
         if (telemetry_fd > 0 && FD_ISSET(telemetry_fd, &rfds)) {
-            n = read(telemetry_fd, buf, sizeof(buf)-1);
+            n = read(telemetry_fd, rx + rx_len, sizeof(rx) - rx_len - 1);
             if (n > 0) {
-                buf[n] = 0;
-                printf("[TELEMETRY] {\n%s}\n", buf);
-            } else {
+                link_bytes += n;
+                link_heard();
+
+                // Binary frames start with the magic byte, text frames never do.
+                if (binary < 0)
+                    binary = rx[0] == TLM_MAGIC;
+
+                if (!binary) {
+                    printf("[TELEMETRY] {\n%.*s}\n", n, (char *)rx);
+                    link_records++;
+                } else {
+                    rx_len += n;
+                    if (drain_frames() < 0) {
+                        fprintf(stderr, "Malformed telemetry frame.\n");
+                        n = 0;
+                    }
+                }
+                link_report();
+            }
+            if (n <= 0) {
                 printf("Telemetry disconnected.\n");
                 shutdown(telemetry_fd, SHUT_RDWR);
                 close(telemetry_fd);
@@ -205,7 +801,15 @@ int main(int argc, char **argv) {
             char cmdline[32];
             if (fgets(cmdline, sizeof(cmdline), stdin)) {
                 current_action_t action;
-                if (get_action_from_cmd(cmdline, &action)) {
+                int sub = get_subscription_from_cmd(cmdline);
+
+                if (sub > 0) {
+                    subscribed = true;
+                    subscription_send(udp_fd, &fc_addr);
+                } else if (sub < 0) {
+                    printf("Invalid subscription: %s", cmdline);
+                    printf("Usage: sub <battery|accel|stats|motors|action|gps|all> <rate_hz> [threshold]\n");
+                } else if (get_action_from_cmd(cmdline, &action)) {
                     printactln(action);
                     ssize_t sent = 
                         sendto(udp_fd, &action, sizeof(action), 0, (struct sockaddr*)&fc_addr, sizeof(fc_addr));
@@ -216,7 +820,7 @@ int main(int argc, char **argv) {
                         perror("sendto");
                 } else {
                     printf("Invalid command: %s", cmdline);
-                    printf("Valid: fly, samplegps, land, idle, charge, abort\n");
+                    printf("Valid: fly, samplegps, land, idle, charge, abort, sub\n");
                 }
             }
         }
@@ -238,6 +842,12 @@ _shutdown:
         telemetry_fd = -1;
     }
 
+    /* Close UDP telemetry receivers, leaving their groups */
+    for (int i = 0; i < udp_len; ++i) {
+        close(udp[i].fd);
+        udp[i].fd = -1;
+    }
+
     /* Close telemetry listener */
     if (telemetry_listen_fd >= 0) {
         shutdown(telemetry_listen_fd, SHUT_RDWR);
@@ -245,6 +855,7 @@ _shutdown:
         telemetry_listen_fd = -1;
     }
 
+    dash_stop();
     printf("All sockets closed. Exiting.\n");
     return ret;
 }
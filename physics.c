@@ -0,0 +1,212 @@
+/**
+  * @file physics.c
+  * @brief Integrates the airframe dynamics and publishes the ground truth the sensors sample.
+  *
+  * Main tasks:
+  * - Read motors PWM values and integrate rigid-body quadrotor dynamics at a fixed 1 kHz step.
+  * - Publish true position, velocity, attitude and specific force within the shared memory (see `truth_t`).
+  * - Catch up with the wall clock when woken up late, and drop the steps beyond a bounded backlog.
+  * - Benchmark the cost of one integration step and report the real-time factor.
+  *
+  * @note
+  *
+  * Semi-implicit Euler: velocities are updated first, then positions and attitude move with the new velocities.
+  * It is stable at this step for the stiffest part of the model (motor lag and drag) and costs a fraction of RK4.
+  *
+  * Motors sit in an X configuration, body frame is x forward, y left, z up:
+  *   0 front-left (CCW)    1 front-right (CW)
+  *   2 rear-left (CW)      3 rear-right (CCW)
+  * Thrust grows with the square of the PWM and hovers at `PHYS_HOVER_PWM`, the level the flight controller climbs to.
+  *
+  * The state lives in the shared memory, so a respawned actor carries on the same trajectory.
+  **/
+
+#include "proj_types.h"
+
+#define PHYS_MAX_BACKLOG    50                  // Steps integrated at most per wakeup, older ones are dropped.
+#define PHYS_REPORT_US      10000000            // Statistics period.
+#define PHYS_BENCH_STEPS    200000              // Steps of the startup benchmark.
+
+static truth_t t;
+static bool started = false;
+static struct timespec next_step;
+static uint64_t sim_ns;                         // Wall clock time the integration has reached.
+static wait_stats_t wait_stats = { .name = "physics" };
+
+/* Statistics of the current report period. */
+static uint64_t report_start_ns, period_steps, period_dropped, period_step_ns;
+
+static inline uint64_t mono_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/**
+  * @brief Advances `s` by one step under PWM `m`.
+  **/
+static void physics_step(truth_t *s, const motors_t *m) {
+    const float d = PHYS_ARM * (float)M_SQRT1_2, k = PHYS_DT / PHYS_MOTOR_TAU;
+    float qw = s->att[0], qx = s->att[1], qy = s->att[2], qz = s->att[3];
+    float wx = s->rate[0], wy = s->rate[1], wz = s->rate[2];
+    float v0[3] = { s->vel[0], s->vel[1], s->vel[2] };
+    float total = 0.0f, tx, ty, tz, zb[3], a[3], fw[3], n;
+    bool ground;
+
+    // Motors follow their PWM with a first order lag.
+    for (int i = 0; i < 4; ++i) {
+        float pwm = m->motors[i] < 0.0f ? 0.0f : m->motors[i] > 1.0f ? 1.0f : m->motors[i];
+        s->thrust[i] += (PHYS_MOTOR_MAX_THRUST * pwm * pwm - s->thrust[i]) * k;
+        total += s->thrust[i];
+    }
+
+    // Thrust acts along the body z axis, expressed in the world frame.
+    zb[0] = 2.0f * (qx * qz + qw * qy);
+    zb[1] = 2.0f * (qy * qz - qw * qx);
+    zb[2] = 1.0f - 2.0f * (qx * qx + qy * qy);
+
+    for (int i = 0; i < 3; ++i)
+        a[i] = (zb[i] * total - PHYS_DRAG_LIN * s->vel[i]) / PHYS_MASS;
+    a[2] -= PHYS_GRAVITY;
+
+    for (int i = 0; i < 3; ++i) {
+        s->vel[i] += a[i] * PHYS_DT;
+        s->pos[i] += s->vel[i] * PHYS_DT;
+    }
+
+    // Ground contact: the legs stop any downward motion, friction holds the drone in place.
+    ground = s->pos[2] <= 0.0f;
+    if (ground) {
+        s->pos[2] = 0.0f;
+        if (s->vel[2] < 0.0f)
+            s->vel[0] = s->vel[1] = s->vel[2] = 0.0f;
+    }
+
+    // Rotation. Torques of the thrust differences, propeller reaction and drag, with the gyroscopic term.
+    tx = d * (s->thrust[0] - s->thrust[1] + s->thrust[2] - s->thrust[3]) - PHYS_DRAG_ANG * wx;
+    ty = d * (s->thrust[2] + s->thrust[3] - s->thrust[0] - s->thrust[1]) - PHYS_DRAG_ANG * wy;
+    tz = PHYS_YAW_COEF * (s->thrust[0] - s->thrust[1] - s->thrust[2] + s->thrust[3]) - PHYS_DRAG_ANG * wz;
+
+    if (ground && s->vel[2] == 0.0f) {
+        wx = wy = wz = 0.0f;
+    } else {
+        wx += (tx - (PHYS_INERTIA_Z - PHYS_INERTIA_XY) * wy * wz) / PHYS_INERTIA_XY * PHYS_DT;
+        wy += (ty - (PHYS_INERTIA_XY - PHYS_INERTIA_Z) * wz * wx) / PHYS_INERTIA_XY * PHYS_DT;
+        wz += tz / PHYS_INERTIA_Z * PHYS_DT;
+    }
+
+    // q += q * (0, w) * dt / 2, then renormalized.
+    s->att[0] = qw + 0.5f * PHYS_DT * (-qx * wx - qy * wy - qz * wz);
+    s->att[1] = qx + 0.5f * PHYS_DT * ( qw * wx + qy * wz - qz * wy);
+    s->att[2] = qy + 0.5f * PHYS_DT * ( qw * wy - qx * wz + qz * wx);
+    s->att[3] = qz + 0.5f * PHYS_DT * ( qw * wz + qx * wy - qy * wx);
+    n = 1.0f / sqrtf(s->att[0] * s->att[0] + s->att[1] * s->att[1] + s->att[2] * s->att[2] + s->att[3] * s->att[3]);
+    for (int i = 0; i < 4; ++i)
+        s->att[i] *= n;
+
+    s->rate[0] = wx;
+    s->rate[1] = wy;
+    s->rate[2] = wz;
+
+    // Specific force: the acceleration actually achieved (ground reaction included) minus gravity, in the body frame.
+    for (int i = 0; i < 3; ++i)
+        fw[i] = (s->vel[i] - v0[i]) / PHYS_DT;
+    fw[2] += PHYS_GRAVITY;
+
+    qw = s->att[0], qx = s->att[1], qy = s->att[2], qz = s->att[3];
+    s->force[0] = (1.0f - 2.0f * (qy * qy + qz * qz)) * fw[0] + 2.0f * (qx * qy + qw * qz) * fw[1]
+        + 2.0f * (qx * qz - qw * qy) * fw[2];
+    s->force[1] = 2.0f * (qx * qy - qw * qz) * fw[0] + (1.0f - 2.0f * (qx * qx + qz * qz)) * fw[1]
+        + 2.0f * (qy * qz + qw * qx) * fw[2];
+    s->force[2] = 2.0f * (qx * qz + qw * qy) * fw[0] + 2.0f * (qy * qz - qw * qx) * fw[1]
+        + (1.0f - 2.0f * (qx * qx + qy * qy)) * fw[2];
+
+    s->steps++;
+}
+
+/**
+  * @brief Measures the cost of one step on a scratch copy of the state, climbing at full PWM from the ground.
+  **/
+static void physics_bench(void) {
+    truth_t s = { .att = { 1.0f } };
+    motors_t m = { .motors = { 1.0f, 1.0f, 1.0f, 1.0f } };
+    uint64_t start = mono_ns(), ns;
+
+    for (int i = 0; i < PHYS_BENCH_STEPS; ++i)
+        physics_step(&s, &m);
+
+    ns = mono_ns() - start;
+    printf("Physics bench: %d steps in %.3f ms, %.1f ns/step, real-time factor %.0f (alt %.1f m).\n",
+        PHYS_BENCH_STEPS, ns / 1e6, (double)ns / PHYS_BENCH_STEPS,
+        (double)PHYS_BENCH_STEPS * PHYS_PERIOD_US * 1000.0 / ns, s.pos[2]);
+}
+
+/**
+  * @brief Physics loop.
+  *
+  * Does the following:
+  * - Integrates every step due since the last wakeup under the current PWM.
+  * - Publishes the resulting ground truth.
+  * - Reports the integration cost and the real-time factor each `PHYS_REPORT_US`.
+  **/
+void physics_loop(drone_shared_t *shm_ptr) {
+    uint64_t now, due, start;
+    motors_t m;
+
+    if (!started) {
+        uint32_t v = atomic_load_explicit(&shm_ptr->truth.version, memory_order_relaxed);
+
+        // A writer that died in the middle of a publication leaves the version odd. This actor is the only writer.
+        if (v & 1)
+            atomic_store_explicit(&shm_ptr->truth.version, v + 1, memory_order_release);
+        truth_read(shm_ptr, &t);
+        if (t.att[0] == 0.0f && t.att[1] == 0.0f && t.att[2] == 0.0f && t.att[3] == 0.0f)
+            t.att[0] = 1.0f;
+
+        physics_bench();
+
+        clock_gettime(CLOCK_MONOTONIC, &next_step);
+        sim_ns = report_start_ns = mono_ns();
+        started = true;
+    }
+
+    sem_wait(&shm_ptr->pwm.mutex);
+    m = shm_ptr->pwm.motors;
+    sem_post(&shm_ptr->pwm.mutex);
+
+    // Steps due until now. A backlog beyond the bound is dropped, the simulation pauses instead of fast forwarding.
+    now = mono_ns();
+    due = now > sim_ns ? (now - sim_ns) / (PHYS_PERIOD_US * 1000) : 0;
+    if (due > PHYS_MAX_BACKLOG) {
+        period_dropped += due - PHYS_MAX_BACKLOG;
+        sim_ns += (due - PHYS_MAX_BACKLOG) * PHYS_PERIOD_US * 1000;
+        due = PHYS_MAX_BACKLOG;
+    }
+
+    start = mono_ns();
+    for (uint64_t i = 0; i < due; ++i)
+        physics_step(&t, &m);
+    sim_ns += due * PHYS_PERIOD_US * 1000;
+    period_step_ns += mono_ns() - start;
+    period_steps += due;
+
+    t.ts_us = sim_ns / 1000;
+    truth_publish(shm_ptr, &t);
+
+    if (now - report_start_ns >= PHYS_REPORT_US * 1000ull) {
+        printf("Physics: %lu steps, %.1f ns/step, real-time factor %.0f, achieved %.3f, %lu dropped; "
+            "pos=[%.2f, %.2f, %.2f] vel=[%.2f, %.2f, %.2f];\n",
+            period_steps, period_steps ? (double)period_step_ns / period_steps : 0.0,
+            period_step_ns ? (double)period_steps * PHYS_PERIOD_US * 1000.0 / period_step_ns : 0.0,
+            (double)period_steps * PHYS_PERIOD_US * 1000.0 / (now - report_start_ns), period_dropped,
+            t.pos[0], t.pos[1], t.pos[2], t.vel[0], t.vel[1], t.vel[2]);
+        report_start_ns = now;
+        period_steps = period_dropped = period_step_ns = 0;
+    }
+
+    shm_ptr->wdg.physics++;
+
+    deadline_next(&next_step, PHYS_PERIOD_US);
+    notify_wait(NULL, 0, shm_ptr->wait.state, &next_step, &wait_stats);
+}
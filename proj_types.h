@@ -10,6 +10,11 @@
 #ifndef PROJ_TYPES_H
 #define PROJ_TYPES_H
 
+// Required for `sem_clockwait`.
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
 // STD
 #include <stdio.h>
 #include <stdint.h>
@@ -24,6 +29,9 @@
 #include <semaphore.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <netinet/tcp.h>
+#include <sys/ioctl.h>
+#include <linux/sockios.h>
 
 // OPENSSL (TLS)
 #include <arpa/inet.h>
@@ -93,15 +101,281 @@ typedef struct {
     float motors[4];
 } motors_t;
 
-#define GPS_BUFFER_SIZE (128 * 10)
+/**
+  * @brief Ground truth of the simulated airframe, integrated by the physics actor (see physics.c).
+  *
+  * @note World frame is east, north, up with its origin at the takeoff point. Sensors derive their readings from it.
+  **/
+typedef struct {
+    uint64_t ts_us;             // CLOCK_MONOTONIC time of the state.
+    uint64_t steps;             // Integration steps so far.
+    float pos[3];               // Position in the world frame (m).
+    float vel[3];               // Velocity in the world frame (m/s).
+    float att[4];               // Body to world attitude quaternion (w, x, y, z).
+    float rate[3];              // Body angular rates (rad/s).
+    float thrust[4];            // Thrust of each motor (N), lagging behind its PWM.
+    float force[3];             // Specific force in the body frame (m/s^2), what an ideal accelerometer measures.
+} truth_t;
+
+/* Quadrotor model, shared by the physics actor (physics.c) and the batch simulator (swarm.c). */
+#define PHYS_PERIOD_US      1000                // 1 kHz fixed step.
+#define PHYS_DT             (PHYS_PERIOD_US * 1e-6f)
+#define PHYS_GRAVITY        9.81f
+#define PHYS_MASS           1.2f                // kg.
+#define PHYS_ARM            0.17f               // Motor to center (m).
+#define PHYS_INERTIA_XY     0.012f              // kg m^2.
+#define PHYS_INERTIA_Z      0.022f
+#define PHYS_HOVER_PWM      0.7f
+#define PHYS_MOTOR_MAX_THRUST (PHYS_MASS * PHYS_GRAVITY / (4.0f * PHYS_HOVER_PWM * PHYS_HOVER_PWM))  // N per motor.
+#define PHYS_MOTOR_TAU      0.03f               // Motor spin-up time constant (s).
+#define PHYS_YAW_COEF       0.016f              // Reaction torque per newton of thrust (m).
+#define PHYS_DRAG_LIN       0.25f               // Translational drag (N per m/s).
+#define PHYS_DRAG_ANG       0.002f              // Rotational drag (N m per rad/s).
+
+/* Sensor, flight controller and battery models, shared by drone_sys and the batch simulator (swarm.c). */
+#define NOISE_XY_STD        0.02f               // Accelerometer noise, standard deviation (m/s^2).
+#define NOISE_Z_STD         0.05f
+#define DELTA_SIMULATION_US 50000               // Flight controller cycle.
+#define DELTA_DECREASE      0.01f               // PWM change per cycle while landing.
+#define DELTA_INCREASE      0.005f              // PWM change per cycle while climbing to `FLY_THRESH`.
+#define FLY_THRESH          0.7f
+#define ACCEL_STABILIZATION_THRESHOLD 0.5f      // PWM above which the accelerometer corrects the motors.
+#define DISCHARGE_INTERVAL_MS 2000              // 1 % of charge lost each interval, out of `Charge`.
+#define CHARGE_INTERVAL_MS  500                 // 1 % of charge gained each interval, in `Charge`.
+#define BATTERY_LOW         15                  // Charge (%) below which the drone aborts and cannot leave `Charge`.
+
+#define GPS_BUFFER_SIZE     (128 * 10)
+#define GPS_SENTENCE_SIZE   80
+#define GPS_RING_SLOTS      (GPS_BUFFER_SIZE / GPS_SENTENCE_SIZE)
+#define GPS_MAX_READERS     4
+
+/**
+  * @brief Single NMEA sentence stamped with the time it was produced.
+  **/
+typedef struct {
+    uint64_t index;                 // Sequence number of the sentence since startup.
+    struct timespec stamp;          // CLOCK_MONOTONIC production time.
+    uint16_t len;                   // Sentence length including the trailing newline.
+    char s[GPS_SENTENCE_SIZE];      // Raw sentence (not null terminated).
+} nmea_sentence_t;
 
 /**
-  * @brief NMEA string circular buffer. 
+  * @brief Ring slot guarded by a sequence counter. Odd while the producer writes it.
   **/
 typedef struct {
-    char buf[GPS_BUFFER_SIZE];
+    _Atomic(uint32_t) version;
+    nmea_sentence_t sentence;
+} gps_slot_t;
+
+/**
+  * @brief NMEA sentence circular buffer. 
+  *
+  * @note Overwrite-oldest ring. Producer never waits for consumers, the oldest sentence is simply replaced.
+  **/
+typedef struct {
+    gps_slot_t slot[GPS_RING_SLOTS];
 } nmea_t;
 
+/**
+  * @brief Registered GPS consumer. Only the owning process writes its cursor and counters.
+  **/
+typedef struct {
+    _Atomic(pid_t) pid;             // Owner process, 0 when the entry is free.
+    uint64_t cursor;                // Next sentence this consumer has not seen yet.
+    uint64_t dropped;               // Sentences overwritten or skipped before being consumed.
+    uint32_t lagged;                // Number of times the consumer was lapped by the producer.
+} gps_reader_t;
+
+/**
+  * @brief Aggregated sensor streams, one lane each.
+  **/
+typedef enum {
+    AggAccelX, AggAccelY, AggAccelZ,
+    AggMotor0, AggMotor1, AggMotor2, AggMotor3,
+    AggStreams,
+} agg_stream_t;
+
+#define AGG_LANES           8       // `AggStreams` rounded up to a whole SIMD register of floats.
+
+/**
+  * @brief Running accumulators of the current window. Lanes beyond `AggStreams` are unused.
+  **/
+typedef struct {
+    float min[AGG_LANES], max[AGG_LANES];
+    float sum[AGG_LANES], sum_sq[AGG_LANES];
+    uint32_t count;
+} agg_acc_t;
+
+/**
+  * @brief Statistics of one closed window.
+  **/
+typedef struct {
+    float min[AGG_LANES], max[AGG_LANES];
+    float mean[AGG_LANES], rms[AGG_LANES];
+    uint32_t count;                 // Samples in the window, 0 when aggregation is off.
+} agg_window_t;
+
+#define SNAPSHOT_BUFFERS    3
+
+/**
+  * @brief Consistent view of the whole drone state at one instant.
+  **/
+typedef struct {
+    uint64_t epoch;                 // Publication number.
+    struct timespec stamp;          // CLOCK_MONOTONIC publication time.
+    uint8_t battery;                // Battery charge.
+    current_action_t action;        // Drone state.
+    acceleration_t acceleration;    // Latest accelerometer sample.
+    motors_t motors;                // Latest motors PWM ratio.
+    agg_window_t window;            // Last closed window of full rate accelerometer and PWM samples.
+} drone_state_t;
+
+#define MPSC_CAPACITY       64
+#define MPSC_MSG_SIZE       32
+
+/**
+  * @brief Single message cell of MPSC queue.
+  **/
+typedef struct {
+    _Atomic(uint32_t) seq;          // Cell state for the current lap (see mpsc.c).
+    uint8_t data[MPSC_MSG_SIZE];    // Raw message.
+} mpsc_cell_t;
+
+/**
+  * @brief Bounded lock-free multi-producer single-consumer queue.
+  **/
+typedef struct {
+    _Atomic(uint32_t) head;         // Next position claimed by producers.
+    uint32_t tail;                  // Next position read by the consumer. Consumer only.
+    mpsc_cell_t cells[MPSC_CAPACITY];
+} mpsc_queue_t;
+
+/**
+  * @brief Initializes empty MPSC queue.
+  **/
+void mpsc_init(mpsc_queue_t *q);
+
+/**
+  * @brief Posts message to MPSC queue. Lock-free.
+  *
+  * @return false when the queue is full or the message is too large.
+  **/
+bool mpsc_push(mpsc_queue_t *q, const void *msg, size_t len);
+
+/**
+  * @brief Takes the oldest message from MPSC queue. Single consumer only.
+  *
+  * @return false when the queue is empty.
+  **/
+bool mpsc_pop(mpsc_queue_t *q, void *msg, size_t len);
+
+/**
+  * @brief Priority of a requested state change. Higher value wins arbitration.
+  **/
+typedef enum {
+    IntentOperator  = 0,    // Operator commands.
+    IntentSystem    = 1,    // Regular state machine progress (landing finished, ...).
+    IntentSafety    = 2,    // Failures and protections (low battery, lost GPS fix, lost sensors, ...).
+} intent_prio_t;
+
+/**
+  * @brief Actor that requested a state change.
+  **/
+typedef enum {
+    SourceOperator,
+    SourceFlightCtrl,
+    SourceBattery,
+    SourceTelemetry,
+} intent_source_t;
+
+/**
+  * @brief State change request, posted by any actor and applied by the flight controller.
+  **/
+typedef struct {
+    current_action_t type;          // Requested state.
+    uint8_t priority;               // `intent_prio_t`.
+    uint8_t source;                 // `intent_source_t`.
+    struct timespec stamp;          // CLOCK_MONOTONIC enqueue time.
+} intent_t;
+
+_Static_assert(sizeof(intent_t) <= MPSC_MSG_SIZE, "Intent does not fit into MPSC cell.");
+
+/**
+  * @brief Events sent to the operator ahead of periodic telemetry.
+  **/
+typedef enum {
+    AlertState = 1,         // State changed, `value` is the new `current_action_t`.
+    AlertGpsLost,           // No GPS fix within the timeout.
+    AlertWatchdog,          // Heartbeat timeout, `actor` stalled. Locks are reinitialized and all actors restarted.
+    AlertRespawn,           // `actor` was restarted, `value` is its new PID.
+    AlertLinkLost,          // Nothing heard from the operator within the link timeout, `value` is the silence in ms.
+} alert_kind_t;
+
+/**
+  * @brief Drone processes, in `drone_pids_t` order.
+  **/
+typedef enum {
+    ActorFlightCtrl,
+    ActorAccel,
+    ActorBattery,
+    ActorGps,
+    ActorTelemetry,
+    ActorWatchdog,
+    ActorPhysics,
+    ActorMain,
+} actor_t;
+
+/**
+  * @brief Urgent event, posted by any process and sent by the telemetry unit on its urgent lane.
+  **/
+typedef struct {
+    uint8_t kind;                   // `alert_kind_t`.
+    uint8_t actor;                  // `actor_t` that raised it or that it is about.
+    int32_t value;                  // Kind specific.
+    uint64_t stamp_us;              // CLOCK_MONOTONIC time it was raised.
+} alert_t;
+
+_Static_assert(sizeof(alert_t) <= MPSC_MSG_SIZE, "Alert does not fit into MPSC cell.");
+
+/**
+  * @brief How a waiter spends the time until an event or deadline (see `notify_wait`).
+  **/
+typedef enum {
+    WaitPark,           // Futex park. Default of zeroed memory.
+    WaitSpinPark,       // Bounded spin, then futex park.
+    WaitSpinYield,      // Bounded spin, then `sched_yield` polling.
+    WaitSpin,           // Busy spin with CPU pause hint.
+} wait_strategy_t;
+
+/**
+  * @brief Event channel between processes. Futex based.
+  **/
+typedef struct {
+    _Atomic(uint32_t) seq;          // Event counter. Futex word.
+    _Atomic(uint32_t) parked;       // Waiters sleeping in the kernel. Posting skips the wake syscall when zero.
+    _Atomic(uint64_t) stamp;        // CLOCK_MONOTONIC time of the latest event (ns).
+} notify_t;
+
+/**
+  * @brief Per-process wait statistics. Wake-up latency and CPU time burned while waiting.
+  **/
+typedef struct {
+    const char *name;
+    uint32_t waits, events;
+    uint64_t latency_ns, max_latency_ns, cpu_ns, since;
+} wait_stats_t;
+
+/**
+  * @brief Per-state duty cycle accounting of a periodic actor (wakeups and CPU time spent in each drone state).
+  **/
+typedef struct {
+    const char *name;
+    long full_period_us;            // Period at full rate. Used to report wakeups saved by slower profiles.
+    current_action_t action;        // State being accounted.
+    uint64_t since, cpu_since;      // State entry time (CLOCK_MONOTONIC and thread CPU time, ns).
+    uint32_t wakeups;
+} duty_stats_t;
+
 /**
   * @brief Semaphore based implementation of RWLock for multiple readers and multiple writers.
   **/
@@ -135,6 +409,627 @@ void rwlock_write_lock(rw_lock_t *rwlock);
   **/
 void rwlock_write_unlock(rw_lock_t *rwlock);
 
+/**
+  * @brief Fills `ts` with an absolute `CLOCK_MONOTONIC` deadline located `ms` milliseconds from now.
+  **/
+void deadline_after_ms(struct timespec *ts, long ms);
+
+/**
+  * @brief Waits on semaphore until absolute `CLOCK_MONOTONIC` deadline.
+  *
+  * @return 0 on success, -1 with `errno` set on failure (ETIMEDOUT when deadline has passed).
+  **/
+int sem_wait_until(sem_t *sem, const struct timespec *deadline);
+
+/**
+  * @brief Waits on semaphore for at most `ms` milliseconds.
+  **/
+int sem_wait_for_ms(sem_t *sem, long ms);
+
+/**
+  * @brief Sleeps while `*word == expected`, at most until absolute `CLOCK_MONOTONIC` deadline.
+  *
+  * @return 0 when woken up or the value already differs, -1 with `errno` set to ETIMEDOUT on timeout.
+  **/
+int futex_wait_until(_Atomic(uint32_t) *word, uint32_t expected, const struct timespec *deadline);
+
+/**
+  * @brief Wakes up all processes sleeping on `word`.
+  **/
+void futex_wake_all(_Atomic(uint32_t) *word);
+
+/**
+  * @brief Advances periodic deadline `next` by `period_us`. Restarts the schedule when more than a period behind.
+  **/
+void deadline_next(struct timespec *next, long period_us);
+
+/**
+  * @brief Signals an event on the channel.
+  **/
+void notify_post(notify_t *n);
+
+/**
+  * @brief Returns the current event counter of the channel. Pass it as `seen` to `notify_wait`.
+  **/
+uint32_t notify_seq(notify_t *n);
+
+/**
+  * @brief Waits until an event newer than `seen` is posted on `n` (NULL for none), or until absolute deadline.
+  *
+  * @return 0 when an event arrived, -1 when the deadline has passed.
+  **/
+int notify_wait(notify_t *n, uint32_t seen, wait_strategy_t strategy, const struct timespec *deadline, wait_stats_t *stats);
+
+/**
+  * @brief Counts one wakeup of a periodic actor in `action` state. Prints the previous state totals on state change.
+  **/
+void duty_account(duty_stats_t *d, current_action_t action);
+
+/**
+  * @brief Parses wait strategy name (`spin`, `yield`, `spinpark`, `park`).
+  *
+  * @return 0 on success, -1 for unknown names.
+  **/
+int wait_strategy_parse(const char *name, wait_strategy_t *out);
+
+/**
+  * @brief Starts a write of the record guarded by `version`, which stays odd until `seqlock_write_end`.
+  *
+  * @note Concurrent writers exclude each other, spinning while the version is odd.
+  **/
+void seqlock_write_begin(_Atomic(uint32_t) *version);
+
+/**
+  * @brief Ends a write started by `seqlock_write_begin`, making the version even again.
+  **/
+void seqlock_write_end(_Atomic(uint32_t) *version);
+
+/**
+  * @brief Returns the version to pass to `seqlock_read_retry` once the record is copied. Odd while it is written.
+  **/
+uint32_t seqlock_read_begin(const _Atomic(uint32_t) *version);
+
+/**
+  * @brief Tells whether a copy started at version `v` may be torn and must be discarded.
+  **/
+bool seqlock_read_retry(const _Atomic(uint32_t) *version, uint32_t v);
+
+/**
+  * @brief Wait strategy of each shared memory channel.
+  **/
+typedef struct {
+    wait_strategy_t gps;            // GPS producer: demand parking and production period.
+    wait_strategy_t state;          // Accelerometer, flight controller and battery periods, accelerometer samples.
+    wait_strategy_t action;         // Telemetry frames, woken up early by action changes.
+    wait_strategy_t heartbeat;      // Watchdog heartbeat checks.
+} wait_config_t;
+
+#define FMT_F6_MAX  47     // Longest `%.6f` output of a float ("-340282346638528859811704183484516925440.000000").
+
+/**
+  * @brief Writes decimal representation of `v`. No terminator.
+  *
+  * @return Number of characters written (at most 20).
+  **/
+size_t fmt_u64(char *dst, uint64_t v);
+
+/**
+  * @brief Writes decimal representation of signed `v`, as `printf("%d")` would. No terminator.
+  *
+  * @return Number of characters written (at most 11).
+  **/
+size_t fmt_i32(char *dst, int32_t v);
+
+/**
+  * @brief Writes `v` as `printf("%.6f", (double)v)` would. No terminator.
+  *
+  * @return Number of characters written (at most `FMT_F6_MAX`).
+  **/
+size_t fmt_f6(char *dst, float v);
+
+/**
+  * @brief Telemetry wire encoding, selected with the `-e` option of drone_sys.
+  **/
+typedef enum {
+    EncodingText = 0,   // Plain text frames.
+    EncodingDelta,      // Binary keyframes and deltas.
+    EncodingLz4,        // Binary frames batched and LZ4 compressed.
+} telemetry_encoding_t;
+
+#define TLM_MAGIC           0xA5
+#define TLM_HEADER_SIZE     4                                           // Magic, type and length.
+#define TLM_PAYLOAD_MAX     4096                                        // Largest accepted length after the header.
+#define TLM_BATCH_MAX       (TLM_PAYLOAD_MAX - 16)                      // Largest batch content.
+#define TLM_FRAME_MAX       (TLM_HEADER_SIZE + 128 + GPS_SENTENCE_SIZE) // Largest key or delta frame.
+#define TLM_TEXT_MAX        (896 + GPS_SENTENCE_SIZE)                   // Largest text frame.
+#define TLM_ALERT_MAX       96                                          // Largest alert frame, text or binary.
+#define TLM_SUBSCRIBE_MAX   64                                          // Largest subscription frame.
+#define TLM_HEARTBEAT_MAX   32                                          // Largest heartbeat frame, text or binary.
+#define TLM_RESUME_SIZE     (TLM_HEADER_SIZE + 4)                       // Backfill request frame.
+#define TLM_HISTORY         4096                                        // Frames kept for backfill, 40 s in the air.
+#define TLM_HELLO_SIZE      (TLM_HEADER_SIZE + 6)                       // Drone identification frame.
+#define TLM_COMMAND_SIZE    (TLM_HEADER_SIZE + 9)                       // Command and acknowledgement frames.
+
+/**
+  * @brief Binary frame types. Upper nibble of the type byte holds the flags.
+  **/
+typedef enum {
+    FrameKey    = 1,    // Every field, decodable alone.
+    FrameDelta  = 2,    // Fields changed since the previous frame.
+    FrameBatch  = 3,    // Several whole frames back to back.
+    FrameAlert  = 4,    // One alert, outside of the key and delta sequence.
+    FrameSubscribe = 5, // Operator subscription, sent to the flight controller.
+    FrameHeartbeat = 6, // Link liveness and clock offset exchange, sent both ways.
+    FrameResume = 7,    // Operator backfill request, sent to the flight controller.
+    FrameHello  = 8,    // Drone identification, first frame of each connection.
+    FrameCommand = 9,   // Numbered operator command, sent to the flight controller.
+    FrameAck    = 10,   // Command acknowledgement, sent back by the flight controller.
+} tlm_frame_type_t;
+
+#define TLM_FLAG_LZ4        0x10    // Batch payload is LZ4 compressed.
+#define TLM_FLAG_HISTORY    0x20    // Keyframe replayed from the history, outside of the live sequence.
+
+/**
+  * @brief Groups of telemetry fields the operator subscribes to. In text frame order.
+  **/
+typedef enum {
+    TlmBattery,         // `battery`.
+    TlmAccel,           // `acceleration`.
+    TlmAccelStats,      // `samples`, `accel_min`, `accel_max`, `accel_rms`. Only while aggregating.
+    TlmMotors,          // `motors`.
+    TlmAction,          // `action`.
+    TlmGps,             // `gps`, `gps_lost`. Only when there is a new sentence or a timeout.
+    TlmChannels,
+} tlm_channel_t;
+
+/**
+  * @brief Operator subscription. A channel with neither an interval nor a threshold is not sent at all.
+  **/
+typedef struct {
+    uint32_t interval_us[TlmChannels];  // Longest time between two emissions, 0 for on change only.
+    float threshold[TlmChannels];       // Emits early when a value moved more than that, 0 for periodic only.
+} tlm_subscription_t;
+
+/**
+  * @brief Content of one telemetry frame, independent from its wire encoding.
+  *
+  * @note Only the channels in `channels` belong to this frame, other fields hold the last sent values.
+  **/
+typedef struct {
+    uint8_t channels;               // Bit per `tlm_channel_t` emitted in this frame.
+    uint8_t battery;                // Battery charge.
+    current_action_t action;        // Drone state.
+    acceleration_t acceleration;    // Accelerometer sample, or window mean when aggregated.
+    motors_t motors;                // Motors PWM ratio, or window mean when aggregated.
+    uint32_t samples;               // Samples in the aggregation window, 0 when not aggregated.
+    acceleration_t accel_min, accel_max, accel_rms;  // Accelerometer window statistics.
+    bool gps_lost;                  // GPS timed out during this frame.
+    uint8_t gps_len;                // Length of the new GPS sentence, 0 when none.
+    char gps[GPS_SENTENCE_SIZE];    // New GPS sentence.
+} tlm_record_t;
+
+/**
+  * @brief Sent frame kept for backfill.
+  **/
+typedef struct {
+    uint32_t seq;
+    uint64_t ts_us;
+    tlm_record_t record;
+} tlm_history_t;
+
+/**
+  * @brief Last `TLM_HISTORY` sent frames. Frame `seq` is at `frames[seq % TLM_HISTORY]`.
+  **/
+typedef struct {
+    uint32_t head;                  // Sequence number of the next frame.
+    tlm_history_t frames[TLM_HISTORY];
+} tlm_history_ring_t;
+
+/**
+  * @brief Encoder side state. Zeroed state starts with a keyframe.
+  **/
+typedef struct {
+    tlm_record_t prev;              // Last encoded record.
+    uint32_t seq;                   // Sequence number of the next frame.
+    uint64_t ts_us;                 // Time of the last frame.
+    uint64_t key_us;                // Time of the last keyframe, 0 before the first one.
+} tlm_encoder_t;
+
+/**
+  * @brief Decoder side state. Zeroed state waits for a keyframe.
+  **/
+typedef struct {
+    tlm_record_t prev;              // Last decoded record.
+    uint32_t seq;                   // Sequence number of the last decoded frame.
+    uint64_t ts_us;                 // Time of the last decoded frame.
+    bool synced;                    // A keyframe was decoded and no frame was missed since.
+    uint32_t skipped;               // Deltas discarded while not synced.
+} tlm_decoder_t;
+
+/**
+  * @brief Heartbeat content. Times are on the sender clock, except `echo_ts_us` which is on the peer one.
+  **/
+typedef struct {
+    uint32_t seq;
+    uint64_t ts_us;                 // Send time.
+    uint64_t echo_ts_us;            // `ts_us` of the last heartbeat received from the peer, 0 when none.
+    uint64_t echo_rx_us;            // When that heartbeat was received.
+} tlm_heartbeat_t;
+
+/**
+  * @brief Drone identification. Commands go to `flight_ctrl_port` at the address the telemetry comes from.
+  **/
+typedef struct {
+    uint32_t id;                    // Set with the `-i` option of drone_sys, never 0.
+    uint16_t flight_ctrl_port;
+} tlm_hello_t;
+
+/**
+  * @brief Numbered command, or its acknowledgement.
+  **/
+typedef struct {
+    uint32_t seq;                   // Repeated by the operator until acknowledged, applied once.
+    uint32_t id;                    // Drone the command is for, 0 for any. The acknowledging drone.
+    current_action_t action;        // Requested state. The state the drone was in when acknowledging.
+} tlm_command_t;
+
+/**
+  * @brief Receives decoded content (see `tlm_decode`).
+  **/
+typedef struct {
+    void (*record)(const tlm_record_t *r, uint32_t seq, uint64_t ts_us, void *arg);
+    void (*alert)(const alert_t *a, uint32_t seq, void *arg);
+    void (*heartbeat)(const tlm_heartbeat_t *h, void *arg);        // Optional.
+    void (*history)(const tlm_record_t *r, uint32_t seq, uint64_t ts_us, void *arg);   // Optional.
+    void (*hello)(const tlm_hello_t *h, void *arg);                // Optional.
+    void *arg;
+} tlm_sink_t;
+
+/**
+  * @brief Writes the text form of `r`, as sent by `EncodingText`. No terminator.
+  *
+  * @return Number of characters written (at most `TLM_TEXT_MAX`).
+  **/
+size_t tlm_text(const tlm_record_t *r, char *dst);
+
+/**
+  * @brief Encodes `r` as a key or delta frame stamped with `ts_us`.
+  *
+  * @return Frame length (at most `TLM_FRAME_MAX`).
+  **/
+size_t tlm_encode(tlm_encoder_t *e, const tlm_record_t *r, uint64_t ts_us, uint8_t *dst);
+
+/**
+  * @brief Wraps already encoded frames into a single batch frame, LZ4 compressed when that is shorter.
+  *
+  * @return Frame length, or 0 when `len` exceeds `TLM_PAYLOAD_MAX`.
+  **/
+size_t tlm_batch(tlm_encoder_t *e, const uint8_t *frames, size_t len, uint64_t ts_us, uint8_t *dst);
+
+/**
+  * @brief Encodes `a` as an alert frame, text or binary.
+  *
+  * @return Frame length (at most `TLM_ALERT_MAX`).
+  **/
+size_t tlm_alert(const alert_t *a, uint32_t seq, bool text, uint8_t *dst);
+
+/**
+  * @brief Encodes `s` as a subscription frame.
+  *
+  * @return Frame length (at most `TLM_SUBSCRIBE_MAX`).
+  **/
+size_t tlm_subscribe(const tlm_subscription_t *s, uint8_t *dst);
+
+/**
+  * @brief Decodes one whole subscription frame.
+  *
+  * @return 0 on success, -1 on a malformed frame.
+  **/
+int tlm_subscription_decode(const uint8_t *frame, size_t len, tlm_subscription_t *s);
+
+/**
+  * @brief Encodes a heartbeat frame, text or binary. The echo is only sent when `h->echo_ts_us` is set, and never
+  *        as text.
+  *
+  * @return Frame length (at most `TLM_HEARTBEAT_MAX`).
+  **/
+size_t tlm_heartbeat(const tlm_heartbeat_t *h, bool text, uint8_t *dst);
+
+/**
+  * @brief Decodes one whole binary heartbeat frame.
+  *
+  * @return 0 on success, -1 on a malformed frame.
+  **/
+int tlm_heartbeat_decode(const uint8_t *frame, size_t len, tlm_heartbeat_t *h);
+
+/**
+  * @brief Encodes a history keyframe: `r` replayed with its original sequence number and time.
+  *
+  * @return Frame length (at most `TLM_FRAME_MAX`).
+  **/
+size_t tlm_history(const tlm_record_t *r, uint32_t seq, uint64_t ts_us, uint8_t *dst);
+
+/**
+  * @brief Encodes a backfill request for every frame from sequence number `from` on.
+  *
+  * @return Frame length (`TLM_RESUME_SIZE`).
+  **/
+size_t tlm_resume(uint32_t from, uint8_t *dst);
+
+/**
+  * @brief Decodes one whole backfill request.
+  *
+  * @return 0 on success, -1 on a malformed frame.
+  **/
+int tlm_resume_decode(const uint8_t *frame, size_t len, uint32_t *from);
+
+/**
+  * @brief Encodes `h` as a hello frame.
+  *
+  * @return Frame length (`TLM_HELLO_SIZE`).
+  **/
+size_t tlm_hello(const tlm_hello_t *h, uint8_t *dst);
+
+/**
+  * @brief Decodes one whole hello frame.
+  *
+  * @return 0 on success, -1 on a malformed frame.
+  **/
+int tlm_hello_decode(const uint8_t *frame, size_t len, tlm_hello_t *h);
+
+/**
+  * @brief Encodes `c` as a command frame, or as an acknowledgement frame when `ack` is set.
+  *
+  * @return Frame length (`TLM_COMMAND_SIZE`).
+  **/
+size_t tlm_command(const tlm_command_t *c, bool ack, uint8_t *dst);
+
+/**
+  * @brief Decodes one whole command frame, or acknowledgement frame when `ack` is set.
+  *
+  * @return 0 on success, -1 on a malformed frame or one of the other type.
+  **/
+int tlm_command_decode(const uint8_t *frame, size_t len, bool ack, tlm_command_t *c);
+
+/**
+  * @brief Parses a lower case command name (`fly`, `land`, ...).
+  *
+  * @return 0 on success, -1 for unknown names.
+  **/
+int tlm_action_parse(const char *name, current_action_t *out);
+
+/**
+  * @brief Lower case name of a drone state, as parsed by `tlm_action_parse`.
+  **/
+const char *tlm_action_name(current_action_t a);
+
+/**
+  * @brief Default subscription: every channel at `interval_us`, no thresholds.
+  **/
+void tlm_subscription_default(tlm_subscription_t *s, uint32_t interval_us);
+
+/**
+  * @brief Channel name, as used by the operator `sub` command.
+  **/
+const char *tlm_channel_name(uint8_t channel);
+
+/**
+  * @brief Alert kind name.
+  **/
+const char *alert_name(uint8_t kind);
+
+/**
+  * @brief Checks for a whole frame at the start of `buf`.
+  *
+  * @return Frame length, 0 when more bytes are needed, -1 on a malformed header.
+  **/
+int tlm_frame_len(const uint8_t *buf, size_t len);
+
+/**
+  * @brief Decodes one whole frame, passing each record (several for a batch) or alert it carries to `sink`.
+  *
+  * @note History keyframes leave the decoder state alone, live deltas go on right after them.
+  *
+  * @return Number of records and alerts passed, -1 on a malformed frame.
+  **/
+int tlm_decode(tlm_decoder_t *d, const uint8_t *frame, size_t len, const tlm_sink_t *sink);
+
+/**
+  * @brief LZ4 block compression.
+  *
+  * @return Compressed length, 0 when the output would not fit into `cap` bytes.
+  **/
+size_t lz4_compress(const uint8_t *src, size_t len, uint8_t *dst, size_t cap);
+
+/**
+  * @brief LZ4 block decompression.
+  *
+  * @return Decompressed length, -1 on malformed input or when the output would not fit into `cap` bytes.
+  **/
+int lz4_decompress(const uint8_t *src, size_t len, uint8_t *dst, size_t cap);
+
+/**
+  * @brief Telemetry transport, selected with the `-t` option of drone_sys.
+  **/
+typedef enum {
+    TransportTcp = 0,   // Reliable stream. A lost segment delays everything behind it.
+    TransportUdp,       // Datagrams, optionally protected by XOR parity (`-f` option).
+} telemetry_transport_t;
+
+#define DGRAM_MAGIC         0xA6
+#define DGRAM_HEADER_SIZE   7                                           // Magic, type, group and sequence number.
+#define DGRAM_FRAGMENT      1200                                        // Largest data of one datagram.
+#define DGRAM_FRAGMENTS_MAX 16                                          // Fragments of the longest frame.
+#define DGRAM_BODY_MAX      (11 + DGRAM_FRAGMENT)                       // Timestamp, length, fragment and data.
+#define DGRAM_MAX           (DGRAM_HEADER_SIZE + DGRAM_BODY_MAX)
+#define DGRAM_FEC_MAX       16                                          // Largest FEC group.
+#define DGRAM_GROUPS        4                                           // FEC groups the receiver restores at once.
+#define DGRAM_REASSEMBLY    4                                           // Fragmented frames reassembled at once.
+
+/**
+  * @brief Datagram types.
+  **/
+typedef enum {
+    DgramData   = 1,    // One telemetry frame.
+    DgramParity = 2,    // XOR of the data datagrams of one FEC group.
+} dgram_type_t;
+
+/**
+  * @brief Sender side state of the UDP transport.
+  **/
+typedef struct {
+    uint32_t seq;                           // Sequence number of the next data datagram.
+    uint8_t group;                          // FEC group size, 0 without FEC.
+    size_t parity_len;                      // Longest body of the current group.
+    uint8_t parity[DGRAM_BODY_MAX];         // XOR of the bodies of the current group.
+} dgram_tx_t;
+
+/**
+  * @brief Data and parity datagrams of one FEC group, as received.
+  **/
+typedef struct {
+    uint32_t first;                                 // Sequence number of the first data datagram.
+    uint8_t size;                                   // Group size, 0 for an unused entry.
+    uint32_t have;                                  // Bit per data datagram received or restored.
+    bool parity;                                    // Parity received, in the last body.
+    size_t len[DGRAM_FEC_MAX + 1];
+    uint8_t body[DGRAM_FEC_MAX + 1][DGRAM_BODY_MAX];
+} dgram_group_t;
+
+/**
+  * @brief Fragments of one frame, as received.
+  **/
+typedef struct {
+    uint32_t first;                                 // Sequence number of the first fragment.
+    uint8_t count;                                  // Fragment count, 0 for an unused entry.
+    uint16_t have;                                  // Bit per fragment received.
+    bool restored;                                  // Some fragment was restored from parity.
+    size_t len;                                     // Frame length, known once the last fragment arrived.
+    uint8_t data[DGRAM_FRAGMENTS_MAX * DGRAM_FRAGMENT];
+} dgram_frame_t;
+
+/**
+  * @brief Receiver side state and statistics of the UDP transport. Zeroed state waits for the first datagram.
+  **/
+typedef struct {
+    bool started;
+    uint32_t highest;                       // Highest data sequence number received.
+    uint64_t seen;                          // Bit `i` set when `highest - i` was received.
+    uint64_t expected;                      // Data datagrams sent, as far as sequence numbers tell.
+    uint64_t received;                      // Distinct data datagrams received or restored.
+    uint64_t reordered;                     // Received after a higher sequence number.
+    uint64_t duplicates;
+    uint64_t restored;                      // Restored from parity.
+    dgram_group_t groups[DGRAM_GROUPS];
+    dgram_frame_t frames[DGRAM_REASSEMBLY];
+} dgram_rx_t;
+
+/**
+  * @brief Receives each frame of the UDP transport, with its send time.
+  **/
+typedef void (*dgram_sink_t)(const uint8_t *frame, size_t len, uint64_t ts_us, bool restored, void *arg);
+
+/**
+  * @brief Number of datagrams carrying a frame of `len` bytes.
+  **/
+int dgram_fragments(size_t len);
+
+/**
+  * @brief Wraps fragment `index` of a frame into the next data datagram stamped with `ts_us` and adds it to the
+  *        current FEC group.
+  *
+  * @return Datagram length (at most `DGRAM_MAX`), 0 when the frame is too long.
+  **/
+size_t dgram_data(dgram_tx_t *tx, const uint8_t *frame, size_t len, int index, uint64_t ts_us, uint8_t *dst);
+
+/**
+  * @brief Writes the parity datagram of the FEC group completed by the last data datagram.
+  *
+  * @return Datagram length, 0 when there is no completed group.
+  **/
+size_t dgram_parity(dgram_tx_t *tx, uint8_t *dst);
+
+/**
+  * @brief Handles one received datagram. Passes each frame it completes, directly or by restoring another datagram,
+  *        to `deliver`.
+  *
+  * @return 0 on success, -1 on a malformed datagram.
+  **/
+int dgram_receive(dgram_rx_t *rx, const uint8_t *pkt, size_t len, dgram_sink_t deliver, void *arg);
+
+#define SYNC_BINS           32          // Bins of best samples the drone clock is fitted on.
+
+/**
+  * @brief One clock offset exchange, reduced.
+  **/
+typedef struct {
+    uint64_t at_us;                 // Local time the exchange completed.
+    int64_t offset_us;              // Remote minus local clock.
+    uint64_t delay_us;              // Round trip, without the time the remote side held the request.
+} clock_sample_t;
+
+/**
+  * @brief Remote clock estimate: `offset_us + drift * (t - ref_us)` is the remote minus local clock at local time `t`.
+  **/
+typedef struct {
+    clock_sample_t bins[SYNC_BINS];     // Ring of the shortest round trip samples of past bins.
+    int bins_len, bins_next;
+    clock_sample_t best;                // Shortest round trip sample of the bin being filled.
+    uint64_t bin_start_us;
+    bool has_best;
+
+    bool valid;
+    uint64_t ref_us;
+    double offset_us, drift;
+    uint64_t error_us;                  // The remote clock is within that many microseconds of the estimate.
+    uint32_t fitted;                    // Samples the estimate is based on.
+    uint64_t samples, rejected;
+} clock_sync_t;
+
+/**
+  * @brief Adds one four timestamp exchange: request sent at `t1` (local), received at `t2` (remote), answer sent at
+  *        `t3` (remote) and received at `t4` (local). Updates the estimate.
+  **/
+void clock_sync_sample(clock_sync_t *c, uint64_t t1, uint64_t t2, uint64_t t3, uint64_t t4);
+
+/**
+  * @brief Translates remote time `remote_us` into local time.
+  *
+  * @return false while there is no estimate yet.
+  **/
+bool clock_sync_local(const clock_sync_t *c, uint64_t remote_us, uint64_t *local_us);
+
+/**
+  * @brief Serves a whole fleet of drones on telemetry address `addr` with `threads` workers, until `*stop` is set.
+  *        Heartbeats go to every drone each `heartbeat_us` (0 for none). See fleet.c.
+  *
+  * @return Exit code of the operator.
+  **/
+int fleet_serve(const struct sockaddr_in *addr, int threads, uint64_t heartbeat_us, volatile sig_atomic_t *stop);
+
+/**
+  * @brief Starts the dashboard gateway on `addr`: a web page and a WebSocket stream of the telemetry. See dashboard.c.
+  *
+  * @return -1 when it cannot listen.
+  **/
+int dash_start(const struct sockaddr_in *addr);
+
+/**
+  * @brief Stops the dashboard gateway and closes every viewer.
+  **/
+void dash_stop(void);
+
+/**
+  * @brief Streams frame `seq` of `drone` to the dashboard viewers. Callable from any thread, returns at once when
+  *        nobody watches.
+  **/
+void dash_record(uint32_t drone, const tlm_record_t *r, uint32_t seq, uint64_t ts_us);
+
+/**
+  * @brief Streams alert `seq` of `drone` to the dashboard viewers. Callable from any thread.
+  **/
+void dash_alert(uint32_t drone, const alert_t *a, uint32_t seq);
+
 /**
   * @brief Table of PIDs for all drone subsystem processes.
   *
@@ -142,7 +1037,7 @@ void rwlock_write_unlock(rw_lock_t *rwlock);
   *         It allows parent process to respawn them when they are killed or crashed.
   **/
 typedef struct {
-    pid_t flight_ctrl, accel, battery, gps_ctrl, telemetry, wdg;
+    pid_t flight_ctrl, accel, battery, gps_ctrl, telemetry, wdg, physics;
 } drone_pids_t;
 
 
@@ -150,7 +1045,7 @@ typedef struct {
   * @brief  Table of counters, where each actor increments them individually.
   **/
 typedef struct {
-    uint32_t flight_ctrl, accel, battery, gps_ctrl, telemetry;
+    uint32_t flight_ctrl, accel, battery, gps_ctrl, telemetry, physics;
 } wdg_counters_t;
 
 /**
@@ -167,6 +1062,23 @@ typedef struct {
     // Telemetry and flight controller port.
     uint16_t telemetry_port, flight_ctrl_port;
 
+    // Wait strategy per channel.
+    wait_config_t wait;
+    // Telemetry wire encoding.
+    telemetry_encoding_t encoding;
+    // Drone identification, sent to the operator in hello frames.
+    uint32_t drone_id;
+    // Telemetry transport and FEC group size (0 without FEC).
+    telemetry_transport_t transport;
+    uint8_t fec_group;
+    // Multicast group the UDP transport sends to instead of the operator (0 for unicast), and its TTL.
+    struct in_addr multicast_group;
+    uint8_t multicast_ttl;
+    // Longest telemetry silence before a heartbeat is sent, and operator silence before landing (0 disables both).
+    uint32_t heartbeat_us, link_timeout_us;
+    // Sensor aggregation window, 0 sends the latest sample only.
+    uint32_t agg_window_us;
+
     // Counters for watchdog process.
     wdg_counters_t wdg;
 
@@ -174,12 +1086,14 @@ typedef struct {
     struct {
         rw_lock_t lock;         // RWlock.
         current_action_t type;  // Raw data type.
+        notify_t changed;       // Posted on each change.
     } action;
 
     // Single-writer, multiple-readers => one mutex for all.
     struct {
         sem_t mutex;                    // Mutex lock.
         acceleration_t acceleration;    // Raw data type.
+        notify_t published;             // Posted after each sample.
     } accel;
 
     // Single-writer, multiple-readers => one mutex for all.
@@ -188,17 +1102,215 @@ typedef struct {
         motors_t motors;                // Raw data type.
     } pwm;
 
-    // Producer-consumer problem with circular buffer and indexes.
+    // Single-writer, multiple-readers broadcast ring => lock-free, see gps_ring.c.
     struct {
-        sem_t mutex, full, empty;           // Semaphores with termination conditions to prevent busy loop.
-        size_t write, read;                 // Local counter for producer and consumer.
-        nmea_t nmea;                        // Raw buffer.
+        _Atomic(uint64_t) write;                    // Sentences published so far.
+        _Atomic(uint32_t) demand;                   // Bit per reader that currently wants fixes.
+        notify_t wake;                              // Posted when demand appears.
+        gps_reader_t readers[GPS_MAX_READERS];      // Independent consumer cursors.
+        nmea_t nmea;                                // Raw buffer.
     } gps;
 
     // Atomical value => no extra synchronization primitive.
     bat_charge_t battery;
+
+    // Multiple-writers, single-reader => lock-free queue of state change requests, applied by the flight controller.
+    mpsc_queue_t intents;
+
+    // Multiple-writers, single-reader => lock-free queue of urgent events, sent by the telemetry unit.
+    struct {
+        mpsc_queue_t queue;                         // Pending alerts.
+        notify_t posted;                            // Posted on each alert and subscription change.
+    } alerts;
+
+    // Single-writer, single-reader => guarded by a sequence counter like a GPS ring slot, see state.c.
+    struct {
+        _Atomic(uint32_t) version;                  // Odd while the flight controller writes it.
+        tlm_subscription_t sub;                     // Operator subscription, applied by the telemetry unit.
+    } subscription;
+
+    // Single-writer, single-reader => guarded by a sequence counter like the subscription.
+    struct {
+        _Atomic(uint32_t) version;                  // Odd while the flight controller writes it.
+        uint64_t ts_us, rx_us;                      // Last operator heartbeat, echoed by the telemetry unit.
+    } echo;
+
+    // Single-writer, single-reader => guarded by a sequence counter like the subscription.
+    struct {
+        _Atomic(uint32_t) version;                  // Odd while the flight controller writes it.
+        uint32_t from;                              // First frame the operator misses.
+    } resume;
+
+    // Single-writer, multiple-readers => guarded by a sequence counter like the subscription.
+    struct {
+        _Atomic(uint32_t) version;                  // Odd while the physics actor writes it.
+        truth_t state;                              // Latest integrated state.
+    } truth;
+
+    // Written and read by the telemetry unit only. Shared so that a respawned unit still has it.
+    tlm_history_ring_t history;
+
+    // Multiple-writers, multiple-readers => writers serialized by mutex, readers lock-free (see state.c).
+    struct {
+        sem_t mutex;                                // Writers mutex lock.
+        _Atomic(uint64_t) epoch;                    // Latest published snapshot.
+        drone_state_t buf[SNAPSHOT_BUFFERS];        // Triple buffer.
+    } snapshot;
 } drone_shared_t;
 
+/**
+  * @brief Starts snapshot update. Returns next buffer, pre-filled with the latest published state.
+  *
+  * @note Must always be followed by `snapshot_commit`.
+  **/
+drone_state_t *snapshot_begin(drone_shared_t *shm_ptr);
+
+/**
+  * @brief Publishes buffer obtained by `snapshot_begin`.
+  **/
+void snapshot_commit(drone_shared_t *shm_ptr);
+
+/**
+  * @brief Copies the latest published snapshot. Lock-free.
+  **/
+void snapshot_read(drone_shared_t *shm_ptr, drone_state_t *out);
+
+/**
+  * @brief Starts an empty window.
+  **/
+void agg_reset(agg_acc_t *a);
+
+/**
+  * @brief Adds one sample of every stream.
+  **/
+void agg_add(agg_acc_t *restrict a, const float v[restrict AGG_LANES]);
+
+/**
+  * @brief Computes statistics of the accumulated window.
+  **/
+void agg_finish(const agg_acc_t *a, agg_window_t *out);
+
+/**
+  * @brief Changes drone action and publishes it within the snapshot.
+  *
+  * @note Only the flight controller arbitration shall call it. Other actors post intents instead.
+  **/
+void action_set(drone_shared_t *shm_ptr, current_action_t type);
+
+/**
+  * @brief Requests state change. Applied by the flight controller during its next arbitration step.
+  *
+  * @return false when the intent queue is full.
+  **/
+bool intent_post(drone_shared_t *shm_ptr, current_action_t type, intent_prio_t priority, intent_source_t source);
+
+/**
+  * @brief Raises an alert for the operator and wakes the telemetry unit.
+  *
+  * @return false when the alert queue is full.
+  **/
+bool alert_post(drone_shared_t *shm_ptr, alert_kind_t kind, actor_t actor, int32_t value);
+
+/**
+  * @brief Publishes new operator subscription and wakes the telemetry unit. Flight controller only.
+  **/
+void subscription_publish(drone_shared_t *shm_ptr, const tlm_subscription_t *sub);
+
+/**
+  * @brief Copies the subscription if it changed since `*version`, then updates `*version`. Lock-free.
+  *
+  * @return true when `out` holds a new subscription.
+  **/
+bool subscription_read(drone_shared_t *shm_ptr, uint32_t *version, tlm_subscription_t *out);
+
+/**
+  * @brief Publishes the send time of the last operator heartbeat and its receive time, for the telemetry unit to
+  *        echo. Flight controller only.
+  **/
+void echo_publish(drone_shared_t *shm_ptr, uint64_t ts_us, uint64_t rx_us);
+
+/**
+  * @brief Fills the echo fields of `out` if a heartbeat was published since `*version`, then updates `*version`.
+  *        Lock-free.
+  *
+  * @return true when `out` holds a new echo.
+  **/
+bool echo_read(drone_shared_t *shm_ptr, uint32_t *version, tlm_heartbeat_t *out);
+
+/**
+  * @brief Publishes an operator backfill request and wakes the telemetry unit. Flight controller only.
+  **/
+void resume_publish(drone_shared_t *shm_ptr, uint32_t from);
+
+/**
+  * @brief Copies the backfill request if one was published since `*version`, then updates `*version`. Lock-free.
+  *
+  * @return true when `from` holds a new request.
+  **/
+bool resume_read(drone_shared_t *shm_ptr, uint32_t *version, uint32_t *from);
+
+/**
+  * @brief Publishes the integrated airframe state. Physics actor only.
+  **/
+void truth_publish(drone_shared_t *shm_ptr, const truth_t *t);
+
+/**
+  * @brief Copies the latest airframe state. Lock-free, retries while the physics actor writes it.
+  **/
+void truth_read(drone_shared_t *shm_ptr, truth_t *out);
+
+/**
+  * @brief NMEA sentences of the simulated GPS, sent in that order.
+  **/
+typedef enum {
+    NmeaGGA,
+    NmeaGSA,
+    NmeaRMC,
+    NmeaVTG,
+    NmeaCount,
+} nmea_kind_t;
+
+/**
+  * @brief Formats sentence `kind` of a fix at `pos` moving at `vel` (world frame) into `buf`. See nmea.c.
+  *
+  * @return Sentence length.
+  **/
+size_t nmea_format(char *buf, size_t size, nmea_kind_t kind, const float pos[3], const float vel[3]);
+
+/**
+  * @brief Publishes one sentence to all GPS consumers. Overwrites the oldest slot.
+  **/
+void gps_ring_publish(drone_shared_t *shm_ptr, const char *s, size_t len);
+
+/**
+  * @brief Registers a new GPS consumer.
+  *
+  * @return Reader id, or -1 when all reader entries are taken.
+  **/
+int gps_reader_join(drone_shared_t *shm_ptr);
+
+/**
+  * @brief Unregisters GPS consumer.
+  **/
+void gps_reader_leave(drone_shared_t *shm_ptr, int id);
+
+/**
+  * @brief Raises or clears demand of the given GPS consumer. The producer only runs while any demand is raised.
+  **/
+void gps_reader_demand(drone_shared_t *shm_ptr, int id, bool on);
+
+/**
+  * @brief Returns the current GPS demand mask, after dropping demand left behind by dead consumers.
+  **/
+uint32_t gps_demand(drone_shared_t *shm_ptr);
+
+/**
+  * @brief Reads next sentence for the given GPS consumer without blocking.
+  *
+  * @return 1 when `out` holds a sentence, 0 when nothing new is available.
+  **/
+int gps_ring_read(drone_shared_t *shm_ptr, int id, nmea_sentence_t *out, bool latest);
+
 #define __PRINTACT_HELPER(name) \
     case name:                  \
         msg = #name;            \
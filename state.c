@@ -0,0 +1,248 @@
+/** 
+  * @file state.c
+  * @brief Publication of a consistent drone state snapshot.
+  *
+  * Main tasks:
+  * - Let every writer (battery, accelerometer, flight controller, action changes) update its fields of one shared
+  *   snapshot, so that all fields of a published snapshot belong to the same instant.
+  * - Let readers (telemetry, recorders) obtain the latest snapshot without taking any lock.
+  * - Let any actor request a state change through the intent queue.
+  * - Let any process raise an alert for the telemetry urgent lane.
+  * - Pass the operator subscription from the flight controller to the telemetry unit.
+  * - Pass the last operator heartbeat the same way, for the clock offset exchange, and operator backfill requests.
+  * - Pass the airframe ground truth from the physics actor to the sensors.
+  *
+  * @note
+  *
+  * Snapshots are triple buffered and identified by a monotonically increasing epoch. Writers are serialized by a mutex
+  * and always prepare buffer `epoch + 1`, while readers copy buffer `epoch`. That buffer is only reused by the writer
+  * of `epoch + 3`, which cannot start before `epoch + 2` is published, so a reader retries only when it observes the
+  * epoch advancing by two or more while copying.
+  **/
+
+#include "proj_types.h"
+
+/**
+  * @brief Starts snapshot update. Returns next buffer, pre-filled with the latest published state.
+  *
+  * @note Must always be followed by `snapshot_commit`.
+  **/
+drone_state_t *snapshot_begin(drone_shared_t *shm_ptr) {
+    uint64_t epoch;
+    drone_state_t *next;
+
+    sem_wait(&shm_ptr->snapshot.mutex);
+
+    epoch = atomic_load_explicit(&shm_ptr->snapshot.epoch, memory_order_relaxed);
+    next = &shm_ptr->snapshot.buf[(epoch + 1) % SNAPSHOT_BUFFERS];
+    *next = shm_ptr->snapshot.buf[epoch % SNAPSHOT_BUFFERS];
+
+    return next;
+}
+
+/**
+  * @brief Publishes buffer obtained by `snapshot_begin`.
+  **/
+void snapshot_commit(drone_shared_t *shm_ptr) {
+    uint64_t epoch = atomic_load_explicit(&shm_ptr->snapshot.epoch, memory_order_relaxed) + 1;
+    drone_state_t *next = &shm_ptr->snapshot.buf[epoch % SNAPSHOT_BUFFERS];
+
+    next->epoch = epoch;
+    clock_gettime(CLOCK_MONOTONIC, &next->stamp);
+
+    atomic_store_explicit(&shm_ptr->snapshot.epoch, epoch, memory_order_release);
+    sem_post(&shm_ptr->snapshot.mutex);
+}
+
+/**
+  * @brief Copies the latest published snapshot. Lock-free.
+  **/
+void snapshot_read(drone_shared_t *shm_ptr, drone_state_t *out) {
+    for (;;) {
+        uint64_t epoch = atomic_load_explicit(&shm_ptr->snapshot.epoch, memory_order_acquire);
+
+        memcpy(out, &shm_ptr->snapshot.buf[epoch % SNAPSHOT_BUFFERS], sizeof(*out));
+
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&shm_ptr->snapshot.epoch, memory_order_relaxed) - epoch < SNAPSHOT_BUFFERS - 1)
+            return;
+    }
+}
+
+/**
+  * @brief Changes drone action, publishes it within the snapshot and notifies `action.changed` waiters.
+  **/
+void action_set(drone_shared_t *shm_ptr, current_action_t type) {
+    drone_state_t *s;
+
+    rwlock_write_lock(&shm_ptr->action.lock);
+    shm_ptr->action.type = type;
+
+    s = snapshot_begin(shm_ptr);
+    s->action = type;
+    snapshot_commit(shm_ptr);
+
+    rwlock_write_unlock(&shm_ptr->action.lock);
+
+    notify_post(&shm_ptr->action.changed);
+    alert_post(shm_ptr, AlertState, ActorFlightCtrl, type);
+}
+
+/**
+  * @brief Requests state change. Applied by the flight controller during its next arbitration step.
+  **/
+bool intent_post(drone_shared_t *shm_ptr, current_action_t type, intent_prio_t priority, intent_source_t source) {
+    intent_t intent = {
+        .type = type,
+        .priority = priority,
+        .source = source,
+    };
+
+    clock_gettime(CLOCK_MONOTONIC, &intent.stamp);
+
+    if (!mpsc_push(&shm_ptr->intents, &intent, sizeof(intent))) {
+        fprintf(stderr, "Intent queue is full, state change request dropped.\n");
+        return false;
+    }
+
+    return true;
+}
+
+/**
+  * @brief Raises an alert for the operator and wakes the telemetry unit.
+  **/
+bool alert_post(drone_shared_t *shm_ptr, alert_kind_t kind, actor_t actor, int32_t value) {
+    struct timespec now;
+    alert_t alert = {
+        .kind = kind,
+        .actor = actor,
+        .value = value,
+    };
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    alert.stamp_us = now.tv_sec * 1000000ull + now.tv_nsec / 1000;
+
+    if (!mpsc_push(&shm_ptr->alerts.queue, &alert, sizeof(alert))) {
+        fprintf(stderr, "Alert queue is full, alert dropped.\n");
+        return false;
+    }
+
+    notify_post(&shm_ptr->alerts.posted);
+    return true;
+}
+
+/**
+  * @brief Publishes new operator subscription and wakes the telemetry unit. Flight controller only.
+  **/
+void subscription_publish(drone_shared_t *shm_ptr, const tlm_subscription_t *sub) {
+    seqlock_write_begin(&shm_ptr->subscription.version);
+    shm_ptr->subscription.sub = *sub;
+    seqlock_write_end(&shm_ptr->subscription.version);
+    notify_post(&shm_ptr->alerts.posted);
+}
+
+/**
+  * @brief Copies the subscription if it changed since `*version`, then updates `*version`. Lock-free.
+  *
+  * @note A torn copy is simply retried on the next call.
+  **/
+bool subscription_read(drone_shared_t *shm_ptr, uint32_t *version, tlm_subscription_t *out) {
+    uint32_t v = seqlock_read_begin(&shm_ptr->subscription.version);
+
+    if (v == *version)
+        return false;
+
+    memcpy(out, &shm_ptr->subscription.sub, sizeof(*out));
+    if (seqlock_read_retry(&shm_ptr->subscription.version, v))
+        return false;
+
+    *version = v;
+    return true;
+}
+
+/**
+  * @brief Publishes the last operator heartbeat for the telemetry unit to echo. Flight controller only.
+  *
+  * @note The telemetry unit is not woken up, the echo carries its own send time and can wait for the next frame.
+  **/
+void echo_publish(drone_shared_t *shm_ptr, uint64_t ts_us, uint64_t rx_us) {
+    seqlock_write_begin(&shm_ptr->echo.version);
+    shm_ptr->echo.ts_us = ts_us;
+    shm_ptr->echo.rx_us = rx_us;
+    seqlock_write_end(&shm_ptr->echo.version);
+}
+
+/**
+  * @brief Copies the echo if it changed since `*version`, then updates `*version`. Lock-free.
+  **/
+bool echo_read(drone_shared_t *shm_ptr, uint32_t *version, tlm_heartbeat_t *out) {
+    uint32_t v = seqlock_read_begin(&shm_ptr->echo.version);
+    uint64_t ts_us, rx_us;
+
+    if (v == *version)
+        return false;
+
+    ts_us = shm_ptr->echo.ts_us;
+    rx_us = shm_ptr->echo.rx_us;
+    if (seqlock_read_retry(&shm_ptr->echo.version, v))
+        return false;
+
+    out->echo_ts_us = ts_us;
+    out->echo_rx_us = rx_us;
+    *version = v;
+    return true;
+}
+
+/**
+  * @brief Publishes an operator backfill request and wakes the telemetry unit. Flight controller only.
+  **/
+void resume_publish(drone_shared_t *shm_ptr, uint32_t from) {
+    seqlock_write_begin(&shm_ptr->resume.version);
+    shm_ptr->resume.from = from;
+    seqlock_write_end(&shm_ptr->resume.version);
+    notify_post(&shm_ptr->alerts.posted);
+}
+
+/**
+  * @brief Copies the backfill request if it changed since `*version`, then updates `*version`. Lock-free.
+  **/
+bool resume_read(drone_shared_t *shm_ptr, uint32_t *version, uint32_t *from) {
+    uint32_t v = seqlock_read_begin(&shm_ptr->resume.version);
+    uint32_t f;
+
+    if (v == *version)
+        return false;
+
+    f = shm_ptr->resume.from;
+    if (seqlock_read_retry(&shm_ptr->resume.version, v))
+        return false;
+
+    *from = f;
+    *version = v;
+    return true;
+}
+
+/**
+  * @brief Publishes the integrated airframe state. Physics actor only.
+  **/
+void truth_publish(drone_shared_t *shm_ptr, const truth_t *t) {
+    seqlock_write_begin(&shm_ptr->truth.version);
+    shm_ptr->truth.state = *t;
+    seqlock_write_end(&shm_ptr->truth.version);
+}
+
+/**
+  * @brief Copies the latest airframe state. Lock-free.
+  *
+  * @note Unlike the other channels, a torn copy is retried at once. Sensors sample the truth on their own schedule
+  *       and always need a value, while the writer only holds it for the time of one copy.
+  **/
+void truth_read(drone_shared_t *shm_ptr, truth_t *out) {
+    uint32_t v;
+
+    do {
+        while ((v = seqlock_read_begin(&shm_ptr->truth.version)) & 1)
+            sched_yield();
+        memcpy(out, &shm_ptr->truth.state, sizeof(*out));
+    } while (seqlock_read_retry(&shm_ptr->truth.version, v));
+}
@@ -0,0 +1,762 @@
+/**
+  * @file swarm.c
+  * @brief Batch simulator: many drones in one process, wire compatible with the operator fleet mode (`-w`).
+  *
+  * Main tasks:
+  * - Hold the dynamics, accelerometer model and battery of every drone in structure-of-arrays blocks.
+  * - Advance all of them at the fixed step of physics.c with vector kernels, AVX2 when the CPU has it, on `-j` threads
+  *   that each own a contiguous range of blocks.
+  * - Run the flight controller of each drone at its own cycle (see flight_ctrl.c).
+  * - Introduce every drone with a hello and send its telemetry at `-r` frames per second, over TCP or UDP, as drone_sys
+  *   with `-e delta` does. State changes go out as alerts.
+  * - Take numbered commands on one UDP socket per thread and acknowledge them for the drone they address.
+  * - `-b`: step the swarm without any network as fast as it goes, and report how many drones one host steps in real
+  *   time.
+  *
+  * @note
+  *
+  * A block holds `SWARM_LANES` drones, every field as one vector of lanes, so that a kernel loads, computes and stores
+  * whole vectors. The kernels are written with GCC vector extensions and compiled twice (`target_clones`): for AVX2,
+  * picked at load time when the CPU has it, and for the baseline, where each vector operation is split into SSE ones.
+  * The model is the one of physics.c, step for step, except for the quaternion renormalization: a first order
+  * Newton step towards unit length instead of a square root, exact enough for the drift of one step.
+  *
+  * Drones without a lane of their own (the padding of the last block) stay on the ground with their motors off.
+  *
+  * The control cycle, battery rules and state machine follow flight_ctrl.c and battery.c. `Abort` lands like `Land`
+  * and ends in `Charge`. The operator subscription, heartbeats and backfill requests are ignored: the frame rate is
+  * fixed. Controllers and frames of different drones are spread over the steps of their period, so that every step
+  * costs about the same.
+  **/
+
+#include "proj_types.h"
+#include <pthread.h>
+
+#define SWARM_LANES         8
+#define SWARM_THREADS_MAX   64
+#define SWARM_CTRL_STEPS    (DELTA_SIMULATION_US / PHYS_PERIOD_US)
+#define SWARM_POLL_STEPS    10                          // Commands and TCP backlog checks.
+#define SWARM_MAX_BACKLOG   50                          // Steps integrated at most per wakeup, older ones are dropped.
+#define SWARM_REPORT_US     10000000
+#define SWARM_HELLO_US      1000000                     // Hello repetition over UDP.
+#define SWARM_GPS_US        1000000                     // One NMEA sentence per second in `SampleGPS`.
+#define SWARM_SPACING       5.0f                        // Takeoff grid (m).
+#define SWARM_OUT           2048                        // TCP bytes queued per drone while its socket is full.
+
+#define DISCHARGE_PER_S     (1000.0f / DISCHARGE_INTERVAL_MS)   // Battery model of battery.c, in % per second.
+#define CHARGE_PER_S        (1000.0f / CHARGE_INTERVAL_MS)
+
+typedef float v8f __attribute__((vector_size(SWARM_LANES * sizeof(float))));
+typedef int32_t v8i __attribute__((vector_size(SWARM_LANES * sizeof(int32_t))));
+typedef uint32_t v8u __attribute__((vector_size(SWARM_LANES * sizeof(uint32_t))));
+
+/**
+  * @brief State of `SWARM_LANES` drones. Same fields as `truth_t`, plus the sensor and battery models.
+  **/
+typedef struct {
+    v8f pos[3], vel[3], att[4], rate[3];
+    v8f thrust[4], pwm[4];
+    v8f force[3];                   // Specific force in the body frame.
+    v8f accel[3];                   // Its accelerometer reading.
+    v8f battery;                    // Charge (%).
+    v8f charge_rate;                // Charge change in the current state (% per second).
+    v8u rng;                        // Noise generator.
+} swarm_block_t;
+
+/**
+  * @brief Control and wire state of one drone.
+  **/
+typedef struct {
+    int fd;
+    uint32_t id;
+    current_action_t action;
+    current_action_t command;       // Operator command taken at the next control cycle, `Reserved` for none.
+    uint32_t command_seq;           // Last numbered command applied.
+    bool command_seen;
+    tlm_encoder_t enc;
+    dgram_tx_t tx;                  // UDP: datagram numbering.
+    uint32_t alert_seq;
+    uint64_t hello_us, gps_us;
+    int gps_next;                   // Next `nmea_kind_t`.
+    size_t out_len;                 // TCP: bytes waiting in `out`.
+    uint8_t out[SWARM_OUT];
+} swarm_drone_t;
+
+typedef struct {
+    pthread_t thread;
+    int index;
+    swarm_block_t *blocks;
+    int blocks_len;
+    swarm_drone_t *drones;
+    int len;
+    int cmd_fd;                     // Commands to these drones, -1 when not open.
+    uint16_t cmd_port;
+    uint64_t steps, step_ns, dropped, frames, bytes, skipped, commands;
+} swarm_thread_t;
+
+volatile sig_atomic_t sigterm = 0;
+
+static telemetry_transport_t transport = TransportTcp;
+static bool bench = false;
+static long frame_steps = 100;      // Steps between two frames of a drone.
+static uint64_t end_us = UINT64_MAX;
+
+static uint64_t now_us(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000ull + now.tv_nsec / 1000;
+}
+
+static void sigterm_handler(int sig) {
+    (void)sig;
+    sigterm = 1;
+}
+
+/* Lane-wise `m ? a : b`, `m` being a comparison result. Vectors only pass through macros and pointers, the
+   baseline build has no ABI for them. */
+#define vsel(m, a, b)   ((v8f)(((v8i)(a) & (m)) | ((v8i)(b) & ~(m))))
+
+/* Standard normal noise per lane, approximated by the sum of four uniform 16 bit samples of a xorshift generator. */
+static inline void gauss8(v8u *x, v8f *out) {
+    v8u u[2];
+    v8i sum;
+
+    for (int i = 0; i < 2; ++i) {
+        *x ^= *x << 13;
+        *x ^= *x >> 17;
+        *x ^= *x << 5;
+        u[i] = *x;
+    }
+    sum = (v8i)((u[0] & 0xffff) + (u[0] >> 16) + (u[1] & 0xffff) + (u[1] >> 16));
+    *out = (__builtin_convertvector(sum, v8f) * (1.0f / 65536.0f) - 2.0f) * 1.7320508f;
+}
+
+/**
+  * @brief Advances `len` blocks by one step: dynamics as in physics.c, accelerometer reading and battery.
+  **/
+__attribute__((target_clones("avx2", "default")))
+static void swarm_step(swarm_block_t *restrict blocks, int len) {
+    const float d = PHYS_ARM * (float)M_SQRT1_2, k = PHYS_DT / PHYS_MOTOR_TAU;
+    const v8f zero = { 0 };
+
+    for (int b = 0; b < len; ++b) {
+        swarm_block_t *s = &blocks[b];
+        v8f qw = s->att[0], qx = s->att[1], qy = s->att[2], qz = s->att[3];
+        v8f wx = s->rate[0], wy = s->rate[1], wz = s->rate[2];
+        v8f v0[3] = { s->vel[0], s->vel[1], s->vel[2] };
+        v8f total = zero, zb[3], a[3], fw[3], noise[3], tx, ty, tz, n;
+        v8i ground, stop, rest;
+
+        // Motors follow their PWM with a first order lag.
+        for (int i = 0; i < 4; ++i) {
+            v8f pwm = s->pwm[i];
+
+            pwm = vsel(pwm < 0.0f, zero, pwm);
+            pwm = vsel(pwm > 1.0f, zero + 1.0f, pwm);
+            s->thrust[i] += (PHYS_MOTOR_MAX_THRUST * pwm * pwm - s->thrust[i]) * k;
+            total += s->thrust[i];
+        }
+
+        zb[0] = 2.0f * (qx * qz + qw * qy);
+        zb[1] = 2.0f * (qy * qz - qw * qx);
+        zb[2] = 1.0f - 2.0f * (qx * qx + qy * qy);
+
+        for (int i = 0; i < 3; ++i)
+            a[i] = (zb[i] * total - PHYS_DRAG_LIN * s->vel[i]) / PHYS_MASS;
+        a[2] -= PHYS_GRAVITY;
+
+        for (int i = 0; i < 3; ++i) {
+            s->vel[i] += a[i] * PHYS_DT;
+            s->pos[i] += s->vel[i] * PHYS_DT;
+        }
+
+        ground = s->pos[2] <= 0.0f;
+        s->pos[2] = vsel(ground, zero, s->pos[2]);
+        stop = ground & (s->vel[2] < 0.0f);
+        for (int i = 0; i < 3; ++i)
+            s->vel[i] = vsel(stop, zero, s->vel[i]);
+
+        tx = d * (s->thrust[0] - s->thrust[1] + s->thrust[2] - s->thrust[3]) - PHYS_DRAG_ANG * wx;
+        ty = d * (s->thrust[2] + s->thrust[3] - s->thrust[0] - s->thrust[1]) - PHYS_DRAG_ANG * wy;
+        tz = PHYS_YAW_COEF * (s->thrust[0] - s->thrust[1] - s->thrust[2] + s->thrust[3]) - PHYS_DRAG_ANG * wz;
+
+        rest = ground & (s->vel[2] == 0.0f);
+        n = wx;
+        wx = vsel(rest, zero, wx + (tx - (PHYS_INERTIA_Z - PHYS_INERTIA_XY) * wy * wz) / PHYS_INERTIA_XY * PHYS_DT);
+        wy = vsel(rest, zero, wy + (ty - (PHYS_INERTIA_XY - PHYS_INERTIA_Z) * wz * n) / PHYS_INERTIA_XY * PHYS_DT);
+        wz = vsel(rest, zero, wz + tz / PHYS_INERTIA_Z * PHYS_DT);
+
+        s->att[0] = qw + 0.5f * PHYS_DT * (-qx * wx - qy * wy - qz * wz);
+        s->att[1] = qx + 0.5f * PHYS_DT * ( qw * wx + qy * wz - qz * wy);
+        s->att[2] = qy + 0.5f * PHYS_DT * ( qw * wy - qx * wz + qz * wx);
+        s->att[3] = qz + 0.5f * PHYS_DT * ( qw * wz + qx * wy - qy * wx);
+        n = (3.0f - (s->att[0] * s->att[0] + s->att[1] * s->att[1] + s->att[2] * s->att[2] + s->att[3] * s->att[3]))
+            * 0.5f;
+        for (int i = 0; i < 4; ++i)
+            s->att[i] *= n;
+
+        s->rate[0] = wx;
+        s->rate[1] = wy;
+        s->rate[2] = wz;
+
+        for (int i = 0; i < 3; ++i)
+            fw[i] = (s->vel[i] - v0[i]) * (1.0f / PHYS_DT);
+        fw[2] += PHYS_GRAVITY;
+
+        qw = s->att[0], qx = s->att[1], qy = s->att[2], qz = s->att[3];
+        s->force[0] = (1.0f - 2.0f * (qy * qy + qz * qz)) * fw[0] + 2.0f * (qx * qy + qw * qz) * fw[1]
+            + 2.0f * (qx * qz - qw * qy) * fw[2];
+        s->force[1] = 2.0f * (qx * qy - qw * qz) * fw[0] + (1.0f - 2.0f * (qx * qx + qz * qz)) * fw[1]
+            + 2.0f * (qy * qz + qw * qx) * fw[2];
+        s->force[2] = 2.0f * (qx * qz + qw * qy) * fw[0] + 2.0f * (qy * qz - qw * qx) * fw[1]
+            + (1.0f - 2.0f * (qx * qx + qy * qy)) * fw[2];
+
+        for (int i = 0; i < 3; ++i)
+            gauss8(&s->rng, &noise[i]);
+        s->accel[0] = s->force[0] + NOISE_XY_STD * noise[0];
+        s->accel[1] = s->force[1] + NOISE_XY_STD * noise[1];
+        s->accel[2] = s->force[2] + NOISE_Z_STD * noise[2];
+
+        s->battery += s->charge_rate * PHYS_DT;
+        s->battery = vsel(s->battery < 0.0f, zero, s->battery);
+        s->battery = vsel(s->battery > 100.0f, zero + 100.0f, s->battery);
+    }
+}
+
+/**
+  * @brief Sends the TCP bytes queued for drone `d`, as many as its socket takes.
+  **/
+static void drone_flush(swarm_thread_t *t, swarm_drone_t *d) {
+    ssize_t n = send(d->fd, d->out, d->out_len, MSG_DONTWAIT | MSG_NOSIGNAL);
+
+    if (n < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            perror("send");
+            sigterm = 1;
+        }
+        return;
+    }
+    t->bytes += n;
+    d->out_len -= n;
+    memmove(d->out, d->out + n, d->out_len);
+}
+
+/**
+  * @brief Sends one whole frame of drone `d`. Over UDP a datagram the socket does not take is lost, as on the air.
+  **/
+static void drone_send(swarm_thread_t *t, swarm_drone_t *d, const uint8_t *frame, size_t len, uint64_t ts_us) {
+    uint8_t pkt[DGRAM_HEADER_SIZE + DGRAM_BODY_MAX];
+    size_t pkt_len;
+
+    if (transport == TransportTcp) {
+        memcpy(d->out + d->out_len, frame, len);
+        d->out_len += len;
+        drone_flush(t, d);
+        return;
+    }
+
+    pkt_len = dgram_data(&d->tx, frame, len, 0, ts_us, pkt);
+    if (send(d->fd, pkt, pkt_len, MSG_DONTWAIT) < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != ECONNREFUSED) {
+            perror("send");
+            sigterm = 1;
+        }
+        return;
+    }
+    t->bytes += pkt_len;
+}
+
+/**
+  * @brief Room for one more frame in the TCP queue of `d`. A frame that does not fit is never encoded, so the deltas
+  *        of the stream stay consistent.
+  **/
+static bool drone_room(const swarm_drone_t *d, size_t len) {
+    return transport != TransportTcp || d->out_len + len <= SWARM_OUT;
+}
+
+/**
+  * @brief Applies the new state of drone `d` and tells the operator.
+  **/
+static void drone_state(swarm_thread_t *t, swarm_drone_t *d, current_action_t action) {
+    uint8_t frame[TLM_ALERT_MAX];
+    alert_t a = { .kind = AlertState, .actor = ActorFlightCtrl, .value = action, .stamp_us = now_us() };
+
+    d->action = action;
+    if (bench || !drone_room(d, TLM_ALERT_MAX))
+        return;
+    drone_send(t, d, frame, tlm_alert(&a, d->alert_seq++, false, frame), a.stamp_us);
+}
+
+/**
+  * @brief One flight controller cycle of drone `i` of thread `t`: motors, battery protection and state machine.
+  **/
+static void drone_control(swarm_thread_t *t, int i) {
+    swarm_block_t *s = &t->blocks[i / SWARM_LANES];
+    swarm_drone_t *d = &t->drones[i];
+    int l = i % SWARM_LANES;
+    current_action_t next = d->action, cmd = d->command;
+    float avg = 0.0f, battery = s->battery[l], correction;
+
+    d->command = Reserved;
+    for (int m = 0; m < 4; ++m)
+        avg += s->pwm[m][l];
+    avg /= 4.0f;
+
+    switch (d->action) {
+        case Fly:
+            correction = avg >= ACCEL_STABILIZATION_THRESHOLD ? s->accel[0][l] + s->accel[1][l] : 0.0f;
+            for (int m = 0; m < 4; ++m) {
+                float p = s->pwm[m][l] + (avg < FLY_THRESH ? DELTA_INCREASE : 0.0f) - correction;
+                s->pwm[m][l] = p < 0.0f ? 0.0f : p > 1.0f ? 1.0f : p;
+            }
+            if (cmd & (SampleGPS | Land | Abort))
+                next = cmd;
+            break;
+        case SampleGPS:
+            if (cmd & (Fly | Abort))
+                next = cmd;
+            break;
+        case Idle:
+            if (cmd & (Fly | Charge | Abort))
+                next = cmd;
+            break;
+        case Charge:
+            if ((cmd & (Idle | Abort)) && battery >= BATTERY_LOW)
+                next = cmd;
+            break;
+        case Land:
+        case Abort:
+            if (d->action == Land && (cmd & (Fly | Abort))) {
+                next = cmd;
+                break;
+            }
+            avg = 0.0f;
+            for (int m = 0; m < 4; ++m) {
+                float p = s->pwm[m][l] - DELTA_DECREASE;
+                s->pwm[m][l] = p < 0.0f ? 0.0f : p;
+                avg += s->pwm[m][l];
+            }
+            if (avg == 0.0f)
+                next = d->action == Abort ? Charge : Idle;
+            break;
+        default:
+            next = Abort;
+    }
+
+    if (battery < BATTERY_LOW && next != Abort && next != Charge)
+        next = Abort;
+
+    s->charge_rate[l] = next == Charge ? CHARGE_PER_S : -DISCHARGE_PER_S;
+    if (next != d->action)
+        drone_state(t, d, next);
+}
+
+/**
+  * @brief Sends the telemetry frame of drone `i` of thread `t`, and its hello over UDP when due.
+  **/
+static void drone_frame(swarm_thread_t *t, int i, uint64_t ts_us) {
+    swarm_block_t *s = &t->blocks[i / SWARM_LANES];
+    swarm_drone_t *d = &t->drones[i];
+    int l = i % SWARM_LANES;
+    uint8_t frame[TLM_FRAME_MAX];
+    tlm_record_t r = d->enc.prev;
+
+    if (transport == TransportUdp && ts_us - d->hello_us >= SWARM_HELLO_US) {
+        d->hello_us = ts_us;
+        drone_send(t, d, frame, tlm_hello(&(tlm_hello_t){ .id = d->id, .flight_ctrl_port = t->cmd_port }, frame),
+            ts_us);
+    }
+    if (!drone_room(d, TLM_FRAME_MAX)) {
+        t->skipped++;
+        return;
+    }
+
+    r.channels = 1 << TlmBattery | 1 << TlmAccel | 1 << TlmMotors | 1 << TlmAction;
+    r.battery = (uint8_t)ceilf(s->battery[l]);
+    r.action = d->action;
+    r.acceleration = (acceleration_t){ s->accel[0][l], s->accel[1][l], s->accel[2][l] };
+    for (int m = 0; m < 4; ++m)
+        r.motors.motors[m] = s->pwm[m][l];
+    r.samples = 0;
+    r.gps_lost = false;
+    r.gps_len = 0;
+
+    if (d->action == SampleGPS && ts_us - d->gps_us >= SWARM_GPS_US) {
+        float pos[3] = { s->pos[0][l], s->pos[1][l], s->pos[2][l] };
+        float vel[3] = { s->vel[0][l], s->vel[1][l], s->vel[2][l] };
+        char nmea[GPS_SENTENCE_SIZE + 1];
+        size_t len = nmea_format(nmea, sizeof(nmea), d->gps_next, pos, vel);
+
+        r.gps_len = len < GPS_SENTENCE_SIZE ? len : GPS_SENTENCE_SIZE;
+        memcpy(r.gps, nmea, r.gps_len);
+        if (len > 0)
+            r.channels |= 1 << TlmGps;
+        d->gps_next = (d->gps_next + 1) % NmeaCount;
+        d->gps_us = ts_us;
+    }
+
+    // Every frame stands alone over UDP.
+    if (transport == TransportUdp)
+        d->enc.key_us = 0;
+    drone_send(t, d, frame, tlm_encode(&d->enc, &r, ts_us, frame), ts_us);
+    t->frames++;
+}
+
+/**
+  * @brief Acknowledges command `c` for drone `d` and queues it, unless it is a repeated or older one (see
+  *        flight_ctrl.c).
+  **/
+static void command_take(swarm_thread_t *t, swarm_drone_t *d, const tlm_command_t *c, const struct sockaddr_in *from) {
+    uint8_t ack[TLM_COMMAND_SIZE];
+
+    tlm_command(&(tlm_command_t){ .seq = c->seq, .id = d->id, .action = d->action }, true, ack);
+    if (sendto(t->cmd_fd, ack, sizeof(ack), MSG_DONTWAIT, (const struct sockaddr *)from, sizeof(*from)) < 0)
+        perror("sendto(ack)");
+
+    if (d->command_seen && (int32_t)(c->seq - d->command_seq) <= 0)
+        return;
+    d->command_seq = c->seq;
+    d->command_seen = true;
+    d->command = c->action;
+    t->commands++;
+}
+
+/**
+  * @brief Takes every queued command of the ground station. A command for drone 0 goes to all drones of the thread.
+  *        Heartbeats, subscriptions and backfill requests are dropped.
+  **/
+static void commands_read(swarm_thread_t *t) {
+    uint8_t frame[TLM_FRAME_MAX];
+    struct sockaddr_in from;
+    socklen_t len = sizeof(from);
+    tlm_command_t c;
+    ssize_t n;
+
+    while ((n = recvfrom(t->cmd_fd, frame, sizeof(frame), MSG_DONTWAIT, (struct sockaddr *)&from, &len)) >= 0) {
+        len = sizeof(from);
+        if (tlm_command_decode(frame, n, false, &c) < 0)
+            continue;
+        if (c.id == 0) {
+            for (int i = 0; i < t->len; ++i)
+                command_take(t, &t->drones[i], &c, &from);
+        } else if (c.id >= t->drones[0].id && c.id - t->drones[0].id < (uint32_t)t->len) {
+            command_take(t, &t->drones[c.id - t->drones[0].id], &c, &from);
+        }
+    }
+}
+
+/**
+  * @brief Runs the per drone work due at step `step`: controllers and frames, each drone at its own phase.
+  **/
+static void swarm_due(swarm_thread_t *t, uint64_t step, uint64_t ts_us) {
+    for (int i = (SWARM_CTRL_STEPS - step % SWARM_CTRL_STEPS) % SWARM_CTRL_STEPS; i < t->len; i += SWARM_CTRL_STEPS)
+        drone_control(t, i);
+    if (bench)
+        return;
+    for (int i = (frame_steps - step % frame_steps) % frame_steps; i < t->len; i += frame_steps)
+        drone_frame(t, i, ts_us);
+}
+
+/**
+  * @brief Thread loop: every step due since the last wakeup, then sleeps until the next one. In the benchmark, steps
+  *        back to back until the end.
+  **/
+static void *swarm_loop(void *arg) {
+    swarm_thread_t *t = arg;
+    uint64_t sim_ns, report_ns, start, now, due, step = 0;
+    uint64_t period_steps = 0, period_ns = 0, period_dropped = 0, period_frames = 0;
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    sim_ns = report_ns = ts.tv_sec * 1000000000ull + ts.tv_nsec;
+
+    while (!sigterm) {
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        now = ts.tv_sec * 1000000000ull + ts.tv_nsec;
+        if (now / 1000 >= end_us)
+            break;
+
+        due = bench ? SWARM_MAX_BACKLOG : now > sim_ns ? (now - sim_ns) / (PHYS_PERIOD_US * 1000) : 0;
+        if (due > SWARM_MAX_BACKLOG) {
+            period_dropped += due - SWARM_MAX_BACKLOG;
+            sim_ns += (due - SWARM_MAX_BACKLOG) * PHYS_PERIOD_US * 1000;
+            due = SWARM_MAX_BACKLOG;
+        }
+
+        start = now;
+        for (uint64_t i = 0; i < due; ++i, ++step) {
+            swarm_step(t->blocks, t->blocks_len);
+            swarm_due(t, step, now / 1000);
+            if (!bench && step % SWARM_POLL_STEPS == 0) {
+                commands_read(t);
+                for (int k = 0; transport == TransportTcp && k < t->len; ++k)
+                    if (t->drones[k].out_len > 0)
+                        drone_flush(t, &t->drones[k]);
+            }
+        }
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        now = ts.tv_sec * 1000000000ull + ts.tv_nsec;
+        sim_ns += due * PHYS_PERIOD_US * 1000;
+        period_ns += now - start;
+        period_steps += due;
+
+        if (!bench && now - report_ns >= SWARM_REPORT_US * 1000ull) {
+            printf("Thread %d: %d drones, %.1f ns/drone-step, achieved %.3f, %lu steps dropped, %.0f frames/s, "
+                "%lu frames skipped, %lu commands\n", t->index, t->len,
+                period_steps ? (double)period_ns / period_steps / t->len : 0.0,
+                (double)period_steps * PHYS_PERIOD_US * 1000.0 / (now - report_ns), (unsigned long)period_dropped,
+                (t->frames - period_frames) * 1e9 / (now - report_ns), (unsigned long)t->skipped,
+                (unsigned long)t->commands);
+            report_ns = now;
+            period_frames = t->frames;
+            period_steps = period_ns = period_dropped = 0;
+        }
+
+        t->steps += due;
+        t->step_ns += now - start;
+
+        if (!bench) {
+            ts.tv_sec = (sim_ns + PHYS_PERIOD_US * 1000) / 1000000000ull;
+            ts.tv_nsec = (sim_ns + PHYS_PERIOD_US * 1000) % 1000000000ull;
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+        }
+    }
+    return NULL;
+}
+
+/**
+  * @brief Opens the command socket of thread `t`, on a port chosen by the system.
+  **/
+static int thread_open(swarm_thread_t *t) {
+    struct sockaddr_in local = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_ANY) };
+    socklen_t len = sizeof(local);
+
+    t->cmd_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (t->cmd_fd < 0) {
+        perror("socket(commands)");
+        return -1;
+    }
+    if (bind(t->cmd_fd, (struct sockaddr *)&local, sizeof(local)) < 0 ||
+        getsockname(t->cmd_fd, (struct sockaddr *)&local, &len) < 0)
+    {
+        perror("bind(commands)");
+        return -1;
+    }
+    // All drones of the thread receive a fleet command at once.
+    if (setsockopt(t->cmd_fd, SOL_SOCKET, SO_RCVBUF, &(int){ t->len * 1024 }, sizeof(int)) < 0)
+        perror("setsockopt(SO_RCVBUF)");
+    t->cmd_port = ntohs(local.sin_port);
+    return 0;
+}
+
+/**
+  * @brief Opens the telemetry stream of drone `d` and introduces it. Over UDP the hello goes with the first frame.
+  **/
+static int drone_open(swarm_drone_t *d, const struct sockaddr_in *addr, uint16_t cmd_port) {
+    uint8_t hello[TLM_HELLO_SIZE];
+
+    d->fd = socket(AF_INET, transport == TransportTcp ? SOCK_STREAM : SOCK_DGRAM, 0);
+    if (d->fd < 0) {
+        perror("socket");
+        return -1;
+    }
+    if (connect(d->fd, (const struct sockaddr *)addr, sizeof(*addr)) < 0) {
+        perror("connect");
+        return -1;
+    }
+    if (transport == TransportTcp &&
+        send(d->fd, hello, tlm_hello(&(tlm_hello_t){ .id = d->id, .flight_ctrl_port = cmd_port }, hello),
+            MSG_NOSIGNAL) != TLM_HELLO_SIZE)
+    {
+        perror("send(hello)");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+  * @brief Places every drone on the ground of its takeoff grid cell, level, motors off, battery full.
+  **/
+static void swarm_init(swarm_block_t *blocks, int blocks_len, long count) {
+    int side = (int)ceil(sqrt((double)count));
+
+    memset(blocks, 0, blocks_len * sizeof(*blocks));
+    for (int i = 0; i < blocks_len * SWARM_LANES; ++i) {
+        swarm_block_t *s = &blocks[i / SWARM_LANES];
+        int l = i % SWARM_LANES;
+
+        s->pos[0][l] = (i % side) * SWARM_SPACING;
+        s->pos[1][l] = (i / side) * SWARM_SPACING;
+        s->att[0][l] = 1.0f;
+        s->battery[l] = 100.0f;
+        s->charge_rate[l] = -DISCHARGE_PER_S;
+        s->rng[l] = 2654435761u * (i + 1) | 1;
+    }
+}
+
+int main(int argc, char **argv) {
+    static swarm_thread_t threads[SWARM_THREADS_MAX];
+    struct sigaction sa = { .sa_handler = sigterm_handler };
+    struct sockaddr_in addr = { .sin_family = AF_INET };
+    swarm_block_t *blocks = NULL;
+    swarm_drone_t *drones = NULL;
+    long jobs = 1, seconds = 0, count, first_id = 1, blocks_len;
+    uint64_t steps = 0, step_ns = 0, frames = 0, bytes = 0, start_us;
+    int opt, ret = 0, opened = 0, started = 0;
+    double rate_hz = 10.0, s, drone_steps;
+    char *end;
+
+    while ((opt = getopt(argc, argv, "t:j:d:r:i:b")) != -1) {
+        switch (opt) {
+            case 't':
+                if (strcmp(optarg, "tcp") == 0)         transport = TransportTcp;
+                else if (strcmp(optarg, "udp") == 0)    transport = TransportUdp;
+                else {
+                    fprintf(stderr, "Bad telemetry transport.\n");
+                    goto _usage;
+                }
+                break;
+            case 'j':
+            case 'd':
+                *(opt == 'j' ? &jobs : &seconds) = strtol(optarg, &end, 10);
+                if (*optarg == 0 || *end != 0 || jobs < 1 || jobs > SWARM_THREADS_MAX || seconds < 0) {
+                    fprintf(stderr, "Bad thread count (1 to %d) or duration.\n", SWARM_THREADS_MAX);
+                    goto _usage;
+                }
+                break;
+            case 'r':
+                rate_hz = strtod(optarg, &end);
+                if (*optarg == 0 || *end != 0 || !(rate_hz > 0) || rate_hz > 1e6 / PHYS_PERIOD_US) {
+                    fprintf(stderr, "Bad frame rate (%d at most).\n", 1000000 / PHYS_PERIOD_US);
+                    goto _usage;
+                }
+                break;
+            case 'i':
+                first_id = strtol(optarg, &end, 10);
+                if (*optarg == 0 || *end != 0 || first_id < 1) {
+                    fprintf(stderr, "Bad first drone id.\n");
+                    goto _usage;
+                }
+                break;
+            case 'b':
+                bench = true;
+                break;
+            default:
+                goto _usage;
+        }
+    }
+
+    if (argc - optind < (bench ? 1 : 3)) {
+_usage:
+        fprintf(stderr, "Usage: %s [-t tcp|udp] [-j threads] [-d seconds] [-r frames_per_s] [-i first_id] "
+            "<operator_ip> <telemetry_port> <drones>\n       %s -b [-j threads] [-d seconds] <drones>\n",
+            argv[0], argv[0]);
+        return 1;
+    }
+    argv += optind - 1;     // Positional arguments start at argv[1].
+
+    count = strtol(argv[bench ? 1 : 3], &end, 10);
+    if (*end != 0 || count < 1) {
+        fprintf(stderr, "Bad drone count.\n");
+        return 1;
+    }
+    if (!bench) {
+        if (inet_pton(AF_INET, argv[1], &addr.sin_addr) <= 0) {
+            fprintf(stderr, "Bad operator address.\n");
+            return 1;
+        }
+        addr.sin_port = htons(atoi(argv[2]));
+    } else if (seconds == 0) {
+        seconds = 10;
+    }
+    frame_steps = lround(1e6 / PHYS_PERIOD_US / rate_hz);
+    blocks_len = (count + SWARM_LANES - 1) / SWARM_LANES;
+    if (jobs > blocks_len)
+        jobs = blocks_len;
+
+    sigemptyset(&sa.sa_mask);
+    if (sigaction(SIGTERM, &sa, NULL) == -1 || sigaction(SIGINT, &sa, NULL) == -1) {
+        perror("sigaction");
+        return 1;
+    }
+
+    blocks = aligned_alloc(sizeof(v8f), blocks_len * sizeof(*blocks));
+    drones = calloc(count, sizeof(*drones));
+    if (blocks == NULL || drones == NULL) {
+        perror("alloc");
+        ret = 1;
+        goto _shutdown;
+    }
+    swarm_init(blocks, blocks_len, count);
+
+    // Threads own whole blocks. The drones of the padding lanes belong to nobody.
+    for (int i = 0; i < jobs; ++i) {
+        long first = blocks_len * i / jobs, last = blocks_len * (i + 1) / jobs;
+
+        threads[i].index = i;
+        threads[i].blocks = blocks + first;
+        threads[i].blocks_len = last - first;
+        threads[i].drones = drones + first * SWARM_LANES;
+        threads[i].len = (last * SWARM_LANES < count ? last * SWARM_LANES : count) - first * SWARM_LANES;
+        threads[i].cmd_fd = -1;
+    }
+    for (long i = 0; i < count; ++i) {
+        drones[i].fd = -1;
+        drones[i].id = first_id + i;
+        drones[i].action = Idle;
+        drones[i].command = Reserved;
+    }
+
+    for (int i = 0; i < jobs && !bench; ++i) {
+        if (thread_open(&threads[i]) < 0) {
+            ret = 1;
+            goto _shutdown;
+        }
+        for (int k = 0; k < threads[i].len; ++k, ++opened) {
+            if (drone_open(&threads[i].drones[k], &addr, threads[i].cmd_port) < 0) {
+                ret = 1;
+                goto _shutdown;
+            }
+        }
+    }
+    printf("%ld drones in %ld blocks of %d, %ld threads, %s kernel%s%s.\n", count, blocks_len, SWARM_LANES, jobs,
+        __builtin_cpu_supports("avx2") ? "AVX2" : "baseline", bench ? ", benchmark" : ", connected over ",
+        bench ? "" : transport == TransportTcp ? "TCP" : "UDP");
+
+    start_us = now_us();
+    if (seconds > 0)
+        end_us = start_us + seconds * 1000000ull;
+    for (int i = 0; i < jobs; ++i) {
+        if ((errno = pthread_create(&threads[i].thread, NULL, swarm_loop, &threads[i])) != 0) {
+            perror("pthread_create");
+            sigterm = 1;
+            break;
+        }
+        started++;
+    }
+    for (int i = 0; i < started; ++i) {
+        pthread_join(threads[i].thread, NULL);
+        steps += threads[i].steps * threads[i].len;
+        step_ns += threads[i].step_ns;
+        frames += threads[i].frames;
+        bytes += threads[i].bytes;
+    }
+
+    // Real time is one step per drone each `PHYS_PERIOD_US`.
+    s = (now_us() - start_us) / 1e6;
+    drone_steps = steps / s;
+    printf("Stepped %lu drone-steps in %.1f s: %.0f drone-steps/s, %.1f ns/drone-step on each thread, %.0f drones "
+        "in real time, %.0f frames/s, %.0f B/s\n", (unsigned long)steps, s, drone_steps,
+        steps ? (double)step_ns / steps : 0.0, drone_steps * PHYS_PERIOD_US / 1e6, frames / s, bytes / s);
+
+_shutdown:
+    for (int i = 0; i < opened; ++i)
+        close(drones[i].fd);
+    for (int i = 0; i < jobs; ++i)
+        if (threads[i].cmd_fd >= 0)
+            close(threads[i].cmd_fd);
+    free(drones);
+    free(blocks);
+    return ret;
+}
@@ -1,35 +1,202 @@
 /** 
   * @file telemetry.c
-  * @brief Connects to operator and sends all sensor data via TCP.
+  * @brief Connects to operator and sends all sensor data via TCP or UDP.
   *
   * Main tasks:
   *  - Connect to operator TCP server (IP/port from shared memory).
-  *  - Periodically send battery, accel, and action state.
+  *  - Send the channels the operator subscribed to, each at its own rate or when it moved past its threshold. Full
+  *    rate in the air at most, reduced rate on the ground.
+  *  - Encode frames as text, binary deltas or LZ4 compressed batches of deltas (`-e` option of drone_sys).
+  *  - Send alerts on an urgent lane that overtakes queued periodic frames.
+  *  - Send accelerometer window statistics instead of a single sample when aggregation is on.
+  *  - Send frames as UDP datagrams with XOR parity instead (`-t udp`, `-f` options of drone_sys), possibly to a
+  *    multicast group joined by any number of ground stations (`-m`, `-T` options).
+  *  - Send a heartbeat whenever nothing else was sent for `-b` ms, so that the operator can tell a quiet
+  *    subscription from a dead link.
+  *  - Echo each operator heartbeat in a binary heartbeat of its own, stamped when it is handed to the socket, so that
+  *    the operator can estimate the drone clock (see clock_sync.c).
+  *  - Keep the last `TLM_HISTORY` frames and replay the ones an operator missed when it asks for them after a
+  *    reconnect.
+  *  - Introduce the drone with a hello frame at the start of each connection, and every `HELLO_PERIOD_US` over UDP
+  *    where any datagram may be the first one heard. Binary encodings only, text streams must not start with one.
+  *
+  * @note
+  *
+  * The kernel is only allowed to hold `TELEMETRY_UNSENT_MAX` unsent bytes, everything else waits in the lanes
+  * below. Lanes are switched between whole frames only, so an alert waits for at most the frame being sent and the
+  * small kernel backlog, never for the periodic frames queued behind them. Periodic frames are dropped oldest first
+  * when the link cannot keep up.
+  *
+  * Over UDP every frame can be decoded alone: binary frames are all keyframes and LZ4 batches start with one. A lost
+  * datagram therefore never delays nor invalidates the frames after it. Frames longer than one datagram (text frames
+  * of large GPS sentences, LZ4 batches) are fragmented, see datagram.c.
+  *
+  * A multicast frame is sent once, whatever the number of ground stations listening. The sending cost per frame
+  * (`cpu/frame` in the link report) is the same as with one unicast receiver, while a TCP connection per station costs
+  * it once per station.
+  *
+  * Every frame built gets the next history sequence number, also used as its wire sequence number, so the operator
+  * knows where it left off. A backfill replays frames as history keyframes on a lane of their own, sent only when the
+  * other lanes are empty: live frames keep their latency and the backlog takes whatever bandwidth is left. Over TCP it
+  * ends right before the first frame of the connection, over UDP (which has none) at the request. UDP has no flow
+  * control either, it is paced at `BACKFILL_BURST` frames per wakeup.
+  *
+  * Subscriptions are compiled into a plan holding one emitter per subscribed channel. Each wakeup only walks the
+  * plan, so unsubscribed channels are never read, compared, formatted nor sent, and the actor sleeps until the
+  * earliest emitter is due.
   *
   */
 
 #include "proj_types.h"
 
-#define TELEMETRY_TIMEOUT_US    10000
-#define TELEMETRY_BUF_SIZE      512 
+#define TELEMETRY_TIMEOUT_US    10000       // 100 Hz frames while the motors may spin.
+#define TELEMETRY_GROUND_US     100000      // 10 Hz frames on the ground (`Idle`, `Charge`).
+#define TELEMETRY_BUF_SIZE      (TLM_HEADER_SIZE + TLM_PAYLOAD_MAX)
+#define TELEMETRY_BATCH_US      100000      // Longest time a frame waits in an LZ4 batch.
+#define LINK_REPORT_S           10
 #define CONNECTION_TIMEOUT_MS   10000
 #define GPS_WAIT_TIMEOUT_S      5
-
-#define PERCENT(f) (int)(f * 100 + 0.5f)
+#define JITTER_REPORT_FRAMES    1000
+#define TELEMETRY_UNSENT_MAX    256         // Unsent bytes the kernel may hold.
+#define BACKLOG_POLL_US         1000        // Send retry period while the link is saturated.
+#define URGENT_FRAMES           16
+#define BULK_FRAMES             4
+#define BACKFILL_BURST          8           // History frames per wakeup over UDP.
+#define HELLO_PERIOD_US         1000000     // Hello repetition over UDP.
 
 static int sock_fd = -1;
 static bool init = true;
+static telemetry_transport_t transport = TransportTcp;
+
+static struct timespec last_fix;
+static struct timespec sampling_start;
+static bool gps_sampling = false, gps_lost = false, gps_first_fix = false;
+static int gps_reader = -1;
+
+/* Absolute deadline of the next wakeup. Keeps the frame cadence independent from the time spent building it. */
+static struct timespec next_frame;
+static wait_stats_t wait_stats = { .name = "telemetry" };
+static duty_stats_t duty = { .name = "telemetry", .full_period_us = TELEMETRY_TIMEOUT_US };
+static current_action_t frame_action = Idle;
+
+/**
+  * @brief Sends one subscribed channel.
+  **/
+typedef struct {
+    uint8_t channel;                // `tlm_channel_t`.
+    uint32_t interval_us;           // 0 for on change only.
+    float threshold;                // 0 for periodic only.
+    struct timespec next;           // Next periodic emission.
+    bool (*fill)(const drone_state_t *s, tlm_record_t *r);          // Copies the channel, false when it has no data.
+    float (*change)(const drone_state_t *s, const tlm_record_t *r); // How far it moved since it was last sent.
+} emitter_t;
+
+/* Compiled subscription. Only subscribed channels have an emitter. */
+static emitter_t plan[TlmChannels];
+static int plan_len;
+static bool plan_threshold;         // Some emitter checks its threshold on every full rate wakeup.
+static bool planned = false;
+static uint32_t sub_version;
+
+/* Last sent value of every channel. Channels missing from a frame keep their values, so deltas skip them for free. */
+static tlm_record_t sent;
+
+/* Newest GPS sentence or timeout not sent yet. */
+static char gps_fix[GPS_SENTENCE_SIZE];
+static uint8_t gps_fix_len;
+static bool gps_fix_lost;
+
+/* Binary encodings state. Reset on each new connection. */
+static tlm_encoder_t encoder;
+static uint8_t batch[TLM_BATCH_MAX];
+static size_t batch_len;
+static uint64_t batch_start_us;
+
+/* Output lanes. Rings of whole frames, `head` is written and `tail` is sent next. */
+static struct {
+    size_t len;
+    uint64_t stamp_us;              // When the alert was raised.
+    uint8_t data[TLM_ALERT_MAX];
+} urgent[URGENT_FRAMES];
+static uint32_t urgent_head, urgent_tail, alert_seq;
+
+static struct {
+    size_t len;
+    uint8_t data[TELEMETRY_BUF_SIZE];
+} bulk[BULK_FRAMES];
+static uint32_t bulk_head, bulk_tail;
+
+/* Frame being sent. */
+static uint8_t out[TELEMETRY_BUF_SIZE];
+static size_t out_len, out_off;
+static uint64_t out_stamp_us;       // Alert stamp, 0 for a periodic frame.
+
+/* UDP transport. `datagram` holds fragment `out_frag` of the frame being sent, wrapped. */
+static dgram_tx_t dgram;
+static uint8_t datagram[DGRAM_MAX];
+static size_t datagram_len;
+static int out_frag;
+static uint64_t out_ts_us;
+static bool multicast = false;
+
+/* Link heartbeat. */
+static uint64_t last_queued_us;     // Time the last frame was queued.
+static uint32_t beat_seq;
+
+/* Drone identification, sent ahead of everything else. */
+static tlm_hello_t hello;
+static uint64_t hello_us;
+static bool hello_pending = false;
+
+/* Operator heartbeat to echo. Sent between the lanes, it is stamped when it leaves. */
+static tlm_heartbeat_t echo;
+static uint32_t echo_version;
+static bool echo_pending = false;
+
+/* Backfill, the lowest lane. Replays `backfill_next` up to `backfill_end` from the history ring in shared memory. */
+static tlm_history_ring_t *history;
+static uint32_t resume_version, conn_first_seq;
+static uint32_t backfill_next, backfill_end, backfill_sent, backfill_budget;
+static bool backfilling = false;
+static struct timespec backfill_since;
+
+/* Sent since the last link report. */
+static uint64_t link_bytes, link_frames, link_dropped;
+static struct timespec link_since, link_cpu;
+
+static const char *encoding_names[] = { "text", "delta", "lz4" };
+static const char *transport_names[] = { "tcp", "udp" };
+
+/**
+  * @brief Frame interval statistics (microseconds), one entry per drone state.
+  **/
+typedef struct {
+    uint32_t frames;
+    double sum, sum_sq;
+    long min, max;
+} frame_jitter_t;
+
+static frame_jitter_t jitter[8];
+static struct timespec last_frame;
+static current_action_t last_action = Reserved;
 
 /**
   * @brief Tries to connect to operator's TCP server via data stored in shared memory. 
+  *
+  * @note Over UDP only sets the destination, which always succeeds. Multicast datagrams leave through the drone
+  *       interface and are looped back, so ground stations on the drone host receive them too.
   **/
 static bool try_connect(drone_shared_t *shm_ptr) {
     struct sockaddr_in op_addr;
+    struct in_addr iface;
+    char group[INET_ADDRSTRLEN];
+    unsigned char ttl = shm_ptr->multicast_ttl, loop = 1;
 
     if (sock_fd != -1)
         close(sock_fd);
 
-    sock_fd = socket(AF_INET, SOCK_STREAM, 0);
+    transport = shm_ptr->transport;
+    sock_fd = socket(AF_INET, transport == TransportUdp ? SOCK_DGRAM : SOCK_STREAM, 0);
     if (sock_fd < 0) {
         perror("telemetry socket()");
         return false;
@@ -46,8 +213,25 @@ static bool try_connect(drone_shared_t *shm_ptr) {
         return false;
     }
 
-    printf("Trying TCP connect to %s:%d...\n",
-           shm_ptr->operator_ip,
+    multicast = transport == TransportUdp && shm_ptr->multicast_group.s_addr != 0;
+    if (multicast) {
+        op_addr.sin_addr = shm_ptr->multicast_group;
+        if (inet_pton(AF_INET, shm_ptr->drone_ip, &iface) <= 0 ||
+            setsockopt(sock_fd, IPPROTO_IP, IP_MULTICAST_IF, &iface, sizeof(iface)) < 0 ||
+            setsockopt(sock_fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl)) < 0 ||
+            setsockopt(sock_fd, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop)) < 0)
+        {
+            perror("telemetry multicast setsockopt");
+            close(sock_fd);
+            sock_fd = -1;
+            return false;
+        }
+    }
+
+    inet_ntop(AF_INET, &op_addr.sin_addr, group, sizeof(group));
+    printf("Trying %s connect to %s:%d...\n",
+           multicast ? "UDP multicast" : transport == TransportUdp ? "UDP" : "TCP",
+           group,
            shm_ptr->telemetry_port);
 
     if (connect(sock_fd, (struct sockaddr*)&op_addr, sizeof(op_addr)) < 0) {
@@ -61,121 +245,678 @@ static bool try_connect(drone_shared_t *shm_ptr) {
     return true;
 }
 
-/* Helper function to fill TCP message buffer. */
-#define BUF_APPEND(msg, ptr, fmt, ...)                                                                          \
-    do {                                                                                                        \
-        if ((ptr) < sizeof(msg)) {                                                                              \
-            int _written = snprintf((msg) + (ptr), sizeof(msg) - (ptr), fmt "\n", ##__VA_ARGS__);               \
-            if (_written > 0) {                                                                                 \
-                (ptr) += (_written < (int)(sizeof(msg) - (ptr)) ? _written : (int)(sizeof(msg) - (ptr) - 1));   \
-            }                                                                                                   \
-        }                                                                                                       \
-    } while (0)
+/**
+  * @brief Records the interval since the previous frame for the given state and periodically prints its statistics.
+  **/
+static void jitter_record(current_action_t action, const struct timespec *now) {
+    frame_jitter_t *j = &jitter[__builtin_ctz(action) & 7];
+    long us;
+
+    if (last_frame.tv_sec != 0 && action == last_action) {
+        us = (now->tv_sec - last_frame.tv_sec) * 1000000 + (now->tv_nsec - last_frame.tv_nsec) / 1000;
+
+        if (j->frames == 0 || us < j->min) j->min = us;
+        if (j->frames == 0 || us > j->max) j->max = us;
+        j->sum += us;
+        j->sum_sq += (double)us * us;
+        j->frames++;
+    }
+
+    // Reports when the state is left or when enough frames were gathered.
+    frame_jitter_t *r = &jitter[__builtin_ctz(last_action) & 7];
+    if (r->frames > 0 && (action != last_action || r->frames >= JITTER_REPORT_FRAMES)) {
+        double mean = r->sum / r->frames;
+        double var = r->sum_sq / r->frames - mean * mean;
+
+        printf("Frame interval in state %d: n=%u mean=%.1f us stddev=%.1f us min=%ld us max=%ld us\n",
+            last_action, r->frames, mean, var > 0 ? sqrt(var) : 0.0, r->min, r->max);
+        memset(r, 0, sizeof(*r));
+    }
+
+    last_frame = *now;
+    last_action = action;
+}
 
 /**
-  * @brief telemetry sender loop function.
+  * @brief Non-blocking, latest-wins GPS consumer stage.
   *
-  * Does the following:
-  * - Reads all types of data within the shared memory region.
-  * - If operator is ready, sends data packages for real time samples of the system.
-  * - Not all resources are guaranteed to be sent in each package.
-  * - Only sends GPS data when internal state is `SampleGPS` (consumer).
+  * Takes only the newest sentence published since the previous call. Older unseen sentences are skipped and counted
+  * as dropped, so sampling that starts late never replays a stale backlog.
   *
+  * @return Number of bytes appended to `msg`.
   **/
-void telemetry_loop(drone_shared_t *shm_ptr) {
-    char msg[256] = {0};
-    size_t ptr = 0;
-    bat_charge_t battery;
-    acceleration_t accel;
-    current_action_t action;
-    motors_t m;
+static size_t gps_drain(drone_shared_t *shm_ptr, char *msg, size_t space) {
+    nmea_sentence_t fix;
+    struct timespec now;
+    gps_reader_t *r = &shm_ptr->gps.readers[gps_reader];
 
-    if (init) {
-        if (try_connect(shm_ptr))
-            init = false;
-        else
-            goto _wdg;
+    if (!gps_ring_read(shm_ptr, gps_reader, &fix, true) || fix.len > space)
+        return 0;
+
+    memcpy(msg, fix.s, fix.len);
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    printf("GPS fix age=%ld us dropped=%lu: %.*s",
+        (now.tv_sec - fix.stamp.tv_sec) * 1000000 + (now.tv_nsec - fix.stamp.tv_nsec) / 1000,
+        (unsigned long)r->dropped, (int)fix.len, fix.s);
+
+    return fix.len;
+}
+
+/**
+  * @brief Queues alert on the urgent lane. Drops the oldest one when the lane is full.
+  **/
+static void urgent_push(const alert_t *a, bool text) {
+    if (urgent_head - urgent_tail == URGENT_FRAMES) {
+        fprintf(stderr, "Urgent lane full, oldest alert dropped.\n");
+        urgent_tail++;
     }
 
-    battery = atomic_load_explicit(&shm_ptr->battery, memory_order_acquire);
-    BUF_APPEND(msg, ptr, "BAT = %d%%", battery);
+    urgent[urgent_head % URGENT_FRAMES].len = tlm_alert(a, alert_seq++, text, urgent[urgent_head % URGENT_FRAMES].data);
+    urgent[urgent_head % URGENT_FRAMES].stamp_us = a->stamp_us;
+    urgent_head++;
+}
+
+/**
+  * @brief Queues periodic frame on the bulk lane. Drops the oldest one when the lane is full.
+  **/
+static void bulk_push(const uint8_t *frame, size_t len) {
+    struct timespec now;
 
-    if (sem_trywait(&shm_ptr->accel.mutex) == 0) {
-        accel = shm_ptr->accel.acceleration;
-        sem_post(&shm_ptr->accel.mutex);
-        BUF_APPEND(msg, ptr, "ACCEL = (x: %.6f, y: %.6f, z: %.6f)", accel.x, accel.y, accel.z);
+    if (bulk_head - bulk_tail == BULK_FRAMES) {
+        bulk_tail++;
+        link_dropped++;
+        encoder.key_us = 0;     // Deltas after a gap are useless, next frame is a keyframe.
     }
 
-    if (sem_trywait(&shm_ptr->pwm.mutex) == 0) {
-        m = shm_ptr->pwm.motors;
-        sem_post(&shm_ptr->pwm.mutex);
-        BUF_APPEND(msg, ptr, "MOTORS PWM = [%d%%, %d%%, %d%%, %d%%]", 
-            PERCENT(m.motors[0]),
-            PERCENT(m.motors[1]),
-            PERCENT(m.motors[2]),
-            PERCENT(m.motors[3])
-        );
+    memcpy(bulk[bulk_head % BULK_FRAMES].data, frame, len);
+    bulk[bulk_head % BULK_FRAMES].len = len;
+    bulk_head++;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    last_queued_us = now.tv_sec * 1000000ull + now.tv_nsec / 1000;
+}
+
+static bool lanes_pending(void) {
+    return out_off < out_len || hello_pending || urgent_head != urgent_tail || echo_pending || bulk_head != bulk_tail || backfilling;
+}
+
+/**
+  * @brief Moves the next history frame to `out`.
+  **/
+static void backfill_next_frame(void) {
+    const tlm_history_t *h = &history->frames[backfill_next % TLM_HISTORY];
+    struct timespec now;
+
+    // Overwritten while the backlog was sent, a slow link fell more than the whole history behind.
+    if (h->seq != backfill_next) {
+        backfill_next = history->head - TLM_HISTORY;
+        h = &history->frames[backfill_next % TLM_HISTORY];
+    }
+
+    out_len = tlm_history(&h->record, h->seq, h->ts_us, out);
+    out_stamp_us = 0;
+    backfill_next++;
+    backfill_sent++;
+    backfill_budget--;
+
+    if ((int32_t)(backfill_next - backfill_end) >= 0) {
+        backfilling = false;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        printf("Backfill done: %u frames in %ld ms.\n", backfill_sent,
+            (now.tv_sec - backfill_since.tv_sec) * 1000 + (now.tv_nsec - backfill_since.tv_nsec) / NANOSECONDS_IN_MS);
+    }
+}
+
+/**
+  * @brief Moves the next frame to `out`: the hello, urgent lane, heartbeat echo, bulk lane and backfill, in that
+  *        order.
+  *
+  * @return false when there is nothing to send.
+  **/
+static bool lanes_next(void) {
+    struct timespec now;
+
+    if (hello_pending) {
+        out_len = tlm_hello(&hello, out);
+        out_stamp_us = 0;
+        hello_pending = false;
+    } else if (urgent_head != urgent_tail) {
+        out_len = urgent[urgent_tail % URGENT_FRAMES].len;
+        out_stamp_us = urgent[urgent_tail % URGENT_FRAMES].stamp_us;
+        memcpy(out, urgent[urgent_tail % URGENT_FRAMES].data, out_len);
+        urgent_tail++;
+    } else if (echo_pending) {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        echo.seq = beat_seq++;
+        echo.ts_us = now.tv_sec * 1000000ull + now.tv_nsec / 1000;
+        out_len = tlm_heartbeat(&echo, false, out);
+        out_stamp_us = 0;
+        echo_pending = false;
+        last_queued_us = echo.ts_us;
+    } else if (bulk_head != bulk_tail) {
+        out_len = bulk[bulk_tail % BULK_FRAMES].len;
+        out_stamp_us = 0;
+        memcpy(out, bulk[bulk_tail % BULK_FRAMES].data, out_len);
+        bulk_tail++;
+    } else if (backfilling && backfill_budget > 0) {
+        backfill_next_frame();
+    } else {
+        return false;
+    }
+
+    out_off = 0;
+    return true;
+}
+
+static void alert_sent(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    printf("Alert handed to the kernel %lu us after it was raised, %u periodic frames queued.\n",
+        (unsigned long)(now.tv_sec * 1000000ull + now.tv_nsec / 1000 - out_stamp_us), bulk_head - bulk_tail);
+}
+
+/**
+  * @brief Sends queued frames as datagrams, one per fragment, each followed by the parity of the FEC group it
+  *        completes.
+  *
+  * @return -1 when the socket failed.
+  **/
+static int lanes_pump_udp(void) {
+    struct timespec now;
+    ssize_t n;
+
+    for (;;) {
+        if (out_off == out_len) {
+            if (!lanes_next())
+                return 0;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            out_ts_us = now.tv_sec * 1000000ull + now.tv_nsec / 1000;
+            out_frag = 0;
+            datagram_len = dgram_data(&dgram, out, out_len, out_frag, out_ts_us, datagram);
+        }
+
+        // The socket buffer is full, the same datagram is retried later. A refused datagram (nobody listens yet) is
+        // as good as lost.
+        n = send(sock_fd, datagram, datagram_len, MSG_DONTWAIT);
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return 0;
+        if (n < 0 && errno != ECONNREFUSED)
+            return -1;
+
+        link_bytes += datagram_len;
+
+        datagram_len = dgram_parity(&dgram, datagram);
+        if (datagram_len > 0 && send(sock_fd, datagram, datagram_len, MSG_DONTWAIT) == (ssize_t)datagram_len)
+            link_bytes += datagram_len;
+
+        if (++out_frag < dgram_fragments(out_len)) {
+            datagram_len = dgram_data(&dgram, out, out_len, out_frag, out_ts_us, datagram);
+            continue;
+        }
+
+        out_off = out_len;
+        if (out_stamp_us)
+            alert_sent();
+    }
+}
+
+/**
+  * @brief Sends as much as the socket takes without blocking, urgent lane first.
+  *
+  * @return -1 when the connection is lost.
+  **/
+static int lanes_pump(void) {
+    if (transport == TransportUdp)
+        return lanes_pump_udp();
+
+    for (;;) {
+        if (out_off == out_len && !lanes_next())
+            return 0;
+
+        // Keeps the backlog in the lanes, where alerts can still overtake it. `TCP_NOTSENT_LOWAT` is not enough, it
+        // only applies when the kernel starts a new buffer and a loopback buffer holds 64 KiB.
+        int unsent = 0;
+        if (ioctl(sock_fd, SIOCOUTQNSD, &unsent) == 0 && unsent >= TELEMETRY_UNSENT_MAX)
+            return 0;
+        size_t room = TELEMETRY_UNSENT_MAX - unsent;
+
+        // MSG_NOSIGNAL prevents SIGPIPE when operator crashes during communication.
+        ssize_t n = send(sock_fd, out + out_off, out_len - out_off < room ? out_len - out_off : room,
+            MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return 0;
+        if (n <= 0)
+            return -1;
+
+        out_off += n;
+        link_bytes += n;
+
+        if (out_off == out_len && out_stamp_us)
+            alert_sent();
+    }
+}
+
+/**
+  * @brief Drops everything queued for the previous connection, except alerts. A backfill waits for a new request.
+  **/
+static void lanes_reset(void) {
+    bulk_head = bulk_tail = 0;
+    out_len = out_off = 0;
+    memset(&encoder, 0, sizeof(encoder));
+    batch_len = 0;
+    backfilling = false;
+    conn_first_seq = history->head;
+}
+
+/**
+  * @brief Starts replaying history from frame `from` on, up to the first live frame the operator has.
+  **/
+static void backfill_start(uint32_t from, telemetry_encoding_t encoding) {
+    uint32_t head = history->head;
+    uint32_t oldest = head > TLM_HISTORY ? head - TLM_HISTORY : 0;
+    uint32_t start = from;
+
+    if (encoding == EncodingText) {
+        printf("Backfill from seq %u ignored, text frames cannot be replayed.\n", from);
+        return;
+    }
+
+    backfill_end = transport == TransportTcp ? conn_first_seq : head;
+    if ((int32_t)(start - oldest) < 0)
+        start = oldest;
+    if ((int32_t)(start - backfill_end) >= 0) {
+        printf("Backfill from seq %u: nothing missing.\n", from);
+        return;
     }
 
-    rwlock_read_lock(&shm_ptr->action.lock);
-    action = shm_ptr->action.type;
-    rwlock_read_unlock(&shm_ptr->action.lock);
-    BUF_APPEND(msg, ptr, "ACTION = %d", action);
+    printf("Backfill from seq %u: %u frames, seq %u to %u%s.\n", from, backfill_end - start, start, backfill_end - 1,
+        start != from ? ", older ones are gone" : "");
+    backfill_next = start;
+    backfill_sent = 0;
+    backfilling = true;
+    clock_gettime(CLOCK_MONOTONIC, &backfill_since);
+}
+
+static bool reached(const struct timespec *now, const struct timespec *t) {
+    return now->tv_sec > t->tv_sec || (now->tv_sec == t->tv_sec && now->tv_nsec >= t->tv_nsec);
+}
+
+static float vec_change(const acceleration_t *a, const acceleration_t *b) {
+    return fmaxf(fabsf(a->x - b->x), fmaxf(fabsf(a->y - b->y), fabsf(a->z - b->z)));
+}
+
+/**
+  * @brief Acceleration to send: the window mean when aggregating, the latest sample otherwise.
+  **/
+static acceleration_t state_accel(const drone_state_t *s) {
+    const agg_window_t *w = &s->window;
+
+    if (w->count == 0)
+        return s->acceleration;
+    return (acceleration_t){ w->mean[AggAccelX], w->mean[AggAccelY], w->mean[AggAccelZ] };
+}
+
+static float state_motor(const drone_state_t *s, int i) {
+    return s->window.count ? s->window.mean[AggMotor0 + i] : s->motors.motors[i];
+}
+
+static bool fill_battery(const drone_state_t *s, tlm_record_t *r) {
+    r->battery = s->battery;
+    return true;
+}
+
+static float change_battery(const drone_state_t *s, const tlm_record_t *r) {
+    return fabsf((float)s->battery - r->battery);
+}
+
+static bool fill_accel(const drone_state_t *s, tlm_record_t *r) {
+    r->acceleration = state_accel(s);
+    return true;
+}
+
+static float change_accel(const drone_state_t *s, const tlm_record_t *r) {
+    acceleration_t a = state_accel(s);
+    return vec_change(&a, &r->acceleration);
+}
+
+static bool fill_accel_stats(const drone_state_t *s, tlm_record_t *r) {
+    const agg_window_t *w = &s->window;
+
+    if (w->count == 0)
+        return false;
+
+    r->samples = w->count;
+    r->accel_min = (acceleration_t){ w->min[AggAccelX], w->min[AggAccelY], w->min[AggAccelZ] };
+    r->accel_max = (acceleration_t){ w->max[AggAccelX], w->max[AggAccelY], w->max[AggAccelZ] };
+    r->accel_rms = (acceleration_t){ w->rms[AggAccelX], w->rms[AggAccelY], w->rms[AggAccelZ] };
+    return true;
+}
+
+/**
+  * @brief RMS is what moves when vibrations change.
+  **/
+static float change_accel_stats(const drone_state_t *s, const tlm_record_t *r) {
+    const agg_window_t *w = &s->window;
+    acceleration_t rms = { w->rms[AggAccelX], w->rms[AggAccelY], w->rms[AggAccelZ] };
+
+    return w->count ? vec_change(&rms, &r->accel_rms) : 0.0f;
+}
+
+static bool fill_motors(const drone_state_t *s, tlm_record_t *r) {
+    for (int i = 0; i < 4; ++i)
+        r->motors.motors[i] = state_motor(s, i);
+    return true;
+}
+
+static float change_motors(const drone_state_t *s, const tlm_record_t *r) {
+    float d = 0.0f;
+
+    for (int i = 0; i < 4; ++i)
+        d = fmaxf(d, fabsf(state_motor(s, i) - r->motors.motors[i]));
+    return d;
+}
+
+static bool fill_action(const drone_state_t *s, tlm_record_t *r) {
+    r->action = s->action;
+    return true;
+}
+
+static float change_action(const drone_state_t *s, const tlm_record_t *r) {
+    return s->action != r->action ? INFINITY : 0.0f;
+}
+
+static bool fill_gps(const drone_state_t *s, tlm_record_t *r) {
+    (void)s;
+    if (gps_fix_len == 0 && !gps_fix_lost)
+        return false;
+
+    memcpy(r->gps, gps_fix, gps_fix_len);
+    r->gps_len = gps_fix_len;
+    r->gps_lost = gps_fix_lost;
+    gps_fix_len = 0;
+    gps_fix_lost = false;
+    return true;
+}
+
+static float change_gps(const drone_state_t *s, const tlm_record_t *r) {
+    (void)s; (void)r;
+    return gps_fix_len > 0 || gps_fix_lost ? INFINITY : 0.0f;
+}
+
+/**
+  * @brief Compiles subscription into the emitter plan. Every channel is due right away.
+  **/
+static void plan_compile(const tlm_subscription_t *sub) {
+    static const struct {
+        bool (*fill)(const drone_state_t *, tlm_record_t *);
+        float (*change)(const drone_state_t *, const tlm_record_t *);
+    } emitters[TlmChannels] = {
+        [TlmBattery]    = { fill_battery, change_battery },
+        [TlmAccel]      = { fill_accel, change_accel },
+        [TlmAccelStats] = { fill_accel_stats, change_accel_stats },
+        [TlmMotors]     = { fill_motors, change_motors },
+        [TlmAction]     = { fill_action, change_action },
+        [TlmGps]        = { fill_gps, change_gps },
+    };
+
+    plan_len = 0;
+    plan_threshold = false;
+    printf("Telemetry plan:");
+
+    for (int i = 0; i < TlmChannels; ++i) {
+        if (sub->interval_us[i] == 0 && !(sub->threshold[i] > 0))
+            continue;
+
+        plan[plan_len++] = (emitter_t){
+            .channel = i,
+            .interval_us = sub->interval_us[i],
+            .threshold = sub->threshold[i],
+            .fill = emitters[i].fill,
+            .change = emitters[i].change,
+        };
+        plan_threshold |= sub->threshold[i] > 0;
+        printf(" %s every %u us above %g,", tlm_channel_name(i), sub->interval_us[i], sub->threshold[i]);
+    }
+
+    printf(" %d channels\n", plan_len);
+    memset(&next_frame, 0, sizeof(next_frame));
+}
+
+/**
+  * @brief Keeps the newest GPS sentence for the GPS channel and detects GPS timeouts.
+  *
+  * @note Runs whether the channel is subscribed or not, a GPS timeout aborts the flight.
+  **/
+static void gps_poll(drone_shared_t *shm_ptr, current_action_t action, const struct timespec *now) {
+    size_t len;
 
     // Telemetry unit is the consumer for GPS data.
     if (action == SampleGPS) {
-        BUF_APPEND(msg, ptr, "GPS {\n");
-        printf("Obtained GPS strings: ");
-
-        while (ptr < sizeof(msg) - 2) {
-            char c;
-            struct timespec ts;
-
-            clock_gettime(CLOCK_MONOTONIC, &ts);
-            ts.tv_sec += GPS_WAIT_TIMEOUT_S;
-
-            // Wait with timeout for new GPS data
-            if (sem_timedwait(&shm_ptr->gps.full, &ts) == -1) {
-                if (errno == ETIMEDOUT) {
-                    printf("\n[GPS timeout: no new data]\n");
-                    BUF_APPEND(msg, ptr, "NO FIX.");
-
-                    // Set to abort state.
-                    rwlock_write_lock(&shm_ptr->action.lock);
-                    shm_ptr->action.type = Abort;
-                    rwlock_write_unlock(&shm_ptr->action.lock);
-
-                    break;
-                } else {
-                    perror("sem_timedwait(full)");
-                    break;
-                }
+        // Fix timeout is measured from the moment sampling was requested.
+        if (!gps_sampling) {
+            gps_sampling = true;
+            gps_lost = false;
+            gps_first_fix = false;
+            last_fix = sampling_start = *now;
+            gps_reader = gps_reader_join(shm_ptr);
+            if (gps_reader < 0)
+                fprintf(stderr, "No free GPS reader entry.\n");
+            else
+                gps_reader_demand(shm_ptr, gps_reader, true);
+        }
+
+        len = gps_reader >= 0 ? gps_drain(shm_ptr, gps_fix, sizeof(gps_fix)) : 0;
+        if (len > 0) {
+            gps_fix_len = len;
+            last_fix = *now;
+            if (!gps_first_fix) {
+                gps_first_fix = true;
+                printf("GPS time to first fix: %ld ms\n",
+                    (now->tv_sec - sampling_start.tv_sec) * 1000 + (now->tv_nsec - sampling_start.tv_nsec) / NANOSECONDS_IN_MS);
+            }
+        } else if (!gps_lost && (now->tv_sec - last_fix.tv_sec) * 1000
+                + (now->tv_nsec - last_fix.tv_nsec) / NANOSECONDS_IN_MS >= GPS_WAIT_TIMEOUT_S * 1000) {
+            gps_lost = gps_fix_lost = true;
+            printf("\n[GPS timeout: no new data for %d s]\n", GPS_WAIT_TIMEOUT_S);
+            alert_post(shm_ptr, AlertGpsLost, ActorTelemetry, GPS_WAIT_TIMEOUT_S);
+
+            // Request abort state.
+            intent_post(shm_ptr, Abort, IntentSafety, SourceTelemetry);
+        }
+    } else if (gps_sampling) {
+        gps_sampling = false;
+        gps_fix_len = 0;
+        gps_reader_leave(shm_ptr, gps_reader);
+        gps_reader = -1;
+    }
+}
+
+/**
+  * @brief Runs the plan on `state`, queues a frame on the bulk lane when any channel is due and schedules the next
+  *        wakeup.
+  *
+  * A channel is due when its interval elapsed or, on full rate wakeups, when it moved past its threshold. Intervals
+  * shorter than the rate of the current drone state are stretched to it.
+  **/
+static void frame_build(drone_shared_t *shm_ptr, const drone_state_t *state, const struct timespec *now,
+    telemetry_encoding_t encoding)
+{
+    uint8_t msg[TELEMETRY_BUF_SIZE];
+    size_t ptr = 0;
+    uint8_t emitted = 0;
+    current_action_t action = state->action;
+    uint64_t now_us = now->tv_sec * 1000000ull + now->tv_nsec / 1000;
+    long rate_us = action & (Idle | Charge) ? TELEMETRY_GROUND_US : TELEMETRY_TIMEOUT_US;
+    struct timespec wake = *now;
+
+    duty_account(&duty, action);
+    gps_poll(shm_ptr, action, now);
+
+    // Idle wakeups keep subscription changes and GPS timeouts responsive. Thresholds are checked at the full rate.
+    deadline_next(&wake, plan_threshold ? rate_us : TELEMETRY_GROUND_US);
+    next_frame = wake;
+
+    for (emitter_t *e = plan; e < plan + plan_len; ++e) {
+        long interval_us = e->interval_us > (uint32_t)rate_us ? (long)e->interval_us : rate_us;
+        bool periodic = e->interval_us > 0 && reached(now, &e->next);
+
+        if ((periodic || (e->threshold > 0 && e->change(state, &sent) > e->threshold)) && e->fill(state, &sent)) {
+            emitted |= 1u << e->channel;
+
+            // A threshold emission restarts the interval, which then bounds the age of the value.
+            if (!periodic) {
+                e->next = *now;
+                periodic = true;
             }
-            if (sem_timedwait(&shm_ptr->gps.mutex, &ts) == -1) {
-                perror("sem_timedwait(mutex)");
-                sem_post(&shm_ptr->gps.full);
-                break;
+        }
+
+        // Also moves on when the channel had no data, e.g. no new GPS sentence.
+        if (periodic)
+            deadline_next(&e->next, interval_us);
+        if (e->interval_us > 0 && !reached(&e->next, &next_frame))
+            next_frame = e->next;
+    }
+
+    if (!emitted)
+        return;
+
+    jitter_record(action, now);
+    sent.channels = emitted;
+
+    // Every frame is kept for backfill, whether the link takes it or not.
+    history->frames[history->head % TLM_HISTORY] = (tlm_history_t){
+        .seq = history->head,
+        .ts_us = now_us,
+        .record = sent,
+    };
+    encoder.seq = history->head++;
+
+    // A datagram must not depend on the ones before it, any of them may be lost.
+    if (transport == TransportUdp && (encoding == EncodingDelta || batch_len == 0))
+        encoder.key_us = 0;
+
+    switch (encoding) {
+        case EncodingText:
+            ptr = tlm_text(&sent, (char *)msg);
+            break;
+        case EncodingDelta:
+            ptr = tlm_encode(&encoder, &sent, now_us, msg);
+            break;
+        case EncodingLz4: {
+            // State changes and GPS timeouts are not held back in the batch.
+            bool flush = sent.action != encoder.prev.action || sent.gps_lost;
+
+            if (batch_len == 0)
+                batch_start_us = now_us;
+            batch_len += tlm_encode(&encoder, &sent, now_us, batch + batch_len);
+
+            if (flush || now_us - batch_start_us >= TELEMETRY_BATCH_US || batch_len + TLM_FRAME_MAX > sizeof(batch)) {
+                ptr = tlm_batch(&encoder, batch, batch_len, now_us, msg);
+                batch_len = 0;
             }
+            break;
+        }
+    }
+
+    // GPS data is only meant for this frame.
+    sent.gps_len = 0;
+    sent.gps_lost = false;
+
+    if (ptr > 0)
+        bulk_push(msg, ptr);
+    link_frames++;
+}
+
+/**
+  * @brief telemetry sender loop function.
+  *
+  * Does the following:
+  * - Moves posted alerts to the urgent lane.
+  * - Reads a consistent snapshot of all data within the shared memory region and queues a periodic frame when due.
+  * - If operator is ready, sends queued frames, urgent lane first.
+  * - Only sends GPS data when internal state is `SampleGPS` (consumer).
+  *
+  **/
+void telemetry_loop(drone_shared_t *shm_ptr) {
+    drone_state_t state;
+    alert_t alert;
+    struct timespec now, wake;
+    uint32_t seen = notify_seq(&shm_ptr->alerts.posted);
+    telemetry_encoding_t encoding = shm_ptr->encoding;
+    tlm_subscription_t sub;
+    uint32_t from;
+
+    history = &shm_ptr->history;
+    hello = (tlm_hello_t){ .id = shm_ptr->drone_id, .flight_ctrl_port = shm_ptr->flight_ctrl_port };
+
+    // Everything at full rate until the operator subscribes. A respawned unit picks the operator subscription up.
+    if (!planned) {
+        tlm_subscription_default(&sub, TELEMETRY_TIMEOUT_US);
+        plan_compile(&sub);
+        planned = true;
+    }
+    if (subscription_read(shm_ptr, &sub_version, &sub))
+        plan_compile(&sub);
+
+    // Alerts are kept until there is a connection to send them through.
+    while (mpsc_pop(&shm_ptr->alerts.queue, &alert, sizeof(alert)))
+        urgent_push(&alert, encoding == EncodingText);
+
+    if (init) {
+        if (try_connect(shm_ptr)) {
+            init = false;
+            lanes_reset();
+            dgram.group = shm_ptr->fec_group;
+            hello_pending = encoding != EncodingText;
+        } else {
+            deadline_next(&next_frame, TELEMETRY_TIMEOUT_US);   // Retries at the frame rate.
+            goto _wdg;
+        }
+    }
+
+    // Requests arriving while disconnected wait for the connection.
+    if (resume_read(shm_ptr, &resume_version, &from))
+        backfill_start(from, encoding);
 
-            // Read single char
-            c = shm_ptr->gps.nmea.buf[shm_ptr->gps.read];
-            msg[ptr++] = c;
-            shm_ptr->gps.read = (shm_ptr->gps.read + 1) % GPS_BUFFER_SIZE;
+    // Every field of the frame comes from the same published instant. A state change sends every channel right away
+    // and restarts the schedule with the new rate.
+    snapshot_read(shm_ptr, &state);
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (state.action != frame_action || reached(&now, &next_frame)) {
+        if (state.action != frame_action)
+            for (int i = 0; i < plan_len; ++i)
+                plan[i].next = now;
+        frame_action = state.action;
+        frame_build(shm_ptr, &state, &now, encoding);
+    }
 
-            sem_post(&shm_ptr->gps.mutex);
-            sem_post(&shm_ptr->gps.empty);
+    // Heartbeats are ordinary bulk frames, any other frame proves the link alive just as well. Text cannot carry the
+    // echo.
+    if (echo_read(shm_ptr, &echo_version, &echo) && encoding != EncodingText)
+        echo_pending = true;
+    if (transport == TransportUdp && encoding != EncodingText) {
+        uint64_t now_us = now.tv_sec * 1000000ull + now.tv_nsec / 1000;
 
-            if (c == '\n')
-                break;
+        if (now_us - hello_us >= HELLO_PERIOD_US) {
+            hello_pending = true;
+            hello_us = now_us;
         }
+    }
+    if (shm_ptr->heartbeat_us > 0) {
+        uint64_t now_us = now.tv_sec * 1000000ull + now.tv_nsec / 1000;
 
-        BUF_APPEND(msg, ptr, "\n}");
-        printf("\n");
+        if (now_us - last_queued_us >= shm_ptr->heartbeat_us && !echo_pending) {
+            tlm_heartbeat_t h = { .seq = beat_seq++, .ts_us = now_us };
+            uint8_t beat[TLM_HEARTBEAT_MAX];
+
+            bulk_push(beat, tlm_heartbeat(&h, encoding == EncodingText, beat));
+        }
     }
 
-    // Sends the message via connected TCP socket.
-    int n = send(sock_fd, msg, ptr, MSG_NOSIGNAL);  // MSG_NOSIGNAL prevents SIGPIPE when operator crashes during communication.
-    if (n <= 0) {
+    backfill_budget = transport == TransportUdp ? BACKFILL_BURST : UINT32_MAX;
+    if (lanes_pump() < 0) {
         fprintf(stderr, "Telemetry send failed, connection lost\n");
         close(sock_fd);
         sock_fd = -1;
@@ -183,7 +924,47 @@ void telemetry_loop(drone_shared_t *shm_ptr) {
         return;
     }
 
+    // Bandwidth is what long range links are limited by, CPU per frame is what more ground stations would cost.
+    if (link_since.tv_sec == 0) {
+        link_since = now;
+        clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &link_cpu);
+    }
+    if (now.tv_sec - link_since.tv_sec >= LINK_REPORT_S) {
+        struct timespec cpu;
+        double s = (now.tv_sec - link_since.tv_sec) + (now.tv_nsec - link_since.tv_nsec) / 1e9;
+
+        clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu);
+        double cpu_us = (cpu.tv_sec - link_cpu.tv_sec) * 1e6 + (cpu.tv_nsec - link_cpu.tv_nsec) / 1e3;
+
+        printf("Telemetry link (%s over %s%s): %.0f B/s, %.1f frames/s, %.1f B/frame, %.1f us cpu/frame, "
+            "%lu frames dropped\n",
+            encoding_names[encoding], transport_names[transport], multicast ? " multicast" : "", link_bytes / s,
+            link_frames / s, link_frames ? (double)link_bytes / link_frames : 0.0,
+            link_frames ? cpu_us / link_frames : 0.0, (unsigned long)link_dropped);
+        link_bytes = link_frames = link_dropped = 0;
+        link_since = now;
+        link_cpu = cpu;
+    }
+
 _wdg:
     shm_ptr->wdg.telemetry++;
-    usleep(TELEMETRY_TIMEOUT_US);
+
+    // Sleeping until the next frame or heartbeat deadline, the next alert or subscription. A saturated link is
+    // retried more often.
+    wake = next_frame;
+    if (!init && shm_ptr->heartbeat_us > 0) {
+        uint64_t beat_us = last_queued_us + shm_ptr->heartbeat_us;
+        struct timespec beat = { .tv_sec = beat_us / 1000000, .tv_nsec = beat_us % 1000000 * 1000 };
+
+        if (!reached(&beat, &wake))
+            wake = beat;
+    }
+    if (!init && lanes_pending()) {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        deadline_next(&now, BACKLOG_POLL_US);
+        if (now.tv_sec < wake.tv_sec || (now.tv_sec == wake.tv_sec && now.tv_nsec < wake.tv_nsec))
+            wake = now;
+    }
+
+    notify_wait(&shm_ptr->alerts.posted, seen, shm_ptr->wait.action, &wake, &wait_stats);
 }
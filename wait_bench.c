@@ -0,0 +1,304 @@
+/**
+  * @file wait_bench.c
+  * @brief Checks and benchmarks the timed waiting primitives of ipc_sync.c.
+  *
+  * Main tasks:
+  * - Wait 1, 10, 100 and 1000 ms on a semaphore nobody posts and on a futex word nobody changes, and check that
+  *   each wait times out, never before its deadline and not much after it.
+  * - Check that a post from another process ends a wait early, with success.
+  * - Report the wall clock duration and the CPU time spent per wait.
+  * - `-p`: ping-pong between two processes over `notify_t` channels with each wait strategy, at several event
+  *   periods, and report the wake-up latency against the CPU the waiting side burns.
+  *
+  * @note
+  *
+  * The exit status is 0 when every check passed, so that `sh compile.sh check` can run it. No wait may end before its
+  * deadline. A wait is late when it overshoots it by more than `BENCH_LATE_MS` plus `BENCH_LATE_PCT` percent of its
+  * duration: a loaded host preempts a few, so only a late median fails. Waits cost too much CPU above `BENCH_CPU_PCT`
+  * percent of their duration: a deadline the kernel misreads would busy loop on immediate timeouts, like
+  * `sem_timedwait` fed a monotonic time did.
+  *
+  * In the ping-pong, the pinging process posts an event each period and parks until the answer, the ponging process
+  * waits for the events with the strategy under test and answers each one. Latency runs from the post to the wake-up
+  * of the ponging process, and its CPU share covers the whole run, periods spent waiting included. This is the
+  * accelerometer to flight controller hand-off of drone_sys (`-w state=...`).
+  **/
+
+#include "proj_types.h"
+
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#define BENCH_LATE_MS       5
+#define BENCH_LATE_PCT      10
+#define BENCH_CPU_PCT       10
+#define BENCH_REPEATS_MAX   200
+#define BENCH_PING_MS       1000        // Duration of each ping-pong run.
+#define BENCH_PONG_WAIT_MS  100         // Deadline of each wait of the ponging process.
+
+/**
+  * @brief Objects shared with the posting process.
+  **/
+typedef struct {
+    sem_t sem;
+    _Atomic(uint32_t) word;
+    notify_t ping, pong;
+    _Atomic(bool) stop;
+    uint64_t events, latency_ns, max_latency_ns, cpu_ns, wall_ns;    // Written by the ponging process.
+} bench_shared_t;
+
+static const long durations_ms[] = { 1, 10, 100, 1000 };
+static const int repeats[] = { BENCH_REPEATS_MAX, 50, 10, 5 };
+
+static const char *strategies[] = { "spin", "yield", "spinpark", "park" };
+static const long periods_us[] = { 100, 1000, 10000 };
+
+static int failures;
+
+static uint64_t clock_ns(clockid_t clk) {
+    struct timespec ts;
+
+    clock_gettime(clk, &ts);
+    return (uint64_t)ts.tv_sec * NANOSECONDS_IN_SEC + ts.tv_nsec;
+}
+
+/**
+  * @brief One wait of `ms` milliseconds with primitive `futex`, or the semaphore otherwise.
+  *
+  * @return What the primitive returned, with `errno` set by it.
+  **/
+static int bench_wait(bench_shared_t *b, bool futex, long ms) {
+    struct timespec deadline;
+
+    if (!futex)
+        return sem_wait_for_ms(&b->sem, ms);
+
+    deadline_after_ms(&deadline, ms);
+    while (atomic_load_explicit(&b->word, memory_order_acquire) == 0) {
+        if (futex_wait_until(&b->word, 0, &deadline) == -1)
+            return -1;
+    }
+    return 0;
+}
+
+/**
+  * @brief Times `count` waits of `ms` milliseconds that nobody ends early, and checks each of them.
+  **/
+static void bench_timeouts(bench_shared_t *b, bool futex, long ms, int count) {
+    uint64_t elapsed[BENCH_REPEATS_MAX], sum = 0, cpu = clock_ns(CLOCK_PROCESS_CPUTIME_ID);
+    uint64_t limit = ms * NANOSECONDS_IN_MS * (100 + BENCH_LATE_PCT) / 100 + BENCH_LATE_MS * NANOSECONDS_IN_MS;
+    int bad = 0, late = 0;
+
+    for (int i = 0; i < count; ++i) {
+        uint64_t start = clock_ns(CLOCK_MONOTONIC);
+        int s = bench_wait(b, futex, ms);
+
+        elapsed[i] = clock_ns(CLOCK_MONOTONIC) - start;
+        if (s != -1 || errno != ETIMEDOUT || elapsed[i] < (uint64_t)ms * NANOSECONDS_IN_MS) {
+            fprintf(stderr, "%s wait of %ld ms: returned %d (%s) after %.3f ms.\n", futex ? "Futex" : "Semaphore",
+                ms, s, s == 0 ? "success" : strerror(errno), elapsed[i] / 1e6);
+            bad++;
+        }
+        late += elapsed[i] > limit;
+        sum += elapsed[i];
+    }
+    cpu = clock_ns(CLOCK_PROCESS_CPUTIME_ID) - cpu;
+
+    // Insertion sort, for the median and extremes.
+    for (int i = 1; i < count; ++i) {
+        uint64_t e = elapsed[i];
+        int k = i;
+
+        for (; k > 0 && elapsed[k - 1] > e; --k)
+            elapsed[k] = elapsed[k - 1];
+        elapsed[k] = e;
+    }
+
+    if (elapsed[count / 2] > limit) {
+        fprintf(stderr, "%s waits of %ld ms: median %.3f ms is late.\n", futex ? "Futex" : "Semaphore", ms,
+            elapsed[count / 2] / 1e6);
+        bad++;
+    }
+
+    if (cpu * 100 > sum * BENCH_CPU_PCT) {
+        fprintf(stderr, "%s waits of %ld ms: %.1f%% CPU while waiting.\n", futex ? "Futex" : "Semaphore", ms,
+            100.0 * cpu / sum);
+        bad++;
+    }
+
+    printf("%-9s %5ld ms x %3d: min %9.3f, median %9.3f, max %9.3f ms, %2d late, cpu %5.1f us/wait (%.3f%%)  %s\n",
+        futex ? "futex" : "semaphore", ms, count, elapsed[0] / 1e6, elapsed[count / 2] / 1e6, elapsed[count - 1] / 1e6,
+        late, cpu / 1e3 / count, 100.0 * cpu / sum, bad ? "FAIL" : "ok");
+    failures += bad;
+}
+
+/**
+  * @brief Waits `ms` milliseconds while another process posts after half of it, and checks that the post ends it.
+  **/
+static void bench_wakeup(bench_shared_t *b, bool futex, long ms) {
+    uint64_t start, elapsed, limit = ms * NANOSECONDS_IN_MS / 2 + BENCH_LATE_MS * NANOSECONDS_IN_MS;
+    pid_t pid;
+    int s;
+
+    atomic_store_explicit(&b->word, 0, memory_order_relaxed);
+    start = clock_ns(CLOCK_MONOTONIC);
+    pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        failures++;
+        return;
+    }
+    if (pid == 0) {
+        usleep(ms * 1000 / 2);
+        if (futex) {
+            atomic_store_explicit(&b->word, 1, memory_order_release);
+            futex_wake_all(&b->word);
+        } else {
+            sem_post(&b->sem);
+        }
+        _exit(0);
+    }
+
+    s = bench_wait(b, futex, ms);
+    elapsed = clock_ns(CLOCK_MONOTONIC) - start;
+    waitpid(pid, NULL, 0);
+
+    printf("%-9s %5ld ms, posted at %ld ms: returned %d after %.3f ms  %s\n", futex ? "futex" : "semaphore", ms,
+        ms / 2, s, elapsed / 1e6, s == 0 && elapsed <= limit ? "ok" : "FAIL");
+    if (s != 0 || elapsed > limit)
+        failures++;
+}
+
+/**
+  * @brief Ponging process: answers every ping, waiting for them with `strategy`, until told to stop.
+  **/
+static void pong_loop(bench_shared_t *b, wait_strategy_t strategy) {
+    uint64_t start = clock_ns(CLOCK_MONOTONIC), cpu = clock_ns(CLOCK_PROCESS_CPUTIME_ID);
+    uint32_t seen = notify_seq(&b->ping);
+    struct timespec deadline;
+
+    while (!atomic_load_explicit(&b->stop, memory_order_acquire)) {
+        deadline_after_ms(&deadline, BENCH_PONG_WAIT_MS);
+        if (notify_wait(&b->ping, seen, strategy, &deadline, NULL) < 0)
+            continue;
+
+        uint64_t latency = clock_ns(CLOCK_MONOTONIC) - atomic_load_explicit(&b->ping.stamp, memory_order_relaxed);
+
+        seen = notify_seq(&b->ping);
+        notify_post(&b->pong);
+        b->events++;
+        b->latency_ns += latency;
+        if (latency > b->max_latency_ns)
+            b->max_latency_ns = latency;
+    }
+
+    b->cpu_ns = clock_ns(CLOCK_PROCESS_CPUTIME_ID) - cpu;
+    b->wall_ns = clock_ns(CLOCK_MONOTONIC) - start;
+}
+
+/**
+  * @brief One ping-pong run: an event each `period_us`, answered by a process waiting with strategy `name`.
+  **/
+static void bench_pingpong(bench_shared_t *b, const char *name, long period_us) {
+    struct timespec next, deadline;
+    wait_strategy_t strategy;
+    uint64_t end, round_ns = 0;
+    uint32_t seen, pings = 0;
+    pid_t pid;
+
+    wait_strategy_parse(name, &strategy);
+
+    memset(&b->ping, 0, sizeof(b->ping));
+    memset(&b->pong, 0, sizeof(b->pong));
+    b->events = b->latency_ns = b->max_latency_ns = b->cpu_ns = b->wall_ns = 0;
+    atomic_store_explicit(&b->stop, false, memory_order_release);
+
+    pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        failures++;
+        return;
+    }
+    if (pid == 0) {
+        pong_loop(b, strategy);
+        _exit(0);
+    }
+
+    // Lets the ponging process start waiting.
+    usleep(10000);
+
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    end = clock_ns(CLOCK_MONOTONIC) + BENCH_PING_MS * NANOSECONDS_IN_MS;
+    while (clock_ns(CLOCK_MONOTONIC) < end) {
+        uint64_t start = clock_ns(CLOCK_MONOTONIC);
+
+        seen = notify_seq(&b->pong);
+        notify_post(&b->ping);
+        deadline_after_ms(&deadline, BENCH_PONG_WAIT_MS);
+        if (notify_wait(&b->pong, seen, WaitPark, &deadline, NULL) == 0) {
+            round_ns += clock_ns(CLOCK_MONOTONIC) - start;
+            pings++;
+        }
+
+        deadline_next(&next, period_us);
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) == EINTR)
+            continue;
+    }
+
+    atomic_store_explicit(&b->stop, true, memory_order_release);
+    notify_post(&b->ping);
+    waitpid(pid, NULL, 0);
+
+    printf("%-8s %6ld us: %6u events, latency avg %8.1f us, max %8.1f us, round trip %8.1f us, waiter cpu %5.1f%%\n",
+        name, period_us, pings, b->events ? b->latency_ns / 1e3 / b->events : 0.0, b->max_latency_ns / 1e3,
+        pings ? round_ns / 1e3 / pings : 0.0, b->wall_ns ? 100.0 * b->cpu_ns / b->wall_ns : 0.0);
+}
+
+int main(int argc, char **argv) {
+    bench_shared_t *b = mmap(NULL, sizeof(*b), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    bool pingpong = false;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "p")) != -1) {
+        if (opt != 'p') {
+            fprintf(stderr, "Usage: %s [-p]\n", argv[0]);
+            return 1;
+        }
+        pingpong = true;
+    }
+
+    if (b == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+    if (sem_init(&b->sem, 1, 0) == -1) {
+        perror("sem_init");
+        return 1;
+    }
+
+    if (pingpong) {
+        printf("Ping-pong, %d ms per run (strategy, event period):\n", BENCH_PING_MS);
+        for (size_t i = 0; i < sizeof(strategies) / sizeof(strategies[0]); ++i)
+            for (size_t k = 0; k < sizeof(periods_us) / sizeof(periods_us[0]); ++k)
+                bench_pingpong(b, strategies[i], periods_us[k]);
+        sem_destroy(&b->sem);
+        munmap(b, sizeof(*b));
+        return failures ? 1 : 0;
+    }
+
+    printf("Timed waits nobody ends early (late beyond %d ms + %d%%, CPU beyond %d%% fail):\n", BENCH_LATE_MS,
+        BENCH_LATE_PCT, BENCH_CPU_PCT);
+    for (int futex = 0; futex < 2; ++futex)
+        for (size_t i = 0; i < sizeof(durations_ms) / sizeof(durations_ms[0]); ++i)
+            bench_timeouts(b, futex, durations_ms[i], repeats[i]);
+
+    printf("Timed waits ended by another process:\n");
+    for (int futex = 0; futex < 2; ++futex)
+        bench_wakeup(b, futex, 200);
+
+    sem_destroy(&b->sem);
+    munmap(b, sizeof(*b));
+
+    printf("%s: %d failed checks.\n", failures ? "FAIL" : "PASS", failures);
+    return failures ? 1 : 0;
+}
@@ -32,34 +32,41 @@ uint32_t get_time_ms() {
   * @note Internal state of data within the shared memory is preserved. Only locks are reinitialized.
   **/
 void watchdog_loop(drone_shared_t *shm_ptr) {
-    static uint32_t old[5] = {0};
+    static uint32_t old[6] = {0};
     // Keep last time heartbeat changed for each process (in milliseconds)
-    static unsigned long last_change_time[5] = {0};
+    static unsigned long last_change_time[6] = {0};
+    static wait_stats_t wait_stats = { .name = "watchdog" };
+    static const actor_t actors[6] = { ActorAccel, ActorBattery, ActorGps, ActorTelemetry, ActorFlightCtrl, ActorPhysics };
+    struct timespec next_check;
 
     // Initialize last_change_time on first run
-    for (int i = 0; i < 5; ++i) {
+    for (int i = 0; i < 6; ++i) {
         last_change_time[i] = get_time_ms();
         old[i] = 0;
     }
 
+    clock_gettime(CLOCK_MONOTONIC, &next_check);
+
     while (1) {
-        uint32_t new[5] = {
+        uint32_t new[6] = {
             shm_ptr->wdg.accel,
             shm_ptr->wdg.battery,
             shm_ptr->wdg.gps_ctrl,
             shm_ptr->wdg.telemetry,
             shm_ptr->wdg.flight_ctrl,
+            shm_ptr->wdg.physics,
         };
 
         unsigned long now = get_time_ms();
 
-        for (int i = 0; i < 5; ++i) {
+        for (int i = 0; i < 6; ++i) {
             if (new[i] != old[i]) {
                 last_change_time[i] = now;
             } else {
                 if (now - last_change_time[i] >= WDG_TIMEOUT_MS) {
                     pid_t ppid = getppid();
                     printf("Process %d heartbeat timeout! Sending SIGUSR1 to parent %d\n", i, ppid);
+                    alert_post(shm_ptr, AlertWatchdog, actors[i], 0);
                     kill(ppid, SIGUSR1);
                     return;
                 }
@@ -67,6 +74,7 @@ void watchdog_loop(drone_shared_t *shm_ptr) {
             old[i] = new[i];
         }
 
-        usleep(WDG_SLEEP_US);
+        deadline_next(&next_check, WDG_SLEEP_US);
+        notify_wait(NULL, 0, shm_ptr->wait.heartbeat, &next_check, &wait_stats);
     }
 }